@@ -0,0 +1,183 @@
+#!/usr/bin/env python3
+#
+# Generate the hook lookup table: hybris/common/hooks_table.h
+#
+# Usage:
+# cpp $(CPPFLAGS) -DHYBRIS_HOOKS_TABLE_GENERATOR hooks.c | \
+#     python3 generate_hooks_table.py hooks_p hooks_n ... > hooks_table.h
+#
+# The hook lists are read from the preprocessed hooks.c so that exactly the
+# entries which end up in the compiled arrays are indexed. The lists have to
+# be given in override order: when a symbol is hooked by several lists, the
+# first enabled list on the command line wins.
+#
+# The generated table is a minimal perfect hash over all hooked symbol names
+# (hash and displace, see http://stevehanov.ca/blog/index.php?id=119). For
+# every name it records the index of its entry in each list, or -1. It is
+# entirely constant so no work is needed at runtime and the table is shared
+# between all processes using libhybris.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+# http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+import re
+import sys
+
+FNV_PRIME = 0x01000193
+BLOOM_SHIFT = 26
+
+
+def table_hash(d, name):
+    # keep in sync with hook_table_hash() in hooks.c
+    if d == 0:
+        d = FNV_PRIME
+    for c in name.encode():
+        d = ((d * FNV_PRIME) & 0xffffffff) ^ c
+    return d
+
+
+def parse_lists(source, names):
+    lists = {}
+    for m in re.finditer(r'static\s+const\s+struct\s+_hook\s+(\w+)\s*\[\s*\]\s*=\s*\{(.*?)\}\s*;',
+                         source, re.S):
+        lists[m.group(1)] = re.findall(r'\{\s*"([^"]+)"\s*,', m.group(2))
+
+    for name in names:
+        if name not in lists:
+            sys.exit('hook list %s not found in input' % name)
+
+    return [lists[name] for name in names]
+
+
+def perfect_hash(keys):
+    size = len(keys)
+    buckets = [[] for i in range(size)]
+    displacement = [0] * size
+    slots = [None] * size
+
+    for key in keys:
+        buckets[table_hash(0, key) % size].append(key)
+
+    buckets.sort(key=len, reverse=True)
+
+    # place colliding buckets first, searching a displacement which maps all
+    # of their keys to free slots
+    b = 0
+    while b < size and len(buckets[b]) > 1:
+        bucket = buckets[b]
+        d = 1
+        item = 0
+        taken = []
+        while item < len(bucket):
+            slot = table_hash(d, bucket[item]) % size
+            if slots[slot] is not None or slot in taken:
+                d += 1
+                item = 0
+                taken = []
+            else:
+                taken.append(slot)
+                item += 1
+        displacement[table_hash(0, bucket[0]) % size] = d
+        for i in range(len(bucket)):
+            slots[taken[i]] = bucket[i]
+        b += 1
+
+    # single key buckets are stored directly in the remaining free slots
+    free = [i for i in range(size) if slots[i] is None]
+    while b < size and len(buckets[b]) == 1:
+        slot = free.pop()
+        displacement[table_hash(0, buckets[b][0]) % size] = -slot - 1
+        slots[slot] = buckets[b][0]
+        b += 1
+
+    return displacement, slots
+
+
+def main():
+    names = sys.argv[1:]
+    if not names:
+        sys.exit('usage: %s LIST... < preprocessed hooks.c' % sys.argv[0])
+
+    lists = parse_lists(sys.stdin.read(), names)
+
+    index = {}
+    for column, hooks in enumerate(lists):
+        for i, hook in enumerate(hooks):
+            entry = index.setdefault(hook, [-1] * len(lists))
+            # the first entry of a list wins, just like for the whole table
+            if entry[column] < 0:
+                entry[column] = i
+
+    keys = sorted(index)
+    displacement, slots = perfect_hash(keys)
+
+    bloom_words = 1
+    while bloom_words * 32 < len(keys) * 16:
+        bloom_words <<= 1
+    bloom = [0] * bloom_words
+    for key in keys:
+        h = table_hash(0, key)
+        bloom[(h // 32) % bloom_words] |= (1 << (h % 32)) | (1 << ((h >> BLOOM_SHIFT) % 32))
+
+    offsets = {}
+    pool = 0
+    for key in slots:
+        offsets[key] = pool
+        pool += len(key) + 1
+    if pool > 0xffff:
+        sys.exit('hook names do not fit into the name pool')
+
+    out = sys.stdout
+    out.write('/* Generated by generate_hooks_table.py from hooks.c, do not edit. */\n\n')
+    out.write('enum _hook_list {\n')
+    for name in names:
+        out.write('    HOOK_LIST_%s,\n' % name[len('hooks_'):].upper())
+    out.write('    HOOK_LIST_COUNT\n};\n\n')
+
+    out.write('struct _hook_table_entry {\n')
+    out.write('    uint16_t name;\n')
+    out.write('    int16_t index[HOOK_LIST_COUNT];\n')
+    out.write('};\n\n')
+
+    out.write('#define HOOK_TABLE_SIZE %d\n' % len(keys))
+    out.write('#define HOOK_TABLE_BLOOM_WORDS %d\n' % bloom_words)
+    out.write('#define HOOK_TABLE_BLOOM_SHIFT %d\n\n' % BLOOM_SHIFT)
+
+    out.write('static const struct _hook *const hook_lists[HOOK_LIST_COUNT] = {\n')
+    for name in names:
+        out.write('    %s,\n' % name)
+    out.write('};\n\n')
+
+    out.write('static const char hook_table_names[] =\n')
+    for key in slots:
+        out.write('    "%s\\0"\n' % key)
+    out.write('    ;\n\n')
+
+    out.write('static const uint32_t hook_table_bloom[HOOK_TABLE_BLOOM_WORDS] = {\n')
+    for i in range(0, bloom_words, 4):
+        out.write('    %s,\n' % ', '.join('0x%08x' % w for w in bloom[i:i + 4]))
+    out.write('};\n\n')
+
+    out.write('static const int32_t hook_table_displacement[HOOK_TABLE_SIZE] = {\n')
+    for i in range(0, len(displacement), 8):
+        out.write('    %s,\n' % ', '.join('%d' % d for d in displacement[i:i + 8]))
+    out.write('};\n\n')
+
+    out.write('static const struct _hook_table_entry hook_table[HOOK_TABLE_SIZE] = {\n')
+    for key in slots:
+        out.write('    { %5d, { %s } }, /* %s */\n' %
+                  (offsets[key], ', '.join('%d' % i for i in index[key]), key))
+    out.write('};\n')
+
+
+if __name__ == '__main__':
+    main()
@@ -22,6 +22,7 @@
 #include <hybris/common/binding.h>
 
 #include "hooks_shm.h"
+#include "hooks_pthread.h"
 
 #include <stdio.h>
 #include <stdarg.h>
@@ -94,6 +95,8 @@ extern int my_property_list(void (*propfn)(const char *key, const char *value, v
 static locale_t hybris_locale;
 static int locale_inited = 0;
 static hybris_hook_cb hook_callback = NULL;
+/* the linker may relocate libraries on several threads, see HYBRIS_LD_PARALLEL */
+static pthread_mutex_t hook_callback_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 #ifdef WANT_ARM_TRACING
 static void (*_android_linker_init)(int sdk_version, void* (*get_hooked_symbol)(const char*, const char*), int enable_linker_gdb_support, void *(_create_wrapper)(const char*, void*, int), int wrapping_enabled) = NULL;
@@ -149,13 +152,6 @@ void * (*_android_shared_globals)() = NULL;
 
 #define ANDROID_COND_IS_SHARED(c)  (((c)->value & ANDROID_COND_SHARED_MASK) != 0)
 
-/* For the static initializer types */
-#define ANDROID_PTHREAD_MUTEX_INITIALIZER            0
-#define ANDROID_PTHREAD_RECURSIVE_MUTEX_INITIALIZER  0x4000
-#define ANDROID_PTHREAD_ERRORCHECK_MUTEX_INITIALIZER 0x8000
-#define ANDROID_PTHREAD_COND_INITIALIZER             0
-#define ANDROID_PTHREAD_RWLOCK_INITIALIZER           0
-
 #define MALI_HIST_DUMP_THREAD_NAME "mali-hist-dump"
 
 /* Debug */
@@ -280,45 +276,6 @@ int android_pthread_cond_signal(android_cond_t *cond)
     return __android_pthread_cond_pulse(cond, 1);
 }
 
-static void hybris_set_mutex_attr(unsigned int android_value, pthread_mutexattr_t *attr)
-{
-    /* Init already sets as PTHREAD_MUTEX_NORMAL */
-    pthread_mutexattr_init(attr);
-
-    if (android_value & ANDROID_PTHREAD_RECURSIVE_MUTEX_INITIALIZER) {
-        pthread_mutexattr_settype(attr, PTHREAD_MUTEX_RECURSIVE);
-    } else if (android_value & ANDROID_PTHREAD_ERRORCHECK_MUTEX_INITIALIZER) {
-        pthread_mutexattr_settype(attr, PTHREAD_MUTEX_ERRORCHECK);
-    }
-}
-
-static pthread_mutex_t* hybris_alloc_init_mutex(unsigned int android_mutex)
-{
-    pthread_mutex_t *realmutex = malloc(sizeof(pthread_mutex_t));
-    pthread_mutexattr_t attr;
-    hybris_set_mutex_attr(android_mutex, &attr);
-    pthread_mutex_init(realmutex, &attr);
-    return realmutex;
-}
-
-static pthread_cond_t* hybris_alloc_init_cond(void)
-{
-    pthread_cond_t *realcond = malloc(sizeof(pthread_cond_t));
-    pthread_condattr_t attr;
-    pthread_condattr_init(&attr);
-    pthread_cond_init(realcond, &attr);
-    return realcond;
-}
-
-static pthread_rwlock_t* hybris_alloc_init_rwlock(void)
-{
-    pthread_rwlock_t *realrwlock = malloc(sizeof(pthread_rwlock_t));
-    pthread_rwlockattr_t attr;
-    pthread_rwlockattr_init(&attr);
-    pthread_rwlock_init(realrwlock, &attr);
-    return realrwlock;
-}
-
 /*
  * utils, such as malloc, memcpy
  *
@@ -676,8 +633,8 @@ static int _hybris_hook_pthread_mutex_init(pthread_mutex_t *__mutex,
         pthread_mutexattr_getpshared(__mutexattr, &pshared);
 
     if (!pshared) {
-        /* non shared, standard mutex: use malloc */
-        realmutex = malloc(sizeof(pthread_mutex_t));
+        /* non shared, standard mutex: use the mutex pool */
+        realmutex = hybris_pthread_mutex_alloc();
 
         *((uintptr_t *)__mutex) = (uintptr_t) realmutex;
     }
@@ -710,11 +667,13 @@ static int _hybris_hook_pthread_mutex_destroy(pthread_mutex_t *__mutex)
 
     if (!hybris_is_pointer_in_shm((void*)realmutex)) {
         ret = pthread_mutex_destroy(realmutex);
-        free(realmutex);
+        hybris_pthread_mutex_free(realmutex);
     }
     else {
-        realmutex = (pthread_mutex_t *)hybris_get_shmpointer((hybris_shm_pointer_t)realmutex);
+        hybris_shm_pointer_t handle = (hybris_shm_pointer_t)realmutex;
+        realmutex = (pthread_mutex_t *)hybris_get_shmpointer(handle);
         ret = pthread_mutex_destroy(realmutex);
+        hybris_shm_free(handle, sizeof(pthread_mutex_t));
     }
 
     *((uintptr_t *)__mutex) = 0;
@@ -744,8 +703,7 @@ static int _hybris_hook_pthread_mutex_lock(pthread_mutex_t *__mutex)
     if (value <= ANDROID_TOP_ADDR_VALUE_MUTEX) {
         TRACE("value %p <= ANDROID_TOP_ADDR_VALUE_MUTEX 0x%x",
               (void*) value, ANDROID_TOP_ADDR_VALUE_MUTEX);
-        realmutex = hybris_alloc_init_mutex(value);
-        *((uintptr_t *)__mutex) = (uintptr_t) realmutex;
+        realmutex = hybris_lazy_init_mutex(__mutex, value);
     }
 
     return pthread_mutex_lock(realmutex);
@@ -767,8 +725,7 @@ static int _hybris_hook_pthread_mutex_trylock(pthread_mutex_t *__mutex)
         realmutex = (pthread_mutex_t *)hybris_get_shmpointer((hybris_shm_pointer_t)value);
 
     if (value <= ANDROID_TOP_ADDR_VALUE_MUTEX) {
-        realmutex = hybris_alloc_init_mutex(value);
-        *((uintptr_t *)__mutex) = (uintptr_t) realmutex;
+        realmutex = hybris_lazy_init_mutex(__mutex, value);
     }
 
     return pthread_mutex_trylock(realmutex);
@@ -818,8 +775,7 @@ static int _hybris_hook_pthread_mutex_lock_timeout_np(pthread_mutex_t *__mutex,
     realmutex = (pthread_mutex_t *) value;
 
     if (value <= ANDROID_TOP_ADDR_VALUE_MUTEX) {
-        realmutex = hybris_alloc_init_mutex(value);
-        *((uintptr_t *)__mutex) = (uintptr_t) realmutex;
+        realmutex = hybris_lazy_init_mutex(__mutex, value);
     }
 
     clock_gettime(CLOCK_REALTIME, &tv);
@@ -851,8 +807,7 @@ static int _hybris_hook_pthread_mutex_timedlock(pthread_mutex_t *__mutex,
 
     pthread_mutex_t *realmutex = (pthread_mutex_t *) value;
     if (value <= ANDROID_TOP_ADDR_VALUE_MUTEX) {
-        realmutex = hybris_alloc_init_mutex(value);
-        *((uintptr_t *)__mutex) = (uintptr_t) realmutex;
+        realmutex = hybris_lazy_init_mutex(__mutex, value);
     }
 
     return pthread_mutex_timedlock(realmutex, __abs_timeout);
@@ -887,8 +842,8 @@ static int _hybris_hook_pthread_cond_init(pthread_cond_t *cond,
         pthread_condattr_getpshared(attr, &pshared);
 
     if (!pshared) {
-        /* non shared, standard cond: use malloc */
-        realcond = malloc(sizeof(pthread_cond_t));
+        /* non shared, standard cond: use the cond pool */
+        realcond = hybris_pthread_cond_alloc();
 
         *((uintptr_t *) cond) = (uintptr_t) realcond;
     }
@@ -925,11 +880,13 @@ static int _hybris_hook_pthread_cond_destroy(pthread_cond_t *cond)
          * condition variable. */
         realcond->__data.__wrefs = 0;
         ret = pthread_cond_destroy(realcond);
-        free(realcond);
+        hybris_pthread_cond_free(realcond);
     }
     else {
-        realcond = (pthread_cond_t *)hybris_get_shmpointer((hybris_shm_pointer_t)realcond);
+        hybris_shm_pointer_t handle = (hybris_shm_pointer_t)realcond;
+        realcond = (pthread_cond_t *)hybris_get_shmpointer(handle);
         ret = pthread_cond_destroy(realcond);
+        hybris_shm_free(handle, sizeof(pthread_cond_t));
     }
 
     *((uintptr_t *)cond) = 0;
@@ -953,8 +910,7 @@ static int _hybris_hook_pthread_cond_broadcast(pthread_cond_t *cond)
         realcond = (pthread_cond_t *)hybris_get_shmpointer((hybris_shm_pointer_t)value);
 
     if (value <= ANDROID_TOP_ADDR_VALUE_COND) {
-        realcond = hybris_alloc_init_cond();
-        *((uintptr_t *) cond) = (uintptr_t) realcond;
+        realcond = hybris_lazy_init_cond(cond, value);
     }
 
     return pthread_cond_broadcast(realcond);
@@ -976,8 +932,7 @@ static int _hybris_hook_pthread_cond_signal(pthread_cond_t *cond)
         realcond = (pthread_cond_t *)hybris_get_shmpointer((hybris_shm_pointer_t)value);
 
     if (value <= ANDROID_TOP_ADDR_VALUE_COND) {
-        realcond = hybris_alloc_init_cond();
-        *((uintptr_t *) cond) = (uintptr_t) realcond;
+        realcond = hybris_lazy_init_cond(cond, value);
     }
 
     return pthread_cond_signal(realcond);
@@ -1002,8 +957,7 @@ static int _hybris_hook_pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t
         realcond = (pthread_cond_t *)hybris_get_shmpointer((hybris_shm_pointer_t)cvalue);
 
     if (cvalue <= ANDROID_TOP_ADDR_VALUE_COND) {
-        realcond = hybris_alloc_init_cond();
-        *((uintptr_t *) cond) = (uintptr_t) realcond;
+        realcond = hybris_lazy_init_cond(cond, cvalue);
     }
 
     pthread_mutex_t *realmutex = (pthread_mutex_t *) mvalue;
@@ -1011,8 +965,7 @@ static int _hybris_hook_pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t
         realmutex = (pthread_mutex_t *)hybris_get_shmpointer((hybris_shm_pointer_t)mvalue);
 
     if (mvalue <= ANDROID_TOP_ADDR_VALUE_MUTEX) {
-        realmutex = hybris_alloc_init_mutex(mvalue);
-        *((uintptr_t *) mutex) = (uintptr_t) realmutex;
+        realmutex = hybris_lazy_init_mutex(mutex, mvalue);
     }
 
     return pthread_cond_wait(realcond, realmutex);
@@ -1038,8 +991,7 @@ static int _hybris_hook_pthread_cond_clockwait(pthread_cond_t *cond, pthread_mut
         realcond = (pthread_cond_t *)hybris_get_shmpointer((hybris_shm_pointer_t)cvalue);
 
     if (cvalue <= ANDROID_TOP_ADDR_VALUE_COND) {
-        realcond = hybris_alloc_init_cond();
-        *((uintptr_t *) cond) = (uintptr_t) realcond;
+        realcond = hybris_lazy_init_cond(cond, cvalue);
     }
 
     pthread_mutex_t *realmutex = (pthread_mutex_t *) mvalue;
@@ -1047,8 +999,7 @@ static int _hybris_hook_pthread_cond_clockwait(pthread_cond_t *cond, pthread_mut
         realmutex = (pthread_mutex_t *)hybris_get_shmpointer((hybris_shm_pointer_t)mvalue);
 
     if (mvalue <= ANDROID_TOP_ADDR_VALUE_MUTEX) {
-        realmutex = hybris_alloc_init_mutex(mvalue);
-        *((uintptr_t *) mutex) = (uintptr_t) realmutex;
+        realmutex = hybris_lazy_init_mutex(mutex, mvalue);
     }
 
     return pthread_cond_clockwait(realcond, realmutex, clock_id, abstime);
@@ -1074,8 +1025,7 @@ static int _hybris_hook_pthread_cond_timedwait(pthread_cond_t *cond,
         realcond = (pthread_cond_t *)hybris_get_shmpointer((hybris_shm_pointer_t)cvalue);
 
     if (cvalue <= ANDROID_TOP_ADDR_VALUE_COND) {
-        realcond = hybris_alloc_init_cond();
-        *((uintptr_t *) cond) = (uintptr_t) realcond;
+        realcond = hybris_lazy_init_cond(cond, cvalue);
     }
 
     pthread_mutex_t *realmutex = (pthread_mutex_t *) mvalue;
@@ -1083,8 +1033,7 @@ static int _hybris_hook_pthread_cond_timedwait(pthread_cond_t *cond,
         realmutex = (pthread_mutex_t *)hybris_get_shmpointer((hybris_shm_pointer_t)mvalue);
 
     if (mvalue <= ANDROID_TOP_ADDR_VALUE_MUTEX) {
-        realmutex = hybris_alloc_init_mutex(mvalue);
-        *((uintptr_t *) mutex) = (uintptr_t) realmutex;
+        realmutex = hybris_lazy_init_mutex(mutex, mvalue);
     }
 
     return pthread_cond_timedwait(realcond, realmutex, abstime);
@@ -1110,8 +1059,7 @@ static int _hybris_hook_pthread_cond_timedwait_relative_np(pthread_cond_t *cond,
         realcond = (pthread_cond_t *)hybris_get_shmpointer((hybris_shm_pointer_t)cvalue);
 
     if (cvalue <= ANDROID_TOP_ADDR_VALUE_COND) {
-        realcond = hybris_alloc_init_cond();
-        *((uintptr_t *) cond) = (uintptr_t) realcond;
+        realcond = hybris_lazy_init_cond(cond, cvalue);
     }
 
     pthread_mutex_t *realmutex = (pthread_mutex_t *) mvalue;
@@ -1119,8 +1067,7 @@ static int _hybris_hook_pthread_cond_timedwait_relative_np(pthread_cond_t *cond,
         realmutex = (pthread_mutex_t *)hybris_get_shmpointer((hybris_shm_pointer_t)mvalue);
 
     if (mvalue <= ANDROID_TOP_ADDR_VALUE_MUTEX) {
-        realmutex = hybris_alloc_init_mutex(mvalue);
-        *((uintptr_t *) mutex) = (uintptr_t) realmutex;
+        realmutex = hybris_lazy_init_mutex(mutex, mvalue);
     }
 
     struct timespec tv;
@@ -1253,8 +1200,8 @@ static int _hybris_hook_pthread_rwlock_init(pthread_rwlock_t *__rwlock,
         pthread_rwlockattr_getpshared(realattr, &pshared);
 
     if (!pshared) {
-        /* non shared, standard rwlock: use malloc */
-        realrwlock = malloc(sizeof(pthread_rwlock_t));
+        /* non shared, standard rwlock: use the rwlock pool */
+        realrwlock = hybris_pthread_rwlock_alloc();
 
         *((uintptr_t *) __rwlock) = (uintptr_t) realrwlock;
     }
@@ -1280,13 +1227,17 @@ static int _hybris_hook_pthread_rwlock_destroy(pthread_rwlock_t *__rwlock)
 
     if (!hybris_is_pointer_in_shm((void*)realrwlock)) {
         ret = pthread_rwlock_destroy(realrwlock);
-        free(realrwlock);
+        hybris_pthread_rwlock_free(realrwlock);
     }
     else {
+        hybris_shm_pointer_t handle = (hybris_shm_pointer_t)realrwlock;
+        realrwlock = (pthread_rwlock_t *)hybris_get_shmpointer(handle);
         ret = pthread_rwlock_destroy(realrwlock);
-        realrwlock = (pthread_rwlock_t *)hybris_get_shmpointer((hybris_shm_pointer_t)realrwlock);
+        hybris_shm_free(handle, sizeof(pthread_rwlock_t));
     }
 
+    *((uintptr_t *)__rwlock) = 0;
+
     return ret;
 }
 
@@ -1299,8 +1250,7 @@ static pthread_rwlock_t* hybris_set_realrwlock(pthread_rwlock_t *rwlock)
         realrwlock = (pthread_rwlock_t *)hybris_get_shmpointer((hybris_shm_pointer_t)value);
 
     if ((uintptr_t)realrwlock <= ANDROID_TOP_ADDR_VALUE_RWLOCK) {
-        realrwlock = hybris_alloc_init_rwlock();
-        *((uintptr_t *)rwlock) = (uintptr_t) realrwlock;
+        realrwlock = hybris_lazy_init_rwlock(rwlock, value);
     }
     return realrwlock;
 }
@@ -2956,7 +2906,7 @@ int _hybris_hook_android_fdsan_close_with_tag(int fd, uint64_t tag)
 }
 
 // old property hooks for pre-android 8 approach
-static struct _hook hooks_properties[] = {
+static const struct _hook hooks_properties[] = {
     HOOK_INDIRECT(property_get),
     HOOK_INDIRECT(property_set),
     HOOK_INDIRECT(property_list),
@@ -2973,7 +2923,7 @@ static struct _hook hooks_properties[] = {
     HOOK_INDIRECT(__system_property_find_nth),
 };
 
-static struct _hook hooks_common[] = {
+static const struct _hook hooks_common[] = {
 
     HOOK_DIRECT(getenv),
     HOOK_DIRECT_NO_DEBUG(printf),
@@ -3278,7 +3228,7 @@ static struct _hook hooks_common[] = {
     HOOK_INDIRECT(__fpurge),
 };
 
-static struct _hook hooks_mm[] = {
+static const struct _hook hooks_mm[] = {
     HOOK_DIRECT(strtol),
     HOOK_DIRECT_NO_DEBUG(strlcat),
     HOOK_DIRECT_NO_DEBUG(strlcpy),
@@ -3386,7 +3336,7 @@ static struct _hook hooks_mm[] = {
     HOOK_TO(scandir64, _hybris_hook_scandir),
 };
 
-static struct _hook hooks_n[] = {
+static const struct _hook hooks_n[] = {
     /* stdio.h */
     HOOK_INDIRECT(fgetpos64),
     HOOK_INDIRECT(fsetpos64),
@@ -3400,7 +3350,7 @@ static struct _hook hooks_n[] = {
     HOOK_TO(scandirat64, _hybris_hook_scandirat),
 };
 
-static struct _hook hooks_p[] = {
+static const struct _hook hooks_p[] = {
     /* stdio.h */
     HOOK_INDIRECT(fflush_unlocked),
     HOOK_INDIRECT(fputc_unlocked),
@@ -3417,11 +3367,6 @@ static struct _hook hooks_p[] = {
     HOOK_DIRECT_NO_DEBUG(pthread_setschedprio),
 };
 
-static int hook_cmp(const void *a, const void *b)
-{
-    return strcmp(((struct _hook*)a)->name, ((struct _hook*)b)->name);
-}
-
 void hybris_set_hook_callback(hybris_hook_cb callback)
 {
     hook_callback = callback;
@@ -3501,9 +3446,96 @@ static int get_android_sdk_version()
     return sdk_version;
 }
 
-#define HOOKS_SIZE(hooks) \
-    (sizeof(hooks) / sizeof(hooks[0]))
+/*
+ * Hook lookup table
+ *
+ * hooks_table.h is generated at build time by generate_hooks_table.py from
+ * the hook lists above. It holds a minimal perfect hash over all hooked
+ * symbol names which records, for each name, its index in every list. The
+ * lists which apply to the running SDK version are then checked in override
+ * order, so newer hooks override those which are available for all versions.
+ * A bloom filter in front of the table rejects most symbols without a hook
+ * before the table is touched at all.
+ */
+#ifndef HYBRIS_HOOKS_TABLE_GENERATOR
+#include "hooks_table.h"
+#endif
+
+/* keep in sync with table_hash() in generate_hooks_table.py */
+static uint32_t hook_table_hash(uint32_t d, const char *name)
+{
+    const unsigned char *p = (const unsigned char *) name;
+
+    if (d == 0)
+        d = 0x01000193;
+
+    while (*p != 0)
+        d = (d * 0x01000193) ^ *p++;
+
+    return d;
+}
+
+static unsigned int hook_lists_enabled(void)
+{
+    static unsigned int lists = 0;
+    int sdk_version;
 
+    if (lists)
+        return lists;
+
+    sdk_version = get_android_sdk_version();
+
+#if defined(WANT_LINKER_O) || defined(WANT_LINKER_Q)
+    if (sdk_version > 27)
+        lists |= 1u << HOOK_LIST_P;
+#endif
+#if defined(WANT_LINKER_N) || defined(WANT_LINKER_O) || defined(WANT_LINKER_Q)
+    if (sdk_version > 23)
+        lists |= 1u << HOOK_LIST_N;
+#endif
+#if defined(WANT_LINKER_MM) || defined(WANT_LINKER_N) || defined(WANT_LINKER_O) || defined(WANT_LINKER_Q)
+    if (sdk_version > 21)
+        lists |= 1u << HOOK_LIST_MM;
+#endif
+    // make sure to skip the property hooks only when o.so is actually loaded
+    // since for testing and we sometimes set things like 99 as sdk version.
+    // The o linker is loaded when sdk_version >= 27 and exists.
+    if (sdk_version < 27)
+        lists |= 1u << HOOK_LIST_PROPERTIES;
+
+    lists |= 1u << HOOK_LIST_COMMON;
+
+    return lists;
+}
+
+static const struct _hook *hook_table_lookup(const char *sym)
+{
+    const struct _hook_table_entry *entry;
+    unsigned int lists = hook_lists_enabled();
+    uint32_t hash = hook_table_hash(0, sym);
+    uint32_t word = hook_table_bloom[(hash / 32) % HOOK_TABLE_BLOOM_WORDS];
+    int32_t d;
+    int i;
+
+    if (((word >> (hash % 32)) & (word >> ((hash >> HOOK_TABLE_BLOOM_SHIFT) % 32)) & 1) == 0)
+        return NULL;
+
+    d = hook_table_displacement[hash % HOOK_TABLE_SIZE];
+    if (d < 0)
+        entry = &hook_table[-d - 1];
+    else
+        entry = &hook_table[hook_table_hash(d, sym) % HOOK_TABLE_SIZE];
+
+    if (strcmp(hook_table_names + entry->name, sym) != 0)
+        return NULL;
+
+    for (i = 0; i < HOOK_LIST_COUNT; i++) {
+        if ((lists & (1u << i)) && entry->index[i] >= 0)
+            return &hook_lists[i][entry->index[i]];
+    }
+
+    return NULL;
+}
 
 int strendswith(const char *str, const char *suffix, int lensuf)
 {
@@ -3513,20 +3545,21 @@ int strendswith(const char *str, const char *suffix, int lensuf)
 
 static void* __hybris_get_hooked_symbol(const char *sym, const char *requester)
 {
-    static int sorted = 0;
     static intptr_t counter = -1;
     static int do_print_unhooked = -1;
-    void *found = NULL;
-    struct _hook key;
-    int sdk_version = -1;
+    const struct _hook *found = NULL;
 
     /* First check if we have a callback registered which could
      * give us a context specific hook implementation */
     if (hook_callback)
     {
-        found = hook_callback(sym, requester);
-        if (found)
-            return (void*) found;
+        void *hook;
+
+        pthread_mutex_lock(&hook_callback_mutex);
+        hook = hook_callback(sym, requester);
+        pthread_mutex_unlock(&hook_callback_mutex);
+        if (hook)
+            return hook;
     }
 
 #ifdef WANT_ADRENO_QUIRKS
@@ -3535,47 +3568,14 @@ static void* __hybris_get_hooked_symbol(const char *sym, const char *requester)
     }
 #endif
 
-    if (!sorted)
-    {
-        qsort(hooks_properties, HOOKS_SIZE(hooks_properties), sizeof(hooks_properties[0]), hook_cmp);
-        qsort(hooks_common, HOOKS_SIZE(hooks_common), sizeof(hooks_common[0]), hook_cmp);
-        qsort(hooks_mm, HOOKS_SIZE(hooks_mm), sizeof(hooks_mm[0]), hook_cmp);
-        qsort(hooks_n, HOOKS_SIZE(hooks_n), sizeof(hooks_n[0]), hook_cmp);
-        qsort(hooks_p, HOOKS_SIZE(hooks_p), sizeof(hooks_p[0]), hook_cmp);
-        sorted = 1;
-    }
-
-    /* Allow newer hooks to override those which are available for all versions */
-    key.name = sym;
-    sdk_version = get_android_sdk_version();
-
-#if defined(WANT_LINKER_O) || defined(WANT_LINKER_Q)
-    if (sdk_version > 27)
-        found = bsearch(&key, hooks_p, HOOKS_SIZE(hooks_p), sizeof(hooks_p[0]), hook_cmp);
-#endif
-#if defined(WANT_LINKER_N) || defined(WANT_LINKER_O) || defined(WANT_LINKER_Q)
-    if (!found && sdk_version > 23)
-        found = bsearch(&key, hooks_n, HOOKS_SIZE(hooks_n), sizeof(hooks_n[0]), hook_cmp);
-#endif
-#if defined(WANT_LINKER_MM) || defined(WANT_LINKER_N) || defined(WANT_LINKER_O) || defined(WANT_LINKER_Q)
-    if (!found && sdk_version > 21)
-        found = bsearch(&key, hooks_mm, HOOKS_SIZE(hooks_mm), sizeof(hooks_mm[0]), hook_cmp);
-#endif
-    // make sure to skip the property hooks only when o.so is actually loaded
-    // since for testing and we sometimes set things like 99 as sdk version.
-    // The o linker is loaded when sdk_version >= 27 and exists.
-    if (!found && sdk_version < 27)
-        found = bsearch(&key, hooks_properties, HOOKS_SIZE(hooks_properties), sizeof(hooks_properties[0]), hook_cmp);
-
-    if (!found)
-        found = bsearch(&key, hooks_common, HOOKS_SIZE(hooks_common), sizeof(hooks_common[0]), hook_cmp);
+    found = hook_table_lookup(sym);
 
     if (found)
     {
         if(hybris_should_trace(NULL, NULL))
-            return ((struct _hook*) found)->debug_func;
+            return found->debug_func;
         else
-            return ((struct _hook*) found)->func;
+            return found->func;
     }
 
     if (strncmp(sym, "pthread", 7) == 0 ||
@@ -3585,12 +3585,13 @@ static void* __hybris_get_hooked_symbol(const char *sym, const char *requester)
         if (strcmp(sym, "pthread_sigmask") == 0)
            return NULL;
         /* not safe */
-        counter--;
+        /* atomic, the linker may relocate libraries on several threads */
+        intptr_t missing = __sync_sub_and_fetch(&counter, 1);
         // If you're experiencing a crash later on check the address of the
         // function pointer being call. If it matches the printed counter
         // value here then you can easily find out which symbol is missing.
-        LOGD("Missing hook for pthread symbol %s (counter %" PRIiPTR ")\n", sym, counter);
-        return (void *) counter;
+        LOGD("Missing hook for pthread symbol %s (counter %" PRIiPTR ")\n", sym, missing);
+        return (void *) missing;
     }
 
     if (do_print_unhooked == -1) {
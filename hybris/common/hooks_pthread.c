@@ -0,0 +1,231 @@
+/*
+ * Copyright (c) 2012 Carsten Munk <carsten.munk@gmail.com>
+ * Copyright (c) 2012 Canonical Ltd
+ * Copyright (c) 2013 Christophe Chapuis <chris.chapuis@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "config.h"
+
+#include "hooks_pthread.h"
+#include "hooks_shm.h"
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <pthread.h>
+
+/* Debug */
+#include "logging.h"
+#define LOGD(message, ...) HYBRIS_DEBUG_LOG(HOOKS, message, ##__VA_ARGS__)
+
+/* For the static initializer types */
+#define ANDROID_PTHREAD_MUTEX_INITIALIZER            0
+#define ANDROID_PTHREAD_RECURSIVE_MUTEX_INITIALIZER  0x4000
+#define ANDROID_PTHREAD_ERRORCHECK_MUTEX_INITIALIZER 0x8000
+#define ANDROID_PTHREAD_COND_INITIALIZER             0
+#define ANDROID_PTHREAD_RWLOCK_INITIALIZER           0
+
+/*
+ * Each object gets its own cache line, so that objects which are handed out
+ * one after another do not share a line between unrelated threads.
+ */
+#define HYBRIS_POOL_SLOT_SIZE  64
+#define HYBRIS_POOL_SLAB_SIZE  4096
+
+typedef struct _hybris_pool_slot {
+    struct _hybris_pool_slot *next;
+} hybris_pool_slot_t;
+
+typedef struct _hybris_pool {
+    pthread_mutex_t lock;
+    hybris_pool_slot_t *free_list;
+} hybris_pool_t;
+
+typedef char hybris_pool_mutex_fits[sizeof(pthread_mutex_t) <= HYBRIS_POOL_SLOT_SIZE ? 1 : -1];
+typedef char hybris_pool_cond_fits[sizeof(pthread_cond_t) <= HYBRIS_POOL_SLOT_SIZE ? 1 : -1];
+typedef char hybris_pool_rwlock_fits[sizeof(pthread_rwlock_t) <= HYBRIS_POOL_SLOT_SIZE ? 1 : -1];
+
+static hybris_pool_t _mutex_pool = { PTHREAD_MUTEX_INITIALIZER, NULL };
+static hybris_pool_t _cond_pool = { PTHREAD_MUTEX_INITIALIZER, NULL };
+static hybris_pool_t _rwlock_pool = { PTHREAD_MUTEX_INITIALIZER, NULL };
+
+/*
+ * Take a slot from the pool, carving a new slab into slots when it is empty.
+ * Slabs are never returned to the system, released slots are reused instead.
+ */
+static void *_hybris_pool_alloc(hybris_pool_t *pool)
+{
+    hybris_pool_slot_t *slot;
+
+    pthread_mutex_lock(&pool->lock);
+
+    if (!pool->free_list) {
+        unsigned char *slab = NULL;
+        size_t offset;
+
+        if (posix_memalign((void **) &slab, HYBRIS_POOL_SLOT_SIZE, HYBRIS_POOL_SLAB_SIZE) != 0) {
+            pthread_mutex_unlock(&pool->lock);
+            HYBRIS_ERROR_LOG(HOOKS, "ERROR: Failed to allocate pthread object slab");
+            return NULL;
+        }
+
+        for (offset = 0; offset < HYBRIS_POOL_SLAB_SIZE; offset += HYBRIS_POOL_SLOT_SIZE) {
+            slot = (hybris_pool_slot_t *) (slab + offset);
+            slot->next = pool->free_list;
+            pool->free_list = slot;
+        }
+    }
+
+    slot = pool->free_list;
+    pool->free_list = slot->next;
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return slot;
+}
+
+static void _hybris_pool_free(hybris_pool_t *pool, void *ptr)
+{
+    hybris_pool_slot_t *slot = ptr;
+
+    if (!slot)
+        return;
+
+    pthread_mutex_lock(&pool->lock);
+    slot->next = pool->free_list;
+    pool->free_list = slot;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+pthread_mutex_t *hybris_pthread_mutex_alloc(void)
+{
+    return _hybris_pool_alloc(&_mutex_pool);
+}
+
+void hybris_pthread_mutex_free(pthread_mutex_t *mutex)
+{
+    _hybris_pool_free(&_mutex_pool, mutex);
+}
+
+pthread_cond_t *hybris_pthread_cond_alloc(void)
+{
+    return _hybris_pool_alloc(&_cond_pool);
+}
+
+void hybris_pthread_cond_free(pthread_cond_t *cond)
+{
+    _hybris_pool_free(&_cond_pool, cond);
+}
+
+pthread_rwlock_t *hybris_pthread_rwlock_alloc(void)
+{
+    return _hybris_pool_alloc(&_rwlock_pool);
+}
+
+void hybris_pthread_rwlock_free(pthread_rwlock_t *rwlock)
+{
+    _hybris_pool_free(&_rwlock_pool, rwlock);
+}
+
+static void hybris_set_mutex_attr(unsigned int android_value, pthread_mutexattr_t *attr)
+{
+    /* Init already sets as PTHREAD_MUTEX_NORMAL */
+    pthread_mutexattr_init(attr);
+
+    if (android_value & ANDROID_PTHREAD_RECURSIVE_MUTEX_INITIALIZER) {
+        pthread_mutexattr_settype(attr, PTHREAD_MUTEX_RECURSIVE);
+    } else if (android_value & ANDROID_PTHREAD_ERRORCHECK_MUTEX_INITIALIZER) {
+        pthread_mutexattr_settype(attr, PTHREAD_MUTEX_ERRORCHECK);
+    }
+}
+
+/*
+ * Publish realobj into the first word of the bionic object, unless another
+ * thread got there first. Returns the value which is stored there now.
+ */
+static uintptr_t _hybris_publish(void *object, uintptr_t value, void *realobj)
+{
+    uintptr_t current = __sync_val_compare_and_swap((uintptr_t *) object,
+                                                    value, (uintptr_t) realobj);
+
+    return current == value ? (uintptr_t) realobj : current;
+}
+
+/* The winner of a publication race might also have been a pshared init */
+static void *_hybris_resolve(uintptr_t value)
+{
+    if (hybris_is_pointer_in_shm((void *) value))
+        return hybris_get_shmpointer((hybris_shm_pointer_t) value);
+
+    return (void *) value;
+}
+
+pthread_mutex_t *hybris_lazy_init_mutex(pthread_mutex_t *mutex, uintptr_t value)
+{
+    pthread_mutex_t *realmutex = hybris_pthread_mutex_alloc();
+    pthread_mutexattr_t attr;
+    uintptr_t current;
+
+    hybris_set_mutex_attr(value, &attr);
+    pthread_mutex_init(realmutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    current = _hybris_publish(mutex, value, realmutex);
+    if (current != (uintptr_t) realmutex) {
+        LOGD("Lost initialization race for mutex %p", mutex);
+        pthread_mutex_destroy(realmutex);
+        hybris_pthread_mutex_free(realmutex);
+    }
+
+    return _hybris_resolve(current);
+}
+
+pthread_cond_t *hybris_lazy_init_cond(pthread_cond_t *cond, uintptr_t value)
+{
+    pthread_cond_t *realcond = hybris_pthread_cond_alloc();
+    uintptr_t current;
+
+    pthread_cond_init(realcond, NULL);
+
+    current = _hybris_publish(cond, value, realcond);
+    if (current != (uintptr_t) realcond) {
+        LOGD("Lost initialization race for cond %p", cond);
+        pthread_cond_destroy(realcond);
+        hybris_pthread_cond_free(realcond);
+    }
+
+    return _hybris_resolve(current);
+}
+
+pthread_rwlock_t *hybris_lazy_init_rwlock(pthread_rwlock_t *rwlock, uintptr_t value)
+{
+    pthread_rwlock_t *realrwlock = hybris_pthread_rwlock_alloc();
+    uintptr_t current;
+
+    pthread_rwlock_init(realrwlock, NULL);
+
+    current = _hybris_publish(rwlock, value, realrwlock);
+    if (current != (uintptr_t) realrwlock) {
+        LOGD("Lost initialization race for rwlock %p", rwlock);
+        pthread_rwlock_destroy(realrwlock);
+        hybris_pthread_rwlock_free(realrwlock);
+    }
+
+    return _hybris_resolve(current);
+}
+
+// vim:ts=4:sw=4:noexpandtab
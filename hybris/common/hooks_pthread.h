@@ -0,0 +1,56 @@
+/*
+ * Copyright (c) 2012 Carsten Munk <carsten.munk@gmail.com>
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef HOOKS_PTHREAD_H_
+#define HOOKS_PTHREAD_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Allocate and release the glibc objects backing non process-shared bionic
+ * mutexes, conditions and rwlocks. They are taken from per type pools of
+ * cache line sized slots instead of being allocated one by one.
+ */
+pthread_mutex_t *hybris_pthread_mutex_alloc(void);
+void hybris_pthread_mutex_free(pthread_mutex_t *mutex);
+pthread_cond_t *hybris_pthread_cond_alloc(void);
+void hybris_pthread_cond_free(pthread_cond_t *cond);
+pthread_rwlock_t *hybris_pthread_rwlock_alloc(void);
+void hybris_pthread_rwlock_free(pthread_rwlock_t *rwlock);
+
+/*
+ * Initialize the glibc object for a statically initialized bionic object
+ * whose first word still holds the initializer value, and publish it into
+ * that word. When several threads race to do this, only one of them wins
+ * and all of them return the object which was published.
+ */
+pthread_mutex_t *hybris_lazy_init_mutex(pthread_mutex_t *mutex, uintptr_t value);
+pthread_cond_t *hybris_lazy_init_cond(pthread_cond_t *cond, uintptr_t value);
+pthread_rwlock_t *hybris_lazy_init_rwlock(pthread_rwlock_t *rwlock, uintptr_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
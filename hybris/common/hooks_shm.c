@@ -43,18 +43,51 @@
 #else
 # define HYBRIS_SHM_MASK    0xFF000000UL
 #endif
-#define HYBRIS_SHM_PATH     "/hybris_shm_data"
+/*
+ * Processes attach to the region of any libhybris running at the time, so
+ * the name changes along with the layout of hybris_shm_data_t: older ones
+ * keep using the region they understand.
+ */
+#define HYBRIS_SHM_PATH     "/hybris_shm_data_v2"
+
+/*
+ * The whole range addressable by a handle is reserved in every process up
+ * front. Growing the region then only extends the shm object, and the
+ * mapping never has to move while other threads are using it.
+ */
+#define HYBRIS_SHM_MAP_SIZE ((size_t)(~HYBRIS_SHM_MASK) + 1)
+
+/*
+ * Objects are allocated from size classes, so that a released object can be
+ * reused by any later allocation of the same class. Larger requests are
+ * served directly from the end of the region and never reclaimed.
+ */
+static const int _hybris_shm_class_sizes[] = { 16, 32, 48, 64, 96, 128, 192, 256 };
+#define HYBRIS_SHM_NUM_CLASSES \
+    ((int)(sizeof(_hybris_shm_class_sizes) / sizeof(_hybris_shm_class_sizes[0])))
+#define HYBRIS_SHM_ALIGN    16
+#define HYBRIS_SHM_NO_BLOCK (-1)
+
+/* Free list of a size class; the next offset is kept in the free block itself */
+typedef struct _hybris_shm_class_t {
+    pthread_mutex_t lock;
+    int free_head;
+} hybris_shm_class_t;
 
 /* Structure of a shared memory region */
 typedef struct _hybris_shm_data_t {
     pthread_mutex_t access_mutex;
     int current_offset;
     int max_offset;
-    unsigned char data;
+    hybris_shm_class_t classes[HYBRIS_SHM_NUM_CLASSES];
+    /* bytes handed out and not yet released, over all processes */
+    size_t live_size;
+    size_t peak_size;
+    unsigned char data[] __attribute__((aligned(HYBRIS_SHM_ALIGN)));
 } hybris_shm_data_t;
 
 /* A helper to switch between the size of the data and the size of the shm object */
-const int HYBRIS_SHM_DATA_HEADER_SIZE = (sizeof(hybris_shm_data_t) - sizeof(unsigned char));
+#define HYBRIS_SHM_DATA_HEADER_SIZE ((int) offsetof(hybris_shm_data_t, data))
 
 /* pointer to the shared memory region */
 static hybris_shm_data_t *_hybris_shm_data = NULL;
@@ -62,12 +95,11 @@ static hybris_shm_data_t *_hybris_shm_data = NULL;
 /* the SHM mem_id of the shared memory region */
 static int _hybris_shm_fd = -1;
 
-/* the size of the shared memory region that is currently mmap'ed to this process */
-static int _current_mapped_size = 0;
+/* serializes attaching to the shm region between the threads of this process */
+static pthread_mutex_t _hybris_shm_init_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /* forward-declare the internal static methods */
 static void _release_shm(void);
-static void _sync_mmap_with_shm(void);
 static void _hybris_shm_init(void);
 static void _hybris_shm_extend_region(void);
 
@@ -77,7 +109,7 @@ static void _hybris_shm_extend_region(void);
 static void _release_shm(void)
 {
     if (_hybris_shm_data) {
-        munmap(_hybris_shm_data, _current_mapped_size); /* unmap from this process */
+        munmap(_hybris_shm_data, HYBRIS_SHM_MAP_SIZE); /* unmap from this process */
         _hybris_shm_data = NULL; /* pointer is no more valid */
     }
     if (_hybris_shm_fd >= 0) {
@@ -88,22 +120,19 @@ static void _release_shm(void)
 }
 
 /*
- * Synchronize the size of the mmap with the size of the shm region
+ * Map the whole reserved range of the shm object into this process
  */
-static void _sync_mmap_with_shm()
+static hybris_shm_data_t *_hybris_shm_map(int fd)
 {
-    if (_hybris_shm_fd >= 0 && _hybris_shm_data) {
-        if (_current_mapped_size < _hybris_shm_data->max_offset + HYBRIS_SHM_DATA_HEADER_SIZE) {
-            /* Note that mremap may change the address pointed by _hybris_shm_data.
-             * But as we never point directly into _hybris_shm_data, it's fine.
-             * */
-            _hybris_shm_data = (hybris_shm_data_t *)mremap( _hybris_shm_data, _current_mapped_size,
-                                  _hybris_shm_data->max_offset + HYBRIS_SHM_DATA_HEADER_SIZE,
-                                  MREMAP_MAYMOVE );
-
-            _current_mapped_size = _hybris_shm_data->max_offset + HYBRIS_SHM_DATA_HEADER_SIZE;
-        }
+    void *data = mmap(NULL, HYBRIS_SHM_MAP_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_NORESERVE, fd, 0);
+
+    if (data == MAP_FAILED) {
+        HYBRIS_ERROR_LOG(HOOKS, "ERROR: mmap failed: %s\n", strerror(errno));
+        return NULL;
     }
+
+    return (hybris_shm_data_t *)data;
 }
 
 /*
@@ -112,38 +141,38 @@ static void _sync_mmap_with_shm()
  */
 static void _hybris_shm_init()
 {
+    pthread_mutex_lock(&_hybris_shm_init_mutex);
+
     if (_hybris_shm_fd < 0) {
         const size_t size_to_map = HYBRIS_SHM_DATA_HEADER_SIZE + HYBRIS_DATA_SIZE; /* 4000 bytes for the data, plus the header size */
 
         /* initialize or get shared memory segment */
-        _hybris_shm_fd = shm_open(HYBRIS_SHM_PATH, O_RDWR, 0660);
-        if (_hybris_shm_fd >= 0) {
+        int fd = shm_open(HYBRIS_SHM_PATH, O_RDWR, 0660);
+        if (fd >= 0) {
             /* Map the memory object */
-            _hybris_shm_data = (hybris_shm_data_t *)mmap( NULL, size_to_map,
-                                             PROT_READ | PROT_WRITE, MAP_SHARED,
-                                             _hybris_shm_fd, 0 );
-            _current_mapped_size = size_to_map;
-
-            _sync_mmap_with_shm();
+            _hybris_shm_data = _hybris_shm_map(fd);
+            if (_hybris_shm_data) {
+                __sync_synchronize();
+                _hybris_shm_fd = fd;
+            }
+            else
+                close(fd);
         }
         else {
             LOGD("Creating a new shared memory segment.");
 
             mode_t pumask = umask(0);
-            _hybris_shm_fd = shm_open(HYBRIS_SHM_PATH, O_RDWR | O_CREAT, 0666);
+            fd = shm_open(HYBRIS_SHM_PATH, O_RDWR | O_CREAT, 0666);
             umask(pumask);
-            if (_hybris_shm_fd >= 0) {
-                TEMP_FAILURE_RETRY(ftruncate( _hybris_shm_fd, size_to_map ));
+            if (fd >= 0) {
+                TEMP_FAILURE_RETRY(ftruncate( fd, size_to_map ));
                 /* Map the memory object */
-                _hybris_shm_data = (hybris_shm_data_t *)mmap( NULL, size_to_map,
-                                             PROT_READ | PROT_WRITE, MAP_SHARED,
-                                             _hybris_shm_fd, 0 );
-                if (_hybris_shm_data == MAP_FAILED) {
-                    HYBRIS_ERROR_LOG(HOOKS, "ERROR: mmap failed: %s\n", strerror(errno));
-                    _release_shm();
+                _hybris_shm_data = _hybris_shm_map(fd);
+                if (_hybris_shm_data == NULL) {
+                    close(fd);
+                    shm_unlink(HYBRIS_SHM_PATH);
                 }
                 else {
-                    _current_mapped_size = size_to_map;
                     /* Initialize the memory object */
                     memset((void*)_hybris_shm_data, 0, size_to_map);
                     _hybris_shm_data->max_offset = HYBRIS_DATA_SIZE;
@@ -152,8 +181,16 @@ static void _hybris_shm_init()
                     pthread_mutexattr_init(&attr);
                     pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
                     pthread_mutex_init(&_hybris_shm_data->access_mutex, &attr);
+                    for (int i = 0; i < HYBRIS_SHM_NUM_CLASSES; i++) {
+                        pthread_mutex_init(&_hybris_shm_data->classes[i].lock, &attr);
+                        _hybris_shm_data->classes[i].free_head = HYBRIS_SHM_NO_BLOCK;
+                    }
                     pthread_mutexattr_destroy(&attr);
 
+                    /* other threads only use the region once the fd is set */
+                    __sync_synchronize();
+                    _hybris_shm_fd = fd;
+
                     atexit(_release_shm);
                 }
             }
@@ -162,17 +199,44 @@ static void _hybris_shm_init()
             }
         }
     }
+
+    pthread_mutex_unlock(&_hybris_shm_init_mutex);
 }
 
 /*
- * Extend the SHM region's size
+ * Extend the SHM region's size, called with the access mutex held
  */
 static void _hybris_shm_extend_region()
 {
-    TEMP_FAILURE_RETRY(ftruncate( _hybris_shm_fd, _current_mapped_size + HYBRIS_DATA_SIZE ));
     _hybris_shm_data->max_offset += HYBRIS_DATA_SIZE;
+    TEMP_FAILURE_RETRY(ftruncate( _hybris_shm_fd,
+                       HYBRIS_SHM_DATA_HEADER_SIZE + _hybris_shm_data->max_offset ));
+}
 
-    _sync_mmap_with_shm();
+/*
+ * Find the size class for an allocation, or -1 if it is too large for one
+ */
+static int _hybris_shm_size_class(size_t size)
+{
+    for (int i = 0; i < HYBRIS_SHM_NUM_CLASSES; i++) {
+        if (size <= (size_t) _hybris_shm_class_sizes[i])
+            return i;
+    }
+
+    return -1;
+}
+
+static void _hybris_shm_account(ssize_t delta)
+{
+    size_t live = __sync_add_and_fetch(&_hybris_shm_data->live_size, delta);
+    size_t peak = _hybris_shm_data->peak_size;
+
+    while (live > peak) {
+        size_t old = __sync_val_compare_and_swap(&_hybris_shm_data->peak_size, peak, live);
+        if (old == peak)
+            break;
+        peak = old;
+    }
 }
 
 /************ public functions *******************/
@@ -203,20 +267,14 @@ void *hybris_get_shmpointer(hybris_shm_pointer_t handle)
             _hybris_shm_init();
         }
 
-        pthread_mutex_lock(&_hybris_shm_data->access_mutex);
-
-        _sync_mmap_with_shm();  /* make sure our mmap is sync'ed */
-
         if (_hybris_shm_data != NULL) {
             uintptr_t offset = handle & (~HYBRIS_SHM_MASK);
-            realpointer = &(_hybris_shm_data->data) + offset;
+            realpointer = _hybris_shm_data->data + offset;
 
             /* Be careful when activating this trace: this method is called *a lot* !
             LOGD("handle = %x, offset  = %d, realpointer = %x)", handle, offset, realpointer);
              */
         }
-
-        pthread_mutex_unlock(&_hybris_shm_data->access_mutex);
     }
 
     return realpointer;
@@ -228,33 +286,108 @@ void *hybris_get_shmpointer(hybris_shm_pointer_t handle)
 hybris_shm_pointer_t hybris_shm_alloc(size_t size)
 {
     hybris_shm_pointer_t location = 0;
+    int size_class = _hybris_shm_size_class(size);
+    int offset = HYBRIS_SHM_NO_BLOCK;
 
     if (_hybris_shm_fd < 0) {
         /* if we are not yet attached to any shm region, then do it now */
         _hybris_shm_init();
     }
 
-    pthread_mutex_lock(&_hybris_shm_data->access_mutex);
-
-    /* Make sure our mmap is sync'ed */
-    _sync_mmap_with_shm();
-
     if (_hybris_shm_data == NULL || _hybris_shm_fd < 0)
         return 0;
 
-    if (_hybris_shm_data->current_offset + size >= _hybris_shm_data->max_offset) {
-        /* the current buffer if full: extend it a little bit more */
-        _hybris_shm_extend_region();
-        _sync_mmap_with_shm();
+    if (size_class >= 0) {
+        hybris_shm_class_t *class = &_hybris_shm_data->classes[size_class];
+
+        size = _hybris_shm_class_sizes[size_class];
+
+        /* First try to reuse a released object of the same class */
+        pthread_mutex_lock(&class->lock);
+        offset = class->free_head;
+        if (offset != HYBRIS_SHM_NO_BLOCK)
+            class->free_head = *(int *)(_hybris_shm_data->data + offset);
+        pthread_mutex_unlock(&class->lock);
+    }
+    else {
+        size = (size + HYBRIS_SHM_ALIGN - 1) & ~(size_t)(HYBRIS_SHM_ALIGN - 1);
     }
 
-    /* there is now enough place in this pool */
-    location = _hybris_shm_data->current_offset | HYBRIS_SHM_MASK;
-    LOGD("Allocated a shared object (size = %zu, at offset %d)", size, _hybris_shm_data->current_offset);
+    if (offset == HYBRIS_SHM_NO_BLOCK) {
+        pthread_mutex_lock(&_hybris_shm_data->access_mutex);
 
-    _hybris_shm_data->current_offset += size;
+        if (HYBRIS_SHM_DATA_HEADER_SIZE + _hybris_shm_data->current_offset + size
+                > HYBRIS_SHM_MAP_SIZE - HYBRIS_DATA_SIZE) {
+            pthread_mutex_unlock(&_hybris_shm_data->access_mutex);
+            HYBRIS_ERROR_LOG(HOOKS, "ERROR: Shared memory region is full !");
+            return 0;
+        }
 
-    pthread_mutex_unlock(&_hybris_shm_data->access_mutex);
+        while (_hybris_shm_data->current_offset + size >= (size_t) _hybris_shm_data->max_offset) {
+            /* the current buffer if full: extend it a little bit more */
+            _hybris_shm_extend_region();
+        }
+
+        offset = _hybris_shm_data->current_offset;
+        _hybris_shm_data->current_offset += size;
+
+        pthread_mutex_unlock(&_hybris_shm_data->access_mutex);
+    }
+
+    _hybris_shm_account(size);
+
+    /* there is now enough place in this pool */
+    location = offset | HYBRIS_SHM_MASK;
+    LOGD("Allocated a shared object (size = %zu, at offset %d, %zu bytes in use)",
+         size, offset, _hybris_shm_data->live_size);
 
     return location;
 }
+
+/*
+ * Release a space allocated with hybris_shm_alloc, size has to be the
+ * same as the one given to hybris_shm_alloc
+ */
+void hybris_shm_free(hybris_shm_pointer_t handle, size_t size)
+{
+    int size_class = _hybris_shm_size_class(size);
+    int offset;
+
+    if (!hybris_is_pointer_in_shm((void*)handle) || _hybris_shm_data == NULL)
+        return;
+
+    offset = handle & (~HYBRIS_SHM_MASK);
+
+    if (size_class < 0) {
+        LOGD("Leaking a large shared object (size = %zu, at offset %d)", size, offset);
+        return;
+    }
+
+    hybris_shm_class_t *class = &_hybris_shm_data->classes[size_class];
+
+    size = _hybris_shm_class_sizes[size_class];
+
+    pthread_mutex_lock(&class->lock);
+    *(int *)(_hybris_shm_data->data + offset) = class->free_head;
+    class->free_head = offset;
+    pthread_mutex_unlock(&class->lock);
+
+    _hybris_shm_account(-(ssize_t) size);
+
+    LOGD("Released a shared object (size = %zu, at offset %d)", size, offset);
+}
+
+/*
+ * Report the number of bytes currently allocated in the shared memory
+ * region, and the highest number ever allocated at the same time
+ */
+void hybris_shm_get_usage(size_t *live, size_t *peak)
+{
+    if (_hybris_shm_fd < 0)
+        _hybris_shm_init();
+
+    if (live)
+        *live = _hybris_shm_data ? _hybris_shm_data->live_size : 0;
+    if (peak)
+        *peak = _hybris_shm_data ? _hybris_shm_data->peak_size : 0;
+}
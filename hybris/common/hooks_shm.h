@@ -30,6 +30,14 @@ typedef uintptr_t hybris_shm_pointer_t;
  * Allocate a space in the shared memory region of hybris
  */
 hybris_shm_pointer_t hybris_shm_alloc(size_t size);
+/*
+ * Release a space allocated with hybris_shm_alloc, the size has to match
+ */
+void hybris_shm_free(hybris_shm_pointer_t handle, size_t size);
+/*
+ * Get the number of bytes currently allocated in the shm region, and the peak
+ */
+void hybris_shm_get_usage(size_t *live, size_t *peak);
 /* 
  * Test if the pointers points to the shm region
  */
@@ -21,91 +21,373 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <string.h>
 #include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 
 #include <hybris/properties/properties.h>
 #include "properties_p.h"
 
+#define BUILD_PROP_PATH "/system/build.prop"
+
+/* the parsed properties are shared between processes through this file */
+#define PROP_IMAGE_PATH "/dev/shm/hybris_propcache"
+#define PROP_IMAGE_MAGIC 0x43505248 /* "HRPC" */
+#define PROP_IMAGE_VERSION 1
+
+/* build.prop is checked for changes at most this often, in seconds */
+#define PROP_CHECK_INTERVAL 1
+
+/*
+ * The prop image is a read-only blob: a header, the entries sorted by key and
+ * a pool of nul terminated strings. Offsets are relative to the start of the
+ * image, so it can be mapped anywhere.
+ */
+struct hybris_prop_image_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint32_t generation;
+	uint32_t count;
+	/* identity of the build.prop this image was built from */
+	uint64_t source_ino;
+	uint64_t source_mtime;
+	uint64_t source_size;
+	uint32_t size;
+	uint32_t reserved;
+};
+
+struct hybris_prop_image_entry
+{
+	uint32_t key;
+	uint32_t value;
+};
+
+struct hybris_prop_image
+{
+	const struct hybris_prop_image_header *header;
+	const struct hybris_prop_image_entry *entries;
+	const char *base;
+};
+
+/* a property collected while building the image */
 struct hybris_prop_value
 {
 	char *key;
 	char *value;
+	int order;
 };
 
-/* surely enough for anyone */
-#define MAX_PROPS 1000
+struct hybris_prop_builder
+{
+	struct hybris_prop_value *props;
+	int count;
+	int alloc;
+};
 
-/* the sorted prop array */
-static struct hybris_prop_value prop_array[MAX_PROPS];
+/* the image currently in use, replaced as a whole when build.prop changes */
+static struct hybris_prop_image *prop_image;
+static pthread_mutex_t prop_image_mutex = PTHREAD_MUTEX_INITIALIZER;
 
-/* the current highest index in prop_array */
-static int max_prop;
+/* when build.prop was last checked, so most lookups need not stat it */
+static time_t prop_checked;
 
 /* helpers */
-static void cache_update();
-static int prop_qcmp(const void *a, const void *b);
-static struct hybris_prop_value *cache_find_internal(const char *key);
-static void cache_add_internal(const char *key, const char *value);
-static void cache_repopulate_internal(FILE *f);
-static void cache_empty_internal();
-static void cache_repopulate_cmdline_internal();
-
-/* the inode/mtime of the prop cache, used for invalidation */
-static ino_t static_prop_inode;
-static time_t static_prop_mtime;
+static const struct hybris_prop_image *cache_update();
+static int cache_source_changed(const struct hybris_prop_image *image);
+static void cache_reload_internal();
+static const char *cache_find_internal(const struct hybris_prop_image *image, const char *key);
+static void cache_add_internal(struct hybris_prop_builder *builder, const char *key, const char *value);
+static void cache_repopulate_internal(struct hybris_prop_builder *builder, FILE *f);
+static void cache_repopulate_cmdline_internal(struct hybris_prop_builder *builder);
+static void cache_empty_internal(struct hybris_prop_builder *builder);
 
 
 /* public:
  * find a prop value from the file cache.
  *
  * the return value is the value of the given property key, or NULL if the
- * property key is not found. the returned value is owned by the caller,
- * and must be freed.
+ * property key is not found. the returned value is owned by the cache and
+ * stays valid for the lifetime of the process.
  */
 char *hybris_propcache_find(const char *key)
 {
-	char *ret = NULL;
+	const struct hybris_prop_image *image = cache_update();
 
-	cache_update();
+	if (!image)
+		return NULL;
 
-	/* then look up the key and do a copy if we get a result */
-	struct hybris_prop_value *prop = cache_find_internal(key);
-	if (prop)
-		return prop->value;
-
-	return ret;
+	return (char *) cache_find_internal(image, key);
 }
 
 void hybris_propcache_list(hybris_propcache_list_cb cb, void *cookie)
 {
-	int n;
-	struct hybris_prop_value *current;
+	const struct hybris_prop_image *image;
+	uint32_t n;
 
 	if (!cb)
 		return;
 
-	cache_update();
+	image = cache_update();
+	if (!image)
+		return;
+
+	for (n = 0; n < image->header->count; n++) {
+		cb(image->base + image->entries[n].key,
+		   image->base + image->entries[n].value, cookie);
+	}
+}
+
+/* private:
+ * returns the image to use for lookups, (re)loading it first if there is none
+ * yet or build.prop changed since it was built.
+ */
+static const struct hybris_prop_image *cache_update()
+{
+	const struct hybris_prop_image *image = __atomic_load_n(&prop_image, __ATOMIC_ACQUIRE);
+
+	if (image && !cache_source_changed(image))
+		return image;
+
+	pthread_mutex_lock(&prop_image_mutex);
+	cache_reload_internal();
+	image = prop_image;
+	pthread_mutex_unlock(&prop_image_mutex);
+
+	return image;
+}
+
+static int cache_source_matches(const struct hybris_prop_image_header *header,
+								const struct stat *st)
+{
+	return header->source_ino == (uint64_t) st->st_ino &&
+		header->source_mtime == (uint64_t) st->st_mtime &&
+		header->source_size == (uint64_t) st->st_size;
+}
+
+/* private:
+ * checks whether build.prop changed since the image was built, comparing the
+ * file's inode, mtime and size with the image.
+ *
+ * the coarse clock is read without a syscall, so lookups only stat build.prop
+ * once every PROP_CHECK_INTERVAL seconds. an inotify watch would avoid that
+ * too, but would cost every process an inotify instance.
+ */
+static int cache_source_changed(const struct hybris_prop_image *image)
+{
+	struct timespec now;
+	struct stat st;
 
-	for (n = 0; n < max_prop; n++) {
-		current = &prop_array[n];
-		cb(current->key, current->value, cookie);
+	if (clock_gettime(CLOCK_MONOTONIC_COARSE, &now) == 0) {
+		if (now.tv_sec - __atomic_load_n(&prop_checked, __ATOMIC_RELAXED) < PROP_CHECK_INTERVAL)
+			return 0;
+		__atomic_store_n(&prop_checked, now.tv_sec, __ATOMIC_RELAXED);
 	}
+
+	if (stat(BUILD_PROP_PATH, &st) != 0)
+		return 0;
+
+	return !cache_source_matches(image->header, &st);
 }
 
-static void cache_update()
+/* private:
+ * sets up an image for the given blob, after checking that it is complete and
+ * all of its strings are terminated.
+ */
+static struct hybris_prop_image *cache_image_init(const void *data, size_t size)
 {
+	const struct hybris_prop_image_header *header = data;
+	struct hybris_prop_image *image;
+	uint32_t n;
+
+	if (size < sizeof(*header) || header->magic != PROP_IMAGE_MAGIC ||
+		header->version != PROP_IMAGE_VERSION || header->size != size)
+		return NULL;
+
+	if (header->count > (size - sizeof(*header)) / sizeof(struct hybris_prop_image_entry))
+		return NULL;
+
+	if (((const char *) data)[size - 1] != '\0')
+		return NULL;
+
+	image = malloc(sizeof(*image));
+	if (!image)
+		return NULL;
+
+	image->header = header;
+	image->entries = (const struct hybris_prop_image_entry *)(header + 1);
+	image->base = data;
+
+	for (n = 0; n < header->count; n++) {
+		if (image->entries[n].key >= size || image->entries[n].value >= size) {
+			free(image);
+			return NULL;
+		}
+	}
+
+	return image;
+}
+
+/* private:
+ * maps the image another process built, if it is for the current build.prop
+ */
+static struct hybris_prop_image *cache_image_open(const struct stat *source)
+{
+	struct hybris_prop_image *image = NULL;
 	struct stat st;
-	FILE *f = fopen("/system/build.prop", "r");
+	void *data;
+	int fd;
+
+	fd = open(PROP_IMAGE_PATH, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	/* only trust images written by us or by root */
+	if (fstat(fd, &st) != 0 || (st.st_uid != geteuid() && st.st_uid != 0) ||
+		st.st_size < (off_t) sizeof(struct hybris_prop_image_header)) {
+		close(fd);
+		return NULL;
+	}
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	if (data == MAP_FAILED)
+		return NULL;
+
+	image = cache_image_init(data, st.st_size);
+	if (!image || !cache_source_matches(image->header, source)) {
+		free(image);
+		munmap(data, st.st_size);
+		return NULL;
+	}
 
+	return image;
+}
+
+/* private:
+ * compares two hybris_prop_value by key, so as to sort the props for the
+ * image. the first occurence of a key sorts first.
+ */
+static int prop_qcmp(const void *a, const void *b)
+{
+	struct hybris_prop_value *aa = (struct hybris_prop_value *)a;
+	struct hybris_prop_value *bb = (struct hybris_prop_value *)b;
+	int ret = strcmp(aa->key, bb->key);
+
+	return ret ? ret : aa->order - bb->order;
+}
+
+/* private:
+ * serializes the collected props into an image blob allocated with malloc
+ */
+static void *cache_image_build(struct hybris_prop_builder *builder,
+							   const struct stat *source, uint32_t generation,
+							   size_t *size)
+{
+	struct hybris_prop_image_header *header;
+	struct hybris_prop_image_entry *entries;
+	size_t total = sizeof(*header);
+	int count = 0;
+	char *data, *pool;
+	int i;
+
+	qsort(builder->props, builder->count, sizeof(struct hybris_prop_value), prop_qcmp);
+
+	/* preserve current behavior of first prop key => match */
+	for (i = 0; i < builder->count; i++) {
+		if (count > 0 && !strcmp(builder->props[i].key, builder->props[count - 1].key)) {
+			free(builder->props[i].key);
+			free(builder->props[i].value);
+			continue;
+		}
+		builder->props[count++] = builder->props[i];
+		total += sizeof(*entries) + strlen(builder->props[i].key) + 1 +
+			strlen(builder->props[i].value) + 1;
+	}
+	builder->count = count;
+
+	/* keep the last byte a terminator, even for an empty image */
+	total++;
+
+	data = calloc(1, total);
+	if (!data)
+		return NULL;
+
+	header = (struct hybris_prop_image_header *) data;
+	entries = (struct hybris_prop_image_entry *)(header + 1);
+	pool = (char *)(entries + count);
+
+	for (i = 0; i < builder->count; i++) {
+		entries[i].key = pool - data;
+		pool = stpcpy(pool, builder->props[i].key) + 1;
+		entries[i].value = pool - data;
+		pool = stpcpy(pool, builder->props[i].value) + 1;
+	}
+
+	header->magic = PROP_IMAGE_MAGIC;
+	header->version = PROP_IMAGE_VERSION;
+	header->generation = generation;
+	header->count = count;
+	header->source_ino = source->st_ino;
+	header->source_mtime = source->st_mtime;
+	header->source_size = source->st_size;
+	header->size = total;
+
+	*size = total;
+	return data;
+}
+
+/* private:
+ * publishes a freshly built image for other processes and maps it back, so
+ * all of them share the same pages. returns NULL if this is not possible.
+ */
+static void *cache_image_publish(const void *data, size_t size)
+{
+	char path[] = PROP_IMAGE_PATH ".XXXXXX";
+	void *mapped;
+	int fd;
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		return NULL;
+
+	if (fchmod(fd, 0644) != 0 || write(fd, data, size) != (ssize_t) size ||
+		rename(path, PROP_IMAGE_PATH) != 0) {
+		unlink(path);
+		close(fd);
+		return NULL;
+	}
+
+	mapped = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+
+	return mapped == MAP_FAILED ? NULL : mapped;
+}
+
+/* private:
+ * loads the image matching the current build.prop, building it if no other
+ * process did already. called with prop_image_mutex held.
+ */
+static void cache_reload_internal()
+{
+	struct hybris_prop_builder builder = { NULL, 0, 0 };
+	struct hybris_prop_image *image;
+	struct stat st;
+	size_t size;
+	void *data, *mapped;
+	FILE *f;
+
+	f = fopen(BUILD_PROP_PATH, "r");
 	if (!f)
 		return;
 
-	/* before searching, we must first determine whether our cache is valid. if
-	 * it isn't, we must discard our results and re-create the cache.
-	 *
-	 * we use fstat here to avoid a race between stat and something else
+	/* we use fstat here to avoid a race between stat and something else
 	 * touching the file.
 	 */
 	if (fstat(fileno(f), &st) != 0) {
@@ -113,94 +395,115 @@ static void cache_update()
 		goto out;
 	}
 
-	/* TODO: is there any better way to detect changes? */
-	if (static_prop_inode != st.st_ino ||
-		static_prop_mtime != st.st_mtime) {
-		static_prop_inode = st.st_ino;
-		static_prop_mtime = st.st_mtime;
+	if (prop_image && cache_source_matches(prop_image->header, &st))
+		goto out;
+
+	image = cache_image_open(&st);
+	if (!image) {
+		/* nobody built the image for this build.prop yet, do it now */
+		cache_repopulate_internal(&builder, f);
+		cache_repopulate_cmdline_internal(&builder);
+
+		data = cache_image_build(&builder, &st,
+								 prop_image ? prop_image->header->generation + 1 : 0,
+								 &size);
+		cache_empty_internal(&builder);
 
-		/* cache is stale. fill it back up with fresh data first. */
-		cache_empty_internal();
-		cache_repopulate_internal(f);
-		cache_repopulate_cmdline_internal();
+		if (!data)
+			goto out;
 
-		/* sort by keys */
-		qsort(prop_array, max_prop, sizeof(struct hybris_prop_value), prop_qcmp);
+		mapped = cache_image_publish(data, size);
+		if (mapped) {
+			free(data);
+			data = mapped;
+		}
+
+		image = cache_image_init(data, size);
+		if (!image)
+			goto out;
 	}
 
+	/* previous images are never unmapped, lookups might still be using them */
+	__atomic_store_n(&prop_image, image, __ATOMIC_RELEASE);
+
 out:
 	fclose(f);
 }
 
 /* private:
- * empties the prop cache, ready for repopulation
+ * empties the prop builder
  */
-static void cache_empty_internal()
+static void cache_empty_internal(struct hybris_prop_builder *builder)
 {
 	int i;
-	for (i = 0; i < max_prop; ++i) {
-		free(prop_array[i].key);
-		free(prop_array[i].value);
+	for (i = 0; i < builder->count; ++i) {
+		free(builder->props[i].key);
+		free(builder->props[i].value);
 	}
 
-	max_prop = 0;
-}
-
-/* private:
- * compares two hybris_prop_value by key, so as to maintain a qsorted array of
- * props, and search the array.
- */
-static int prop_qcmp(const void *a, const void *b)
-{
-	struct hybris_prop_value *aa = (struct hybris_prop_value *)a;
-	struct hybris_prop_value *bb = (struct hybris_prop_value *)b;
-
-	return strcmp(aa->key, bb->key);
+	free(builder->props);
+	builder->props = NULL;
+	builder->count = 0;
+	builder->alloc = 0;
 }
 
 /* private:
- * find a given key in the in-memory prop cache.
+ * find a given key in a prop image.
  *
  * returns the value of the given property key, or NULL if the property is not
- * found. Note that this does not pass ownership of the hybris_prop_value or the
- * data inside it.
+ * found.
  */
-static struct hybris_prop_value *cache_find_internal(const char *key)
+static const char *cache_find_internal(const struct hybris_prop_image *image, const char *key)
 {
-	struct hybris_prop_value prop_key;
-	prop_key.key = (char*)key;
+	uint32_t lo = 0, hi = image->header->count;
+
+	while (lo < hi) {
+		uint32_t mid = lo + (hi - lo) / 2;
+		int cmp = strcmp(key, image->base + image->entries[mid].key);
+
+		if (cmp == 0)
+			return image->base + image->entries[mid].value;
+		if (cmp < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
 
-	return bsearch(&prop_key, prop_array, max_prop, sizeof(struct hybris_prop_value), prop_qcmp);
+	return NULL;
 }
 
 /* private:
- * add a given property to the in-memory prop cache for later retrieval.
+ * add a given property to the prop builder.
  *
  * both `key' and `value' are copied from the caller.
  */
-static void cache_add_internal(const char *key, const char *value)
+static void cache_add_internal(struct hybris_prop_builder *builder, const char *key, const char *value)
 {
 	/* Skip values that can be bigger than value max */
 	if (strlen(value) >= PROP_VALUE_MAX -1)
 		return;
 
-	/* preserve current behavior of first prop key => match */
-	if (cache_find_internal(key))
-		return;
+	if (builder->count == builder->alloc) {
+		int alloc = builder->alloc ? builder->alloc * 2 : 256;
+		struct hybris_prop_value *props = realloc(builder->props, alloc * sizeof(*props));
 
-	prop_array[max_prop].key = strdup(key);
-	prop_array[max_prop++].value = strdup(value);
+		if (!props)
+			return;
 
-	if (max_prop >= MAX_PROPS) {
-		fprintf(stderr, "libhybris: ran out of props, increase MAX_PROPS");
-		exit(1);
+		builder->props = props;
+		builder->alloc = alloc;
 	}
+
+	builder->props[builder->count].key = strdup(key);
+	builder->props[builder->count].value = strdup(value);
+	builder->props[builder->count].order = builder->count;
+	builder->count++;
 }
 
 /* private:
- * repopulates the prop cache from a given file `f'.
+ * repopulates the prop builder from a given file `f'.
  */
-static void cache_repopulate_internal(FILE *f)
+static void cache_repopulate_internal(struct hybris_prop_builder *builder, FILE *f)
 {
 	char buf[1024];
 	char *mkey, *value;
@@ -220,14 +523,14 @@ static void cache_repopulate_internal(FILE *f)
 		if (!value)
 			continue;
 
-		cache_add_internal(mkey, value);
+		cache_add_internal(builder, mkey, value);
 	}
 }
 
 /* private:
- * repopulate the prop cache from /proc/cmdline
+ * repopulate the prop builder from /proc/cmdline
  */
-static void cache_repopulate_cmdline_internal()
+static void cache_repopulate_cmdline_internal(struct hybris_prop_builder *builder)
 {
 	/* Find a key value from the kernel command line, which is parsed
 	 * by Android at init (on an Android working system) */
@@ -270,7 +573,7 @@ static void cache_repopulate_cmdline_internal()
 			char prop[PROP_NAME_MAX];
 			snprintf(prop, sizeof(prop) -1, "ro.%s", boot_prop_name);
 
-			cache_add_internal(prop, value);
+			cache_add_internal(builder, prop, value);
 		}
 	}
 }
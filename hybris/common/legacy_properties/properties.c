@@ -34,6 +34,8 @@
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <poll.h>
+#include <pthread.h>
+#include <stdint.h>
 
 #include <hybris/properties/properties.h>
 #include "properties_p.h"
@@ -41,24 +43,81 @@
 static const char property_service_socket[] = "/dev/socket/" PROP_SERVICE_NAME;
 static int send_prop_msg_no_reply = 0;
 
+/* Requests sent on a persistent connection before reading the replies,
+ * small enough for the socket buffers to hold them */
+#define PROP_PIPELINE_DEPTH 64
+
+/* How long the first pipelined request waits for its reply, like bionic
+ * waits for init to acknowledge a set */
+#define PROP_PROBE_TIMEOUT_MS 250
+
+/* The pipelined gets of all threads share one connection, one batch after
+ * the other */
+static pthread_mutex_t prop_conn_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t prop_conn_once = PTHREAD_ONCE_INIT;
+static int prop_conn = -1;
+
+/* Whether the property service answers PROP_MSG_GETPROP_PIPELINED, which
+ * init doesn't. The first pipelined request of the process finds out. */
+enum {
+	PIPELINED_UNKNOWN,
+	PIPELINED_SUPPORTED,
+	PIPELINED_UNSUPPORTED
+};
+static int prop_pipelined_support = PIPELINED_UNKNOWN;
+
 typedef struct prop_msg_s {
         unsigned cmd;
         char name[PROP_NAME_MAX];
         char value[PROP_VALUE_MAX];
 } prop_msg_t;
 
-/* Get/Set a property from the Android Init property socket */
-static int send_prop_msg(prop_msg_t *msg,
-		void (*propfn)(const char *, const char *, void *),
-		void *cookie)
+/* HYBRIS_PROPERTY_SERVICE_SOCKET allows to talk to another service, e.g.
+ * for testing */
+static const char *get_property_service_socket(void)
+{
+	const char *path = getenv("HYBRIS_PROPERTY_SERVICE_SOCKET");
+
+	return path ? path : property_service_socket;
+}
+
+static int connect_property_service(void)
 {
 	union {
 		struct sockaddr_un addr;
 		struct sockaddr addr_g;
 	} addr;
+	const char *path = get_property_service_socket();
 	socklen_t alen;
 	size_t namelen;
 	int s;
+
+	s = socket(AF_LOCAL, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (s < 0) {
+		return -1;
+	}
+
+	memset(&addr, 0, sizeof(addr));
+	namelen = strlen(path);
+	strncpy(addr.addr.sun_path, path,
+			sizeof(addr.addr.sun_path) - 1);
+	addr.addr.sun_family = AF_LOCAL;
+	alen = namelen + offsetof(struct sockaddr_un, sun_path) + 1;
+
+	if (TEMP_FAILURE_RETRY(connect(s, &addr.addr_g, alen) < 0)) {
+		close(s);
+		return -1;
+	}
+
+	return s;
+}
+
+/* Get/Set a property from the Android Init property socket */
+static int send_prop_msg(prop_msg_t *msg,
+		void (*propfn)(const char *, const char *, void *),
+		void *cookie)
+{
+	int s;
 	int r;
 	int result = -1;
 	int patched_init = 0;
@@ -70,23 +129,11 @@ static int send_prop_msg(prop_msg_t *msg,
 	if (send_prop_msg_no_reply == 1)
 		return -EIO;
 
-	s = socket(AF_LOCAL, SOCK_STREAM, 0);
+	s = connect_property_service();
 	if (s < 0) {
 		return result;
 	}
 
-	memset(&addr, 0, sizeof(addr));
-	namelen = strlen(property_service_socket);
-	strncpy(addr.addr.sun_path, property_service_socket,
-			sizeof(addr.addr.sun_path));
-	addr.addr.sun_family = AF_LOCAL;
-	alen = namelen + offsetof(struct sockaddr_un, sun_path) + 1;
-
-	if (TEMP_FAILURE_RETRY(connect(s, &addr.addr_g, alen) < 0)) {
-		close(s);
-		return result;
-	}
-
 	r = TEMP_FAILURE_RETRY(send(s, msg, sizeof(prop_msg_t), 0));
 
 	if (r == sizeof(prop_msg_t)) {
@@ -120,6 +167,134 @@ static int send_prop_msg(prop_msg_t *msg,
 	return result;
 }
 
+static void lock_prop_conn(void)
+{
+	pthread_mutex_lock(&prop_conn_mutex);
+}
+
+static void unlock_prop_conn(void)
+{
+	pthread_mutex_unlock(&prop_conn_mutex);
+}
+
+/* The connection is shared with the parent after a fork(): replies would
+ * go to either of them */
+static void drop_prop_conn_in_child(void)
+{
+	if (prop_conn >= 0) {
+		close(prop_conn);
+		prop_conn = -1;
+	}
+	pthread_mutex_unlock(&prop_conn_mutex);
+}
+
+static void init_prop_conn(void)
+{
+	pthread_atfork(lock_prop_conn, unlock_prop_conn, drop_prop_conn_in_child);
+}
+
+static int send_all(int s, const void *data, size_t size)
+{
+	const char *p = data;
+
+	while (size > 0) {
+		ssize_t r = TEMP_FAILURE_RETRY(send(s, p, size, MSG_NOSIGNAL));
+		if (r <= 0)
+			return -1;
+		p += r;
+		size -= r;
+	}
+
+	return 0;
+}
+
+static int recv_reply(int s, prop_msg_t *msg, int probe)
+{
+	struct pollfd pfd = { s, POLLIN, 0 };
+
+	/* a service not knowing the command might neither reply nor close */
+	if (probe && TEMP_FAILURE_RETRY(poll(&pfd, 1, PROP_PROBE_TIMEOUT_MS)) != 1)
+		return -1;
+
+	if (TEMP_FAILURE_RETRY(recv(s, msg, sizeof(prop_msg_t), MSG_WAITALL)) != sizeof(prop_msg_t))
+		return -1;
+
+	return 0;
+}
+
+/* Get several properties on the persistent connection of the process,
+ * the replies are stored back into msgs */
+static int send_prop_msgs_pipelined(prop_msg_t *msgs, int count)
+{
+	int attempt, i, n, result = -EIO;
+
+	if (__atomic_load_n(&prop_pipelined_support, __ATOMIC_RELAXED) == PIPELINED_UNSUPPORTED ||
+			send_prop_msg_no_reply)
+		return -EIO;
+
+	pthread_once(&prop_conn_once, init_prop_conn);
+	pthread_mutex_lock(&prop_conn_mutex);
+
+	for (i = 0; i < count; i++)
+		msgs[i].cmd = PROP_MSG_GETPROP_PIPELINED;
+
+	/* a connection kept from earlier might have been closed by the service
+	 * meanwhile, retry once on a new one then */
+	for (attempt = 0; attempt < 2; attempt++) {
+		int fresh = (prop_conn < 0);
+		int probe = (prop_pipelined_support == PIPELINED_UNKNOWN);
+		int received = 0;
+
+		if (fresh)
+			prop_conn = connect_property_service();
+		if (prop_conn < 0)
+			break;
+
+		for (i = 0; i < count; i += n) {
+			/* until the service answered once, it gets a single request */
+			n = count - i < PROP_PIPELINE_DEPTH ? count - i : PROP_PIPELINE_DEPTH;
+			if (probe)
+				n = 1;
+
+			if (send_all(prop_conn, &msgs[i], n * sizeof(prop_msg_t)) < 0)
+				break;
+
+			for (; received < i + n; received++) {
+				if (recv_reply(prop_conn, &msgs[received], probe) < 0)
+					break;
+			}
+			if (received < i + n)
+				break;
+
+			if (probe) {
+				__atomic_store_n(&prop_pipelined_support, PIPELINED_SUPPORTED,
+						__ATOMIC_RELAXED);
+				probe = 0;
+			}
+		}
+
+		if (received == count) {
+			result = 0;
+			break;
+		}
+
+		close(prop_conn);
+		prop_conn = -1;
+
+		if (fresh) {
+			/* init closes the connection or answers with an error code, no
+			 * service at all is probed again on the next request */
+			if (probe && received == 0)
+				__atomic_store_n(&prop_pipelined_support, PIPELINED_UNSUPPORTED,
+						__ATOMIC_RELAXED);
+			break;
+		}
+	}
+
+	pthread_mutex_unlock(&prop_conn_mutex);
+	return result;
+}
+
 int my_property_list(void (*propfn)(const char *key, const char *value, void *cookie), void *cookie)
 {
 	int err;
@@ -145,8 +320,12 @@ static int property_get_socket(const char *key, char *value, const char *default
 	msg.cmd = PROP_MSG_GETPROP;
 
 	if (key) {
-		strncpy(msg.name, key, sizeof(msg.name));
-		err = send_prop_msg(&msg, NULL, NULL);
+		strncpy(msg.name, key, sizeof(msg.name) - 1);
+		err = send_prop_msgs_pipelined(&msg, 1);
+		if (err < 0) {
+			msg.cmd = PROP_MSG_GETPROP;
+			err = send_prop_msg(&msg, NULL, NULL);
+		}
 		if (err < 0)
 			return err;
 	}
@@ -162,6 +341,23 @@ static int property_get_socket(const char *key, char *value, const char *default
 	return 0;
 }
 
+static int property_get_file_cache(const char *key, char *value, const char *default_value)
+{
+	char *ret = key ? hybris_propcache_find(key) : NULL;
+
+	if (ret) {
+		strcpy(value, ret);
+		return strlen(value);
+	} else if (default_value != NULL) {
+		strcpy(value, default_value);
+		return strlen(value);
+	} else {
+		value[0] = '\0';
+	}
+
+	return 0;
+}
+
 int my_property_get(const char *key, char *value, const char *default_value)
 {
 	char *ret = NULL;
@@ -170,36 +366,160 @@ int my_property_get(const char *key, char *value, const char *default_value)
 	if (value == NULL) return -1;
 
 
-	// Runtime cache will serialize property lookups within the process.
-	// This will increase latency if multiple threads are doing many
-	// parallel lookups to new properties, but the overhead should
-	// be offset with the caching eventually.
-	runtime_cache_lock();
-	if (runtime_cache_get(key, value) == 0) {
+	// Lookups in the runtime cache don't take any lock. Threads missing
+	// on the same property share a single request to the property
+	// service, which is made without holding any lock.
+	if (key && runtime_cache_get(key, value) == 0) {
 		ret = value;
+	} else if (key) {
+		unsigned ticket;
+		int fetch = runtime_cache_begin_fetch(key, value, &ticket);
+
+		if (fetch == 0) {
+			if (property_get_socket(key, value, NULL) == 0) {
+				runtime_cache_end_fetch(key, value, ticket);
+				ret = value;
+			} else {
+				runtime_cache_end_fetch(key, NULL, ticket);
+			}
+		} else if (fetch > 0) {
+			ret = value;
+		}
 	} else if (property_get_socket(key, value, default_value) == 0) {
-		runtime_cache_insert(key, value);
 		ret = value;
 	}
-	runtime_cache_unlock();
+
+	/* The cache holds what the service answered, the default of this
+	 * caller is applied afterwards */
+	if (ret && ret[0] == '\0' && default_value) {
+		if (strlen(default_value) > PROP_VALUE_MAX -1) return -1;
+		strcpy(value, default_value);
+	}
 
 	if (ret)
 		return strlen(ret);
 
 
 	/* In case the socket is not available, search the property file cache by hand */
-	ret = hybris_propcache_find(key);
+	return property_get_file_cache(key, value, default_value);
+}
 
-	if (ret) {
-		strcpy(value, ret);
-		return strlen(value);
-	} else if (default_value != NULL) {
-		strcpy(value, default_value);
-		return strlen(value);
+static void apply_default_value(char *value, const char *default_value)
+{
+	if (value[0] == '\0' && default_value) {
+		strncpy(value, default_value, PROP_VALUE_MAX - 1);
+		value[PROP_VALUE_MAX - 1] = '\0';
+	}
+}
+
+/* Asks the property service for one key of a batch without pipelining,
+ * answering the fetch of the cache if this thread owns it */
+static void property_get_batch_key(const char *key, char *value, int owned, unsigned ticket)
+{
+	if (property_get_socket(key, value, NULL) == 0) {
+		if (owned)
+			runtime_cache_end_fetch(key, value, ticket);
 	} else {
-		value = '\0';
+		if (owned)
+			runtime_cache_end_fetch(key, NULL, ticket);
+		property_get_file_cache(key, value, NULL);
+	}
+}
+
+int my_property_get_batch(const char * const *keys, char * const *values,
+		const char * const *default_values, int count)
+{
+	prop_msg_t *msgs;
+	unsigned *tickets;
+	int *pending, *owned, *first;
+	int npending = 0;
+	int i, j, err;
+
+	if (count <= 0) return count < 0 ? -1 : 0;
+	if (!keys || !values) return -1;
+
+	for (i = 0; i < count; i++) {
+		if (!keys[i] || strlen(keys[i]) > PROP_NAME_MAX -1) return -1;
+		if (!values[i]) return -1;
+	}
+
+	msgs = calloc(count, sizeof(prop_msg_t));
+	tickets = calloc(count, sizeof(unsigned));
+	pending = calloc(count, sizeof(int));
+	owned = calloc(count, sizeof(int));
+	first = calloc(count, sizeof(int));
+	if (!msgs || !tickets || !pending || !owned || !first) {
+		free(msgs);
+		free(tickets);
+		free(pending);
+		free(owned);
+		free(first);
+		return -1;
+	}
+
+	/* A key asked for twice is fetched once, the others copy its value */
+	for (i = 0; i < count; i++) {
+		first[i] = i;
+		for (j = 0; j < i; j++) {
+			if (first[j] == j && strcmp(keys[i], keys[j]) == 0) {
+				first[i] = j;
+				break;
+			}
+		}
+	}
+
+	/* The batch never waits for fetches, neither its own ones nor those
+	 * of other threads: keys another thread is asking for are asked for
+	 * here too, without caching the answer */
+	for (i = 0; i < count; i++) {
+		int fetch = 1;
+
+		if (first[i] != i)
+			continue;
+
+		if (runtime_cache_get(keys[i], values[i]) != 0)
+			fetch = runtime_cache_try_begin_fetch(keys[i], values[i], &tickets[i]);
+
+		if (fetch == 0 || fetch == -EAGAIN) {
+			strncpy(msgs[npending].name, keys[i], sizeof(msgs[npending].name) - 1);
+			owned[npending] = (fetch == 0);
+			pending[npending++] = i;
+		} else if (fetch < 0) {
+			property_get_file_cache(keys[i], values[i], NULL);
+		}
 	}
 
+	err = npending > 0 ? send_prop_msgs_pipelined(msgs, npending) : 0;
+
+	for (j = 0; j < npending; j++) {
+		i = pending[j];
+
+		if (err == 0) {
+			msgs[j].value[PROP_VALUE_MAX - 1] = '\0';
+			strcpy(values[i], msgs[j].value);
+			if (owned[j])
+				runtime_cache_end_fetch(keys[i], values[i], tickets[i]);
+		} else {
+			/* no pipelining service, one request per key */
+			property_get_batch_key(keys[i], values[i], owned[j], tickets[i]);
+		}
+	}
+
+	/* The cache holds what the service answered, the defaults of this
+	 * caller are applied afterwards */
+	for (i = 0; i < count; i++) {
+		if (first[i] != i)
+			strcpy(values[i], values[first[i]]);
+	}
+	for (i = 0; i < count; i++)
+		apply_default_value(values[i], default_values ? default_values[i] : NULL);
+
+	free(msgs);
+	free(tickets);
+	free(pending);
+	free(owned);
+	free(first);
+
 	return 0;
 }
 
@@ -213,9 +533,7 @@ int my_property_set(const char *key, const char *value)
 	if (strlen(key) > PROP_NAME_MAX -1) return -1;
 	if (strlen(value) > PROP_VALUE_MAX -1) return -1;
 
-	runtime_cache_lock();
 	runtime_cache_remove(key);
-	runtime_cache_unlock();
 
 	memset(&msg, 0, sizeof(msg));
 	msg.cmd = PROP_MSG_SETPROP;
@@ -24,16 +24,22 @@ void hybris_propcache_list(hybris_propcache_list_cb cb, void *cookie);
 char *hybris_propcache_find(const char *key);
 
 #ifndef NO_RUNTIME_PROPERTY_CACHE
-void runtime_cache_lock();
-void runtime_cache_unlock();
+/* lookups never block, returns 0 and fills value on a hit */
 int  runtime_cache_get(const char *key, char *value);
-void runtime_cache_insert(const char *key, char *value);
+/* on a miss: returns 0 if the caller has to ask the property service and
+ * report the answer with runtime_cache_end_fetch(), 1 if another thread
+ * did and value is filled in, or a negative value if that request failed */
+int  runtime_cache_begin_fetch(const char *key, char *value, unsigned *ticket);
+/* the same without waiting for another thread: returns -EAGAIN instead
+ * while one is asking the property service for the key */
+int  runtime_cache_try_begin_fetch(const char *key, char *value, unsigned *ticket);
+void runtime_cache_end_fetch(const char *key, const char *value, unsigned ticket);
 void runtime_cache_remove(const char *key);
 #else
-#define runtime_cache_lock()
-#define runtime_cache_unlock()
 #define runtime_cache_get(K,V) (-1)
-#define runtime_cache_insert(K,V)
+#define runtime_cache_begin_fetch(K,V,T) (*(T) = 0)
+#define runtime_cache_try_begin_fetch(K,V,T) (*(T) = 0)
+#define runtime_cache_end_fetch(K,V,T)
 #define runtime_cache_remove(K)
 #endif
 
@@ -21,12 +21,15 @@
  */
 
 #include <stdlib.h>
-#include <assert.h>
+#include <stdint.h>
 #include <errno.h>
 #include <string.h>
 #include <time.h>
 #include <pthread.h>
 
+#include <hybris/properties/properties.h>
+#include "properties_p.h"
+
 
 #define HYBRIS_PROPERTY_CACHE_DEFAULT_TIMEOUT_SECS 10
 
@@ -35,146 +38,347 @@
 */
 static time_t runtime_cache_timeout_secs = HYBRIS_PROPERTY_CACHE_DEFAULT_TIMEOUT_SECS;
 
+#define RUNTIME_CACHE_INITIAL_SIZE 64
 
-/** Key, value pair and the time of previous update (in seconds) */
+/** A cached property. Entries are never freed once they are in the table,
+	only their value is invalidated. The key is immutable, the value and
+	its update time are protected by the sequence counter: it is odd while
+	the value is being written, and readers retry if it changed under them.
+*/
 struct hybris_prop_value
 {
 	char *key;
-	char *value;
+	uint32_t hash;
+	unsigned seq;
+	int valid;
 	time_t last_update;
+	char value[PROP_VALUE_MAX];
+
+	/* protected by writer_mutex: whether a request to the property
+	   service is in flight, and which one */
+	int fetching;
+	unsigned generation;
 };
 
-static struct hybris_prop_value * prop_array = 0;
-static int num_prop = 0;
-static int num_alloc = 0;
+/** Open addressing hash table of entries. When it fills up, it is replaced
+	by a bigger copy. The old table is kept around, as readers might still
+	be looking at it.
+*/
+struct hybris_prop_table
+{
+	uint32_t mask;
+	uint32_t count;
+	struct hybris_prop_value **slots;
+	struct hybris_prop_table *retired;
+};
 
-/** Protect access to statics */
-static pthread_mutex_t array_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct hybris_prop_table *prop_table = 0;
 
-/* private:
- * compares two hybris_prop_value by key, so as to maintain a qsorted array of
- * props, and search the array.
- */
-static int prop_qcmp(const void *a, const void *b)
+/** Serializes modifications of the table and its entries; readers don't
+	take it. Threads missing on the same key wait on fetch_cond for the
+	one doing the request to the property service.
+*/
+static pthread_mutex_t writer_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t fetch_cond = PTHREAD_COND_INITIALIZER;
+static pthread_once_t init_once = PTHREAD_ONCE_INIT;
+
+static uint32_t runtime_cache_hash(const char *key)
 {
-	struct hybris_prop_value *aa = (struct hybris_prop_value *)a;
-	struct hybris_prop_value *bb = (struct hybris_prop_value *)b;
+	uint32_t h = 2166136261u;
 
-	return strcmp(aa->key, bb->key);
+	while (*key)
+		h = (h ^ (unsigned char) *key++) * 16777619u;
+
+	return h;
 }
 
-static struct hybris_prop_value *cache_find_internal(const char *key)
+static struct hybris_prop_table *runtime_cache_table_alloc(uint32_t size)
 {
-	struct hybris_prop_value prop_key;
-	prop_key.key = (char*)key;
+	struct hybris_prop_table *table = calloc(1, sizeof(*table));
+
+	if (!table)
+		return NULL;
 
-	return bsearch(&prop_key, prop_array, num_prop, sizeof(struct hybris_prop_value), prop_qcmp);
+	table->slots = calloc(size, sizeof(*table->slots));
+	if (!table->slots) {
+		free(table);
+		return NULL;
+	}
+
+	table->mask = size - 1;
+	return table;
 }
 
 static void runtime_cache_init()
 {
-	num_alloc = 8;
-	prop_array = malloc(num_alloc * sizeof(struct hybris_prop_value));
-
 	const char *timeout_str = getenv("HYBRIS_PROPERTY_CACHE_TIMEOUT_SECS");
 	if (timeout_str) {
 		runtime_cache_timeout_secs = atoi(timeout_str);
 	}
+
+	__atomic_store_n(&prop_table, runtime_cache_table_alloc(RUNTIME_CACHE_INITIAL_SIZE),
+					 __ATOMIC_RELEASE);
 }
 
 static void runtime_cache_ensure_initialized()
 {
-	if (!prop_array) {
-		runtime_cache_init();
+	pthread_once(&init_once, runtime_cache_init);
+}
+
+static struct hybris_prop_value *cache_find_internal(const char *key, uint32_t hash)
+{
+	struct hybris_prop_table *table = __atomic_load_n(&prop_table, __ATOMIC_ACQUIRE);
+	struct hybris_prop_value *entry;
+	uint32_t i;
+
+	if (!table)
+		return NULL;
+
+	for (i = hash & table->mask; ; i = (i + 1) & table->mask) {
+		entry = __atomic_load_n(&table->slots[i], __ATOMIC_ACQUIRE);
+		if (!entry)
+			return NULL;
+		if (entry->hash == hash && strcmp(entry->key, key) == 0)
+			return entry;
 	}
 }
 
-/** Invalidate an entry in the cache
-  *
-  * Cache will never shrink. Instead, assume that the same key
-  * will be queried soon after invalidation and reuse the entry.
-  */
-static void runtime_cache_invalidate_entry(struct hybris_prop_value *entry)
+static void cache_insert_slot(struct hybris_prop_table *table, struct hybris_prop_value *entry)
 {
-	free(entry->value);
-	entry->value = NULL;
+	uint32_t i = entry->hash & table->mask;
+
+	while (table->slots[i])
+		i = (i + 1) & table->mask;
+
+	__atomic_store_n(&table->slots[i], entry, __ATOMIC_RELEASE);
+	table->count++;
 }
 
-static int runtime_cache_get_impl(const char *key, char *value)
-{
-	int ret = -ENOENT;
-
-	struct hybris_prop_value *entry = cache_find_internal(key);
-	if (entry != NULL && entry->value != NULL) {
-		struct timespec now;
-		clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
-		time_t delta_secs = now.tv_sec - entry->last_update;
-		if (delta_secs > runtime_cache_timeout_secs) {
-			// assume the data in cache is stale, and force refresh
-			runtime_cache_invalidate_entry(entry);
-		} else {
-			// success, return value from cache
-			strcpy(value, entry->value);
-			ret = 0;
+/** Add a new, not yet valid entry for key. Called with writer_mutex held. */
+static struct hybris_prop_value *cache_add_internal(const char *key, uint32_t hash)
+{
+	struct hybris_prop_table *table = prop_table;
+	struct hybris_prop_value *entry;
+	uint32_t i;
+
+	if (!table)
+		return NULL;
+
+	/* keep the load factor below 1/2 */
+	if (2 * (table->count + 1) > table->mask + 1) {
+		struct hybris_prop_table *bigger = runtime_cache_table_alloc(2 * (table->mask + 1));
+		if (!bigger)
+			return NULL;
+
+		for (i = 0; i <= table->mask; i++) {
+			if (table->slots[i])
+				cache_insert_slot(bigger, table->slots[i]);
 		}
+
+		bigger->retired = table;
+		__atomic_store_n(&prop_table, bigger, __ATOMIC_RELEASE);
+		table = bigger;
 	}
 
-	return ret;
+	entry = calloc(1, sizeof(*entry));
+	if (!entry)
+		return NULL;
+
+	entry->key = strdup(key);
+	entry->hash = hash;
+	if (!entry->key) {
+		free(entry);
+		return NULL;
+	}
+
+	cache_insert_slot(table, entry);
+	return entry;
 }
 
-static void runtime_cache_insert_impl(const char *key, char *value)
+/** Update the value of an entry. Called with writer_mutex held. */
+static void cache_write_internal(struct hybris_prop_value *entry, const char *value)
 {
 	struct timespec now;
 	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
 
-	struct hybris_prop_value *entry = cache_find_internal(key);
-	if (entry) {
-		assert(entry->value == NULL);
-		// key,value pair was invalidated earlier,
-		// reuse entry in the property array
-		entry->value = strdup(value);
+	__atomic_store_n(&entry->seq, entry->seq + 1, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	if (value) {
+		strncpy(entry->value, value, PROP_VALUE_MAX - 1);
+		entry->value[PROP_VALUE_MAX - 1] = '\0';
 		entry->last_update = now.tv_sec;
+		entry->valid = 1;
 	} else {
-		if (num_alloc == num_prop) {
-			num_alloc = 3 * num_alloc / 2;
-			prop_array = realloc(prop_array, num_alloc * sizeof(struct hybris_prop_value));
-		}
+		entry->valid = 0;
+	}
 
-		struct hybris_prop_value new_entry = { strdup(key), strdup(value), now.tv_sec };
-		prop_array[num_prop++] = new_entry;
+	__atomic_store_n(&entry->seq, entry->seq + 1, __ATOMIC_RELEASE);
+}
+
+/** Read a valid, not stale value of an entry without taking any lock */
+static int cache_read_internal(struct hybris_prop_value *entry, char *value)
+{
+	char buf[PROP_VALUE_MAX];
+	unsigned seq;
+	int valid;
+	time_t last_update;
+
+	do {
+		seq = __atomic_load_n(&entry->seq, __ATOMIC_ACQUIRE);
+		if (seq & 1)
+			continue;
+
+		valid = entry->valid;
+		last_update = entry->last_update;
+		memcpy(buf, entry->value, sizeof(buf));
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while ((seq & 1) || seq != __atomic_load_n(&entry->seq, __ATOMIC_RELAXED));
 
-		qsort(prop_array, num_prop, sizeof(struct hybris_prop_value), prop_qcmp);
+	if (!valid)
+		return -ENOENT;
+
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC_COARSE, &now);
+	if (now.tv_sec - last_update > runtime_cache_timeout_secs) {
+		// assume the data in cache is stale, and force refresh
+		return -ENOENT;
 	}
+
+	buf[PROP_VALUE_MAX - 1] = '\0';
+	strcpy(value, buf);
+	return 0;
 }
 
 
-void runtime_cache_lock()
+int runtime_cache_get(const char *key, char *value)
 {
-	pthread_mutex_lock(&array_mutex);
-}
+	struct hybris_prop_value *entry;
 
-void runtime_cache_unlock()
-{
-	pthread_mutex_unlock(&array_mutex);
+	runtime_cache_ensure_initialized();
+
+	entry = cache_find_internal(key, runtime_cache_hash(key));
+	if (!entry)
+		return -ENOENT;
+
+	return cache_read_internal(entry, value);
 }
 
-void runtime_cache_remove(const char *key)
+static int begin_fetch(const char *key, char *value, unsigned *ticket, int wait)
 {
+	uint32_t hash = runtime_cache_hash(key);
+	struct hybris_prop_value *entry;
+	int ret;
+
 	runtime_cache_ensure_initialized();
-	struct hybris_prop_value *entry = cache_find_internal(key);
-	if (entry) {
-		runtime_cache_invalidate_entry(entry);
+
+	pthread_mutex_lock(&writer_mutex);
+
+	entry = cache_find_internal(key, hash);
+	if (!entry)
+		entry = cache_add_internal(key, hash);
+
+	for (;;) {
+		if (!entry) {
+			/* out of memory, fetch without caching */
+			*ticket = 0;
+			ret = 0;
+			break;
+		}
+
+		if (cache_read_internal(entry, value) == 0) {
+			/* filled in while we were waiting */
+			ret = 1;
+			break;
+		}
+
+		if (!entry->fetching) {
+			entry->fetching = 1;
+			*ticket = ++entry->generation;
+			ret = 0;
+			break;
+		}
+
+		if (!wait) {
+			ret = -EAGAIN;
+			break;
+		}
+
+		/* another thread is already asking for this key, use its answer */
+		unsigned generation = entry->generation;
+
+		while (entry->fetching && entry->generation == generation)
+			pthread_cond_wait(&fetch_cond, &writer_mutex);
+
+		if (entry->generation == generation && !entry->fetching &&
+			cache_read_internal(entry, value) != 0) {
+			/* the request failed, don't try it again right away */
+			ret = -ENOENT;
+			break;
+		}
 	}
+
+	pthread_mutex_unlock(&writer_mutex);
+
+	return ret;
 }
 
-int runtime_cache_get(const char *key, char *value)
+int runtime_cache_begin_fetch(const char *key, char *value, unsigned *ticket)
 {
-	runtime_cache_ensure_initialized();
-	return runtime_cache_get_impl(key, value);
+	return begin_fetch(key, value, ticket, 1);
+}
+
+int runtime_cache_try_begin_fetch(const char *key, char *value, unsigned *ticket)
+{
+	return begin_fetch(key, value, ticket, 0);
+}
+
+void runtime_cache_end_fetch(const char *key, const char *value, unsigned ticket)
+{
+	struct hybris_prop_value *entry;
+
+	pthread_mutex_lock(&writer_mutex);
+
+	entry = cache_find_internal(key, runtime_cache_hash(key));
+
+	/* the property might have been set in the meantime, and the answer
+	 * is stale then: only store it if it belongs to the current request
+	 */
+	if (entry && entry->fetching && entry->generation == ticket) {
+		if (value)
+			cache_write_internal(entry, value);
+
+		entry->fetching = 0;
+		pthread_cond_broadcast(&fetch_cond);
+	}
+
+	pthread_mutex_unlock(&writer_mutex);
 }
 
-void runtime_cache_insert(const char *key, char *value)
+/** Invalidate an entry in the cache
+  *
+  * Cache will never shrink. Instead, assume that the same key
+  * will be queried soon after invalidation and reuse the entry.
+  */
+void runtime_cache_remove(const char *key)
 {
+	struct hybris_prop_value *entry;
+
 	runtime_cache_ensure_initialized();
-	runtime_cache_insert_impl(key, value);
+
+	pthread_mutex_lock(&writer_mutex);
+
+	entry = cache_find_internal(key, runtime_cache_hash(key));
+	if (entry) {
+		cache_write_internal(entry, NULL);
+		if (entry->fetching) {
+			/* drop the result of the request which is in flight */
+			entry->fetching = 0;
+			entry->generation++;
+			pthread_cond_broadcast(&fetch_cond);
+		}
+	}
+
+	pthread_mutex_unlock(&writer_mutex);
 }
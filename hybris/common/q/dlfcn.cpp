@@ -40,7 +40,6 @@
 #include <bionic/pthread_internal.h>
 #include "private/bionic_globals.h"
 #include "private/bionic_tls.h"
-#include "private/ScopedPthreadMutexLocker.h"
 
 #define __LINKER_PUBLIC__ __attribute__((visibility("default")))
 
@@ -93,7 +92,70 @@ _Unwind_Ptr __loader_dl_unwind_find_exidx(_Unwind_Ptr pc, int* pcount) __LINKER_
 #endif
 }
 
-static pthread_mutex_t g_dl_mutex = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+// Lookups (dlsym, dladdr, dl_iterate_phdr and the unwinder's exidx lookup)
+// only read the soinfo list and run concurrently under the read lock, so C++
+// unwinding and dlsym from other threads don't wait for a dlopen in progress.
+// Everything that changes the list, the namespaces or the linker settings
+// takes the write lock.
+//
+// Like the recursive mutex this replaces, the lock may be taken again by the
+// thread holding it: constructors run by dlopen call dlsym or throw, phdr
+// callbacks and symbol hooks may dlopen. A thread holding the write lock
+// doesn't lock again, and one holding the read lock has to give it up to
+// write, since a read lock can't be upgraded. Until it has the read lock
+// back, dlclose() doesn't unmap the libraries it may still be reading.
+static pthread_rwlock_t g_dl_lock = PTHREAD_RWLOCK_INITIALIZER;
+static __thread size_t g_dl_read_depth;
+static __thread size_t g_dl_write_depth;
+
+class ScopedDlReadLocker {
+ public:
+  ScopedDlReadLocker() : counted_(g_dl_write_depth == 0) {
+    if (counted_ && g_dl_read_depth++ == 0) {
+      pthread_rwlock_rdlock(&g_dl_lock);
+    }
+  }
+
+  ~ScopedDlReadLocker() {
+    if (counted_ && --g_dl_read_depth == 0) {
+      pthread_rwlock_unlock(&g_dl_lock);
+    }
+  }
+
+ private:
+  bool counted_;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedDlReadLocker);
+};
+
+class ScopedDlWriteLocker {
+ public:
+  ScopedDlWriteLocker() {
+    if (g_dl_write_depth++ == 0) {
+      if (g_dl_read_depth != 0) {
+        g_suspended_readers++;
+        pthread_rwlock_unlock(&g_dl_lock);
+      }
+      pthread_rwlock_wrlock(&g_dl_lock);
+    }
+  }
+
+  ~ScopedDlWriteLocker() {
+    if (--g_dl_write_depth == 0) {
+      if (g_dl_read_depth == 0) {
+        release_deferred_soinfos();
+      }
+      pthread_rwlock_unlock(&g_dl_lock);
+      if (g_dl_read_depth != 0) {
+        pthread_rwlock_rdlock(&g_dl_lock);
+        g_suspended_readers--;
+      }
+    }
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ScopedDlWriteLocker);
+};
 
 static __thread char *dl_err_str;
 char __thread dlerror_buffer[__BIONIC_DLERROR_BUFFER_SIZE];
@@ -133,12 +195,12 @@ char* __loader_dlerror() {
 }
 
 void __loader_android_get_LD_LIBRARY_PATH(char* buffer, size_t buffer_size) {
-  ScopedPthreadMutexLocker locker(&g_dl_mutex);
+  ScopedDlReadLocker locker;
   do_android_get_LD_LIBRARY_PATH(buffer, buffer_size);
 }
 
 void __loader_android_update_LD_LIBRARY_PATH(const char* ld_library_path) {
-  ScopedPthreadMutexLocker locker(&g_dl_mutex);
+  ScopedDlWriteLocker locker;
   do_android_update_LD_LIBRARY_PATH(ld_library_path);
 }
 
@@ -146,7 +208,7 @@ static void* dlopen_ext(const char* filename,
                         int flags,
                         const android_dlextinfo* extinfo,
                         const void* caller_addr) {
-  ScopedPthreadMutexLocker locker(&g_dl_mutex);
+  ScopedDlWriteLocker locker;
   g_linker_logger.ResetState();
   void* result = do_dlopen(filename, flags, extinfo, caller_addr);
   if (result == nullptr) {
@@ -168,7 +230,7 @@ void* __loader_dlopen(const char* filename, int flags, const void* caller_addr)
 }
 
 void* dlsym_impl(void* handle, const char* symbol, const char* version, const void* caller_addr) {
-  ScopedPthreadMutexLocker locker(&g_dl_mutex);
+  ScopedDlReadLocker locker;
   g_linker_logger.ResetState();
   void* result;
   if (!do_dlsym(handle, symbol, version, caller_addr, &result)) {
@@ -188,12 +250,12 @@ void* __loader_dlvsym(void* handle, const char* symbol, const char* version, con
 }
 
 int __loader_dladdr(const void* addr, Dl_info* info) {
-  ScopedPthreadMutexLocker locker(&g_dl_mutex);
+  ScopedDlReadLocker locker;
   return do_dladdr(addr, info);
 }
 
 int __loader_dlclose(void* handle) {
-  ScopedPthreadMutexLocker locker(&g_dl_mutex);
+  ScopedDlWriteLocker locker;
   int result = do_dlclose(handle);
   if (result != 0) {
     __bionic_format_dlerror("dlclose failed", linker_get_error_buffer());
@@ -202,7 +264,7 @@ int __loader_dlclose(void* handle) {
 }
 
 int __loader_dl_iterate_phdr(int (*cb)(dl_phdr_info* info, size_t size, void* data), void* data) {
-  ScopedPthreadMutexLocker locker(&g_dl_mutex);
+  ScopedDlReadLocker locker;
   return do_dl_iterate_phdr(cb, data);
 }
 
@@ -213,14 +275,14 @@ int dl_iterate_phdr(int (*cb)(dl_phdr_info* info, size_t size, void* data), void
 
 #if defined(__arm__)
 _Unwind_Ptr __loader_dl_unwind_find_exidx(_Unwind_Ptr pc, int* pcount) {
-  ScopedPthreadMutexLocker locker(&g_dl_mutex);
+  ScopedDlReadLocker locker;
   return do_dl_unwind_find_exidx(pc, pcount);
 }
 #endif
 
 void __loader_android_set_application_target_sdk_version(int target) {
   // lock to avoid modification in the middle of dlopen.
-  ScopedPthreadMutexLocker locker(&g_dl_mutex);
+  ScopedDlWriteLocker locker;
   set_application_target_sdk_version(target);
 }
 
@@ -229,13 +291,13 @@ int __loader_android_get_application_target_sdk_version() {
 }
 
 void __loader_android_dlwarning(void* obj, void (*f)(void*, const char*)) {
-  ScopedPthreadMutexLocker locker(&g_dl_mutex);
+  ScopedDlWriteLocker locker;
   get_dlwarning(obj, f);
 }
 
 bool __loader_android_init_anonymous_namespace(const char* shared_libs_sonames,
                                                const char* library_search_path) {
-  ScopedPthreadMutexLocker locker(&g_dl_mutex);
+  ScopedDlWriteLocker locker;
   bool success = init_anonymous_namespace(shared_libs_sonames, library_search_path);
   if (!success) {
     __bionic_format_dlerror("android_init_anonymous_namespace failed", linker_get_error_buffer());
@@ -251,7 +313,7 @@ android_namespace_t* __loader_android_create_namespace(const char* name,
                                                 const char* permitted_when_isolated_path,
                                                 android_namespace_t* parent_namespace,
                                                 const void* caller_addr) {
-  ScopedPthreadMutexLocker locker(&g_dl_mutex);
+  ScopedDlWriteLocker locker;
 
   android_namespace_t* result = create_namespace(caller_addr,
                                                  name,
@@ -271,7 +333,7 @@ android_namespace_t* __loader_android_create_namespace(const char* name,
 bool __loader_android_link_namespaces(android_namespace_t* namespace_from,
                                       android_namespace_t* namespace_to,
                                       const char* shared_libs_sonames) {
-  ScopedPthreadMutexLocker locker(&g_dl_mutex);
+  ScopedDlWriteLocker locker;
 
   bool success = link_namespaces(namespace_from, namespace_to, shared_libs_sonames);
 
@@ -284,7 +346,7 @@ bool __loader_android_link_namespaces(android_namespace_t* namespace_from,
 
 bool __loader_android_link_namespaces_all_libs(android_namespace_t* namespace_from,
                                                android_namespace_t* namespace_to) {
-  ScopedPthreadMutexLocker locker(&g_dl_mutex);
+  ScopedDlWriteLocker locker;
 
   bool success = link_namespaces_all_libs(namespace_from, namespace_to);
 
@@ -304,12 +366,12 @@ void __loader_cfi_fail(uint64_t CallSiteTypeId, void* Ptr, void *DiagData, void
 }
 
 void __loader_add_thread_local_dtor(void* dso_handle) {
-  ScopedPthreadMutexLocker locker(&g_dl_mutex);
+  ScopedDlWriteLocker locker;
   increment_dso_handle_reference_counter(dso_handle);
 }
 
 void __loader_remove_thread_local_dtor(void* dso_handle) {
-  ScopedPthreadMutexLocker locker(&g_dl_mutex);
+  ScopedDlWriteLocker locker;
   decrement_dso_handle_reference_counter(dso_handle);
 }
 
@@ -39,6 +39,8 @@
 #include <sys/vfs.h>
 #include <unistd.h>
 
+#include <algorithm>
+#include <atomic>
 #include <new>
 #include <string>
 #include <unordered_map>
@@ -64,7 +66,10 @@
 #include "linker_main.h"
 #include "linker_namespaces.h"
 #include "linker_sleb128.h"
+#include "linker_parallel.h"
 #include "linker_phdr.h"
+#include "linker_profile.h"
+#include "linker_reloc_cache.h"
 #include "linker_relocs.h"
 #include "linker_reloc_iterators.h"
 #include "linker_tls.h"
@@ -72,6 +77,7 @@
 
 #include "private/bionic_call_ifunc_resolver.h"
 #include "private/bionic_globals.h"
+#include "private/ScopedPthreadMutexLocker.h"
 #include "android-base/macros.h"
 //#include "android-base/strings.h"
 //#include "android-base/stringprintf.h"
@@ -378,11 +384,13 @@ soinfo* soinfo_alloc(android_namespace_t* ns, const char* name,
   return si;
 }
 
-static void soinfo_free(soinfo* si) {
-  if (si == nullptr) {
-    return;
-  }
+// Threads which gave their read lock up to re-enter the linker for writing
+// (see ScopedDlWriteLocker) go on with the soinfos they were reading, so
+// unloaded libraries stay mapped and their soinfos allocated meanwhile.
+std::atomic<size_t> g_suspended_readers;
+static soinfo_list_t g_deferred_free_list;
 
+static void soinfo_release(soinfo* si) {
   if (si->base != 0 && si->size != 0) {
     if (!si->is_mapped_by_caller()) {
       munmap(reinterpret_cast<void*>(si->base), si->size);
@@ -393,8 +401,31 @@ static void soinfo_free(soinfo* si) {
     }
   }
 
+  si->~soinfo();
+  g_soinfo_allocator.free(si);
+}
+
+// Called with the write lock held
+void release_deferred_soinfos() {
+  if (g_suspended_readers != 0) {
+    return;
+  }
+
+  soinfo* si;
+  while ((si = g_deferred_free_list.pop_front()) != nullptr) {
+    soinfo_release(si);
+  }
+}
+
+static void soinfo_free(soinfo* si) {
+  if (si == nullptr) {
+    return;
+  }
+
   TRACE("name %s: freeing soinfo @ %p", si->get_realpath(), si);
 
+  soinfo_index_remove(si);
+
   if (!solist_remove_soinfo(si)) {
     async_safe_fatal("soinfo=%p is not in soinfo_list (double unload?)", si);
   }
@@ -402,8 +433,11 @@ static void soinfo_free(soinfo* si) {
   // clear links to/from si
   si->remove_all_links();
 
-  si->~soinfo();
-  g_soinfo_allocator.free(si);
+  if (g_suspended_readers != 0) {
+    g_deferred_free_list.push_back(si);
+  } else {
+    soinfo_release(si);
+  }
 }
 
 static void parse_path(const char* path, const char* delimiters,
@@ -589,29 +623,37 @@ void ProtectedDataGuard::protect_data(int protection) {
 
 size_t ProtectedDataGuard::ref_count_ = 0;
 
-// Each size has it's own allocator.
+// Each size has it's own allocator. Lookups running concurrently under the
+// read lock allocate the lists of walk_dependencies_tree() from these.
 template<size_t size>
 class SizeBasedAllocator {
  public:
   static void* alloc() {
+    ScopedPthreadMutexLocker locker(&mutex_);
     return allocator_.alloc();
   }
 
   static void free(void* ptr) {
+    ScopedPthreadMutexLocker locker(&mutex_);
     allocator_.free(ptr);
   }
 
   static void purge() {
+    ScopedPthreadMutexLocker locker(&mutex_);
     allocator_.purge();
   }
 
  private:
   static LinkerBlockAllocator allocator_;
+  static pthread_mutex_t mutex_;
 };
 
 template<size_t size>
 LinkerBlockAllocator SizeBasedAllocator<size>::allocator_(size);
 
+template<size_t size>
+pthread_mutex_t SizeBasedAllocator<size>::mutex_ = PTHREAD_MUTEX_INITIALIZER;
+
 template<typename T>
 class TypeBasedAllocator {
  public:
@@ -719,12 +761,17 @@ class LoadTask {
   }
 
   bool read(const char* realpath, off64_t file_size) {
+    LinkerProfileScope profile("ElfReader::Read", realpath);
     ElfReader& elf_reader = get_elf_reader();
     return elf_reader.Read(realpath, fd_, file_offset_, file_size);
   }
 
   bool load(address_space_params* address_space) {
-    ElfReader& elf_reader = get_elf_reader();
+    return load(address_space, get_elf_reader());
+  }
+
+  bool load(address_space_params* address_space, ElfReader& elf_reader) {
+    LinkerProfileScope profile("ElfReader::Load", elf_reader.name());
     if (!elf_reader.Load(address_space)) {
       return false;
     }
@@ -735,6 +782,7 @@ class LoadTask {
     si_->load_bias = elf_reader.load_bias();
     si_->phnum = elf_reader.phdr_count();
     si_->phdr = elf_reader.loaded_phdr();
+    soinfo_index_add(si_);
 
     return true;
   }
@@ -960,24 +1008,98 @@ static const ElfW(Sym)* dlsym_linear_lookup(android_namespace_t* ns,
   return s;
 }
 
-soinfo* find_containing_library(const void* p) {
-  ElfW(Addr) address = reinterpret_cast<ElfW(Addr)>(p);
-  for (soinfo* si = solist_get_head(); si != nullptr; si = si->next) {
-    if (address < si->base || address - si->base >= si->size) {
+// The PT_LOAD segments of the loaded libraries, sorted by address, for
+// find_containing_library(). dladdr() and the unwinder's exidx lookup use
+// it for every frame of every backtrace, with hundreds of libraries loaded.
+// Segments are added once a library is mapped and removed when it is freed,
+// with the dlfcn.cpp write lock held; parallel loading adds them from
+// several threads, hence the mutex.
+struct SegmentRange {
+  ElfW(Addr) start;
+  ElfW(Addr) end;
+  soinfo* si;
+};
+
+static std::vector<SegmentRange> g_segment_index;
+static pthread_mutex_t g_segment_index_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+// Changes with every update of the index, so that the last hit of a thread
+// is not used anymore once its library may be gone. Starts at 1, the last
+// hit of a new thread has generation 0.
+static size_t g_segment_index_generation = 1;
+
+// Backtraces look up a few libraries many times in a row.
+struct SegmentHit {
+  size_t generation;
+  ElfW(Addr) start;
+  ElfW(Addr) end;
+  soinfo* si;
+};
+
+static __thread SegmentHit t_segment_hit;
+
+void soinfo_index_add(soinfo* si) {
+  if (si->base == 0 || si->size == 0 || si->phdr == nullptr) {
+    return;
+  }
+
+  ScopedPthreadMutexLocker locker(&g_segment_index_mutex);
+  for (size_t i = 0; i != si->phnum; ++i) {
+    const ElfW(Phdr)* phdr = &si->phdr[i];
+    if (phdr->p_type != PT_LOAD) {
       continue;
     }
-    ElfW(Addr) vaddr = address - si->load_bias;
-    for (size_t i = 0; i != si->phnum; ++i) {
-      const ElfW(Phdr)* phdr = &si->phdr[i];
-      if (phdr->p_type != PT_LOAD) {
-        continue;
-      }
-      if (vaddr >= phdr->p_vaddr && vaddr < phdr->p_vaddr + phdr->p_memsz) {
-        return si;
-      }
+
+    // Only the part within the mapping of the library
+    ElfW(Addr) start = std::max(si->load_bias + phdr->p_vaddr, si->base);
+    ElfW(Addr) end = std::min(si->load_bias + phdr->p_vaddr + phdr->p_memsz, si->base + si->size);
+    if (start >= end) {
+      continue;
     }
+
+    auto it = std::lower_bound(g_segment_index.begin(), g_segment_index.end(), start,
+                               [](const SegmentRange& range, ElfW(Addr) value) {
+                                 return range.start < value;
+                               });
+    g_segment_index.insert(it, { start, end, si });
   }
-  return nullptr;
+  g_segment_index_generation++;
+}
+
+void soinfo_index_remove(soinfo* si) {
+  ScopedPthreadMutexLocker locker(&g_segment_index_mutex);
+  g_segment_index.erase(std::remove_if(g_segment_index.begin(), g_segment_index.end(),
+                                       [si](const SegmentRange& range) {
+                                         return range.si == si;
+                                       }),
+                        g_segment_index.end());
+  g_segment_index_generation++;
+}
+
+soinfo* find_containing_library(const void* p) {
+  ElfW(Addr) address = reinterpret_cast<ElfW(Addr)>(p);
+  SegmentHit& hit = t_segment_hit;
+
+  if (hit.generation == g_segment_index_generation &&
+      address >= hit.start && address < hit.end) {
+    return hit.si;
+  }
+
+  // The last segment starting at or below the address
+  auto it = std::upper_bound(g_segment_index.begin(), g_segment_index.end(), address,
+                             [](ElfW(Addr) value, const SegmentRange& range) {
+                               return value < range.start;
+                             });
+  if (it == g_segment_index.begin()) {
+    return nullptr;
+  }
+  --it;
+  if (address >= it->end) {
+    return nullptr;
+  }
+
+  hit = { g_segment_index_generation, it->start, it->end, it->si };
+  return it->si;
 }
 
 class ZipArchiveCache {
@@ -1660,6 +1782,168 @@ static void shuffle(std::vector<LoadTask*>* v) {
 }
 
 
+// Maps the segments of the libraries in load_list on g_ld_parallel_threads
+// threads. Only used for libraries which don't go to a reserved address
+// range, as those have to be placed one after another.
+static bool load_libraries_parallel(const LoadTaskList& load_list) {
+  std::atomic<size_t> next_task(0);
+  std::atomic<bool> failed(false);
+
+  // The readers live in an unordered_map, look them up before fanning out.
+  std::vector<ElfReader*> readers;
+  readers.reserve(load_list.size());
+  for (LoadTask* task : load_list) {
+    readers.push_back(&task->get_elf_reader());
+  }
+
+  linker_parallel_run(std::min(g_ld_parallel_threads, load_list.size()), [&]() {
+    for (size_t i = next_task++; i < load_list.size() && !failed; i = next_task++) {
+      LoadTask* task = load_list[i];
+      address_space_params address_space;
+      if (!task->load(&address_space, *readers[i])) {
+        failed = true;
+        return;
+      }
+
+      // Have the kernel read the mapped file in the background while the
+      // other libraries are mapped, relocation is going to touch most of it.
+      soinfo* si = task->get_soinfo();
+      madvise(reinterpret_cast<void*>(si->base), si->size, MADV_WILLNEED);
+    }
+  });
+
+  return !failed;
+}
+
+static bool can_link_in_parallel(const std::vector<soinfo*>& link_list,
+                                 const android_dlextinfo* extinfo) {
+  if (g_ld_parallel_threads < 2 || link_list.size() < 2) {
+    return false;
+  }
+
+  // RELRO sharing writes to and maps from one file at a running offset.
+  if (extinfo != nullptr &&
+      (extinfo->flags & (ANDROID_DLEXT_WRITE_RELRO | ANDROID_DLEXT_USE_RELRO)) != 0) {
+    return false;
+  }
+
+#ifdef WANT_ARM_TRACING
+  // Creating the wrappers is not thread safe.
+  if (_wrapping_enabled) {
+    return false;
+  }
+#endif
+
+#if !defined(__LP64__)
+  // Text relocations flip the protection of whole segments around ifunc
+  // resolver calls and record dlwarnings, keep those libraries serial.
+  for (soinfo* si : link_list) {
+    if (si->has_text_relocations) {
+      return false;
+    }
+  }
+#endif
+
+  return true;
+}
+
+// Links the libraries of one local group on g_ld_parallel_threads threads.
+//
+// The lookup scope of every library is the same global_group and local_group
+// the serial loop uses, and the symbol tables they are looked up in were all
+// set up by prelink_image(), so the relocation results do not depend on the
+// order. Only ifunc resolvers run code during relocation; to not call into a
+// library which is still being relocated a library is only started once all
+// of its DT_NEEDED libraries in link_list are done. Dependency cycles are
+// broken in BFS order when nothing else is left to run.
+static bool link_libraries_parallel(const std::vector<soinfo*>& link_list,
+                                    const soinfo_list_t& global_group,
+                                    const soinfo_list_t& local_group) {
+  struct LinkJob {
+    soinfo* si;
+    size_t pending_children;
+    bool started;
+  };
+
+  std::vector<LinkJob> jobs;
+  std::unordered_map<const soinfo*, size_t> job_index;
+
+  jobs.reserve(link_list.size());
+  for (soinfo* si : link_list) {
+    job_index[si] = jobs.size();
+    jobs.push_back({ si, 0, false });
+  }
+
+  for (LinkJob& job : jobs) {
+    job.si->get_children().for_each([&](soinfo* child) {
+      if (child != job.si && job_index.count(child) != 0) {
+        job.pending_children++;
+      }
+    });
+  }
+
+  pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+  pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+  size_t remaining = jobs.size();
+  size_t running = 0;
+  bool failed = false;
+
+  linker_parallel_run(std::min(g_ld_parallel_threads, jobs.size()), [&]() {
+    pthread_mutex_lock(&mutex);
+    while (!failed && remaining > 0) {
+      LinkJob* job = nullptr;
+      for (LinkJob& candidate : jobs) {
+        if (!candidate.started && candidate.pending_children == 0) {
+          job = &candidate;
+          break;
+        }
+      }
+
+      if (job == nullptr && running == 0) {
+        for (LinkJob& candidate : jobs) {
+          if (!candidate.started) {
+            job = &candidate;
+            break;
+          }
+        }
+      }
+
+      if (job == nullptr) {
+        pthread_cond_wait(&cond, &mutex);
+        continue;
+      }
+
+      job->started = true;
+      running++;
+      pthread_mutex_unlock(&mutex);
+
+      size_t relro_fd_offset = 0;
+      bool linked = job->si->link_image(global_group, local_group, nullptr, &relro_fd_offset);
+
+      pthread_mutex_lock(&mutex);
+      running--;
+      remaining--;
+      if (!linked) {
+        failed = true;
+      } else {
+        job->si->get_parents().for_each([&](soinfo* parent) {
+          auto it = job_index.find(parent);
+          if (parent != job->si && it != job_index.end()) {
+            jobs[it->second].pending_children--;
+          }
+        });
+      }
+      pthread_cond_broadcast(&cond);
+    }
+    pthread_mutex_unlock(&mutex);
+  });
+
+  pthread_cond_destroy(&cond);
+  pthread_mutex_destroy(&mutex);
+
+  return !failed;
+}
+
 // add_as_children - add first-level loaded libraries (i.e. library_names[], but
 // not their transitive dependencies) as children of the start_with library.
 // This is false when find_libraries is called for dlopen(), when newly loaded
@@ -1789,14 +2073,23 @@ bool find_libraries(android_namespace_t* ns,
     }
   }
 
+  LoadTaskList parallel_load_list;
   for (auto&& task : load_list) {
     address_space_params* address_space =
         (reserved_address_recursive || !task->is_dt_needed()) ? &extinfo_params : &default_params;
+    if (g_ld_parallel_threads > 1 && address_space == &default_params) {
+      parallel_load_list.push_back(task);
+      continue;
+    }
     if (!task->load(address_space)) {
       return false;
     }
   }
 
+  if (!parallel_load_list.empty() && !load_libraries_parallel(parallel_load_list)) {
+    return false;
+  }
+
   // Step 3: pre-link all DT_NEEDED libraries in breadth first order.
   for (auto&& task : load_tasks) {
     soinfo* si = task->get_soinfo();
@@ -1897,6 +2190,31 @@ bool find_libraries(android_namespace_t* ns,
       });
 
     soinfo_list_t global_group = local_group_ns->get_global_group();
+
+    if (g_ld_parallel_threads > 1) {
+      std::vector<soinfo*> link_list;
+      local_group.for_each([&](soinfo* si) {
+        if (!si->is_linked() && si->get_primary_namespace() == local_group_ns) {
+          link_list.push_back(si);
+        }
+      });
+
+      // link_image() only uses the extinfo for RELRO sharing, which
+      // can_link_in_parallel() rules out.
+      if (can_link_in_parallel(link_list, extinfo)) {
+        if (!link_libraries_parallel(link_list, global_group, local_group)) {
+          return false;
+        }
+
+        for (soinfo* si : link_list) {
+          if (!get_cfi_shadow()->AfterLoad(si, solist_get_head())) {
+            return false;
+          }
+        }
+        continue;
+      }
+    }
+
     bool linked = local_group.visit([&](soinfo* si) {
       // Even though local group may contain accessible soinfos from other namespaces
       // we should avoid linking them (because if they are not linked -> they
@@ -2306,7 +2624,11 @@ void* do_dlopen(const char* name, int flags,
   }
 
   ProtectedDataGuard guard;
-  soinfo* si = find_library(ns, translated_name, flags, extinfo, caller);
+  soinfo* si;
+  {
+    LinkerProfileScope profile("dlopen", translated_name);
+    si = find_library(ns, translated_name, flags, extinfo, caller);
+  }
   loading_trace.End();
 
   if (si != nullptr) {
@@ -2446,8 +2768,12 @@ bool do_dlsym(void* handle,
           {
             case STT_FUNC:
             case STT_GNU_IFUNC:
-            case STT_ARM_TFUNC:
+            case STT_ARM_TFUNC: {
+              // dlsym() runs concurrently, creating the wrappers is not thread safe.
+              static pthread_mutex_t wrapper_mutex = PTHREAD_MUTEX_INITIALIZER;
+              ScopedPthreadMutexLocker locker(&wrapper_mutex);
               *symbol = reinterpret_cast<void*>(_create_wrapper((char*)symbol, (void*)found->resolve_symbol_address(sym), WRAPPER_DYNHOOK));
+            }
             default:
               *symbol = reinterpret_cast<void*>(found->resolve_symbol_address(sym));
             }
@@ -2906,9 +3232,207 @@ static bool is_tls_reloc(ElfW(Word) type) {
   }
 }
 
+// Marks the symbol counts SymbolLookupCache hasn't computed yet
+static constexpr uint32_t kSymbolCountUnknown = 0xffffffff;
+
+// The libraries soinfo_do_lookup() searches for the relocations of one
+// library, in the same order, flattened into arrays along with their gnu
+// hash bloom filters when the library is linked. A symbol defined late in a
+// large group misses the filters of most libraries, and these misses then
+// only read one filter word after the other instead of following the group
+// lists into every soinfo.
+class SymbolLookupScope {
+ public:
+  SymbolLookupScope(soinfo* si_from, const soinfo_list_t& global_group,
+                    const soinfo_list_t& local_group) {
+    if (si_from->has_DT_SYMBOLIC) {
+      add(si_from);
+    }
+
+    global_group.for_each([&](soinfo* si) {
+      add(si);
+    });
+
+    local_group.for_each([&](soinfo* si) {
+      if (si != si_from || !si_from->has_DT_SYMBOLIC) {
+        add(si);
+      }
+    });
+  }
+
+  bool find_symbol(const char* name, const version_info* vi, soinfo** si_found_in,
+                   const ElfW(Sym)** symbol, size_t* index_found_at) const {
+    SymbolName symbol_name(name);
+    uint32_t hash = symbol_name.gnu_hash();
+    const ElfW(Sym)* s = nullptr;
+
+    for (size_t i = 0; i < filters_.size(); ++i) {
+      if (!filters_[i].may_contain(hash)) {
+        continue;
+      }
+
+      if (!libraries_[i]->find_symbol_by_name(symbol_name, vi, &s)) {
+        return false;
+      }
+
+      if (s != nullptr) {
+        *si_found_in = libraries_[i];
+        *index_found_at = i;
+        break;
+      }
+    }
+
+    *symbol = s;
+    return true;
+  }
+
+  const std::vector<soinfo*>& libraries() const { return libraries_; }
+
+ private:
+  void add(soinfo* si) {
+    libraries_.push_back(si);
+    filters_.push_back(si->get_gnu_bloom_filter());
+  }
+
+  std::vector<soinfo*> libraries_;
+  std::vector<GnuBloomFilter> filters_;
+
+  DISALLOW_COPY_AND_ASSIGN(SymbolLookupScope);
+};
+
+// The symbols resolved while relocating one library, by symbol index. Its
+// relocations often refer to the same symbol several times (GLOB_DAT and
+// JUMP_SLOT of one function, the ABS entries of vtables), and all of them
+// resolve it the same way: through the hooks, then the lookup groups.
+class SymbolLookupCache {
+ public:
+  struct Entry {
+    bool resolved;
+    // Set by the hooks, or to the wrapper of the hooked symbol
+    ElfW(Addr) hooked_addr;
+    soinfo* lsi;
+    const ElfW(Sym)* s;
+    // The address of a non-TLS definition, once computed
+    bool has_address;
+    ElfW(Addr) address;
+  };
+
+  SymbolLookupCache(soinfo* si_from, const soinfo_list_t& global_group,
+                    const soinfo_list_t& local_group)
+      : si_from_(si_from), global_group_(global_group), local_group_(local_group),
+        lookups_(0), hits_(0), recorded_(0) {}
+
+  // Looks up a symbol which isn't hooked, in the relocation cache record
+  // of the library first.
+  bool find_symbol(ElfW(Word) sym, const char* name, const version_info* vi,
+                   soinfo** si_found_in, const ElfW(Sym)** symbol) {
+    const SymbolLookupScope& scope = this->scope();
+
+    const RelocCacheRecord::Binding* binding = record_ ? record_->find(sym) : nullptr;
+    if (binding != nullptr && check_binding(*binding, name, si_found_in, symbol)) {
+      recorded_++;
+      return true;
+    }
+
+    size_t index = 0;
+    if (!scope.find_symbol(name, vi, si_found_in, symbol, &index)) {
+      return false;
+    }
+
+    // Symbols defined nowhere are looked up again each time, the lookup
+    // is what tells they still are
+    if (record_ && *symbol != nullptr) {
+      record_->add(sym, index, (*si_found_in)->get_symbol_index(*symbol));
+    }
+    return true;
+  }
+
+  void save_record() {
+    if (record_) {
+      record_->save();
+    }
+  }
+
+  Entry* get(ElfW(Word) sym) {
+    if (sym >= entries_.size()) {
+      entries_.resize(sym + 1);
+    }
+    return &entries_[sym];
+  }
+
+  void count_lookup() { lookups_++; }
+  void count_hit() { hits_++; }
+
+  size_t lookups() const { return lookups_; }
+  size_t hits() const { return hits_; }
+  size_t recorded() const { return recorded_; }
+
+ private:
+  // The record was written for the same files, but a binding is only used
+  // if it names a symbol of the same name defined in the library it points
+  // to: anything else is looked up.
+  bool check_binding(const RelocCacheRecord::Binding& binding, const char* name,
+                     soinfo** si_found_in, const ElfW(Sym)** symbol) {
+    const std::vector<soinfo*>& libraries = scope_->libraries();
+    if (binding.library >= libraries.size()) {
+      return false;
+    }
+
+    if (symbol_counts_.empty()) {
+      symbol_counts_.resize(libraries.size(), kSymbolCountUnknown);
+    }
+    soinfo* lib = libraries[binding.library];
+    uint32_t& count = symbol_counts_[binding.library];
+    if (count == kSymbolCountUnknown) {
+      count = lib->get_symbol_count();
+    }
+    if (binding.symbol >= count) {
+      return false;
+    }
+
+    const ElfW(Sym)* s = lib->get_symbol(binding.symbol);
+    if (s->st_shndx == SHN_UNDEF || strcmp(lib->get_string(s->st_name), name) != 0) {
+      DEBUG("relocation cache: \"%s\" isn't where it was recorded", name);
+      return false;
+    }
+
+    *si_found_in = lib;
+    *symbol = s;
+    return true;
+  }
+
+  // Built on the first lookup, most libraries have hardly any
+  const SymbolLookupScope& scope() {
+    if (!scope_) {
+      scope_.reset(new SymbolLookupScope(si_from_, global_group_, local_group_));
+      if (g_ld_reloc_cache_enabled) {
+        record_.reset(new RelocCacheRecord());
+        record_->load(si_from_, scope_->libraries());
+      }
+    }
+    return *scope_;
+  }
+
+  soinfo* si_from_;
+  const soinfo_list_t& global_group_;
+  const soinfo_list_t& local_group_;
+  std::unique_ptr<SymbolLookupScope> scope_;
+  std::unique_ptr<RelocCacheRecord> record_;
+  // Of the libraries of the scope, computed for checking recorded bindings
+  std::vector<uint32_t> symbol_counts_;
+  std::vector<Entry> entries_;
+  size_t lookups_;
+  size_t hits_;
+  size_t recorded_;
+
+  DISALLOW_COPY_AND_ASSIGN(SymbolLookupCache);
+};
+
 template<typename ElfRelIteratorT>
 bool soinfo::relocate(const VersionTracker& version_tracker, ElfRelIteratorT&& rel_iterator,
-                      const soinfo_list_t& global_group, const soinfo_list_t& local_group) {
+                      const soinfo_list_t& global_group, const soinfo_list_t& local_group,
+                      SymbolLookupCache* lookup_cache) {
+  LinkerProfileScope profile("relocate", get_realpath());
   const size_t tls_tp_base = 0/*__libc_shared_globals()->static_tls_layout.offset_thread_pointer()*/;
   std::vector<std::pair<TlsDescriptor*, size_t>> deferred_tlsdesc_relocs;
 
@@ -2955,41 +3479,64 @@ bool soinfo::relocate(const VersionTracker& version_tracker, ElfRelIteratorT&& r
       return false;
     } else {
       sym_name = get_string(symtab_[sym].st_name);
-      const version_info* vi = nullptr;
+      SymbolLookupCache::Entry* cached = lookup_cache->get(sym);
 
-      sym_addr = reinterpret_cast<ElfW(Addr)>(_get_hooked_symbol(sym_name, get_realpath()));
+      if (cached->resolved) {
+        sym_addr = cached->hooked_addr;
+        lsi = cached->lsi;
+        s = cached->s;
+        lookup_cache->count_hit();
+      } else {
+        const version_info* vi = nullptr;
 
-      if (!sym_addr) {
-        if (!lookup_version_info(version_tracker, sym, sym_name, &vi)) {
-          return false;
-        }
+        uint64_t profile_start = g_linker_profile_enabled ? linker_profile_now() : 0;
 
-        if (!soinfo_do_lookup(this, sym_name, vi, &lsi, global_group, local_group, &s)) {
-          return false;
+        sym_addr = reinterpret_cast<ElfW(Addr)>(_get_hooked_symbol(sym_name, get_realpath()));
+        bool hooked = sym_addr != 0;
+
+        if (!sym_addr) {
+          if (!lookup_version_info(version_tracker, sym, sym_name, &vi)) {
+            return false;
+          }
+
+          if (!lookup_cache->find_symbol(sym, sym_name, vi, &lsi, &s)) {
+            return false;
+          }
         }
-      }
 #ifdef WANT_ARM_TRACING
-      else if (_wrapping_enabled)
-      {
-        // this will be slower.
-        if (!lookup_version_info(version_tracker, sym, sym_name, &vi)) {
-          return false;
-        }
+        else if (_wrapping_enabled)
+        {
+          // this will be slower.
+          if (!lookup_version_info(version_tracker, sym, sym_name, &vi)) {
+            return false;
+          }
 
-        if (!soinfo_do_lookup(this, sym_name, vi, &lsi, global_group, local_group, &s)) {
-          return false;
+          if (!lookup_cache->find_symbol(sym, sym_name, vi, &lsi, &s)) {
+            return false;
+          }
+
+          switch(ELF_ST_TYPE(s->st_info))
+          {
+            case STT_FUNC:
+            case STT_GNU_IFUNC:
+            case STT_ARM_TFUNC:
+              sym_addr = (ElfW(Addr))_create_wrapper(sym_name, (void*)sym_addr, WRAPPER_HOOKED);
+              break;
+          }
         }
+#endif
 
-        switch(ELF_ST_TYPE(s->st_info))
-        {
-          case STT_FUNC:
-          case STT_GNU_IFUNC:
-          case STT_ARM_TFUNC:
-            sym_addr = (ElfW(Addr))_create_wrapper(sym_name, (void*)sym_addr, WRAPPER_HOOKED);
-            break;
+        if (g_linker_profile_enabled) {
+          linker_profile_count_symbol(hooked ? kProfileSymbolHooked : kProfileSymbolBionic,
+                                      linker_profile_now() - profile_start);
         }
+
+        cached->resolved = true;
+        cached->hooked_addr = sym_addr;
+        cached->lsi = lsi;
+        cached->s = s;
+        lookup_cache->count_lookup();
       }
-#endif
 
       if (sym_addr == 0 && s == nullptr) {
         // We only allow an undefined symbol if this is a weak reference...
@@ -3058,7 +3605,8 @@ bool soinfo::relocate(const VersionTracker& version_tracker, ElfRelIteratorT&& r
         // STT_GNU_IFUNC symbol.
         bool protect_segments = has_text_relocations &&
                                 lsi == this &&
-                                ELF_ST_TYPE(s->st_info) == STT_GNU_IFUNC;
+                                ELF_ST_TYPE(s->st_info) == STT_GNU_IFUNC &&
+                                !cached->has_address;
         if (protect_segments) {
           if (phdr_table_protect_segments(phdr, phnum, load_bias) < 0) {
             DL_ERR("can't protect segments for \"%s\": %s",
@@ -3085,26 +3633,33 @@ bool soinfo::relocate(const VersionTracker& version_tracker, ElfRelIteratorT&& r
                    sym_name, get_realpath());
             return false;
           }
+          // Runs ifunc resolvers once per symbol, and creates one wrapper
+          if (cached->has_address) {
+            sym_addr = cached->address;
+          } else {
 #ifdef WANT_ARM_TRACING
-          if (_wrapping_enabled) {
-            switch(ELF_ST_TYPE(s->st_info))
-            {
-              case STT_FUNC:
-              case STT_GNU_IFUNC:
-              case STT_ARM_TFUNC:
-                sym_addr = (ElfW(Addr))_create_wrapper(sym_name,
-                        (void*)lsi->resolve_symbol_address(s), WRAPPER_UNHOOKED);
-                break;
-              default:
-                sym_addr = lsi->resolve_symbol_address(s);
-                break;
+            if (_wrapping_enabled) {
+              switch(ELF_ST_TYPE(s->st_info))
+              {
+                case STT_FUNC:
+                case STT_GNU_IFUNC:
+                case STT_ARM_TFUNC:
+                  sym_addr = (ElfW(Addr))_create_wrapper(sym_name,
+                          (void*)lsi->resolve_symbol_address(s), WRAPPER_UNHOOKED);
+                  break;
+                default:
+                  sym_addr = lsi->resolve_symbol_address(s);
+                  break;
+              }
+            } else {
+              sym_addr = lsi->resolve_symbol_address(s);
             }
-          } else {
-            sym_addr = lsi->resolve_symbol_address(s);
-          }
 #else
-          sym_addr = lsi->resolve_symbol_address(s);
+            sym_addr = lsi->resolve_symbol_address(s);
 #endif
+            cached->address = sym_addr;
+            cached->has_address = true;
+          }
         }
 #if !defined(__LP64__)
         if (protect_segments) {
@@ -3463,6 +4018,7 @@ bool soinfo::relocate(const VersionTracker& version_tracker, ElfRelIteratorT&& r
 static soinfo_list_t g_empty_list;
 
 bool soinfo::prelink_image() {
+  LinkerProfileScope profile("prelink_image", get_realpath());
   /* Extract dynamic section */
   ElfW(Word) dynamic_flags = 0;
   phdr_table_get_dynamic_section(phdr, phnum, load_bias, &dynamic, &dynamic_flags);
@@ -3993,6 +4549,8 @@ bool soinfo::link_image(const soinfo_list_t& global_group, const soinfo_list_t&
     return false;
   }
 
+  SymbolLookupCache lookup_cache(this, global_group, local_group);
+
 #if !defined(__LP64__)
   if (has_text_relocations) {
     // Fail if app is targeting M or above.
@@ -4034,7 +4592,7 @@ bool soinfo::link_image(const soinfo_list_t& global_group, const soinfo_list_t&
           version_tracker,
           packed_reloc_iterator<sleb128_decoder>(
             sleb128_decoder(packed_relocs, packed_relocs_size)),
-          global_group, local_group);
+          global_group, local_group, &lookup_cache);
 
       if (!relocated) {
         return false;
@@ -4056,14 +4614,16 @@ bool soinfo::link_image(const soinfo_list_t& global_group, const soinfo_list_t&
   if (rela_ != nullptr) {
     DEBUG("[ relocating %s rela ]", get_realpath());
     if (!relocate(version_tracker,
-            plain_reloc_iterator(rela_, rela_count_), global_group, local_group)) {
+            plain_reloc_iterator(rela_, rela_count_), global_group, local_group,
+            &lookup_cache)) {
       return false;
     }
   }
   if (plt_rela_ != nullptr) {
     DEBUG("[ relocating %s plt rela ]", get_realpath());
     if (!relocate(version_tracker,
-            plain_reloc_iterator(plt_rela_, plt_rela_count_), global_group, local_group)) {
+            plain_reloc_iterator(plt_rela_, plt_rela_count_), global_group, local_group,
+            &lookup_cache)) {
       return false;
     }
   }
@@ -4071,14 +4631,16 @@ bool soinfo::link_image(const soinfo_list_t& global_group, const soinfo_list_t&
   if (rel_ != nullptr) {
     DEBUG("[ relocating %s rel ]", get_realpath());
     if (!relocate(version_tracker,
-            plain_reloc_iterator(rel_, rel_count_), global_group, local_group)) {
+            plain_reloc_iterator(rel_, rel_count_), global_group, local_group,
+            &lookup_cache)) {
       return false;
     }
   }
   if (plt_rel_ != nullptr) {
     DEBUG("[ relocating %s plt rel ]", get_realpath());
     if (!relocate(version_tracker,
-            plain_reloc_iterator(plt_rel_, plt_rel_count_), global_group, local_group)) {
+            plain_reloc_iterator(plt_rel_, plt_rel_count_), global_group, local_group,
+            &lookup_cache)) {
       return false;
     }
   }
@@ -4090,6 +4652,15 @@ bool soinfo::link_image(const soinfo_list_t& global_group, const soinfo_list_t&
   }
 #endif
 
+  lookup_cache.save_record();
+
+  if (lookup_cache.hits() != 0 || lookup_cache.recorded() != 0) {
+    INFO("[ \"%s\": %zu symbols resolved for %zu relocations, %zu lookups saved, "
+         "%zu bound from the relocation cache ]",
+         get_realpath(), lookup_cache.lookups(), lookup_cache.lookups() + lookup_cache.hits(),
+         lookup_cache.hits(), lookup_cache.recorded());
+  }
+
   DEBUG("[ finished linking %s ]", get_realpath());
 
 #if !defined(__LP64__)
@@ -4132,6 +4703,7 @@ bool soinfo::link_image(const soinfo_list_t& global_group, const soinfo_list_t&
 }
 
 bool soinfo::protect_relro() {
+  LinkerProfileScope profile("protect_relro", get_realpath());
   if (phdr_table_protect_gnu_relro(phdr, phnum, load_bias) < 0) {
     DL_ERR("can't enable GNU RELRO protection for \"%s\": %s",
            get_realpath(), strerror(errno));
@@ -47,6 +47,7 @@ typedef Elf64_Xword Elf64_Relr;
 #include "linker_logger.h"
 #include "linker_soinfo.h"
 
+#include <atomic>
 #include <string>
 #include <vector>
 
@@ -107,6 +108,10 @@ void count_relocation(RelocationKind kind);
 soinfo* get_libdl_info(const char* linker_path, const soinfo& linker_si);
 
 soinfo* find_containing_library(const void* p);
+// Keep find_containing_library() up to date, once the segments of si are
+// mapped and before they are unmapped.
+void soinfo_index_add(soinfo* si);
+void soinfo_index_remove(soinfo* si);
 
 int open_executable(const char* path, off64_t* file_offset, std::string* realpath);
 
@@ -121,6 +126,11 @@ int do_dlclose(void* handle);
 
 int do_dl_iterate_phdr(int (*cb)(dl_phdr_info* info, size_t size, void* data), void* data);
 
+// The number of threads which gave their read lock up to write, libraries
+// are only unmapped once it is 0 again: release_deferred_soinfos().
+extern std::atomic<size_t> g_suspended_readers;
+void release_deferred_soinfos();
+
 #if defined(__arm__)
 _Unwind_Ptr do_dl_unwind_find_exidx(_Unwind_Ptr pc, int* pcount);
 #endif
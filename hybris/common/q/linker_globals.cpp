@@ -39,7 +39,8 @@ char** g_envp = nullptr;
 
 std::unordered_map<uintptr_t, soinfo*> g_soinfo_handles_map;
 
-static char __linker_dl_err_buf[768];
+// Per thread, lookups run concurrently and each reports its own error.
+static __thread char __linker_dl_err_buf[768];
 
 char* linker_get_error_buffer() {
   return &__linker_dl_err_buf[0];
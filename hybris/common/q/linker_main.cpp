@@ -39,7 +39,10 @@
 #include "linker_cfi.h"
 #include "linker_gdb_support.h"
 #include "linker_globals.h"
+#include "linker_parallel.h"
 #include "linker_phdr.h"
+#include "linker_profile.h"
+#include "linker_reloc_cache.h"
 #include "linker_tls.h"
 #include "linker_utils.h"
 
@@ -179,6 +182,7 @@ static void add_vdso() {
   si->base = reinterpret_cast<ElfW(Addr)>(ehdr_vdso);
   si->size = phdr_table_get_load_size(si->phdr, si->phnum);
   si->load_bias = get_elf_exec_load_bias(ehdr_vdso);
+  soinfo_index_add(si);
 
   si->prelink_image();
   si->link_image(g_empty_list, soinfo_list_t::make_list(si), nullptr, nullptr);
@@ -382,6 +386,7 @@ static ElfW(Addr) linker_main(KernelArgumentBlock& args, const char* exe_to_load
   si->phnum = exe_info.phdr_count;
   get_elf_base_from_phdr(si->phdr, si->phnum, &si->base, &si->load_bias);
   si->size = phdr_table_get_load_size(si->phdr, si->phnum);
+  soinfo_index_add(si);
   si->dynamic = nullptr;
   si->set_main_executable();
   init_link_map_head(*si, exe_path.c_str());
@@ -795,6 +800,18 @@ extern "C" void android_linker_init(int sdk_version, void* (*get_hooked_symbol)(
     g_ld_debug_verbosity = atoi(LD_DEBUG);
   }
 
+  if (!getauxval(AT_SECURE)) {
+    linker_profile_init(getenv("HYBRIS_LD_PROFILE"));
+  }
+
+  if (!getauxval(AT_SECURE)) {
+    linker_parallel_init(getenv("HYBRIS_LD_PARALLEL"));
+  }
+
+  if (!getauxval(AT_SECURE)) {
+    linker_reloc_cache_init(getenv("HYBRIS_LD_RELOC_CACHE"));
+  }
+
   const char* ldpath_env = nullptr;
   const char* ldpreload_env = nullptr;
   if (!getauxval(AT_SECURE)) {
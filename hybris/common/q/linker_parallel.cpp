@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2026 libhybris contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "linker_parallel.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "linker_debug.h"
+#include "linker_globals.h"
+
+// There is little point in more threads than this for a single dlopen().
+static constexpr size_t kMaxParallelThreads = 32;
+
+size_t g_ld_parallel_threads = 0;
+
+void linker_parallel_init(const char* value) {
+  if (value == nullptr || *value == '\0') {
+    return;
+  }
+
+  long threads = strtol(value, nullptr, 10);
+  if (threads <= 1) {
+    g_ld_parallel_threads = 0;
+    return;
+  }
+
+  g_ld_parallel_threads = threads > static_cast<long>(kMaxParallelThreads) ?
+                          kMaxParallelThreads : static_cast<size_t>(threads);
+  INFO("parallel loading enabled with %zu threads", g_ld_parallel_threads);
+}
+
+struct ParallelThread {
+  pthread_t thread;
+  const std::function<void()>* worker;
+  std::string error;
+};
+
+static void* parallel_worker(void* arg) {
+  ParallelThread* self = static_cast<ParallelThread*>(arg);
+  (*self->worker)();
+  // The error buffer is per thread, and this one starts out empty.
+  self->error = linker_get_error_buffer();
+  return nullptr;
+}
+
+void linker_parallel_run(size_t thread_count, const std::function<void()>& worker) {
+  std::vector<ParallelThread> threads;
+
+  // Not to be reallocated while the threads use their entries.
+  threads.reserve(thread_count);
+  for (size_t i = 1; i < thread_count; ++i) {
+    threads.push_back({ 0, &worker, std::string() });
+    int error = pthread_create(&threads.back().thread, nullptr, parallel_worker, &threads.back());
+    if (error != 0) {
+      // The work is shared through the worker, fewer threads just take longer.
+      TRACE("couldn't start a linker thread: %s", strerror(error));
+      threads.pop_back();
+      break;
+    }
+  }
+
+  worker();
+
+  for (ParallelThread& thread : threads) {
+    pthread_join(thread.thread, nullptr);
+  }
+
+  for (const ParallelThread& thread : threads) {
+    if (!thread.error.empty()) {
+      strlcpy(linker_get_error_buffer(), thread.error.c_str(), linker_get_error_buffer_size());
+      break;
+    }
+  }
+}
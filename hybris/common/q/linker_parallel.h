@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2026 libhybris contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+
+#include <functional>
+
+// Opt-in parallel loading, enabled by setting the HYBRIS_LD_PARALLEL
+// environment variable to the number of threads to use. When enabled,
+// find_libraries() maps the segments of the libraries of one dlopen() and
+// relocates independent libraries of a local group on that many threads.
+// The callback registered with hybris_set_hook_callback() is still called
+// by one thread at a time.
+
+extern size_t g_ld_parallel_threads;
+
+void linker_parallel_init(const char* value);
+
+// Runs worker on thread_count threads, one of them being the calling
+// thread, and returns once all of them have returned. The threads are
+// started for each call, so that there are no idle threads left behind
+// (and nothing to take care of across fork()) when the linker is done.
+// Errors reported on the other threads end up in the error buffer of the
+// calling thread.
+void linker_parallel_run(size_t thread_count, const std::function<void()>& worker);
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2026 libhybris contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "linker_profile.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "linker_debug.h"
+
+bool g_linker_profile_enabled = false;
+
+namespace {
+
+struct ProfileEvent {
+  const char* phase;
+  std::string library;
+  pid_t tid;
+  uint64_t start_ns;
+  uint64_t duration_ns;
+  uint64_t symbols[kProfileSymbolKindCount];
+  uint64_t symbol_ns[kProfileSymbolKindCount];
+};
+
+std::string g_profile_path;
+std::vector<ProfileEvent>* g_profile_events;
+pthread_mutex_t g_profile_mutex = PTHREAD_MUTEX_INITIALIZER;
+uint64_t g_profile_start_ns;
+
+// Totals of the symbol resolutions of this thread, scopes report the
+// difference between their start and end.
+__thread uint64_t t_symbols[kProfileSymbolKindCount];
+__thread uint64_t t_symbol_ns[kProfileSymbolKindCount];
+
+void write_json_string(FILE* f, const char* s) {
+  fputc('"', f);
+  for (; *s != '\0'; s++) {
+    if (*s == '"' || *s == '\\') {
+      fprintf(f, "\\%c", *s);
+    } else if (static_cast<unsigned char>(*s) < 0x20) {
+      fprintf(f, "\\u%04x", *s);
+    } else {
+      fputc(*s, f);
+    }
+  }
+  fputc('"', f);
+}
+
+void write_profile() {
+  FILE* f = fopen(g_profile_path.c_str(), "we");
+  if (f == nullptr) {
+    PRINT("linker profile: can't write \"%s\": %s", g_profile_path.c_str(), strerror(errno));
+    return;
+  }
+
+  pthread_mutex_lock(&g_profile_mutex);
+
+  fprintf(f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+  bool first = true;
+  for (const ProfileEvent& event : *g_profile_events) {
+    fprintf(f, "%s{\"ph\":\"X\",\"cat\":\"linker\",\"name\":\"%s\",\"pid\":%d,\"tid\":%d,"
+            "\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"library\":",
+            first ? "" : ",\n", event.phase, getpid(), event.tid,
+            (event.start_ns - g_profile_start_ns) / 1000.0, event.duration_ns / 1000.0);
+    write_json_string(f, event.library.c_str());
+    if (event.symbols[kProfileSymbolHooked] != 0 || event.symbols[kProfileSymbolBionic] != 0) {
+      fprintf(f, ",\"hooked_symbols\":%llu,\"hooked_lookup_us\":%.3f"
+              ",\"bionic_symbols\":%llu,\"bionic_lookup_us\":%.3f",
+              static_cast<unsigned long long>(event.symbols[kProfileSymbolHooked]),
+              event.symbol_ns[kProfileSymbolHooked] / 1000.0,
+              static_cast<unsigned long long>(event.symbols[kProfileSymbolBionic]),
+              event.symbol_ns[kProfileSymbolBionic] / 1000.0);
+    }
+    fprintf(f, "}}");
+    first = false;
+  }
+  fprintf(f, "\n]}\n");
+
+  pthread_mutex_unlock(&g_profile_mutex);
+
+  fclose(f);
+  INFO("linker profile: wrote %zu events to \"%s\"", g_profile_events->size(),
+       g_profile_path.c_str());
+}
+
+}  // namespace
+
+uint64_t linker_profile_now() {
+  timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+void linker_profile_init(const char* path) {
+  if (path == nullptr || *path == '\0' || g_linker_profile_enabled) {
+    return;
+  }
+
+  g_profile_path = path;
+  g_profile_events = new std::vector<ProfileEvent>();
+  g_profile_events->reserve(1024);
+  g_profile_start_ns = linker_profile_now();
+  g_linker_profile_enabled = true;
+  atexit(write_profile);
+}
+
+void linker_profile_count_symbol(LinkerProfileSymbolKind kind, uint64_t duration_ns) {
+  t_symbols[kind]++;
+  t_symbol_ns[kind] += duration_ns;
+}
+
+void LinkerProfileScope::Begin(const char* phase, const char* library) {
+  phase_ = phase;
+  library_ = library != nullptr ? library : "";
+  for (int i = 0; i < kProfileSymbolKindCount; i++) {
+    symbols_[i] = t_symbols[i];
+    symbol_ns_[i] = t_symbol_ns[i];
+  }
+  start_ns_ = linker_profile_now();
+}
+
+void LinkerProfileScope::End() {
+  ProfileEvent event;
+
+  event.duration_ns = linker_profile_now() - start_ns_;
+  event.phase = phase_;
+  event.library = library_;
+  event.tid = static_cast<pid_t>(syscall(SYS_gettid));
+  event.start_ns = start_ns_;
+  for (int i = 0; i < kProfileSymbolKindCount; i++) {
+    event.symbols[i] = t_symbols[i] - symbols_[i];
+    event.symbol_ns[i] = t_symbol_ns[i] - symbol_ns_[i];
+  }
+
+  pthread_mutex_lock(&g_profile_mutex);
+  g_profile_events->push_back(event);
+  pthread_mutex_unlock(&g_profile_mutex);
+}
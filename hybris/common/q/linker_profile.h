@@ -0,0 +1,83 @@
+/*
+ * Copyright (C) 2026 libhybris contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stdint.h>
+
+class soinfo;
+
+// Profiling of library loading, enabled by pointing the HYBRIS_LD_PROFILE
+// environment variable to a file. The time spent in each loading phase is
+// recorded per library and written there in the Chrome trace event format
+// (load it in chrome://tracing or https://ui.perfetto.dev) when the process
+// exits.
+
+extern bool g_linker_profile_enabled;
+
+enum LinkerProfileSymbolKind {
+  kProfileSymbolHooked = 0,  // resolved by the libhybris hooks
+  kProfileSymbolBionic,      // resolved by a lookup in the loaded libraries
+  kProfileSymbolKindCount
+};
+
+void linker_profile_init(const char* path);
+uint64_t linker_profile_now();
+void linker_profile_count_symbol(LinkerProfileSymbolKind kind, uint64_t duration_ns);
+
+// Records the duration of a phase for a library. Phases can nest; the
+// symbol resolutions counted while a phase is active are reported with it.
+class LinkerProfileScope {
+ public:
+  LinkerProfileScope(const char* phase, const char* library) {
+    if (__builtin_expect(g_linker_profile_enabled, 0)) {
+      Begin(phase, library);
+    } else {
+      phase_ = nullptr;
+    }
+  }
+
+  ~LinkerProfileScope() {
+    if (phase_ != nullptr) {
+      End();
+    }
+  }
+
+ private:
+  void Begin(const char* phase, const char* library);
+  void End();
+
+  const char* phase_;
+  const char* library_;
+  uint64_t start_ns_;
+  uint64_t symbols_[kProfileSymbolKindCount];
+  uint64_t symbol_ns_[kProfileSymbolKindCount];
+
+  LinkerProfileScope(const LinkerProfileScope&) = delete;
+  void operator=(const LinkerProfileScope&) = delete;
+};
@@ -0,0 +1,291 @@
+/*
+ * Copyright (C) 2026 libhybris contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#include "linker_reloc_cache.h"
+
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "linker.h"
+#include "linker_debug.h"
+#include "linker_soinfo.h"
+
+bool g_ld_reloc_cache_enabled = false;
+
+namespace {
+
+// Changes whenever the format or the meaning of the bindings do.
+constexpr uint32_t kRecordMagic = 0x43524c48;  // "HLRC"
+constexpr uint32_t kRecordVersion = 2;
+
+// A record file is the header, the realpath of the library and the bindings.
+struct RecordHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t fingerprint;
+  uint64_t checksum;      // of the bindings
+  uint32_t binding_count;
+  uint32_t path_length;
+};
+
+std::string g_cache_dir;
+
+class Fnv1a {
+ public:
+  Fnv1a() : hash_(0xcbf29ce484222325ULL) {}
+
+  void add(const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+      hash_ = (hash_ ^ bytes[i]) * 0x100000001b3ULL;
+    }
+  }
+
+  void add(uint64_t value) {
+    add(&value, sizeof(value));
+  }
+
+  uint64_t get() const { return hash_; }
+
+ private:
+  uint64_t hash_;
+};
+
+// Whether [addr, addr + size) of si is mapped from its file
+bool is_loaded(const soinfo* si, ElfW(Addr) addr, ElfW(Addr) size) {
+  for (size_t i = 0; i < si->phnum; ++i) {
+    const ElfW(Phdr)& phdr = si->phdr[i];
+    if (phdr.p_type == PT_LOAD && addr >= phdr.p_vaddr &&
+        addr + size <= phdr.p_vaddr + phdr.p_filesz) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool add_build_id(Fnv1a* hash, const soinfo* si) {
+  for (size_t i = 0; i < si->phnum; ++i) {
+    const ElfW(Phdr)& phdr = si->phdr[i];
+    if (phdr.p_type != PT_NOTE || !is_loaded(si, phdr.p_vaddr, phdr.p_memsz)) {
+      continue;
+    }
+
+    const char* note = reinterpret_cast<const char*>(si->load_bias + phdr.p_vaddr);
+    const char* end = note + phdr.p_memsz;
+    while (end - note >= static_cast<ptrdiff_t>(sizeof(ElfW(Nhdr)))) {
+      const ElfW(Nhdr)* nhdr = reinterpret_cast<const ElfW(Nhdr)*>(note);
+      const char* name = note + sizeof(ElfW(Nhdr));
+      const char* desc = name + ((nhdr->n_namesz + 3) & ~3);
+      const char* next = desc + ((nhdr->n_descsz + 3) & ~3);
+      if (next > end || next < desc) {
+        break;
+      }
+      if (nhdr->n_type == NT_GNU_BUILD_ID && nhdr->n_namesz == 4 &&
+          memcmp(name, "GNU", 4) == 0) {
+        hash->add(desc, nhdr->n_descsz);
+        return true;
+      }
+      note = next;
+    }
+  }
+  return false;
+}
+
+void add_file_identity(Fnv1a* hash, const soinfo* si) {
+  // Size and mtime don't tell builds apart which fix timestamps, the
+  // build id or else the dynamic symbols do
+  if (!add_build_id(hash, si)) {
+    hash->add(si->get_symbol(0), si->get_symbol_count() * sizeof(ElfW(Sym)));
+  }
+  hash->add(si->get_st_dev());
+  hash->add(si->get_st_ino());
+  hash->add(si->get_st_size());
+  hash->add(si->get_st_mtime_ns());
+  hash->add(si->get_file_offset());
+  if (si->get_st_dev() == 0 && si->get_st_ino() == 0) {
+    // Not loaded from a file: the vdso, the executable
+    hash->add(si->get_realpath(), strlen(si->get_realpath()));
+  }
+}
+
+// Records steer symbol binding, so only those nobody else could have
+// written are trusted.
+bool is_private(const struct stat& st) {
+  return st.st_uid == geteuid() && (st.st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+bool read_fully(int fd, void* data, size_t size) {
+  return TEMP_FAILURE_RETRY(read(fd, data, size)) == static_cast<ssize_t>(size);
+}
+
+bool write_fully(int fd, const void* data, size_t size) {
+  return TEMP_FAILURE_RETRY(write(fd, data, size)) == static_cast<ssize_t>(size);
+}
+
+}  // namespace
+
+void linker_reloc_cache_init(const char* dir) {
+  if (dir == nullptr || *dir == '\0') {
+    return;
+  }
+
+  struct stat dir_stat;
+  if (stat(dir, &dir_stat) != 0 || !S_ISDIR(dir_stat.st_mode) || !is_private(dir_stat)) {
+    INFO("relocation cache disabled: \"%s\" is not a directory only writable by this user", dir);
+    return;
+  }
+
+  g_cache_dir = dir;
+  g_ld_reloc_cache_enabled = true;
+  INFO("relocation cache enabled in \"%s\"", dir);
+}
+
+void RelocCacheRecord::load(const soinfo* si, const std::vector<soinfo*>& scope) {
+  Fnv1a fingerprint;
+  fingerprint.add(kRecordVersion);
+  fingerprint.add(sizeof(ElfW(Addr)));
+  fingerprint.add(static_cast<uint64_t>(get_application_target_sdk_version()));
+  add_file_identity(&fingerprint, si);
+  fingerprint.add(scope.size());
+  for (const soinfo* lib : scope) {
+    add_file_identity(&fingerprint, lib);
+  }
+  fingerprint_ = fingerprint.get();
+
+  realpath_ = si->get_realpath();
+
+  Fnv1a name;
+  name.add(realpath_.data(), realpath_.size());
+  char file_name[32];
+  snprintf(file_name, sizeof(file_name), "/%016llx.reloc",
+           static_cast<unsigned long long>(name.get()));
+  path_ = g_cache_dir + file_name;
+
+  int fd = TEMP_FAILURE_RETRY(open(path_.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC));
+  if (fd == -1) {
+    return;
+  }
+
+  RecordHeader header;
+  struct stat file_stat;
+  std::string path;
+  std::vector<Binding> bindings;
+  bool valid = fstat(fd, &file_stat) == 0 &&
+               S_ISREG(file_stat.st_mode) &&
+               is_private(file_stat) &&
+               read_fully(fd, &header, sizeof(header)) &&
+               header.magic == kRecordMagic &&
+               header.version == kRecordVersion &&
+               header.path_length == realpath_.size() &&
+               static_cast<uint64_t>(file_stat.st_size) ==
+                   sizeof(header) + header.path_length +
+                   static_cast<uint64_t>(header.binding_count) * sizeof(Binding);
+  if (valid) {
+    path.resize(header.path_length);
+    bindings.resize(header.binding_count);
+    valid = read_fully(fd, &path[0], path.size()) &&
+            read_fully(fd, bindings.data(), bindings.size() * sizeof(Binding));
+  }
+  close(fd);
+
+  if (!valid || path != realpath_) {
+    DEBUG("relocation cache: ignoring \"%s\" for \"%s\"", path_.c_str(), realpath_.c_str());
+    return;
+  }
+
+  if (header.fingerprint != fingerprint_) {
+    DEBUG("relocation cache: \"%s\" or its dependencies changed", realpath_.c_str());
+    return;
+  }
+
+  Fnv1a checksum;
+  checksum.add(bindings.data(), bindings.size() * sizeof(Binding));
+  if (checksum.get() != header.checksum) {
+    DEBUG("relocation cache: \"%s\" is corrupt", path_.c_str());
+    return;
+  }
+
+  bindings_.swap(bindings);
+}
+
+void RelocCacheRecord::add(uint32_t sym, uint32_t library, uint32_t symbol) {
+  if (sym >= bindings_.size()) {
+    bindings_.resize(sym + 1, Binding { kUnknown, 0 });
+  }
+  bindings_[sym].library = library;
+  bindings_[sym].symbol = symbol;
+  dirty_ = true;
+}
+
+void RelocCacheRecord::save() {
+  if (!dirty_) {
+    return;
+  }
+
+  RecordHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kRecordMagic;
+  header.version = kRecordVersion;
+  header.fingerprint = fingerprint_;
+  header.binding_count = bindings_.size();
+  header.path_length = realpath_.size();
+
+  Fnv1a checksum;
+  checksum.add(bindings_.data(), bindings_.size() * sizeof(Binding));
+  header.checksum = checksum.get();
+
+  // Other processes may be writing the same record, the last rename() wins.
+  std::string tmp_path = path_ + "." + std::to_string(syscall(__NR_gettid));
+  int fd = TEMP_FAILURE_RETRY(open(tmp_path.c_str(),
+                                   O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC,
+                                   0600));
+  if (fd == -1) {
+    DEBUG("relocation cache: can't write \"%s\": %s", tmp_path.c_str(), strerror(errno));
+    return;
+  }
+
+  bool written = write_fully(fd, &header, sizeof(header)) &&
+                 write_fully(fd, realpath_.data(), realpath_.size()) &&
+                 write_fully(fd, bindings_.data(), bindings_.size() * sizeof(Binding));
+  close(fd);
+
+  if (!written || rename(tmp_path.c_str(), path_.c_str()) != 0) {
+    DEBUG("relocation cache: can't write \"%s\": %s", path_.c_str(), strerror(errno));
+    unlink(tmp_path.c_str());
+    return;
+  }
+
+  dirty_ = false;
+  DEBUG("relocation cache: wrote %zu bindings of \"%s\"", bindings_.size(), realpath_.c_str());
+}
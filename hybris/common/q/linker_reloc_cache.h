@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2026 libhybris contributors
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions
+ * are met:
+ *  * Redistributions of source code must retain the above copyright
+ *    notice, this list of conditions and the following disclaimer.
+ *  * Redistributions in binary form must reproduce the above copyright
+ *    notice, this list of conditions and the following disclaimer in
+ *    the documentation and/or other materials provided with the
+ *    distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS
+ * FOR A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE
+ * COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT,
+ * INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING,
+ * BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS
+ * OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED
+ * AND ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY,
+ * OR TORT (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT
+ * OF THE USE OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF
+ * SUCH DAMAGE.
+ */
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+class soinfo;
+
+// Opt-in persistent relocation cache, enabled by pointing the
+// HYBRIS_LD_RELOC_CACHE environment variable to a directory owned by the
+// user and writable by nobody else; records written by others are ignored.
+// The cache is off for set-user-ID and set-group-ID programs.
+// Relocating a library records where each of its imported symbols was
+// found: the index of the library in its lookup scope and the index of the
+// symbol there. The next process loading the library binds the symbols from
+// the record instead of looking them up, like prelink does, but without
+// fixing load addresses.
+//
+// A record is used only if the library, every library of its lookup scope
+// (in the same order) and the target SDK version are the same as when it
+// was written; the files are compared by device, inode, size and mtime, and
+// by build id, or their dynamic symbols if they have none. Otherwise the
+// library is relocated as usual and the record written again. A recorded
+// binding is still only used if the symbol it points to is defined and has
+// the name of the import.
+// Symbol hooks are asked first either way, as hybris_set_hook_callback()
+// lets their answers change from one process to the next.
+
+extern bool g_ld_reloc_cache_enabled;
+
+void linker_reloc_cache_init(const char* dir);
+
+// The bindings of one library, by symbol index.
+class RelocCacheRecord {
+ public:
+  struct Binding {
+    uint32_t library;  // index in the lookup scope, or kUnknown
+    uint32_t symbol;   // index in the symbol table of that library
+  };
+
+  static constexpr uint32_t kUnknown = 0xffffffff;  // not recorded
+
+  RelocCacheRecord() : fingerprint_(0), dirty_(false) {}
+
+  // Reads the record of si, keeping its bindings if it was written for the
+  // same files as the ones of si and scope.
+  void load(const soinfo* si, const std::vector<soinfo*>& scope);
+
+  // Returns nullptr if the symbol isn't recorded.
+  const Binding* find(uint32_t sym) const {
+    if (sym >= bindings_.size() || bindings_[sym].library == kUnknown) {
+      return nullptr;
+    }
+    return &bindings_[sym];
+  }
+
+  void add(uint32_t sym, uint32_t library, uint32_t symbol);
+
+  // Writes the record if bindings were added.
+  void save();
+
+ private:
+  std::string path_;
+  std::string realpath_;
+  uint64_t fingerprint_;
+  std::vector<Binding> bindings_;
+  bool dirty_;
+
+  RelocCacheRecord(const RelocCacheRecord&) = delete;
+  void operator=(const RelocCacheRecord&) = delete;
+};
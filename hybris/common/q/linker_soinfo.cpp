@@ -41,6 +41,7 @@
 #include "linker_debug.h"
 #include "linker_globals.h"
 #include "linker_logger.h"
+#include "linker_profile.h"
 #include "linker_utils.h"
 
 #include "hybris_compat.h"
@@ -70,10 +71,15 @@ soinfo::soinfo(android_namespace_t* ns, const char* realpath,
     this->st_dev_ = file_stat->st_dev;
     this->st_ino_ = file_stat->st_ino;
     this->file_offset_ = file_offset;
+    this->st_size_ = file_stat->st_size;
+    this->st_mtime_ns_ = static_cast<int64_t>(file_stat->st_mtim.tv_sec) * 1000000000 +
+                         file_stat->st_mtim.tv_nsec;
   } else {
     st_dev_ = 0;
     st_ino_ = 0;
     file_offset_ = 0;
+    st_size_ = 0;
+    st_mtime_ns_ = 0;
   }
 
   this->rtld_flags_ = rtld_flags;
@@ -223,11 +229,6 @@ bool soinfo::gnu_lookup(SymbolName& symbol_name,
                         const version_info* vi,
                         uint32_t* symbol_index) const {
   uint32_t hash = symbol_name.gnu_hash();
-  uint32_t h2 = hash >> gnu_shift2_;
-
-  uint32_t bloom_mask_bits = sizeof(ElfW(Addr))*8;
-  uint32_t word_num = (hash / bloom_mask_bits) & gnu_maskwords_;
-  ElfW(Addr) bloom_word = gnu_bloom_filter_[word_num];
 
   *symbol_index = 0;
 
@@ -235,7 +236,7 @@ bool soinfo::gnu_lookup(SymbolName& symbol_name,
       symbol_name.get_name(), get_realpath(), reinterpret_cast<void*>(base));
 
   // test against bloom filter
-  if ((1 & (bloom_word >> (hash % bloom_mask_bits)) & (bloom_word >> (h2 % bloom_mask_bits))) == 0) {
+  if (!get_gnu_bloom_filter().may_contain(hash)) {
     TRACE_TYPE(LOOKUP, "NOT FOUND %s in %s@%p",
         symbol_name.get_name(), get_realpath(), reinterpret_cast<void*>(base));
 
@@ -482,9 +483,13 @@ void soinfo::call_constructors() {
     bionic_trace_begin((std::string("calling constructors: ") + get_realpath()).c_str());
   }
 
-  // DT_INIT should be called before DT_INIT_ARRAY if both are present.
-  call_function("DT_INIT", init_func_, get_realpath());
-  call_array("DT_INIT_ARRAY", init_array_, init_array_count_, false, get_realpath());
+  {
+    LinkerProfileScope profile("constructors", get_realpath());
+
+    // DT_INIT should be called before DT_INIT_ARRAY if both are present.
+    call_function("DT_INIT", init_func_, get_realpath());
+    call_array("DT_INIT_ARRAY", init_array_, init_array_count_, false, get_realpath());
+  }
 
   if (!is_linker()) {
     bionic_trace_end();
@@ -562,6 +567,14 @@ ino_t soinfo::get_st_ino() const {
   return 0;
 }
 
+off64_t soinfo::get_st_size() const {
+  return st_size_;
+}
+
+int64_t soinfo::get_st_mtime_ns() const {
+  return st_mtime_ns_;
+}
+
 off64_t soinfo::get_file_offset() const {
   if (has_min_version(1)) {
     return file_offset_;
@@ -716,10 +729,42 @@ const char* soinfo::get_string(ElfW(Word) index) const {
   return strtab_ + index;
 }
 
+uint32_t soinfo::get_symbol_count() const {
+  if (!is_gnu_hash()) {
+    return nchain_;
+  }
+
+  // The chain of the highest bucket ends with the last symbol
+  uint32_t last = 0;
+  for (size_t i = 0; i < gnu_nbucket_; ++i) {
+    if (gnu_bucket_[i] > last) {
+      last = gnu_bucket_[i];
+    }
+  }
+  if (last == 0) {
+    return 0;
+  }
+
+  while ((gnu_chain_[last] & 1) == 0) {
+    ++last;
+  }
+  return last + 1;
+}
+
 bool soinfo::is_gnu_hash() const {
   return (flags_ & FLAG_GNU_HASH) != 0;
 }
 
+GnuBloomFilter soinfo::get_gnu_bloom_filter() const {
+  static const ElfW(Addr) kAllBits = ~static_cast<ElfW(Addr)>(0);
+
+  if (!is_gnu_hash()) {
+    return GnuBloomFilter { &kAllBits, 0, 0 };
+  }
+
+  return GnuBloomFilter { gnu_bloom_filter_, gnu_maskwords_, gnu_shift2_ };
+}
+
 bool soinfo::can_unload() const {
   return !is_linked() ||
          (
@@ -868,6 +913,13 @@ uint32_t SymbolName::gnu_hash() {
   if (!has_gnu_hash_) {
     uint32_t h = 5381;
     const uint8_t* name = reinterpret_cast<const uint8_t*>(name_);
+    // Four characters at a time: h*33^4 + c0*33^3 + c1*33^2 + c2*33 + c3,
+    // so that the multiplications of the characters don't wait for h.
+    while (name[0] != 0 && name[1] != 0 && name[2] != 0 && name[3] != 0) {
+      h = h * (33 * 33 * 33 * 33) +
+          name[0] * (33 * 33 * 33) + name[1] * (33 * 33) + name[2] * 33 + name[3];
+      name += 4;
+    }
     while (*name != 0) {
       h += (h << 5) + *name++; // h*33 + c = h + h * 32 + c = h + h << 5 + c
     }
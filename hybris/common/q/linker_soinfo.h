@@ -93,6 +93,20 @@ class SymbolName {
   DISALLOW_IMPLICIT_CONSTRUCTORS(SymbolName);
 };
 
+// The gnu hash bloom filter of a library. Lookups across a group test the
+// filters of all its libraries, see SymbolLookupScope in linker.cpp.
+struct GnuBloomFilter {
+  const ElfW(Addr)* words;
+  uint32_t maskwords;  // the number of words - 1
+  uint32_t shift2;
+
+  bool may_contain(uint32_t hash) const {
+    const uint32_t bits = sizeof(ElfW(Addr)) * 8;
+    ElfW(Addr) word = words[(hash / bits) & maskwords];
+    return (1 & (word >> (hash % bits)) & (word >> ((hash >> shift2) % bits))) != 0;
+  }
+};
+
 struct version_info {
   constexpr version_info() : elf_hash(0), name(nullptr), target_si(nullptr) {}
 
@@ -103,6 +117,7 @@ struct version_info {
 
 // TODO(dimitry): remove reference from soinfo member functions to this class.
 class VersionTracker;
+class SymbolLookupCache;
 
 struct soinfo_tls {
   TlsSegment segment;
@@ -231,6 +246,8 @@ struct soinfo {
 
   ino_t get_st_ino() const;
   dev_t get_st_dev() const;
+  off64_t get_st_size() const;
+  int64_t get_st_mtime_ns() const;
   off64_t get_file_offset() const;
 
   uint32_t get_rtld_flags() const;
@@ -247,11 +264,19 @@ struct soinfo {
                            const ElfW(Sym)** symbol) const;
 
   ElfW(Sym)* find_symbol_by_address(const void* addr);
+
+  // The relocation cache records symbols by their index
+  const ElfW(Sym)* get_symbol(uint32_t index) const { return symtab_ + index; }
+  uint32_t get_symbol_index(const ElfW(Sym)* s) const { return s - symtab_; }
+  // One past the highest symbol index the hash table knows of
+  uint32_t get_symbol_count() const;
   ElfW(Addr) resolve_symbol_address(const ElfW(Sym)* s) const;
 
   const char* get_string(ElfW(Word) index) const;
   bool can_unload() const;
   bool is_gnu_hash() const;
+  // Libraries without a gnu hash get a filter which contains every symbol
+  GnuBloomFilter get_gnu_bloom_filter() const;
 
   bool inline has_min_version(uint32_t min_version) const {
 #if defined(__work_around_b_24465209__)
@@ -316,7 +341,8 @@ struct soinfo {
 
   template<typename ElfRelIteratorT>
   bool relocate(const VersionTracker& version_tracker, ElfRelIteratorT&& rel_iterator,
-                const soinfo_list_t& global_group, const soinfo_list_t& local_group);
+                const soinfo_list_t& global_group, const soinfo_list_t& local_group,
+                SymbolLookupCache* lookup_cache);
   bool relocate_relr();
   void apply_relr_reloc(ElfW(Addr) offset);
 
@@ -381,6 +407,10 @@ struct soinfo {
   // version >= 5
   std::unique_ptr<soinfo_tls> tls_;
   std::vector<TlsDynamicResolverArg> tlsdesc_args_;
+
+  // hybris: the rest of the file identity, for the relocation cache
+  off64_t st_size_;
+  int64_t st_mtime_ns_;
 };
 
 // This function is used by dlvsym() to calculate hash of sym_ver
@@ -30,6 +30,7 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <malloc.h>
+#include <pthread.h>
 #include "ws.h"
 #include "helper.h"
 #include <assert.h>
@@ -105,10 +106,14 @@ static void * _android_egl_dlsym(const char *symbol)
 	return android_dlsym(egl_handle, symbol);
 }
 
+static void _releaseBufferImages(EGLClientBuffer buffer);
+static void _releaseDisplayImages(EGLDisplay dpy);
+
 struct ws_egl_interface hybris_egl_interface = {
 	_android_egl_dlsym,
 	egl_helper_has_mapping,
 	egl_helper_get_mapping,
+	_releaseBufferImages,
 };
 
 static __thread EGLint __eglHybrisError = EGL_SUCCESS;
@@ -141,51 +146,29 @@ EGLint eglGetError(void)
 	return androidError;
 }
 
-#define _EGL_MAX_DISPLAYS 100
-
-struct _EGLDisplay *_displayMappings[_EGL_MAX_DISPLAYS];
-
-void _addMapping(struct _EGLDisplay *display_id)
+struct _EGLDisplay *hybris_egl_display_get_mapping(EGLDisplay display)
 {
-	int i;
-	for (i = 0; i < _EGL_MAX_DISPLAYS; i++)
-	{
-		if (_displayMappings[i] == NULL)
-		{
-			_displayMappings[i] = display_id;
-			return;
-		}
-	}
+	return egl_helper_get_display_mapping(display);
 }
 
-struct _EGLDisplay *hybris_egl_display_get_mapping(EGLDisplay display)
+void hybris_egl_display_release_mappings(void)
 {
-	int i;
-	for (i = 0; i < _EGL_MAX_DISPLAYS; i++)
-	{
-		if (_displayMappings[i])
-		{
-			if (_displayMappings[i]->dpy == display)
-			{
-				return _displayMappings[i];
-			}
-
-		}
-	}
-	return EGL_NO_DISPLAY;
+	egl_helper_pop_display_mappings(ws_releaseDisplay);
 }
 
-void hybris_egl_display_release_mappings(void)
+struct _display_request {
+	EGLNativeDisplayType display_id;
+	EGLDisplay real_display;
+};
+
+static struct _EGLDisplay *_createDisplay(void *data)
 {
-	int i;
-	for (i = 0; i < _EGL_MAX_DISPLAYS; i++)
-	{
-		if (_displayMappings[i])
-		{
-			ws_releaseDisplay(_displayMappings[i]);
-			_displayMappings[i] = NULL;
-		}
-	}
+	struct _display_request *request = data;
+	struct _EGLDisplay *dpy = ws_GetDisplay(request->display_id);
+
+	if (dpy)
+		dpy->dpy = request->real_display;
+	return dpy;
 }
 
 static const char * _defaultEglPlatform()
@@ -259,14 +242,9 @@ EGLDisplay __eglHybrisGetPlatformDisplayCommon(EGLenum platform,
 		return EGL_NO_DISPLAY;
 	}
 
-	struct _EGLDisplay *dpy = hybris_egl_display_get_mapping(real_display);
-	if (!dpy) {
-		dpy = ws_GetDisplay(display_id);
-		if (!dpy) {
-			return EGL_NO_DISPLAY;
-		}
-		dpy->dpy = real_display;
-		_addMapping(dpy);
+	struct _display_request request = { display_id, real_display };
+	if (!egl_helper_get_or_push_display_mapping(real_display, _createDisplay, &request)) {
+		return EGL_NO_DISPLAY;
 	}
 
 	return real_display;
@@ -304,6 +282,7 @@ EGLBoolean eglTerminate(EGLDisplay dpy)
 	HYBRIS_DLSYSM(egl, &_eglTerminate, "eglTerminate");
 
 	struct _EGLDisplay *display = hybris_egl_display_get_mapping(dpy);
+	_releaseDisplayImages(dpy);
 	ws_Terminate(display);
 	return (*_eglTerminate)(dpy);
 }
@@ -382,6 +361,7 @@ HYBRIS_IMPLEMENT_FUNCTION4(egl, EGLSurface, eglCreatePixmapSurface, EGLDisplay,
 
 EGLBoolean eglDestroySurface(EGLDisplay dpy, EGLSurface surface)
 {
+	EGLNativeWindowType win;
 	HYBRIS_DLSYSM(egl, &_eglDestroySurface, "eglDestroySurface");
 	EGLBoolean result = (*_eglDestroySurface)(dpy, surface);
 
@@ -389,8 +369,9 @@ EGLBoolean eglDestroySurface(EGLDisplay dpy, EGLSurface surface)
          * If the surface was created via eglCreateWindowSurface, we must
          * notify the ws about surface destruction for clean-up.
 	 **/
-	if (egl_helper_has_mapping(surface)) {
-	    ws_DestroyWindow(egl_helper_pop_mapping(surface));
+	win = egl_helper_pop_mapping(surface);
+	if (win) {
+	    ws_DestroyWindow(win);
 	}
 
 	return result;
@@ -410,6 +391,7 @@ EGLBoolean eglSwapInterval(EGLDisplay dpy, EGLint interval)
 {
 	EGLBoolean ret;
 	EGLSurface surface;
+	EGLNativeWindowType win;
 	HYBRIS_TRACE_BEGIN("hybris-egl", "eglSwapInterval", "=%d", interval);
 
 	/* Some egl implementations don't pass through the setSwapInterval
@@ -418,8 +400,9 @@ EGLBoolean eglSwapInterval(EGLDisplay dpy, EGLint interval)
 	 * to chage it. */
 	HYBRIS_DLSYSM(egl, &_eglGetCurrentSurface, "eglGetCurrentSurface");
 	surface = (*_eglGetCurrentSurface)(EGL_DRAW);
-	if (egl_helper_has_mapping(surface))
-	    ws_setSwapInterval(dpy, egl_helper_get_mapping(surface), interval);
+	win = egl_helper_get_mapping(surface);
+	if (win)
+	    ws_setSwapInterval(dpy, win, interval);
 
 	HYBRIS_TRACE_BEGIN("native-egl", "eglSwapInterval", "=%d", interval);
 	HYBRIS_DLSYSM(egl, &_eglSwapInterval, "eglSwapInterval");
@@ -462,8 +445,8 @@ EGLBoolean _my_eglSwapBuffersWithDamageEXT(EGLDisplay dpy, EGLSurface surface, E
 	HYBRIS_TRACE_BEGIN("hybris-egl", "eglSwapBuffersWithDamageEXT", "");
 	HYBRIS_DLSYSM(egl, &_eglSwapBuffers, "eglSwapBuffers");
 
-	if (egl_helper_has_mapping(surface)) {
-		win = egl_helper_get_mapping(surface);
+	win = egl_helper_get_mapping(surface);
+	if (win) {
 		ws_prepareSwap(dpy, win, rects, n_rects);
 		ret = (*_eglSwapBuffers)(dpy, surface);
 		ws_finishSwap(dpy, win);
@@ -486,29 +469,337 @@ EGLBoolean eglSwapBuffers(EGLDisplay dpy, EGLSurface surface)
 HYBRIS_IMPLEMENT_FUNCTION3(egl, EGLBoolean, eglCopyBuffers, EGLDisplay, EGLSurface, EGLNativePixmapType);
 
 
+/*
+ * The wrappers of EGLImages are taken from slabs of _EGL_IMAGE_SLAB_SIZE,
+ * compositors create and destroy images for every client buffer in every
+ * frame. Each thread allocates from and frees to a free list of its own
+ * without locking, and exchanges wrappers with a shared pool a slab's worth
+ * at a time, when its list runs empty or grows beyond two slabs and when the
+ * thread exits. Slabs are never freed, the pool only grows to the peak
+ * number of images.
+ */
+#define _EGL_IMAGE_SLAB_SIZE 64
+
+struct _egl_buffer_image;
+
+struct _egl_image_slot {
+	struct egl_image image;
+	/* The cached Android EGLImage, NULL if the image is the wrapper's own */
+	struct _egl_buffer_image *shared;
+	struct _egl_image_slot *next_free;
+};
+
+static pthread_mutex_t _image_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct _egl_image_slot *_image_pool = NULL;
+
+static pthread_once_t _image_thread_once = PTHREAD_ONCE_INIT;
+static pthread_key_t _image_thread_key;
+static __thread struct _egl_image_slot *_thread_image_slots = NULL;
+static __thread int _thread_image_slot_count = 0;
+
+/* Gives the first count slots of the thread's list back to the pool */
+static void _returnImageSlots(int count)
+{
+	struct _egl_image_slot *first = _thread_image_slots, *last = first;
+	int i;
+
+	if (!first)
+		return;
+	for (i = 1; i < count && last->next_free; i++)
+		last = last->next_free;
+
+	_thread_image_slots = last->next_free;
+	_thread_image_slot_count -= i;
+
+	pthread_mutex_lock(&_image_pool_mutex);
+	last->next_free = _image_pool;
+	_image_pool = first;
+	pthread_mutex_unlock(&_image_pool_mutex);
+}
+
+static void _imageThreadExit(void *data)
+{
+	_returnImageSlots(_thread_image_slot_count);
+}
+
+static void _imageThreadKeyCreate(void)
+{
+	pthread_key_create(&_image_thread_key, _imageThreadExit);
+}
+
+/* Refills the thread's empty list from the pool or a new slab */
+static void _takeImageSlots(void)
+{
+	struct _egl_image_slot *first, *last;
+	int i;
+
+	pthread_once(&_image_thread_once, _imageThreadKeyCreate);
+	/* Have the list returned once the thread exits */
+	pthread_setspecific(_image_thread_key, (void *) 1);
+
+	pthread_mutex_lock(&_image_pool_mutex);
+	first = last = _image_pool;
+	for (i = 1; last && i < _EGL_IMAGE_SLAB_SIZE && last->next_free; i++)
+		last = last->next_free;
+	if (last) {
+		_image_pool = last->next_free;
+		last->next_free = NULL;
+	}
+	pthread_mutex_unlock(&_image_pool_mutex);
+
+	if (!first) {
+		first = malloc(_EGL_IMAGE_SLAB_SIZE * sizeof *first);
+		if (!first)
+			return;
+		for (i = 0; i < _EGL_IMAGE_SLAB_SIZE; i++)
+			first[i].next_free = i + 1 < _EGL_IMAGE_SLAB_SIZE ? &first[i + 1] : NULL;
+	}
+
+	_thread_image_slots = first;
+	_thread_image_slot_count = i;
+}
+
+static struct _egl_image_slot *_allocImageSlot(void)
+{
+	struct _egl_image_slot *slot;
+
+	if (!_thread_image_slots)
+		_takeImageSlots();
+
+	slot = _thread_image_slots;
+	if (!slot)
+		return NULL;
+	_thread_image_slots = slot->next_free;
+	_thread_image_slot_count--;
+
+	slot->shared = NULL;
+	return slot;
+}
+
+static void _freeImageSlot(struct _egl_image_slot *slot)
+{
+	slot->next_free = _thread_image_slots;
+	_thread_image_slots = slot;
+	if (++_thread_image_slot_count > 2 * _EGL_IMAGE_SLAB_SIZE)
+		_returnImageSlots(_EGL_IMAGE_SLAB_SIZE);
+}
+
+/*
+ * With HYBRIS_EGL_IMAGE_CACHE=1, the Android EGLImage of a wl_buffer stays
+ * around once the compositor destroyed its image, and is used again when the
+ * buffer is attached anew, until the window system reports that the
+ * wl_buffer is gone. Every eglCreateImageKHR() still returns a wrapper of its
+ * own. Images are looked up by display and native buffer in a hash table.
+ */
+#define _EGL_IMAGE_CACHE_BUCKETS 256
+
+struct _egl_buffer_image {
+	EGLDisplay dpy;
+	EGLClientBuffer buffer;
+	EGLImageKHR egl_image;
+	/* The number of wrappers using the image */
+	int refs;
+	/* Whether the image is still in the table */
+	int cached;
+	struct _egl_buffer_image *next;
+};
+
+static pthread_mutex_t _image_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static struct _egl_buffer_image *_image_cache[_EGL_IMAGE_CACHE_BUCKETS];
+
+static int _useImageCache(void)
+{
+	static int use_image_cache = -1;
+
+	if (use_image_cache == -1) {
+		const char *env = getenv("HYBRIS_EGL_IMAGE_CACHE");
+		use_image_cache = env && strcmp(env, "1") == 0;
+	}
+
+	return use_image_cache;
+}
+
+static struct _egl_buffer_image **_imageCacheBucket(EGLClientBuffer buffer)
+{
+	uint64_t hash = (uint64_t) (uintptr_t) buffer * 0x9e3779b97f4a7c15ULL;
+
+	return &_image_cache[(hash >> 32) & (_EGL_IMAGE_CACHE_BUCKETS - 1)];
+}
+
+/* Called with _image_cache_mutex locked, takes a reference on the image */
+static struct _egl_buffer_image *_findBufferImage(EGLDisplay dpy, EGLClientBuffer buffer)
+{
+	struct _egl_buffer_image *cached;
+
+	for (cached = *_imageCacheBucket(buffer); cached; cached = cached->next) {
+		if (cached->buffer == buffer && cached->dpy == dpy) {
+			cached->refs++;
+			return cached;
+		}
+	}
+
+	return NULL;
+}
+
+/* Returns the cached image of buffer, creating the Android EGLImage if needed */
+static struct _egl_buffer_image *_getBufferImage(EGLDisplay dpy, EGLClientBuffer buffer)
+{
+	struct _egl_buffer_image *cached, *created;
+	EGLImageKHR eik;
+
+	pthread_mutex_lock(&_image_cache_mutex);
+	cached = _findBufferImage(dpy, buffer);
+	pthread_mutex_unlock(&_image_cache_mutex);
+
+	if (cached)
+		return cached;
+
+	eik = (*_eglCreateImageKHR)(dpy, EGL_NO_CONTEXT, EGL_NATIVE_BUFFER_ANDROID, buffer, NULL);
+	if (eik == EGL_NO_IMAGE_KHR)
+		return NULL;
+
+	created = malloc(sizeof *created);
+	if (!created) {
+		(*_eglDestroyImageKHR)(dpy, eik);
+		return NULL;
+	}
+	created->dpy = dpy;
+	created->buffer = buffer;
+	created->egl_image = eik;
+	created->refs = 1;
+	created->cached = 1;
+
+	/* Another thread may have created one in the meantime */
+	pthread_mutex_lock(&_image_cache_mutex);
+	cached = _findBufferImage(dpy, buffer);
+	if (!cached) {
+		struct _egl_buffer_image **bucket = _imageCacheBucket(buffer);
+
+		created->next = *bucket;
+		*bucket = created;
+	}
+	pthread_mutex_unlock(&_image_cache_mutex);
+
+	if (cached) {
+		(*_eglDestroyImageKHR)(dpy, eik);
+		free(created);
+		return cached;
+	}
+
+	return created;
+}
+
+/* Drops a wrapper's reference, destroys the image if it was the last one and no longer cached */
+static void _putBufferImage(struct _egl_buffer_image *cached)
+{
+	int destroy;
+
+	pthread_mutex_lock(&_image_cache_mutex);
+	destroy = --cached->refs == 0 && !cached->cached;
+	pthread_mutex_unlock(&_image_cache_mutex);
+
+	if (destroy) {
+		(*_eglDestroyImageKHR)(cached->dpy, cached->egl_image);
+		free(cached);
+	}
+}
+
+/*
+ * Removes the cached images of a buffer, or of a display if buffer is NULL,
+ * and destroys those which are not in use.
+ */
+static void _uncacheImages(EGLDisplay dpy, EGLClientBuffer buffer)
+{
+	struct _egl_buffer_image **first = buffer ? _imageCacheBucket(buffer) : &_image_cache[0];
+	struct _egl_buffer_image **last = buffer ? first : &_image_cache[_EGL_IMAGE_CACHE_BUCKETS - 1];
+	struct _egl_buffer_image *unused = NULL, *cached, **bucket, **link;
+
+	pthread_mutex_lock(&_image_cache_mutex);
+	for (bucket = first; bucket <= last; bucket++) {
+		link = bucket;
+		while ((cached = *link) != NULL) {
+			if (buffer ? cached->buffer != buffer : cached->dpy != dpy) {
+				link = &cached->next;
+				continue;
+			}
+
+			*link = cached->next;
+			cached->cached = 0;
+			if (cached->refs == 0) {
+				cached->next = unused;
+				unused = cached;
+			}
+		}
+	}
+	pthread_mutex_unlock(&_image_cache_mutex);
+
+	while ((cached = unused) != NULL) {
+		unused = cached->next;
+		(*_eglDestroyImageKHR)(cached->dpy, cached->egl_image);
+		free(cached);
+	}
+}
+
+/* Called by the window system once a buffer goes away */
+static void _releaseBufferImages(EGLClientBuffer buffer)
+{
+	if (!_useImageCache() || !_eglDestroyImageKHR)
+		return;
+
+	_uncacheImages(EGL_NO_DISPLAY, buffer);
+}
+
+static void _releaseDisplayImages(EGLDisplay dpy)
+{
+	if (!_useImageCache() || !_eglDestroyImageKHR)
+		return;
+
+	_uncacheImages(dpy, NULL);
+}
+
 static EGLImageKHR _my_eglCreateImageKHR(EGLDisplay dpy, EGLContext ctx, EGLenum target, EGLClientBuffer buffer, const EGLint *attrib_list)
 {
 	HYBRIS_DLSYSM(egl, &_eglCreateImageKHR, "eglCreateImageKHR");
+	HYBRIS_DLSYSM(egl, &_eglDestroyImageKHR, "eglDestroyImageKHR");
 	struct _EGLDisplay *display = hybris_egl_display_get_mapping(dpy);
 	EGLContext newctx = ctx;
 	EGLenum newtarget = target;
 	EGLClientBuffer newbuffer = buffer;
 	const EGLint *newattrib_list = attrib_list;
+	struct _egl_buffer_image *cached = NULL;
+	EGLImageKHR eik;
 
 	ws_passthroughImageKHR(&newctx, &newtarget, &newbuffer, &newattrib_list);
 
-	EGLImageKHR eik = (*_eglCreateImageKHR)(dpy, newctx, newtarget, newbuffer, newattrib_list);
+	/* Only images of wl_buffers are cached, their lifetime is known */
+	if (target == EGL_WAYLAND_BUFFER_WL && newtarget == EGL_NATIVE_BUFFER_ANDROID &&
+	    _useImageCache()) {
+		cached = _getBufferImage(dpy, newbuffer);
+		eik = cached ? cached->egl_image : EGL_NO_IMAGE_KHR;
+	} else {
+		eik = (*_eglCreateImageKHR)(dpy, newctx, newtarget, newbuffer, newattrib_list);
+	}
 
 	if (eik == EGL_NO_IMAGE_KHR) {
 		return EGL_NO_IMAGE_KHR;
 	}
 
-	struct egl_image *image;
-	image = malloc(sizeof *image);
+	struct _egl_image_slot *slot = _allocImageSlot();
+	if (!slot) {
+		if (cached)
+			_putBufferImage(cached);
+		else
+			(*_eglDestroyImageKHR)(dpy, eik);
+		__eglHybrisSetError(EGL_BAD_ALLOC);
+		return EGL_NO_IMAGE_KHR;
+	}
+
+	struct egl_image *image = &slot->image;
 	image->egl_image = eik;
 	image->target = target;
 	image->ws_dpy = display;
 	image->ws_buffer = newbuffer;
+	slot->shared = cached;
 
 	return (EGLImageKHR)image;
 }
@@ -531,11 +822,18 @@ EGLBoolean _my_eglDestroyImageKHR(EGLDisplay dpy, EGLImageKHR image)
 {
 	HYBRIS_DLSYSM(egl, &_eglDestroyImageKHR, "eglDestroyImageKHR");
 	struct egl_image *img = image;
-	EGLBoolean ret = (*_eglDestroyImageKHR)(dpy, img ? img->egl_image : NULL);
-	if (ret == EGL_TRUE) {
-		free(img);
+	struct _egl_image_slot *slot = (struct _egl_image_slot *) img;
+
+	if (slot && slot->shared) {
+		_putBufferImage(slot->shared);
+		_freeImageSlot(slot);
 		return EGL_TRUE;
 	}
+
+	EGLBoolean ret = (*_eglDestroyImageKHR)(dpy, img ? img->egl_image : NULL);
+	if (ret == EGL_TRUE && slot) {
+		_freeImageSlot(slot);
+	}
 	return ret;
 }
 
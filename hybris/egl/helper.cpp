@@ -21,45 +21,305 @@
 #include "helper.h"
 
 #include <assert.h>
-#include <map>
+#include <pthread.h>
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+
+
+/*
+ * Maps EGL handles to our objects
+ *
+ * The mappings are looked up on every swap and image creation, possibly
+ * from several threads at once, so lookups take no lock. Keys are kept in
+ * an open addressing table, which is only changed with the mutex held.
+ * Removed entries become tombstones, so that concurrent lookups never miss
+ * an entry which was moved. Once the table needs to grow or to be cleaned
+ * up, a new one replaces it; the old one is freed once no lookup uses it
+ * anymore.
+ *
+ * Keys are pointers or small integers, 0 (EGL_NO_SURFACE, EGL_NO_DISPLAY)
+ * marks an empty entry and is never mapped, and neither are values of 0.
+ */
+template <typename Key, typename Value>
+class _MappingTable
+{
+public:
+    _MappingTable()
+        : m_table(NULL)
+        , m_readers(0)
+    {
+        pthread_mutex_init(&m_mutex, NULL);
+    }
+
+    Value get(Key key)
+    {
+        Value value = (Value) 0;
+
+        if (key == (Key) 0 || key == removed())
+            return value;
+
+        m_readers.fetch_add(1, std::memory_order_seq_cst);
+
+        Table *table = m_table.load(std::memory_order_seq_cst);
+        if (table) {
+            Entry *entry = find(table, key);
+            if (entry)
+                value = entry->value.load(std::memory_order_relaxed);
+        }
+
+        m_readers.fetch_sub(1, std::memory_order_release);
+
+        return value;
+    }
+
+    void push(Key key, Value value)
+    {
+        assert(key != (Key) 0 && key != removed());
+        assert(value != (Value) 0);
+
+        pthread_mutex_lock(&m_mutex);
+        insert(reserve(), key, value);
+        pthread_mutex_unlock(&m_mutex);
+    }
+
+    Value pop(Key key)
+    {
+        Value value = (Value) 0;
+
+        if (key == (Key) 0 || key == removed())
+            return value;
+
+        pthread_mutex_lock(&m_mutex);
+
+        Table *table = m_table.load(std::memory_order_relaxed);
+        Entry *entry = table ? find(table, key) : NULL;
+        if (entry) {
+            value = entry->value.load(std::memory_order_relaxed);
+            entry->key.store(removed(), std::memory_order_release);
+            table->live--;
+        }
+
+        pthread_mutex_unlock(&m_mutex);
+
+        return value;
+    }
+
+    /* Removes all mappings, calling release on each value */
+    void popAll(void (*release)(Value value))
+    {
+        pthread_mutex_lock(&m_mutex);
+
+        Table *table = m_table.load(std::memory_order_relaxed);
+        for (unsigned int i = 0; table && i < table->capacity; i++) {
+            Key key = table->entries[i].key.load(std::memory_order_relaxed);
+
+            if (key != (Key) 0 && key != removed()) {
+                table->entries[i].key.store(removed(), std::memory_order_release);
+                table->live--;
+                release(table->entries[i].value.load(std::memory_order_relaxed));
+            }
+        }
+
+        pthread_mutex_unlock(&m_mutex);
+    }
+
+    /* The mutex serializing changes, for callers which look up and add atomically */
+    pthread_mutex_t *mutex() { return &m_mutex; }
+
+    /* Like push(), with the mutex already locked */
+    void pushLocked(Key key, Value value)
+    {
+        assert(key != (Key) 0 && key != removed());
+        assert(value != (Value) 0);
+
+        insert(reserve(), key, value);
+    }
+
+private:
+    enum { MIN_CAPACITY = 64 };
+
+    struct Entry {
+        std::atomic<Key> key;
+        std::atomic<Value> value;
+    };
+
+    struct Table {
+        unsigned int capacity;
+        /* Entries which aren't empty, including tombstones */
+        unsigned int used;
+        unsigned int live;
+        Entry *entries;
+    };
+
+    static Key removed() { return (Key) UINTPTR_MAX; }
+
+    static unsigned int index(Key key, unsigned int capacity)
+    {
+        uint64_t hash = (uint64_t) (uintptr_t) key * 0x9e3779b97f4a7c15ULL;
+
+        return (unsigned int) (hash >> 32) & (capacity - 1);
+    }
+
+    static Table *newTable(unsigned int capacity)
+    {
+        Table *table = new Table;
+
+        table->capacity = capacity;
+        table->used = 0;
+        table->live = 0;
+        table->entries = new Entry[capacity];
+        for (unsigned int i = 0; i < capacity; i++) {
+            table->entries[i].key.store((Key) 0, std::memory_order_relaxed);
+            table->entries[i].value.store((Value) 0, std::memory_order_relaxed);
+        }
+
+        return table;
+    }
+
+    static void freeTable(Table *table)
+    {
+        delete[] table->entries;
+        delete table;
+    }
+
+    /* Lock-free, returns the entry of key or NULL */
+    static Entry *find(Table *table, Key key)
+    {
+        unsigned int mask = table->capacity - 1;
+        unsigned int i = index(key, table->capacity);
+
+        for (;;) {
+            Key k = table->entries[i].key.load(std::memory_order_acquire);
+
+            if (k == key)
+                return &table->entries[i];
+            if (k == (Key) 0)
+                return NULL;
+            i = (i + 1) & mask;
+        }
+    }
+
+    /* Called with the mutex locked, key must not be in the table yet */
+    static void insert(Table *table, Key key, Value value)
+    {
+        unsigned int mask = table->capacity - 1;
+        unsigned int i = index(key, table->capacity);
+
+        for (;;) {
+            Key k = table->entries[i].key.load(std::memory_order_relaxed);
+
+            if (k == (Key) 0 || k == removed()) {
+                if (k == (Key) 0)
+                    table->used++;
+                table->live++;
+                /* The value has to be visible before lookups find the key */
+                table->entries[i].value.store(value, std::memory_order_relaxed);
+                table->entries[i].key.store(key, std::memory_order_release);
+                return;
+            }
+            i = (i + 1) & mask;
+        }
+    }
+
+    /* Called with the mutex locked, makes room for one more key */
+    Table *reserve()
+    {
+        Table *table = m_table.load(std::memory_order_relaxed);
+
+        if (table && 2 * (table->used + 1) <= table->capacity)
+            return table;
+
+        unsigned int capacity = MIN_CAPACITY;
+        while (table && capacity < 4 * (table->live + 1))
+            capacity *= 2;
+
+        Table *resized = newTable(capacity);
+        if (table) {
+            for (unsigned int i = 0; i < table->capacity; i++) {
+                Key k = table->entries[i].key.load(std::memory_order_relaxed);
+
+                if (k != (Key) 0 && k != removed())
+                    insert(resized, k, table->entries[i].value.load(std::memory_order_relaxed));
+            }
+            m_retired.push_back(table);
+        }
+
+        m_table.store(resized, std::memory_order_seq_cst);
+
+        /* Lookups which started from now on only see the new table */
+        if (m_readers.load(std::memory_order_seq_cst) == 0) {
+            for (size_t i = 0; i < m_retired.size(); i++)
+                freeTable(m_retired[i]);
+            m_retired.clear();
+        }
+
+        return resized;
+    }
+
+    pthread_mutex_t m_mutex;
+    std::atomic<Table *> m_table;
+    std::atomic<int> m_readers;
+    std::vector<Table *> m_retired;
+};
 
 
 /* Keep track of active EGL window surfaces */
-static std::map<EGLSurface,EGLNativeWindowType> _surface_window_map;
+static _MappingTable<EGLSurface, EGLNativeWindowType> _surface_window_map;
+
+/* And of the displays, by the EGLDisplay of Android EGL */
+static _MappingTable<EGLDisplay, struct _EGLDisplay *> _display_map;
 
 
 void egl_helper_push_mapping(EGLSurface surface, EGLNativeWindowType window)
 {
     assert(!egl_helper_has_mapping(surface));
 
-    _surface_window_map[surface] = window;
+    _surface_window_map.push(surface, window);
 }
 
 int egl_helper_has_mapping(EGLSurface surface)
 {
-    return (_surface_window_map.find(surface) != _surface_window_map.end());
+    return egl_helper_get_mapping(surface) != (EGLNativeWindowType) 0;
 }
 
 EGLNativeWindowType egl_helper_get_mapping(EGLSurface surface)
 {
-    std::map<EGLSurface,EGLNativeWindowType>::iterator it;
-    it = _surface_window_map.find(surface);
+    return _surface_window_map.get(surface);
+}
 
-    /* Caller must check with egl_helper_has_mapping() before */
-    assert(it != _surface_window_map.end());
+EGLNativeWindowType egl_helper_pop_mapping(EGLSurface surface)
+{
+    return _surface_window_map.pop(surface);
+}
 
-    return it->second;
+struct _EGLDisplay *egl_helper_get_display_mapping(EGLDisplay dpy)
+{
+    return _display_map.get(dpy);
 }
 
-EGLNativeWindowType egl_helper_pop_mapping(EGLSurface surface)
+struct _EGLDisplay *egl_helper_get_or_push_display_mapping(EGLDisplay dpy,
+        struct _EGLDisplay *(*create)(void *data), void *data)
 {
-    std::map<EGLSurface,EGLNativeWindowType>::iterator it;
-    it = _surface_window_map.find(surface);
+    struct _EGLDisplay *display = _display_map.get(dpy);
 
-    /* Caller must check with egl_helper_has_mapping() before */
-    assert(it != _surface_window_map.end());
+    if (display)
+        return display;
 
-    EGLNativeWindowType result = it->second;
-    _surface_window_map.erase(it);
-    return result;
+    /* Only one thread creates the display */
+    pthread_mutex_lock(_display_map.mutex());
+    display = _display_map.get(dpy);
+    if (!display) {
+        display = create(data);
+        if (display)
+            _display_map.pushLocked(dpy, display);
+    }
+    pthread_mutex_unlock(_display_map.mutex());
+
+    return display;
+}
+
+void egl_helper_pop_display_mappings(void (*release)(struct _EGLDisplay *display))
+{
+    _display_map.popAll(release);
 }
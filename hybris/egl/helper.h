@@ -30,18 +30,40 @@ extern "C" {
 #endif
 
 
+/*
+ * The mappings can be looked up from any thread, lookups don't lock.
+ * Windows are never 0, which stands for a surface without mapping, and
+ * lookups are constant time however many surfaces and displays exist.
+ */
+
 /* Add new mapping from surface to window */
 void egl_helper_push_mapping(EGLSurface surface, EGLNativeWindowType window);
 
 /* Check if a mapping for a surface exist */
 int egl_helper_has_mapping(EGLSurface surface);
 
-/* Return (without removing) the mapping for a surface */
+/* Return (without removing) the mapping for a surface, 0 if there is none */
 EGLNativeWindowType egl_helper_get_mapping(EGLSurface surface);
 
-/* Return and remove the mapping for a surface */
+/* Return and remove the mapping for a surface, 0 if there is none */
 EGLNativeWindowType egl_helper_pop_mapping(EGLSurface surface);
 
+struct _EGLDisplay;
+
+/* Return the display for an EGLDisplay of Android EGL, NULL if there is none */
+struct _EGLDisplay *egl_helper_get_display_mapping(EGLDisplay dpy);
+
+/*
+ * Return the display for an EGLDisplay of Android EGL, adding the one
+ * returned by create(data) if there is none. Concurrent callers get the same
+ * display, create() is called once at most.
+ */
+struct _EGLDisplay *egl_helper_get_or_push_display_mapping(EGLDisplay dpy,
+        struct _EGLDisplay *(*create)(void *data), void *data);
+
+/* Remove all displays, calling release on each */
+void egl_helper_pop_display_mappings(void (*release)(struct _EGLDisplay *display));
+
 
 #ifdef __cplusplus
 };
@@ -233,6 +233,15 @@ extern "C" EGLBoolean eglplatformcommon_eglHybrisReleaseNativeBuffer(EGLClientBu
 }
 
 
+#ifdef WANT_WAYLAND
+/* Lets libEGL drop the EGLImages it cached for the buffer */
+static void buffer_images_destroy(struct wl_listener *listener, void *data)
+{
+	server_wlegl_buffer *buf = wl_container_of(listener, buf, images_listener);
+
+	(*my_egl_interface->release_buffer_images)((EGLClientBuffer) (ANativeWindowBuffer *) buf->buf);
+}
+#endif
 
 extern "C" void
 eglplatformcommon_passthroughImageKHR(EGLContext *ctx, EGLenum *target, EGLClientBuffer *buffer, const EGLint **attrib_list)
@@ -257,6 +266,11 @@ eglplatformcommon_passthroughImageKHR(EGLContext *ctx, EGLenum *target, EGLClien
 		{
 			hybris_dump_buffer_to_file((ANativeWindowBuffer *) buf->buf);
 		}
+		if (!wl_resource_get_destroy_listener(buf->resource, buffer_images_destroy))
+		{
+			buf->images_listener.notify = buffer_images_destroy;
+			wl_resource_add_destroy_listener(buf->resource, &buf->images_listener);
+		}
 		*buffer = (EGLClientBuffer) (ANativeWindowBuffer *) buf->buf;
 		*target = EGL_NATIVE_BUFFER_ANDROID;
 		*ctx = EGL_NO_CONTEXT;
@@ -23,7 +23,10 @@
 #include <inttypes.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
+#include <unistd.h>
 
 #if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
 extern "C" {
@@ -35,8 +38,27 @@ extern "C" {
 
 #define FRAMEBUFFER_PARTITIONS 2
 
-static pthread_cond_t _cond = PTHREAD_COND_INITIALIZER;
-static pthread_mutex_t _mutex = PTHREAD_MUTEX_INITIALIZER;
+static int postthreadenvchecked = 0;
+
+static bool use_post_thread()
+{
+    if (postthreadenvchecked == 0)
+    {
+        const char *env = getenv("HYBRIS_FBDEV_POST_THREAD");
+        if (env != NULL && strcmp(env, "1") == 0)
+            postthreadenvchecked = 2;
+        else
+            postthreadenvchecked = 1;
+    }
+    return postthreadenvchecked == 2;
+}
+
+static int64_t now_us()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
 
 
 FbDevNativeWindowBuffer::FbDevNativeWindowBuffer(unsigned int width,
@@ -48,8 +70,9 @@ FbDevNativeWindowBuffer::FbDevNativeWindowBuffer(unsigned int width,
     ANativeWindowBuffer::height = height;
     ANativeWindowBuffer::format = format;
     ANativeWindowBuffer::usage  = usage;
-    busy = 0;
     status = 0;
+    fenceFd = -1;
+    queuedUs = 0;
 
     hybris_gralloc_allocate(width, height, format, (uint32_t)usage, &handle, (uint32_t*)&stride);
 
@@ -62,6 +85,8 @@ FbDevNativeWindowBuffer::FbDevNativeWindowBuffer(unsigned int width,
 FbDevNativeWindowBuffer::~FbDevNativeWindowBuffer()
 {
     TRACE("%p", this);
+    if (fenceFd >= 0)
+        close(fenceFd);
     hybris_gralloc_release(handle, 1);
 }
 
@@ -72,7 +97,17 @@ FbDevNativeWindow::FbDevNativeWindow()
     m_bufFormat = hybris_gralloc_fbdev_format();
     m_usage = GRALLOC_USAGE_HW_FB;
     m_bufferCount = 0;
+    m_bufferAge = 0;
     m_allocateBuffers = true;
+    ANativeWindow::query = &_query;
+    m_frontBuf = NULL;
+    m_postThreadRunning = false;
+    m_postThreadQuit = false;
+    m_postThreadFailed = false;
+    m_lastPostUs = 0;
+
+    pthread_mutex_init(&m_mutex, NULL);
+    pthread_cond_init(&m_cond, NULL);
 
 #if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
     if (hybris_gralloc_fbdev_framebuffer_count() > 0)
@@ -89,7 +124,10 @@ FbDevNativeWindow::FbDevNativeWindow()
 
 FbDevNativeWindow::~FbDevNativeWindow()
 {
+    stopPostThread();
     destroyBuffers();
+    pthread_cond_destroy(&m_cond);
+    pthread_mutex_destroy(&m_mutex);
 }
 
 
@@ -98,14 +136,12 @@ void FbDevNativeWindow::destroyBuffers()
 {
     TRACE("");
 
-    std::list<FbDevNativeWindowBuffer*>::iterator it = m_bufList.begin();
-    for (; it!=m_bufList.end(); ++it)
+    for (int slot = 0; slot < m_chain.size(); slot++)
     {
-        FbDevNativeWindowBuffer* fbnb = *it;
+        BaseNativeWindowBuffer* fbnb = m_chain.buffer(slot);
         fbnb->common.decRef(&fbnb->common);
     }
-    m_bufList.clear();
-    m_freeBufs = 0;
+    m_chain.clear();
     m_frontBuf = NULL;
 }
 
@@ -148,10 +184,15 @@ int FbDevNativeWindow::dequeueBuffer(BaseNativeWindowBuffer** buffer, int *fence
     HYBRIS_TRACE_BEGIN("fbdev-platform", "dequeueBuffer", "");
     FbDevNativeWindowBuffer* fbnb=NULL;
 
-    pthread_mutex_lock(&_mutex);
+    pthread_mutex_lock(&m_mutex);
 
     if (m_allocateBuffers)
+    {
+        // The post thread still uses the queued buffers
+        while (m_chain.count(SwapChain::QUEUED) > 0)
+            pthread_cond_wait(&m_cond, &m_mutex);
         reallocateBuffers();
+    }
 
     HYBRIS_TRACE_BEGIN("fbdev-platform", "dequeueBuffer-wait", "");
 #if defined(DEBUG)
@@ -159,68 +200,45 @@ int FbDevNativeWindow::dequeueBuffer(BaseNativeWindowBuffer** buffer, int *fence
     if (m_frontBuf)
         TRACE("Status: Has front buf %p", m_frontBuf);
 
-    std::list<FbDevNativeWindowBuffer*>::iterator cit = m_bufList.begin();
-    for (; cit != m_bufList.end(); ++cit)
+    for (int slot = 0; slot < m_chain.size(); slot++)
     {
-        TRACE("Status: Buffer %p with busy %i\n", (*cit), (*cit)->busy);
+        TRACE("Status: Buffer %p in state %i\n", m_chain.buffer(slot), m_chain.state(slot));
     }
 #endif
 
-    while (m_freeBufs==0)
+    // The front buffer is never free, so any free buffer will do
+    while (m_chain.freeCount() == 0)
     {
-        pthread_cond_wait(&_cond, &_mutex);
-    }
-
-    while (1)
-    {
-        std::list<FbDevNativeWindowBuffer*>::iterator it = m_bufList.begin();
-        for (; it != m_bufList.end(); ++it)
+#if ANDROID_VERSION_MAJOR<=4 && ANDROID_VERSION_MINOR<2
+        /*
+         * This is acceptable in case you are on a stack that calls lock() before starting to render into buffer
+         * When you are using fences (>= 2) you'll be waiting on the fence to signal instead. 
+         * 
+         * This optimization allows eglSwapBuffers to return and you can begin to utilize the GPU for rendering. 
+         * The actual lock() probably first comes at glFlush/eglSwapBuffers
+        */
+        if (m_frontBuf && m_chain.state(m_chain.slotOf(m_frontBuf)) == SwapChain::ACQUIRED)
         {
-            if (*it==m_frontBuf)
-                continue;
-            if ((*it)->busy==0)
-            {
-                TRACE("Found a free non-front buffer");
-                break;
-            }
+            TRACE("Used front buffer as buffer");
+            m_chain.release(m_chain.slotOf(m_frontBuf));
+            break;
         }
-
-        if (it == m_bufList.end())
-        {
-#if ANDROID_VERSION_MAJOR<=4 && ANDROID_VERSION_MINOR<2
-            /*
-             * This is acceptable in case you are on a stack that calls lock() before starting to render into buffer
-             * When you are using fences (>= 2) you'll be waiting on the fence to signal instead. 
-             * 
-             * This optimization allows eglSwapBuffers to return and you can begin to utilize the GPU for rendering. 
-             * The actual lock() probably first comes at glFlush/eglSwapBuffers
-            */
-            if (m_frontBuf && m_frontBuf->busy == 0)
-            {
-                TRACE("Used front buffer as buffer");
-                fbnb = m_frontBuf;
-                break;
-            }
 #endif
-            // have to wait once again
-            pthread_cond_wait(&_cond, &_mutex);
-            continue;
-        }
-
-        fbnb = *it;
-        break;
+        pthread_cond_wait(&m_cond, &m_mutex);
     }
 
+    int slot = m_chain.dequeue();
+    fbnb = static_cast<FbDevNativeWindowBuffer*>(m_chain.buffer(slot));
+    m_bufferAge = m_chain.age(slot);
+
     HYBRIS_TRACE_END("fbdev-platform", "dequeueBuffer-wait", "");
     assert(fbnb!=NULL);
-    fbnb->busy = 1;
-    m_freeBufs--;
 
     *buffer = fbnb;
     *fenceFd = -1;
 
     TRACE("%lu DONE --> %p", pthread_self(), fbnb);
-    pthread_mutex_unlock(&_mutex);
+    pthread_mutex_unlock(&m_mutex);
     HYBRIS_TRACE_END("fbdev-platform", "dequeueBuffer", "");
     return 0;
 }
@@ -251,14 +269,43 @@ int FbDevNativeWindow::queueBuffer(BaseNativeWindowBuffer* buffer, int fenceFd)
 
     HYBRIS_TRACE_BEGIN("fbdev-platform", "queueBuffer", "-%p", fbnb);
 
-    pthread_mutex_lock(&_mutex);
+    bool async = use_post_thread() && startPostThread();
+
+    pthread_mutex_lock(&m_mutex);
+
+    int slot = m_chain.slotOf(fbnb);
+    assert(slot >= 0);
+    m_chain.queue(slot);
+    fbnb->queuedUs = now_us();
+    HYBRIS_TRACE_COUNTER("fbdev-platform", "queued", "%i", m_chain.count(SwapChain::QUEUED));
+
+    if (async)
+    {
+        // The post thread waits for the fence and flips, the next buffer
+        // can be dequeued and rendered to meanwhile
+        fbnb->fenceFd = fenceFd;
+        pthread_cond_broadcast(&m_cond);
+        pthread_mutex_unlock(&m_mutex);
+
+        HYBRIS_TRACE_END("fbdev-platform", "queueBuffer", "-%p", fbnb);
+        return 0;
+    }
 
-    assert(fbnb->busy==1);
+    pthread_mutex_unlock(&m_mutex);
 
-    fbnb->busy = 2;
+    int rv = postBuffer(fbnb, fenceFd);
 
-    pthread_mutex_unlock(&_mutex);
+    HYBRIS_TRACE_END("fbdev-platform", "queueBuffer", "-%p", fbnb);
+    return rv;
+}
 
+/*
+ * Waits for the render fence of a QUEUED buffer, posts it and makes it the
+ * front buffer. Called without the window locked, either from queueBuffer
+ * or from the post thread.
+ */
+int FbDevNativeWindow::postBuffer(FbDevNativeWindowBuffer* fbnb, int fenceFd)
+{
 #if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
     HYBRIS_TRACE_BEGIN("fbdev-platform", "queueBuffer_waiting_for_fence", "-%p", fbnb);
     if (fenceFd >= 0)
@@ -271,29 +318,107 @@ int FbDevNativeWindow::queueBuffer(BaseNativeWindowBuffer* buffer, int fenceFd)
 
     HYBRIS_TRACE_BEGIN("fbdev-platform", "queueBuffer-post", "-%p", fbnb);
 
+    int64_t postStart = now_us();
     int rv = hybris_gralloc_fbdev_post(fbnb->handle);
     if (rv!=0)
     {
         fprintf(stderr,"ERROR: fb->post(%s)\n",strerror(-rv));
     }
+    int64_t postEnd = now_us();
     HYBRIS_TRACE_END("fbdev-platform", "queueBuffer-post", "-%p", fbnb);
 
-    pthread_mutex_lock(&_mutex);
+    pthread_mutex_lock(&m_mutex);
+
+    // The previous front buffer is not scanned out anymore
+    if (m_frontBuf)
+    {
+        int front = m_chain.slotOf(m_frontBuf);
+        if (front >= 0 && m_chain.state(front) == SwapChain::ACQUIRED)
+            m_chain.release(front);
+    }
 
-    fbnb->busy=0;
+    int slot = m_chain.acquire();
+    assert(slot >= 0 && m_chain.buffer(slot) == fbnb);
+    (void) slot;
     m_frontBuf = fbnb;
 
-    m_freeBufs++;
+    // Frame pacing: the time between flips, how long a flip blocked and
+    // how long a frame took from eglSwapBuffers to the screen
+    if (m_lastPostUs)
+        HYBRIS_TRACE_COUNTER("fbdev-platform", "frame_interval_us", "%" PRId64, postEnd - m_lastPostUs);
+    HYBRIS_TRACE_COUNTER("fbdev-platform", "post_us", "%" PRId64, postEnd - postStart);
+    HYBRIS_TRACE_COUNTER("fbdev-platform", "queue_to_post_us", "%" PRId64, postEnd - fbnb->queuedUs);
+    HYBRIS_TRACE_COUNTER("fbdev-platform", "queued", "%i", m_chain.count(SwapChain::QUEUED));
+    m_lastPostUs = postEnd;
 
     TRACE("%lu %p %p",pthread_self(), m_frontBuf, fbnb);
 
-    pthread_cond_signal(&_cond);
-    pthread_mutex_unlock(&_mutex);
+    pthread_cond_broadcast(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
 
-    HYBRIS_TRACE_END("fbdev-platform", "queueBuffer", "-%p", fbnb);
     return rv;
 }
 
+bool FbDevNativeWindow::startPostThread()
+{
+    if (m_postThreadRunning)
+        return true;
+    if (m_postThreadFailed)
+        return false;
+
+    if (pthread_create(&m_postThread, NULL, post_thread, this) != 0) {
+        fprintf(stderr, "failed to start the post thread, posting in eglSwapBuffers\n");
+        m_postThreadFailed = true;
+        return false;
+    }
+
+    m_postThreadRunning = true;
+    return true;
+}
+
+void FbDevNativeWindow::stopPostThread()
+{
+    if (!m_postThreadRunning)
+        return;
+
+    pthread_mutex_lock(&m_mutex);
+    m_postThreadQuit = true;
+    pthread_cond_broadcast(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
+
+    pthread_join(m_postThread, NULL);
+    m_postThreadRunning = false;
+}
+
+void *FbDevNativeWindow::post_thread(void *data)
+{
+    static_cast<FbDevNativeWindow *>(data)->postLoop();
+    return NULL;
+}
+
+void FbDevNativeWindow::postLoop()
+{
+    pthread_mutex_lock(&m_mutex);
+    for (;;) {
+        while (m_chain.nextQueued() < 0 && !m_postThreadQuit)
+            pthread_cond_wait(&m_cond, &m_mutex);
+        // The frames queued before the window goes away are still shown
+        if (m_chain.nextQueued() < 0)
+            break;
+
+        FbDevNativeWindowBuffer* fbnb =
+            static_cast<FbDevNativeWindowBuffer*>(m_chain.buffer(m_chain.nextQueued()));
+        int fenceFd = fbnb->fenceFd;
+        fbnb->fenceFd = -1;
+
+        // The buffer stays QUEUED until it is posted, so nobody reuses it
+        pthread_mutex_unlock(&m_mutex);
+        postBuffer(fbnb, fenceFd);
+        pthread_mutex_lock(&m_mutex);
+    }
+    pthread_mutex_unlock(&m_mutex);
+}
+
 
 /*
  * Hook used to cancel a buffer that has been dequeued.
@@ -325,14 +450,14 @@ int FbDevNativeWindow::cancelBuffer(BaseNativeWindowBuffer* buffer, int fenceFd)
     TRACE("");
     FbDevNativeWindowBuffer* fbnb = (FbDevNativeWindowBuffer*)buffer;
 
-    pthread_mutex_lock(&_mutex);
+    pthread_mutex_lock(&m_mutex);
 
-    fbnb->busy=0;
+    int slot = m_chain.slotOf(fbnb);
+    assert(slot >= 0);
+    m_chain.cancel(slot);
 
-    m_freeBufs++;
-
-    pthread_cond_signal(&_cond);
-    pthread_mutex_unlock(&_mutex);
+    pthread_cond_broadcast(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
 
     return 0;
 }
@@ -346,16 +471,16 @@ int FbDevNativeWindow::lockBuffer(BaseNativeWindowBuffer* buffer)
 
     HYBRIS_TRACE_BEGIN("fbdev-platform", "lockBuffer", "-%p", fbnb);
 
-    pthread_mutex_lock(&_mutex);
+    pthread_mutex_lock(&m_mutex);
 
     // wait that the buffer we're locking is not front anymore
     while (m_frontBuf==fbnb)
     {
         TRACE("waiting %p %p", m_frontBuf, fbnb);
-        pthread_cond_wait(&_cond, &_mutex);
+        pthread_cond_wait(&m_cond, &m_mutex);
     }
 
-    pthread_mutex_unlock(&_mutex);
+    pthread_mutex_unlock(&m_mutex);
     HYBRIS_TRACE_END("fbdev-platform", "lockBuffer", "-%p", fbnb);
     return NO_ERROR;
 }
@@ -459,6 +584,32 @@ unsigned int FbDevNativeWindow::getUsage() const
     return m_usage;
 }
 
+/*
+ * see NATIVE_WINDOW_BUFFER_AGE
+ */
+int FbDevNativeWindow::bufferAge() const
+{
+    TRACE("age=%i", m_bufferAge);
+    return m_bufferAge;
+}
+
+/*
+ * NATIVE_WINDOW_BUFFER_AGE comes from the swap chain, the other
+ * queries are answered by BaseNativeWindow
+ */
+int FbDevNativeWindow::_query(const struct ANativeWindow* window, int what, int* value)
+{
+#if ANDROID_VERSION_MAJOR>=8
+    if (what == NATIVE_WINDOW_BUFFER_AGE) {
+        const FbDevNativeWindow* self = static_cast<const FbDevNativeWindow*>(
+                static_cast<const BaseNativeWindow*>(window));
+        *value = self->bufferAge();
+        return NO_ERROR;
+    }
+#endif
+    return BaseNativeWindow::_query(window, what, value);
+}
+
 /*
  *  native_window_set_usage(..., usage)
  *  Sets the intended usage flags for the next buffers
@@ -528,12 +679,11 @@ void FbDevNativeWindow::reallocateBuffers()
         if (fbnb->status)
         {
             fbnb->common.decRef(&fbnb->common);
-            fprintf(stderr,"WARNING: %s: allocated only %d buffers out of %d\n", __PRETTY_FUNCTION__, m_freeBufs, m_bufferCount);
+            fprintf(stderr,"WARNING: %s: allocated only %d buffers out of %d\n", __PRETTY_FUNCTION__, m_chain.size(), m_bufferCount);
             break;
         }
 
-        m_freeBufs++;
-        m_bufList.push_back(fbnb);
+        m_chain.addSlot(fbnb);
     }
 
     m_allocateBuffers = false;
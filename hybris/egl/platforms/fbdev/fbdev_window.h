@@ -18,10 +18,10 @@
 #define FBDEV_WINDOW_H
 
 #include "eglnativewindowbase.h"
+#include "swapchain.h"
 #include <linux/fb.h>
 #include <hardware/gralloc.h>
-
-#include <list>
+#include <pthread.h>
 
 
 class FbDevNativeWindowBuffer : public BaseNativeWindowBuffer {
@@ -35,8 +35,10 @@ protected:
    virtual ~FbDevNativeWindowBuffer() ;
 
 protected:
-    int busy;
     int status;
+    // The render fence and queue time of a QUEUED buffer
+    int fenceFd;
+    int64_t queuedUs;
 };
 
 
@@ -68,20 +70,46 @@ protected:
     virtual int setBuffersFormat(int format);
     virtual int setBuffersDimensions(int width, int height);
     virtual int setBufferCount(int cnt);
+    // see NATIVE_WINDOW_BUFFER_AGE, answered by _query()
+    int bufferAge() const;
 
 private:
+    static int _query(const struct ANativeWindow* window, int what, int* value);
     void destroyBuffers();
     void reallocateBuffers();
+    int postBuffer(FbDevNativeWindowBuffer* fbnb, int fenceFd);
+    bool startPostThread();
+    void stopPostThread();
+    static void *post_thread(void *data);
+    void postLoop();
 
 private:
     uint64_t m_usage;
     int m_bufFormat;
     int m_bufferCount;
-    int m_freeBufs;
+    int m_bufferAge;
     bool m_allocateBuffers;
 
-    std::list<FbDevNativeWindowBuffer*> m_bufList;
+    // The buffer on screen is ACQUIRED until the next one is posted
+    SwapChain m_chain;
     FbDevNativeWindowBuffer* m_frontBuf;
+
+    // Guard the chain and the front buffer, m_cond is signalled whenever
+    // a buffer changes state
+    pthread_mutex_t m_mutex;
+    pthread_cond_t m_cond;
+
+    // With HYBRIS_FBDEV_POST_THREAD=1 the queued buffers are posted by a
+    // thread of the window, so that eglSwapBuffers doesn't block on the flip
+    pthread_t m_postThread;
+    bool m_postThreadRunning;
+    bool m_postThreadQuit;
+    // Set once the thread couldn't be started, this window then posts
+    // in eglSwapBuffers
+    bool m_postThreadFailed;
+
+    // Frame pacing, in microseconds of CLOCK_MONOTONIC
+    int64_t m_lastPostUs;
 };
 
 #endif
@@ -34,6 +34,8 @@ typedef void (*HWCPresentCallback)(void *user_data, struct ANativeWindow *window
  * The specified present callback will be called by the window when a new
  * buffer is ready to be presented on screen. It is responsibility of the
  * caller to make sure that happens, by using the hwcomposer API.
+ * With HYBRIS_HWC_PRESENT_THREAD=1 in the environment the callback is called
+ * from a thread of the window instead of from eglSwapBuffers().
  * Returns the window on success or NULL on failure.
  *
  * \param width The width of the window in pixels.
@@ -78,6 +80,17 @@ int HWCNativeBufferGetFence(struct ANativeWindowBuffer *buf);
  */
 void HWCNativeBufferSetFence(struct ANativeWindowBuffer *buf, int fd);
 
+/** Add a fence FD to the current fence of a buffer.
+ *
+ * The buffer is only reused once both fences signalled. Unlike with
+ * HWCNativeBufferSetFence() the current fence is kept, so a present callback
+ * can add a present fence to the release fence of an earlier buffer. The
+ * window takes ownership of fd.
+ *
+ * \sa HWCNativeBufferSetFence
+ */
+void HWCNativeBufferMergeFence(struct ANativeWindowBuffer *buf, int fd);
+
 #ifdef __cplusplus
 }
 #endif
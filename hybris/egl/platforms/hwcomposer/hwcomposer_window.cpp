@@ -39,23 +39,77 @@ extern "C" {
 #define TRACE(...)
 #define HYBRIS_TRACE_BEGIN(...)
 #define HYBRIS_TRACE_END(...)
+#define HYBRIS_TRACE_COUNTER(...)
 #include "hybris-gralloc.h"
 #else
 #include <hybris/gralloc/gralloc.h> 
 #endif
 
+// Frames which may wait for the present thread without swap interval 0,
+// together with the buffer on screen and the one being presented this
+// makes for triple buffering
+#define MAX_QUEUED_FRAMES 1
+
+static int presentthreadenvchecked = 0;
+
+static bool use_present_thread()
+{
+    if (presentthreadenvchecked == 0)
+    {
+        const char *env = getenv("HYBRIS_HWC_PRESENT_THREAD");
+        if (env != NULL && strcmp(env, "1") == 0)
+            presentthreadenvchecked = 2;
+        else
+            presentthreadenvchecked = 1;
+    }
+    return presentthreadenvchecked == 2;
+}
+
+/*
+ * Replaces *fenceFd by a fence which signals once both it and fd signalled,
+ * taking ownership of fd.
+ */
+static void merge_fence(int *fenceFd, int fd)
+{
+    if (fd < 0)
+        return;
+    if (*fenceFd < 0) {
+        *fenceFd = fd;
+        return;
+    }
+
+    int merged = sync_merge("hwcomposer-window", *fenceFd, fd);
+    if (merged < 0) {
+        // Without a merged fence, wait for the older one right away
+        fprintf(stderr, "failed to merge fences: %s\n", strerror(errno));
+        sync_wait(*fenceFd, -1);
+        close(*fenceFd);
+        *fenceFd = fd;
+        return;
+    }
+
+    close(*fenceFd);
+    close(fd);
+    *fenceFd = merged;
+}
+
 extern "C" struct ANativeWindow *HWCNativeWindowCreate(unsigned int width, unsigned int height, unsigned int format, HWCPresentCallback present, void *cb_data)
 {
     class Window : public HWComposerNativeWindow
     {
     public:
         Window(unsigned int w, unsigned int h, unsigned int f, HWCPresentCallback p, void *d)
-            : HWComposerNativeWindow(w, h, f)
+            : HWComposerNativeWindow(w, h, f, use_present_thread())
             , cb(p)
             , cb_data(d)
         {
         }
 
+        ~Window()
+        {
+            stopPresentThread();
+        }
+
         void present(HWComposerNativeWindowBuffer *b)
         {
             cb(cb_data, static_cast<ANativeWindow *>(this), static_cast<ANativeWindowBuffer *>(b));
@@ -80,6 +134,7 @@ extern "C" void HWCNativeWindowDestroy(struct ANativeWindow *window)
 struct _BufferFenceAccessor : public HWComposerNativeWindowBuffer {
     int get() { return fenceFd; }
     void set(int fd) { fenceFd = fd; };
+    void merge(int fd) { merge_fence(&fenceFd, fd); };
 };
 
 extern "C" int HWCNativeBufferGetFence(struct ANativeWindowBuffer *buf)
@@ -92,6 +147,11 @@ extern "C" void HWCNativeBufferSetFence(struct ANativeWindowBuffer *buf, int fd)
     static_cast<_BufferFenceAccessor *>(buf)->set(fd);
 }
 
+extern "C" void HWCNativeBufferMergeFence(struct ANativeWindowBuffer *buf, int fd)
+{
+    static_cast<_BufferFenceAccessor *>(buf)->merge(fd);
+}
+
 
 HWComposerNativeWindowBuffer::HWComposerNativeWindowBuffer(unsigned int width,
                             unsigned int height,
@@ -103,7 +163,6 @@ HWComposerNativeWindowBuffer::HWComposerNativeWindowBuffer(unsigned int width,
     ANativeWindowBuffer::format = format;
     ANativeWindowBuffer::usage  = usage;
     fenceFd = -1;
-    busy = 0;
     status = 0;
 
     hybris_gralloc_allocate(width, height, format, (uint32_t)usage, &handle, (uint32_t*)&stride);
@@ -124,7 +183,8 @@ HWComposerNativeWindowBuffer::~HWComposerNativeWindowBuffer()
 
 
 ////////////////////////////////////////////////////////////////////////////////
-HWComposerNativeWindow::HWComposerNativeWindow(unsigned int width, unsigned int height, unsigned int format)
+HWComposerNativeWindow::HWComposerNativeWindow(unsigned int width, unsigned int height, unsigned int format,
+                                               bool presentThread)
 {
     pthread_mutex_init(&m_mutex, 0);
     m_width = width;
@@ -132,17 +192,38 @@ HWComposerNativeWindow::HWComposerNativeWindow(unsigned int width, unsigned int
     m_bufFormat = format;
     m_usage = GRALLOC_USAGE_HW_COMPOSER|GRALLOC_USAGE_HW_FB;
     m_bufferCount = 2;
-    m_nextBuffer = 0;
+    m_bufferAge = 0;
+    ANativeWindow::query = &_query;
     m_transformHint = 0;
+    m_swapInterval = 1;
+    m_presentThreadRunning = false;
+    m_presentThreadQuit = false;
+    m_presenting = false;
+    m_frontBuf = NULL;
+    m_droppedFrames = 0;
+    pthread_cond_init(&m_cond, 0);
 
     char *transform_rot = getenv("HYBRIS_HAL_TRANSFORM_ROT");
     if (transform_rot)
         m_transformHint = atoi(transform_rot);
+
+    if (presentThread) {
+        if (pthread_create(&m_presentThread, NULL, present_thread, this) == 0) {
+            m_presentThreadRunning = true;
+            m_bufferCount = 3;
+        } else {
+            fprintf(stderr, "failed to start the present thread, presenting in eglSwapBuffers\n");
+        }
+    }
 }
 
 HWComposerNativeWindow::~HWComposerNativeWindow()
 {
+    // Subclasses which asked for a present thread stopped it already,
+    // present() is gone by now
+    stopPresentThread();
     destroyBuffers();
+    pthread_cond_destroy(&m_cond);
 }
 
 
@@ -151,14 +232,93 @@ void HWComposerNativeWindow::destroyBuffers()
 {
     TRACE("");
 
-    std::vector<HWComposerNativeWindowBuffer*>::iterator it = m_bufList.begin();
-    for (; it!=m_bufList.end(); ++it)
+    for (int slot = 0; slot < m_chain.size(); slot++)
     {
-        HWComposerNativeWindowBuffer* fbnb = *it;
+        BaseNativeWindowBuffer* fbnb = m_chain.buffer(slot);
         fbnb->common.decRef(&fbnb->common);
     }
-    m_bufList.clear();
-    m_nextBuffer = 0;
+    m_chain.clear();
+    m_frontBuf = NULL;
+}
+
+// Called with m_mutex locked, waits until the present thread is idle
+void HWComposerNativeWindow::waitForPresents()
+{
+    while (m_chain.count(SwapChain::QUEUED) > 0 || m_presenting)
+        pthread_cond_wait(&m_cond, &m_mutex);
+}
+
+void HWComposerNativeWindow::invalidateBuffers()
+{
+    pthread_mutex_lock(&m_mutex);
+    waitForPresents();
+    destroyBuffers();
+    pthread_mutex_unlock(&m_mutex);
+}
+
+/*
+ * In mailbox mode queued frames which the present thread didn't pick up
+ * yet are replaced by newer ones, so the client renders unthrottled.
+ */
+bool HWComposerNativeWindow::mailbox() const
+{
+    return m_presentThreadRunning && m_swapInterval == 0;
+}
+
+void HWComposerNativeWindow::stopPresentThread()
+{
+    if (!m_presentThreadRunning)
+        return;
+
+    pthread_mutex_lock(&m_mutex);
+    m_presentThreadQuit = true;
+    pthread_cond_broadcast(&m_cond);
+    pthread_mutex_unlock(&m_mutex);
+
+    pthread_join(m_presentThread, NULL);
+    m_presentThreadRunning = false;
+}
+
+void *HWComposerNativeWindow::present_thread(void *data)
+{
+    static_cast<HWComposerNativeWindow *>(data)->presentLoop();
+    return NULL;
+}
+
+void HWComposerNativeWindow::presentLoop()
+{
+    pthread_mutex_lock(&m_mutex);
+    for (;;) {
+        while (m_chain.nextQueued() < 0 && !m_presentThreadQuit)
+            pthread_cond_wait(&m_cond, &m_mutex);
+        // present() may be gone already, the remaining frames are dropped
+        if (m_presentThreadQuit)
+            break;
+
+        int slot = m_chain.acquire();
+        HWComposerNativeWindowBuffer *b = static_cast<HWComposerNativeWindowBuffer*>(m_chain.buffer(slot));
+        m_presenting = true;
+        pthread_cond_broadcast(&m_cond);
+        pthread_mutex_unlock(&m_mutex);
+
+        HYBRIS_TRACE_BEGIN("hwcomposer-platform", "present", "-%p", b);
+        this->present(b);
+        HYBRIS_TRACE_END("hwcomposer-platform", "present", "-%p", b);
+
+        pthread_mutex_lock(&m_mutex);
+        m_presenting = false;
+
+        // The previous buffer is off screen once the fences present() set
+        // have signalled, which dequeueBuffer hands out with it
+        if (m_frontBuf) {
+            int front = m_chain.slotOf(m_frontBuf);
+            if (front >= 0 && m_chain.state(front) == SwapChain::ACQUIRED)
+                m_chain.release(front);
+        }
+        m_frontBuf = b;
+        pthread_cond_broadcast(&m_cond);
+    }
+    pthread_mutex_unlock(&m_mutex);
 }
 
 
@@ -171,7 +331,18 @@ void HWComposerNativeWindow::destroyBuffers()
  */
 int HWComposerNativeWindow::setSwapInterval(int interval)
 {
-    TRACE("interval=%i WARN STUB", interval);
+    TRACE("interval=%i", interval);
+
+    pthread_mutex_lock(&m_mutex);
+    bool wasMailbox = mailbox();
+    m_swapInterval = interval;
+    // Mailbox mode has a spare buffer to render to while a frame waits
+    if (mailbox() != wasMailbox) {
+        waitForPresents();
+        destroyBuffers();
+    }
+    pthread_mutex_unlock(&m_mutex);
+
     return 0;
 }
 
@@ -202,19 +373,28 @@ int HWComposerNativeWindow::dequeueBuffer(BaseNativeWindowBuffer** buffer, int *
     pthread_mutex_lock(&m_mutex);
 
     // Allocate buffers if the list is empty, typically on the first call
-    if (m_bufList.empty())
+    if (m_chain.size() == 0)
         allocateBuffers();
-    assert(!m_bufList.empty());
-    assert(m_nextBuffer < m_bufList.size());
-
+    assert(m_chain.size() > 0);
+
+    // With the present thread buffers become free as frames are presented
+    while (m_chain.freeCount() == 0 && (m_chain.count(SwapChain::QUEUED) > 0 || m_presenting))
+        pthread_cond_wait(&m_cond, &m_mutex);
+
+    // Grab the buffer which was presented the longest time ago. As buffers
+    // are free again as soon as they are presented, this goes round all of
+    // them and only fails if the client dequeued every single one.
+    int slot = m_chain.dequeue();
+    if (slot < 0) {
+        TRACE("thread=%lu, all %d buffers are dequeued", pthread_self(), m_chain.size());
+        pthread_mutex_unlock(&m_mutex);
+        HYBRIS_TRACE_END("hwcomposer-platform", "dequeueBuffer", "");
+        return -EBUSY;
+    }
 
-    // Grabe the next available buffer in the list and assign m_nextBuffer to
-    // the next one.
-    HWComposerNativeWindowBuffer *b = m_bufList.at(m_nextBuffer);
-    TRACE("thread=%lu, idx=%d, buffer=%p, fence=%d", pthread_self(), m_nextBuffer, b, b->fenceFd);
-    m_nextBuffer++;
-    if (m_nextBuffer >= m_bufList.size())
-        m_nextBuffer = 0;
+    HWComposerNativeWindowBuffer *b = static_cast<HWComposerNativeWindowBuffer*>(m_chain.buffer(slot));
+    m_bufferAge = m_chain.age(slot);
+    TRACE("thread=%lu, idx=%d, buffer=%p, fence=%d", pthread_self(), slot, b, b->fenceFd);
 
     *buffer = b;
     // Transfer the buffer's fence to fenceFd
@@ -255,7 +435,49 @@ int HWComposerNativeWindow::queueBuffer(BaseNativeWindowBuffer* buffer, int fenc
     pthread_mutex_lock(&m_mutex);
     assert(b->fenceFd == -1); // We reset it in dequeue, so it better be -1 still..
     b->fenceFd = fenceFd;
+
+    // Buffers dequeued before the window re-allocated them aren't tracked
+    int slot = m_chain.slotOf(b);
+
+    if (slot >= 0 && m_presentThreadRunning) {
+        if (mailbox()) {
+            // Only the newest frame is shown, drop the ones still waiting.
+            // Their render fence is handed out with them again.
+            int old;
+            while ((old = m_chain.acquire()) >= 0) {
+                m_chain.release(old);
+                m_droppedFrames++;
+            }
+            HYBRIS_TRACE_COUNTER("hwcomposer-platform", "droppedFrames", "%u", m_droppedFrames);
+        } else {
+            while (m_chain.count(SwapChain::QUEUED) >= MAX_QUEUED_FRAMES)
+                pthread_cond_wait(&m_cond, &m_mutex);
+        }
+
+        m_chain.queue(slot);
+        HYBRIS_TRACE_COUNTER("hwcomposer-platform", "queued", "%i", m_chain.count(SwapChain::QUEUED));
+        pthread_cond_broadcast(&m_cond);
+        pthread_mutex_unlock(&m_mutex);
+
+        HYBRIS_TRACE_END("hwcomposer-platform", "queueBuffer", "-%p", b);
+        return 0;
+    }
+
+    // present() is never called from two threads at once
+    if (m_presentThreadRunning)
+        waitForPresents();
+
+    if (slot >= 0) {
+        m_chain.queue(slot);
+        slot = m_chain.acquire();
+    }
+
     this->present(b);
+
+    // present() replaced the fence with the release fence of the buffer,
+    // which is handed out with it by dequeueBuffer.
+    if (slot >= 0)
+        m_chain.release(slot);
     pthread_mutex_unlock(&m_mutex);
 
     TRACE("thread=%lu, buffer=%p, fence=%d", pthread_self(), b, b->fenceFd);
@@ -274,6 +496,11 @@ void HWComposerNativeWindow::setFenceBufferFd(HWComposerNativeWindowBuffer *buff
     buffer->fenceFd = fd;
 }
 
+void HWComposerNativeWindow::mergeFenceBufferFd(HWComposerNativeWindowBuffer *buffer, int fd)
+{
+    merge_fence(&buffer->fenceFd, fd);
+}
+
 /*
  * Hook used to cancel a buffer that has been dequeued.
  * No synchronization is performed between dequeue() and cancel(), so
@@ -308,10 +535,14 @@ int HWComposerNativeWindow::cancelBuffer(BaseNativeWindowBuffer* buffer, int fen
     pthread_mutex_lock(&m_mutex);
 
     // Assign the fence so we can pass it on in dequeue when the buffer is
-    // again acquired.
-    if (fbnb->fenceFd != -1)
-        close(fbnb->fenceFd);
-    fbnb->fenceFd = fenceFd;
+    // again acquired. A present callback may have fenced the buffer
+    // meanwhile, which has to be waited for as well.
+    merge_fence(&fbnb->fenceFd, fenceFd);
+
+    int slot = m_chain.slotOf(fbnb);
+    if (slot >= 0)
+        m_chain.cancel(slot);
+    pthread_cond_broadcast(&m_cond);
 
     TRACE("thread=%lu buffer=%p, fence=%d", pthread_self(), fbnb, fbnb->fenceFd);
     HYBRIS_TRACE_END("hwcomposer-platform", "cancelBuffer", "-%p", fbnb);
@@ -427,6 +658,32 @@ unsigned int HWComposerNativeWindow::getUsage() const
     return m_usage;
 }
 
+/*
+ * see NATIVE_WINDOW_BUFFER_AGE
+ */
+int HWComposerNativeWindow::bufferAge() const
+{
+    TRACE("age=%d", m_bufferAge);
+    return m_bufferAge;
+}
+
+/*
+ * NATIVE_WINDOW_BUFFER_AGE comes from the swap chain, the other
+ * queries are answered by BaseNativeWindow
+ */
+int HWComposerNativeWindow::_query(const struct ANativeWindow* window, int what, int* value)
+{
+#if ANDROID_VERSION_MAJOR>=8
+    if (what == NATIVE_WINDOW_BUFFER_AGE) {
+        const HWComposerNativeWindow* self = static_cast<const HWComposerNativeWindow*>(
+                static_cast<const BaseNativeWindow*>(window));
+        *value = self->bufferAge();
+        return NO_ERROR;
+    }
+#endif
+    return BaseNativeWindow::_query(window, what, value);
+}
+
 /*
  *  native_window_set_usage(..., usage)
  *  Sets the intended usage flags for the next buffers
@@ -444,7 +701,7 @@ int HWComposerNativeWindow::setUsage(uint64_t usage)
     TRACE("usage=x%" PRIx64 " realloc=%d", usage, need_realloc);
     m_usage = usage;
     if (need_realloc)
-        destroyBuffers();
+        invalidateBuffers();
     return NO_ERROR;
 }
 
@@ -461,7 +718,7 @@ int HWComposerNativeWindow::setBuffersFormat(int format)
     TRACE("format=x%x realloc=%d", format, need_realloc);
     m_bufFormat = format;
     if (need_realloc)
-        destroyBuffers();
+        invalidateBuffers();
 
     return NO_ERROR;
 }
@@ -477,7 +734,7 @@ int HWComposerNativeWindow::setBufferCount(int count)
     TRACE("count=%d realloc=%d", count, need_realloc);
     m_bufferCount = count;
     if (need_realloc)
-        destroyBuffers();
+        invalidateBuffers();
     return NO_ERROR;
 }
 
@@ -485,9 +742,10 @@ void HWComposerNativeWindow::allocateBuffers()
 {
     // This function gets called from dequeue which already locked
     // m_mutex, so we do this without locking here.
-    TRACE("cnt=%d", m_bufferCount);
+    unsigned int count = m_bufferCount + (mailbox() ? 1 : 0);
+    TRACE("cnt=%d", count);
 
-    for(unsigned int i = 0; i < m_bufferCount; i++)
+    for(unsigned int i = 0; i < count; i++)
     {
         HWComposerNativeWindowBuffer *b
          = new HWComposerNativeWindowBuffer(m_width, m_height, m_bufFormat, m_usage);
@@ -500,15 +758,12 @@ void HWComposerNativeWindow::allocateBuffers()
 
         if (b->status) {
             b->common.decRef(&b->common);
-            fprintf(stderr,"WARNING: %s: allocated only %zu buffers out of %u\n", __PRETTY_FUNCTION__, m_bufList.size(), m_bufferCount);
+            fprintf(stderr,"WARNING: %s: allocated only %d buffers out of %u\n", __PRETTY_FUNCTION__, m_chain.size(), count);
             break;
         }
 
-        m_bufList.push_back(b);
+        m_chain.addSlot(b);
     }
-
-    // Restart the count, to avoid out-of-bounds access if it shrinked.
-    m_nextBuffer = 0;
 }
 
 /*
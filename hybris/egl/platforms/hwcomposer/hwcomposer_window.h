@@ -18,10 +18,10 @@
 #define FBDEV_WINDOW_H
 
 #include "eglnativewindowbase.h"
+#include "swapchain.h"
 #include <linux/fb.h>
 #include <hardware/gralloc.h>
-
-#include <vector>
+#include <pthread.h>
 
 
 class HWComposerNativeWindowBuffer : public BaseNativeWindowBuffer {
@@ -35,7 +35,6 @@ protected:
    virtual ~HWComposerNativeWindowBuffer() ;
 
 protected:
-    int busy;
     int fenceFd;
     int status;
 };
@@ -43,11 +42,17 @@ protected:
 
 class HWComposerNativeWindow : public EGLBaseNativeWindow {
 public:
-    HWComposerNativeWindow(unsigned int width, unsigned int height, unsigned int format);
+    // With presentThread present() is called from a thread of the window
+    // instead of from eglSwapBuffers. Subclasses asking for it have to call
+    // stopPresentThread() in their destructor, before present() goes away.
+    HWComposerNativeWindow(unsigned int width, unsigned int height, unsigned int format,
+                           bool presentThread = false);
     ~HWComposerNativeWindow();
 
     int getFenceBufferFd(HWComposerNativeWindowBuffer *buffer);
     void setFenceBufferFd(HWComposerNativeWindowBuffer *buffer, int fd);
+    // Adds fd to the fence of the buffer, the buffer is free once both signalled
+    void mergeFenceBufferFd(HWComposerNativeWindowBuffer *buffer, int fd);
 protected:
     // overloads from BaseNativeWindow
     virtual int setSwapInterval(int interval);
@@ -71,18 +76,31 @@ protected:
     virtual int setBuffersFormat(int format);
     virtual int setBuffersDimensions(int width, int height);
     virtual int setBufferCount(int cnt);
+    // see NATIVE_WINDOW_BUFFER_AGE, answered by _query()
+    int bufferAge() const;
     virtual void present(HWComposerNativeWindowBuffer *buffer) = 0;
 
+    // Stops the present thread if the window has one, the remaining queued
+    // frames are dropped
+    void stopPresentThread();
+
 private:
+    static int _query(const struct ANativeWindow* window, int what, int* value);
     void destroyBuffers();
     void allocateBuffers();
+    void waitForPresents();
+    void invalidateBuffers();
+    bool mailbox() const;
+    static void *present_thread(void *data);
+    void presentLoop();
 
 private:
     uint64_t m_usage;
     unsigned int m_bufFormat;
-    std::vector<HWComposerNativeWindowBuffer*> m_bufList;
+    // Buffers are free again once presented, their fence guards the reuse
+    SwapChain m_chain;
     unsigned int m_bufferCount;
-    unsigned int m_nextBuffer;
+    int m_bufferAge;
 
     int m_width;
     int m_height;
@@ -90,6 +108,18 @@ private:
     pthread_mutex_t m_mutex;
 
     unsigned int m_transformHint;
+    int m_swapInterval;
+
+    // The present thread takes the queued buffers one by one. The buffer
+    // on screen stays ACQUIRED until the next one is presented, as some
+    // present callbacks fence the previous buffer.
+    pthread_cond_t m_cond;
+    pthread_t m_presentThread;
+    bool m_presentThreadRunning;
+    bool m_presentThreadQuit;
+    bool m_presenting;
+    HWComposerNativeWindowBuffer *m_frontBuf;
+    unsigned int m_droppedFrames;
 };
 
 #endif
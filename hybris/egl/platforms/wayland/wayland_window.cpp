@@ -32,6 +32,9 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 
 #include "logging.h"
 #include <eglhybris.h>
@@ -42,17 +45,6 @@ extern "C" {
 }
 #endif
 
-static void
-wl_buffer_release(void *data, struct wl_buffer *buffer)
-{
-    WaylandNativeWindow *win = static_cast<WaylandNativeWindow *>(data);
-    win->releaseBuffer(buffer);
-}
-
-static struct wl_buffer_listener wl_buffer_listener = {
-    wl_buffer_release
-};
-
 static void
 wayland_frame_callback(void *data, struct wl_callback *callback, uint32_t time)
 {
@@ -65,6 +57,58 @@ static const struct wl_callback_listener frame_listener = {
     wayland_frame_callback
 };
 
+static int fencethreadenvchecked = 0;
+
+// HYBRIS_WAYLAND_FENCE_THREAD=0 makes eglSwapBuffers wait for the rendering
+// to finish, like it used to, instead of leaving that to the fence thread.
+static bool use_fence_thread()
+{
+    if (fencethreadenvchecked == 0)
+    {
+        const char *env = getenv("HYBRIS_WAYLAND_FENCE_THREAD");
+        if (env != NULL && strcmp(env, "0") == 0)
+            fencethreadenvchecked = 1;
+        else
+            fencethreadenvchecked = 2;
+    }
+    return fencethreadenvchecked == 2;
+}
+
+static bool fence_pending(int fenceFd)
+{
+#if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
+    return fenceFd >= 0 && sync_wait(fenceFd, 0) < 0;
+#else
+    return false;
+#endif
+}
+
+static void wait_fence(int fenceFd)
+{
+    if (fenceFd < 0)
+        return;
+#if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
+    sync_wait(fenceFd, -1);
+#endif
+    close(fenceFd);
+}
+
+// Waits for the fence like wait_fence(), or until wakeFd becomes readable
+static void wait_fence_or_wake(int fenceFd, int wakeFd)
+{
+    if (fenceFd < 0)
+        return;
+#if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
+    struct pollfd fds[2] = {
+        { fenceFd, POLLIN, 0 },
+        { wakeFd, POLLIN, 0 },
+    };
+    while (poll(fds, 2, -1) < 0 && (errno == EINTR || errno == EAGAIN))
+        ;
+#endif
+    close(fenceFd);
+}
+
 int WaylandNativeWindow::dequeueBuffer(BaseNativeWindowBuffer **buffer, int *fenceFd){
     HYBRIS_TRACE_BEGIN("wayland-platform", "dequeueBuffer", "");
 
@@ -76,63 +120,34 @@ int WaylandNativeWindow::dequeueBuffer(BaseNativeWindowBuffer **buffer, int *fen
 
     HYBRIS_TRACE_BEGIN("wayland-platform", "dequeueBuffer_wait_for_buffer", "");
 
-    HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_freeBufs);
-
-    while (m_freeBufs==0) {
-        HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_freeBufs);
-        readQueue(true);
-    }
-
-    std::list<WaylandNativeWindowBuffer *>::iterator it = m_bufList.begin();
-    for (; it != m_bufList.end(); it++)
-    {
-         if ((*it)->busy)
-             continue;
-         if ((*it)->youngest == 1)
-             continue;
-         break;
-    }
-
-    if (it==m_bufList.end()) {
-        HYBRIS_TRACE_BEGIN("wayland-platform", "dequeueBuffer_worst_case_scenario", "");
-        HYBRIS_TRACE_END("wayland-platform", "dequeueBuffer_worst_case_scenario", "");
-
-        it = m_bufList.begin();
-        for (; it != m_bufList.end() && (*it)->busy; it++)
-        {}
+    HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_chain.freeCount());
 
-    }
-    if (it==m_bufList.end()) {
-        unlock();
-        HYBRIS_TRACE_BEGIN("wayland-platform", "dequeueBuffer_no_free_buffers", "");
-        HYBRIS_TRACE_END("wayland-platform", "dequeueBuffer_no_free_buffers", "");
-        TRACE("%p: no free buffers", buffer);
-        return NO_ERROR;
+    while (m_chain.freeCount() == 0) {
+        HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_chain.freeCount());
+        // Buffers can only be released after the fence thread committed the
+        // ones before them, which it needs the lock for.
+        if (m_commitsInFlight > 0)
+            pthread_cond_wait(&m_fenceCond, &mutex);
+        else
+            readQueue(true);
     }
 
-    wnb = *it;
+    // Take the buffer which has been free for the longest time, which leaves
+    // the compositor as much time as possible to really be done with it.
+    wnb = static_cast<WaylandNativeWindowBuffer *>(m_chain.buffer(m_chain.nextFree()));
     assert(wnb!=NULL);
     HYBRIS_TRACE_END("wayland-platform", "dequeueBuffer_wait_for_buffer", "");
 
-    /* If the buffer doesn't match the window anymore, re-allocate */
-    if (wnb->width != m_width || wnb->height != m_height
-        || wnb->format != m_format || wnb->usage != m_usage)
-    {
-        TRACE("wnb:%p,win:%p %i,%i %i,%i x%x,x%x x%x,x%x",
-            wnb,m_window,
-            wnb->width,m_width, wnb->height,m_height,
-            wnb->format,m_format, wnb->usage,m_usage);
-        destroyBuffer(wnb);
-        m_bufList.erase(it);
-        wnb = addBuffer();
-    }
+    /* If the buffer doesn't match the window anymore, re-allocate all of them */
+    if (!matchesWindow(wnb))
+        reallocateBuffers();
 
-    wnb->busy = 1;
+    int slot = m_chain.dequeue();
+    wnb = static_cast<WaylandNativeWindowBuffer *>(m_chain.buffer(slot));
+    m_bufferAge = m_chain.age(slot);
     *buffer = wnb;
-    queue.push_back(wnb);
-    --m_freeBufs;
 
-    HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_freeBufs);
+    HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_chain.freeCount());
     HYBRIS_TRACE_BEGIN("wayland-platform", "dequeueBuffer_gotBuffer", "-%p", wnb);
     HYBRIS_TRACE_END("wayland-platform", "dequeueBuffer_gotBuffer", "-%p", wnb);
     HYBRIS_TRACE_END("wayland-platform", "dequeueBuffer_wait_for_buffer", "");
@@ -149,24 +164,21 @@ void WaylandNativeWindow::prepareSwap(EGLint *damage_rects, EGLint damage_n_rect
     unlock();
 }
 
-void WaylandNativeWindow::finishSwap()
+// Attach and commit wnb, waiting for the frame callback first. Called with
+// the window locked, either from finishSwap() or from the fence thread.
+void WaylandNativeWindow::commitBuffer(WaylandNativeWindowBuffer *wnb,
+                                       const EGLint *damage_rects, EGLint damage_n_rects)
 {
     int ret = 0;
-    lock();
-    if (!m_window) {
-        unlock();
-        return;
-    }
 
     ret = readQueue(false);
     if (this->frame_callback) {
         do {
-            ret = readQueue(true);
-        } while (this->frame_callback && ret != -1);
+            ret = readQueue(true, m_fenceWakeFd);
+        } while (this->frame_callback && ret != -1 && !m_fenceThreadQuit);
     }
-    if (ret < 0) {
+    if (ret < 0 || m_fenceThreadQuit) {
         HYBRIS_TRACE_END("wayland-platform", "queueBuffer_wait_for_frame_callback", "");
-        unlock();
         return;
     }
 
@@ -175,27 +187,17 @@ void WaylandNativeWindow::finishSwap()
         wl_callback_add_listener(this->frame_callback, &frame_listener, this);
     }
 
-    WaylandNativeWindowBuffer *wnb = NULL;
-    if (!queue.empty()) {
-        wnb = queue.front();
-        queue.pop_front();
-    }
-
     if (wnb) {
-        assert(wnb->busy == 1);
+        assert(m_chain.state(m_chain.slotOf(wnb)) == SwapChain::ACQUIRED);
 
-        if (!wnb->wlbuffer) {
-            wnb->init(m_android_wlegl, m_display, wl_queue);
-            TRACE("%p add listener with %p inside", wnb, wnb->wlbuffer);
-            wl_buffer_add_listener(wnb->wlbuffer, &wl_buffer_listener, this);
-        }
+        // Buffers are normally registered when they are allocated
+        if (!wnb->wlbuffer)
+            initBuffer(wnb);
 
         wl_surface_attach(wl_surface_wrapper, wnb->wlbuffer, 0, 0);
 
         m_window->attached_width = wnb->width;
         m_window->attached_height = wnb->height;
-
-        fronted.push_back(wnb);
     }
 
     // If the compositor doesn't support damage_buffer, we deliberately
@@ -203,9 +205,9 @@ void WaylandNativeWindow::finishSwap()
     // https://bugs.freedesktop.org/78190
     if (wl_proxy_get_version((struct wl_proxy *) wl_surface_wrapper) >=
         WL_SURFACE_DAMAGE_BUFFER_SINCE_VERSION) {
-        if (m_damage_n_rects > 0 && m_window->attached_height > 0) {
-            for (int i = 0; i < m_damage_n_rects; i++) {
-                const int *rect = &m_damage_rects[i * 4];
+        if (damage_n_rects > 0 && m_window->attached_height > 0) {
+            for (int i = 0; i < damage_n_rects; i++) {
+                const int *rect = &damage_rects[i * 4];
                 wl_surface_damage_buffer(wl_surface_wrapper,
                                          rect[0], m_window->attached_height - rect[1] - rect[3],
                                          rect[2], rect[3]);
@@ -228,12 +230,137 @@ void WaylandNativeWindow::finishSwap()
     }
 
     wl_display_flush(m_display);
+}
+
+void WaylandNativeWindow::finishSwap()
+{
+    lock();
+    if (!m_window) {
+        unlock();
+        return;
+    }
+
+    WaylandNativeWindowBuffer *wnb = NULL;
+    int fenceFd = -1;
+    int slot = m_chain.acquire();
+    if (slot >= 0) {
+        wnb = static_cast<WaylandNativeWindowBuffer *>(m_chain.buffer(slot));
+        fenceFd = wnb->fence_fd;
+        wnb->fence_fd = -1;
+    }
+
+    // Commits have to stay in order, so once one of them waits for its fence
+    // all following ones go through the fence thread as well.
+    if ((m_commitsInFlight > 0 || fence_pending(fenceFd)) && startFenceThread()) {
+        PendingCommit commit;
+        commit.wnb = wnb;
+        commit.fenceFd = fenceFd;
+        // The damage rects are only valid during eglSwapBuffers
+        if (m_damage_n_rects > 0)
+            commit.damage.assign(m_damage_rects, m_damage_rects + m_damage_n_rects * 4);
+        m_pendingCommits.push_back(commit);
+        m_commitsInFlight++;
+        HYBRIS_TRACE_COUNTER("wayland-platform", "m_commitsInFlight", "%i", m_commitsInFlight);
+        pthread_cond_broadcast(&m_fenceCond);
+    } else {
+        wait_fence(fenceFd);
+        commitBuffer(wnb, m_damage_rects, m_damage_n_rects);
+    }
 
     m_damage_rects = NULL;
     m_damage_n_rects = 0;
     unlock();
 }
 
+bool WaylandNativeWindow::startFenceThread()
+{
+    if (m_fenceThreadRunning)
+        return true;
+
+    m_fenceWakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (m_fenceWakeFd < 0 ||
+        pthread_create(&m_fenceThread, NULL, fence_thread, this) != 0) {
+        fprintf(stderr, "failed to start the fence thread, waiting for fences in eglSwapBuffers\n");
+        if (m_fenceWakeFd >= 0)
+            close(m_fenceWakeFd);
+        m_fenceWakeFd = -1;
+        return false;
+    }
+
+    m_fenceThreadRunning = true;
+    return true;
+}
+
+void WaylandNativeWindow::stopFenceThread()
+{
+    if (!m_fenceThreadRunning)
+        return;
+
+    m_fenceThreadQuit = true;
+
+    // The fence thread keeps the window locked while it waits for a frame
+    // callback, which may never come for a window that is going away. Wake
+    // it up before taking the lock, the eventfd stays readable until it is
+    // closed so the wake-up can't be missed.
+    uint64_t wake = 1;
+    if (write(m_fenceWakeFd, &wake, sizeof(wake)) != sizeof(wake))
+        TRACE("failed to wake the fence thread: %s", strerror(errno));
+
+    lock();
+    pthread_cond_broadcast(&m_fenceCond);
+    unlock();
+
+    pthread_join(m_fenceThread, NULL);
+    m_fenceThreadRunning = false;
+    close(m_fenceWakeFd);
+    m_fenceWakeFd = -1;
+}
+
+// Called with the window locked
+void WaylandNativeWindow::waitForPendingCommits()
+{
+    while (m_commitsInFlight > 0)
+        pthread_cond_wait(&m_fenceCond, &mutex);
+}
+
+void *WaylandNativeWindow::fence_thread(void *data)
+{
+    static_cast<WaylandNativeWindow *>(data)->fenceLoop();
+    return NULL;
+}
+
+void WaylandNativeWindow::fenceLoop()
+{
+    lock();
+    for (;;) {
+        while (m_pendingCommits.empty() && !m_fenceThreadQuit)
+            pthread_cond_wait(&m_fenceCond, &mutex);
+        if (m_pendingCommits.empty())
+            break;
+
+        PendingCommit commit = m_pendingCommits.front();
+        m_pendingCommits.pop_front();
+
+        // The render thread goes on with the next frame meanwhile
+        unlock();
+        HYBRIS_TRACE_BEGIN("wayland-platform", "fence_thread_waiting_for_fence", "-%p", commit.wnb);
+        wait_fence_or_wake(commit.fenceFd, m_fenceWakeFd);
+        HYBRIS_TRACE_END("wayland-platform", "fence_thread_waiting_for_fence", "-%p", commit.wnb);
+        lock();
+
+        // Once the window is going away the remaining commits are dropped
+        if (m_window && !m_fenceThreadQuit) {
+            commitBuffer(commit.wnb, commit.damage.empty() ? NULL : &commit.damage[0],
+                         commit.damage.size() / 4);
+        }
+
+        m_commitsInFlight--;
+        HYBRIS_TRACE_COUNTER("wayland-platform", "m_commitsInFlight", "%i", m_commitsInFlight);
+        pthread_cond_broadcast(&m_fenceCond);
+    }
+    unlock();
+}
+
 static int debugenvchecked = 0;
 
 int WaylandNativeWindow::queueBuffer(BaseNativeWindowBuffer* buffer, int fenceFd)
@@ -243,6 +370,11 @@ int WaylandNativeWindow::queueBuffer(BaseNativeWindowBuffer* buffer, int fenceFd
     HYBRIS_TRACE_BEGIN("wayland-platform", "queueBuffer", "-%p", wnb);
     lock();
 
+    int slot = m_chain.slotOf(wnb);
+    assert(slot >= 0);
+    // Committed by finishSwap(), in the order the buffers were queued
+    m_chain.queue(slot);
+
     if (debugenvchecked == 0)
     {
         if (getenv("HYBRIS_WAYLAND_DUMP_BUFFERS") != NULL)
@@ -250,25 +382,30 @@ int WaylandNativeWindow::queueBuffer(BaseNativeWindowBuffer* buffer, int fenceFd
         else
             debugenvchecked = 1;
     }
-    if (debugenvchecked == 2)
-    {
-        HYBRIS_TRACE_BEGIN("wayland-platform", "queueBuffer_dumping_buffer", "-%p", wnb);
-        hybris_dump_buffer_to_file(wnb->getNativeBuffer());
-        HYBRIS_TRACE_END("wayland-platform", "queueBuffer_dumping_buffer", "-%p", wnb);
-
-    }
 
 #if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
-    HYBRIS_TRACE_BEGIN("wayland-platform", "queueBuffer_waiting_for_fence", "-%p", wnb);
-    if (fenceFd >= 0)
+    // Usually the fence is only waited on before the buffer gets committed,
+    // so that eglSwapBuffers doesn't block on the GPU, see finishSwap().
+    if (fenceFd >= 0 && (debugenvchecked == 2 || !use_fence_thread()))
     {
+        HYBRIS_TRACE_BEGIN("wayland-platform", "queueBuffer_waiting_for_fence", "-%p", wnb);
         sync_wait(fenceFd, -1);
         close(fenceFd);
+        fenceFd = -1;
+        HYBRIS_TRACE_END("wayland-platform", "queueBuffer_waiting_for_fence", "-%p", wnb);
     }
-    HYBRIS_TRACE_END("wayland-platform", "queueBuffer_waiting_for_fence", "-%p", wnb);
+    wnb->fence_fd = fenceFd;
 #endif
 
-    HYBRIS_TRACE_COUNTER("wayland-platform", "fronted.size", "%i", fronted.size());
+    if (debugenvchecked == 2)
+    {
+        HYBRIS_TRACE_BEGIN("wayland-platform", "queueBuffer_dumping_buffer", "-%p", wnb);
+        hybris_dump_buffer_to_file(wnb->getNativeBuffer());
+        HYBRIS_TRACE_END("wayland-platform", "queueBuffer_dumping_buffer", "-%p", wnb);
+
+    }
+
+    HYBRIS_TRACE_COUNTER("wayland-platform", "fronted.size", "%i", m_chain.count(SwapChain::ACQUIRED));
     HYBRIS_TRACE_END("wayland-platform", "queueBuffer", "-%p", wnb);
     unlock();
 
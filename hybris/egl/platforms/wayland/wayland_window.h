@@ -26,6 +26,7 @@
 #ifndef Wayland_WINDOW_H
 #define Wayland_WINDOW_H
 #include "wayland_window_common.h"
+#include "swapchain.h"
 #include "eglnativewindowbase.h"
 #include <linux/fb.h>
 
@@ -39,8 +40,9 @@ extern "C" {
 #include <pthread.h>
 }
 
-#include <list>
 #include <deque>
+#include <vector>
+#include <atomic>
 
 class WaylandNativeWindow : public EGLBaseNativeWindow {
 public:
@@ -84,16 +86,38 @@ protected:
     virtual int setBuffersFormat(int format);
     virtual int setBuffersDimensions(int width, int height);
     virtual int setBufferCount(int cnt);
+    // see NATIVE_WINDOW_BUFFER_AGE, answered by _query()
+    int bufferAge() const;
 
 private:
+    static int _query(const struct ANativeWindow* window, int what, int* value);
+    bool matchesWindow(WaylandNativeWindowBuffer *wnb) const;
+    WaylandNativeWindowBuffer *createBuffer();
     WaylandNativeWindowBuffer *addBuffer();
+    void initBuffer(WaylandNativeWindowBuffer *wnb);
+    void registerBuffers();
+    void reallocateBuffers();
     void destroyBuffer(WaylandNativeWindowBuffer *);
     void destroyBuffers();
-    int readQueue(bool block);
+    int readQueue(bool block, int wakeFd = -1);
+    void commitBuffer(WaylandNativeWindowBuffer *wnb, const EGLint *damage_rects, EGLint damage_n_rects);
+    bool startFenceThread();
+    void stopFenceThread();
+    void waitForPendingCommits();
+    void fenceLoop();
+    static void *fence_thread(void *data);
 
-    std::list<WaylandNativeWindowBuffer *> m_bufList;
-    std::list<WaylandNativeWindowBuffer *> fronted;
-    std::deque<WaylandNativeWindowBuffer *> queue;
+    // A swapped buffer whose acquire fence had not signalled yet
+    struct PendingCommit {
+        WaylandNativeWindowBuffer *wnb;
+        int fenceFd;
+        std::vector<EGLint> damage;
+    };
+
+    // The slots of the buffers attached to the surface are ACQUIRED until
+    // the compositor releases them, wl_buffers are aliases of their slot.
+    SwapChain m_chain;
+    int m_bufferAge;
     struct wl_egl_window *m_window;
     struct wl_display *m_display;
     int m_width;
@@ -106,12 +130,23 @@ private:
     pthread_mutex_t mutex;
     pthread_cond_t cond;
     int m_queueReads;
-    int m_freeBufs;
     EGLint *m_damage_rects, m_damage_n_rects;
     struct wl_callback *frame_callback;
     int m_swap_interval;
     struct wl_display *wl_dpy_wrapper;
     struct wl_surface *wl_surface_wrapper;
+
+    // Commits waiting for their fence, handed over to the fence thread. They
+    // are guarded by mutex and counted in m_commitsInFlight until committed.
+    std::deque<PendingCommit> m_pendingCommits;
+    int m_commitsInFlight = 0;
+    pthread_cond_t m_fenceCond = PTHREAD_COND_INITIALIZER;
+    pthread_t m_fenceThread;
+    bool m_fenceThreadRunning = false;
+    std::atomic<bool> m_fenceThreadQuit{false};
+    // Readable once the fence thread has to quit, it polls it alongside the
+    // fence or the display it waits for.
+    int m_fenceWakeFd = -1;
 };
 
 #endif
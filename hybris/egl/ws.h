@@ -25,6 +25,8 @@ struct ws_egl_interface {
 
 	int (*has_mapping)(EGLSurface surface);
 	EGLNativeWindowType (*get_mapping)(EGLSurface surface);
+	/* Drops the EGLImages cached for a native buffer which goes away */
+	void (*release_buffer_images)(EGLClientBuffer buffer);
 };
 
 /* Defined in egl.c */
@@ -44,6 +44,8 @@
 #include <assert.h>
 
 #include <dlfcn.h>
+#include <pthread.h>
+#include <string.h>
 #include "logging.h"
 
 static int version = -1;
@@ -237,10 +239,14 @@ static void gralloc1_init(void)
 }
 #endif
 
+static void map_cache_forget(buffer_handle_t handle);
+
 int hybris_gralloc_release(buffer_handle_t handle, int was_allocated)
 {
     int ret = -ENOSYS;
 
+    map_cache_forget(handle);
+
     if GRALLOC_COMPAT(
         if (was_allocated) {
             ret = graphic_buffer_allocator_free(handle);
@@ -342,7 +348,7 @@ int hybris_gralloc_allocate(int width, int height, int format, int usage, buffer
     return ret;
 }
 
-int hybris_gralloc_lock(buffer_handle_t handle, int usage, int l, int t, int w, int h, void **vaddr)
+static int gralloc_lock(buffer_handle_t handle, int usage, int l, int t, int w, int h, void **vaddr)
 {
     int ret = -ENOSYS;
 
@@ -378,7 +384,7 @@ int hybris_gralloc_lock(buffer_handle_t handle, int usage, int l, int t, int w,
     return ret;
 }
 
-int hybris_gralloc_unlock(buffer_handle_t handle)
+static int gralloc_unlock(buffer_handle_t handle)
 {
     int ret = -ENOSYS;
 
@@ -395,6 +401,232 @@ int hybris_gralloc_unlock(buffer_handle_t handle)
     return ret;
 }
 
+/*
+ * Persistent CPU mappings
+ *
+ * Software renderers lock the same buffers for every frame, and many
+ * gralloc implementations map and unmap the buffer on each lock and unlock.
+ * With HYBRIS_GRALLOC_MAP_CACHE=<n>, the unlock of up to n buffers is
+ * deferred instead, and locking such a buffer again with a usage and region
+ * its mapping covers returns the same address without calling gralloc.
+ * Buffers are really unlocked when they are locked incompatibly, evicted
+ * as the least recently used one or released.
+ *
+ * gralloc is never called with map_cache_mutex held. A kept mapping being
+ * really unlocked stays in the cache, marked as dropping, until gralloc
+ * returns, and locks and unlocks of its buffer wait for it.
+ *
+ * Skipping an unlock and a lock also skips the cache maintenance gralloc
+ * does there for buffers allocated cached: flushing on unlock for the GPU
+ * to see the CPU's writes, invalidating on lock for the CPU to see the
+ * GPU's. Which buffers need it depends on how they were allocated, which a
+ * lock doesn't tell, so the cache is only used on devices whose caches are
+ * coherent, which say so with HYBRIS_GRALLOC_MAP_CACHE_COHERENT=1. Their
+ * gralloc also has to let buffers be composited while the CPU keeps them
+ * locked.
+ */
+struct map_cache_entry {
+    buffer_handle_t handle;
+    int usage;
+    int l, t, w, h;
+    void *vaddr;
+    /* Locked by the caller, rather than kept locked by the cache */
+    int locked;
+    /* Being unlocked for good, without map_cache_mutex */
+    int dropping;
+    unsigned long last_use;
+};
+
+static pthread_once_t map_cache_once = PTHREAD_ONCE_INIT;
+static pthread_mutex_t map_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+/* signalled whenever a kept mapping has been dropped */
+static pthread_cond_t map_cache_cond = PTHREAD_COND_INITIALIZER;
+static struct map_cache_entry *map_cache = NULL;
+static int map_cache_size = 0;
+static unsigned long map_cache_clock = 0;
+static struct hybris_gralloc_map_cache_stats map_cache_stats;
+
+static void map_cache_init(void)
+{
+    const char *env = getenv("HYBRIS_GRALLOC_MAP_CACHE");
+    const char *coherent = getenv("HYBRIS_GRALLOC_MAP_CACHE_COHERENT");
+    int size = env ? atoi(env) : 0;
+
+    if (size <= 0 || !coherent || strcmp(coherent, "1") != 0)
+        return;
+
+    map_cache = calloc(size, sizeof(struct map_cache_entry));
+    if (map_cache)
+        map_cache_size = size;
+}
+
+/* Called with map_cache_mutex locked, waits until a mapping of handle being dropped is gone */
+static struct map_cache_entry *map_cache_find(buffer_handle_t handle)
+{
+    int i;
+
+again:
+    for (i = 0; i < map_cache_size; i++) {
+        if (map_cache[i].handle == handle) {
+            if (map_cache[i].dropping) {
+                pthread_cond_wait(&map_cache_cond, &map_cache_mutex);
+                goto again;
+            }
+            return &map_cache[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Whether the mapping of entry can stand in for a lock with usage and region */
+static int map_cache_covers(struct map_cache_entry *entry, int usage, int l, int t, int w, int h)
+{
+    return (usage & ~entry->usage) == 0 &&
+        l >= entry->l && t >= entry->t &&
+        l + w <= entry->l + entry->w && t + h <= entry->t + entry->h;
+}
+
+/*
+ * Called with map_cache_mutex locked, really unlocks the buffer of a kept
+ * mapping and removes it. The mutex is released while gralloc unlocks.
+ */
+static void map_cache_drop(struct map_cache_entry *entry)
+{
+    if (!entry->locked) {
+        entry->dropping = 1;
+        pthread_mutex_unlock(&map_cache_mutex);
+        gralloc_unlock(entry->handle);
+        pthread_mutex_lock(&map_cache_mutex);
+        pthread_cond_broadcast(&map_cache_cond);
+    }
+    memset(entry, 0, sizeof(*entry));
+}
+
+/*
+ * Called with map_cache_mutex locked, returns a free entry or NULL. With
+ * evict, the least recently used mapping is dropped if none is free,
+ * which releases the mutex meanwhile.
+ */
+static struct map_cache_entry *map_cache_slot(int evict)
+{
+    struct map_cache_entry *lru = NULL;
+    int i;
+
+    for (i = 0; i < map_cache_size; i++) {
+        if (!map_cache[i].handle)
+            return &map_cache[i];
+        if (!map_cache[i].locked && !map_cache[i].dropping &&
+                (!lru || map_cache[i].last_use < lru->last_use))
+            lru = &map_cache[i];
+    }
+
+    if (lru && evict) {
+        map_cache_drop(lru);
+        map_cache_stats.evictions++;
+        return lru;
+    }
+
+    return NULL;
+}
+
+int hybris_gralloc_lock(buffer_handle_t handle, int usage, int l, int t, int w, int h, void **vaddr)
+{
+    struct map_cache_entry *entry;
+    int ret;
+
+    pthread_once(&map_cache_once, map_cache_init);
+    if (!map_cache_size)
+        return gralloc_lock(handle, usage, l, t, w, h, vaddr);
+
+    pthread_mutex_lock(&map_cache_mutex);
+    entry = map_cache_find(handle);
+    if (entry && !entry->locked && map_cache_covers(entry, usage, l, t, w, h)) {
+        entry->locked = 1;
+        entry->last_use = ++map_cache_clock;
+        *vaddr = entry->vaddr;
+        map_cache_stats.hits++;
+        pthread_mutex_unlock(&map_cache_mutex);
+        return 0;
+    }
+
+    map_cache_stats.misses++;
+    // Locked twice, leave it to gralloc to complain
+    if (entry && entry->locked) {
+        pthread_mutex_unlock(&map_cache_mutex);
+        return gralloc_lock(handle, usage, l, t, w, h, vaddr);
+    }
+    if (entry)
+        map_cache_drop(entry);
+    /* Make room before locking, the mapping is only kept if that worked */
+    map_cache_slot(1);
+    pthread_mutex_unlock(&map_cache_mutex);
+
+    ret = gralloc_lock(handle, usage, l, t, w, h, vaddr);
+    if (ret != 0)
+        return ret;
+
+    pthread_mutex_lock(&map_cache_mutex);
+    if (!map_cache_find(handle) && (entry = map_cache_slot(0)) != NULL) {
+        entry->handle = handle;
+        entry->usage = usage;
+        entry->l = l;
+        entry->t = t;
+        entry->w = w;
+        entry->h = h;
+        entry->vaddr = *vaddr;
+        entry->locked = 1;
+        entry->last_use = ++map_cache_clock;
+    }
+    pthread_mutex_unlock(&map_cache_mutex);
+
+    return ret;
+}
+
+int hybris_gralloc_unlock(buffer_handle_t handle)
+{
+    struct map_cache_entry *entry;
+
+    pthread_once(&map_cache_once, map_cache_init);
+    if (!map_cache_size)
+        return gralloc_unlock(handle);
+
+    pthread_mutex_lock(&map_cache_mutex);
+    entry = map_cache_find(handle);
+    if (entry && entry->locked) {
+        entry->locked = 0;
+        map_cache_stats.deferred_unlocks++;
+        pthread_mutex_unlock(&map_cache_mutex);
+        return 0;
+    }
+    pthread_mutex_unlock(&map_cache_mutex);
+
+    return gralloc_unlock(handle);
+}
+
+/* Really unlocks a buffer whose mapping is kept, before it goes away */
+static void map_cache_forget(buffer_handle_t handle)
+{
+    struct map_cache_entry *entry;
+
+    pthread_once(&map_cache_once, map_cache_init);
+    if (!map_cache_size)
+        return;
+
+    pthread_mutex_lock(&map_cache_mutex);
+    entry = map_cache_find(handle);
+    if (entry)
+        map_cache_drop(entry);
+    pthread_mutex_unlock(&map_cache_mutex);
+}
+
+void hybris_gralloc_get_map_cache_stats(struct hybris_gralloc_map_cache_stats *stats)
+{
+    pthread_mutex_lock(&map_cache_mutex);
+    *stats = map_cache_stats;
+    pthread_mutex_unlock(&map_cache_mutex);
+}
+
 // Legacy fbdev methods. these are not available in gralloc1 thus use old API.
 int hybris_gralloc_fbdev_format(void)
 {
@@ -70,6 +70,442 @@ int android_dladdr(const void *addr, void *info);
         return android_dlsym(name##_handle, sym) != NULL; \
     }
 
+/*
+ * With HYBRIS_USE_IFUNC_DISPATCH defined, the HYBRIS_IMPLEMENT_* macros
+ * generate GNU indirect functions next to the wrappers. A constructor of
+ * the library resolves each symbol from the Android library, and the
+ * resolver, run when the dynamic linker binds the symbol, returns that
+ * function so callers jump directly into the Android library, skipping the
+ * checks the wrappers do on every call.
+ *
+ * Resolvers must not load libraries: they may run as IRELATIVE relocations
+ * while the library is still being loaded (BIND_NOW, hidden visibility),
+ * before any constructor. Then, and for symbols the Android library lacks,
+ * they return the wrapper, which resolves the symbol on its first call.
+ *
+ * This is not possible when FP_ATTRIB is needed, as the Android function
+ * would then be called with the wrong floating point ABI.
+ */
+#if defined(HYBRIS_USE_IFUNC_DISPATCH) && !defined(__ARM_PCS_VFP)
+#define HYBRIS_IFUNC_DISPATCH 1
+#endif
+
+#define HYBRIS_IMPLEMENT_IFUNC(name, symbol) \
+    static void __attribute__((constructor)) symbol##_dispatch_init(void) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+    } \
+    __asm__ (".type " #symbol ", %gnu_indirect_function"); \
+    __typeof__(symbol) *symbol##_dispatch(void) __asm__ (#symbol); \
+    __typeof__(symbol) *symbol##_dispatch(void) \
+    { \
+        return symbol##_fptr ? symbol##_fptr : symbol##_wrapper; \
+    }
+
+#ifdef HYBRIS_IFUNC_DISPATCH
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION0(name, return_type, symbol) \
+    static return_type (*symbol##_fptr)() = NULL; \
+    static return_type symbol##_wrapper() \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION1(name, return_type, symbol, a1) \
+    static return_type (*symbol##_fptr)(a1) = NULL; \
+    static return_type symbol##_wrapper(a1 n1) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(n1); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION2(name, return_type, symbol, a1, a2) \
+    static return_type (*symbol##_fptr)(a1, a2) = NULL; \
+    static return_type symbol##_wrapper(a1 n1, a2 n2) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(n1, n2); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION3(name, return_type, symbol, a1, a2, a3) \
+    static return_type (*symbol##_fptr)(a1, a2, a3) = NULL; \
+    static return_type symbol##_wrapper(a1 n1, a2 n2, a3 n3) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(n1, n2, n3); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION4(name, return_type, symbol, a1, a2, a3, a4) \
+    static return_type (*symbol##_fptr)(a1, a2, a3, a4) = NULL; \
+    static return_type symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(n1, n2, n3, n4); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION5(name, return_type, symbol, a1, a2, a3, a4, a5) \
+    static return_type (*symbol##_fptr)(a1, a2, a3, a4, a5) = NULL; \
+    static return_type symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(n1, n2, n3, n4, n5); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION6(name, return_type, symbol, a1, a2, a3, a4, a5, a6) \
+    static return_type (*symbol##_fptr)(a1, a2, a3, a4, a5, a6) = NULL; \
+    static return_type symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(n1, n2, n3, n4, n5, n6); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION7(name, return_type, symbol, a1, a2, a3, a4, a5, a6, a7) \
+    static return_type (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7) = NULL; \
+    static return_type symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(n1, n2, n3, n4, n5, n6, n7); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION8(name, return_type, symbol, a1, a2, a3, a4, a5, a6, a7, a8) \
+    static return_type (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8) = NULL; \
+    static return_type symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION9(name, return_type, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9) \
+    static return_type (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9) = NULL; \
+    static return_type symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION10(name, return_type, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10) \
+    static return_type (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10) = NULL; \
+    static return_type symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION11(name, return_type, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11) \
+    static return_type (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11) = NULL; \
+    static return_type symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10, a11 n11) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10, n11); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION12(name, return_type, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12) \
+    static return_type (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12) = NULL; \
+    static return_type symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10, a11 n11, a12 n12) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10, n11, n12); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION13(name, return_type, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13) \
+    static return_type (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13) = NULL; \
+    static return_type symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10, a11 n11, a12 n12, a13 n13) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10, n11, n12, n13); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION14(name, return_type, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14) \
+    static return_type (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14) = NULL; \
+    static return_type symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10, a11 n11, a12 n12, a13 n13, a14 n14) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10, n11, n12, n13, n14); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION15(name, return_type, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15) \
+    static return_type (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15) = NULL; \
+    static return_type symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10, a11 n11, a12 n12, a13 n13, a14 n14, a15 n15) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10, n11, n12, n13, n14, n15); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION16(name, return_type, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16) \
+    static return_type (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16) = NULL; \
+    static return_type symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10, a11 n11, a12 n12, a13 n13, a14 n14, a15 n15, a16 n16) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10, n11, n12, n13, n14, n15, n16); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION17(name, return_type, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16, a17) \
+    static return_type (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16, a17) = NULL; \
+    static return_type symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10, a11 n11, a12 n12, a13 n13, a14 n14, a15 n15, a16 n16, a17 n17) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10, n11, n12, n13, n14, n15, n16, n17); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION18(name, return_type, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16, a17, a18) \
+    static return_type (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16, a17, a18) = NULL; \
+    static return_type symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10, a11 n11, a12 n12, a13 n13, a14 n14, a15 n15, a16 n16, a17 n17, a18 n18) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10, n11, n12, n13, n14, n15, n16, n17, n18); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_FUNCTION19(name, return_type, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16, a17, a18, a19) \
+    static return_type (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16, a17, a18, a19) = NULL; \
+    static return_type symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10, a11 n11, a12 n12, a13 n13, a14 n14, a15 n15, a16 n16, a17 n17, a18 n18, a19 n19) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        return symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10, n11, n12, n13, n14, n15, n16, n17, n18, n19); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION0(name, symbol) \
+    static void (*symbol##_fptr)() = NULL; \
+    static void symbol##_wrapper() \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION1(name, symbol, a1) \
+    static void (*symbol##_fptr)(a1) = NULL; \
+    static void symbol##_wrapper(a1 n1) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(n1); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION2(name, symbol, a1, a2) \
+    static void (*symbol##_fptr)(a1, a2) = NULL; \
+    static void symbol##_wrapper(a1 n1, a2 n2) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(n1, n2); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION3(name, symbol, a1, a2, a3) \
+    static void (*symbol##_fptr)(a1, a2, a3) = NULL; \
+    static void symbol##_wrapper(a1 n1, a2 n2, a3 n3) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(n1, n2, n3); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION4(name, symbol, a1, a2, a3, a4) \
+    static void (*symbol##_fptr)(a1, a2, a3, a4) = NULL; \
+    static void symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(n1, n2, n3, n4); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION5(name, symbol, a1, a2, a3, a4, a5) \
+    static void (*symbol##_fptr)(a1, a2, a3, a4, a5) = NULL; \
+    static void symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(n1, n2, n3, n4, n5); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION6(name, symbol, a1, a2, a3, a4, a5, a6) \
+    static void (*symbol##_fptr)(a1, a2, a3, a4, a5, a6) = NULL; \
+    static void symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(n1, n2, n3, n4, n5, n6); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION7(name, symbol, a1, a2, a3, a4, a5, a6, a7) \
+    static void (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7) = NULL; \
+    static void symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(n1, n2, n3, n4, n5, n6, n7); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION8(name, symbol, a1, a2, a3, a4, a5, a6, a7, a8) \
+    static void (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8) = NULL; \
+    static void symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION9(name, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9) \
+    static void (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9) = NULL; \
+    static void symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION10(name, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10) \
+    static void (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10) = NULL; \
+    static void symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION11(name, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11) \
+    static void (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11) = NULL; \
+    static void symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10, a11 n11) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10, n11); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION12(name, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12) \
+    static void (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12) = NULL; \
+    static void symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10, a11 n11, a12 n12) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10, n11, n12); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION13(name, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13) \
+    static void (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13) = NULL; \
+    static void symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10, a11 n11, a12 n12, a13 n13) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10, n11, n12, n13); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION14(name, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14) \
+    static void (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14) = NULL; \
+    static void symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10, a11 n11, a12 n12, a13 n13, a14 n14) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10, n11, n12, n13, n14); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION15(name, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15) \
+    static void (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15) = NULL; \
+    static void symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10, a11 n11, a12 n12, a13 n13, a14 n14, a15 n15) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10, n11, n12, n13, n14, n15); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION16(name, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16) \
+    static void (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16) = NULL; \
+    static void symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10, a11 n11, a12 n12, a13 n13, a14 n14, a15 n15, a16 n16) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10, n11, n12, n13, n14, n15, n16); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION17(name, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16, a17) \
+    static void (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16, a17) = NULL; \
+    static void symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10, a11 n11, a12 n12, a13 n13, a14 n14, a15 n15, a16 n16, a17 n17) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10, n11, n12, n13, n14, n15, n16, n17); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION18(name, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16, a17, a18) \
+    static void (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16, a17, a18) = NULL; \
+    static void symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10, a11 n11, a12 n12, a13 n13, a14 n14, a15 n15, a16 n16, a17 n17, a18 n18) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10, n11, n12, n13, n14, n15, n16, n17, n18); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION19(name, symbol, a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16, a17, a18, a19) \
+    static void (*symbol##_fptr)(a1, a2, a3, a4, a5, a6, a7, a8, a9, a10, a11, a12, a13, a14, a15, a16, a17, a18, a19) = NULL; \
+    static void symbol##_wrapper(a1 n1, a2 n2, a3 n3, a4 n4, a5 n5, a6 n6, a7 n7, a8 n8, a9 n9, a10 n10, a11 n11, a12 n12, a13 n13, a14 n14, a15 n15, a16 n16, a17 n17, a18 n18, a19 n19) \
+    { \
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \
+        symbol##_fptr(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10, n11, n12, n13, n14, n15, n16, n17, n18, n19); \
+    } \
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+
+
+#else
 
 
 #define HYBRIS_IMPLEMENT_FUNCTION0(name, return_type, symbol) \
@@ -431,6 +867,8 @@ int android_dladdr(const void *addr, void *info);
         f(n1, n2, n3, n4, n5, n6, n7, n8, n9, n10, n11, n12, n13, n14, n15, n16, n17, n18, n19); \
     }
 
+#endif /* HYBRIS_IFUNC_DISPATCH */
+
 
 /**
  *         XXX AUTO-GENERATED FILE XXX
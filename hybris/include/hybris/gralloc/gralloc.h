@@ -36,6 +36,21 @@ int hybris_gralloc_retain(buffer_handle_t handle);
 int hybris_gralloc_allocate(int width, int height, int format, int usage, buffer_handle_t *handle, uint32_t *stride);
 int hybris_gralloc_lock(buffer_handle_t handle, int usage, int l, int t, int w, int h, void **vaddr);
 int hybris_gralloc_unlock(buffer_handle_t handle);
+
+/*
+ * Counters of the mapping cache enabled with HYBRIS_GRALLOC_MAP_CACHE and
+ * HYBRIS_GRALLOC_MAP_CACHE_COHERENT
+ */
+struct hybris_gralloc_map_cache_stats {
+    /* Locks served by a kept mapping */
+    unsigned long hits;
+    unsigned long misses;
+    /* Unlocks which kept the mapping */
+    unsigned long deferred_unlocks;
+    unsigned long evictions;
+};
+
+void hybris_gralloc_get_map_cache_stats(struct hybris_gralloc_map_cache_stats *stats);
 int hybris_gralloc_fbdev_format(void);
 int hybris_gralloc_fbdev_framebuffer_count(void);
 int hybris_gralloc_fbdev_setSwapInterval(int interval);
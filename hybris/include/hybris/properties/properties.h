@@ -39,6 +39,12 @@
 #define PROP_MSG_SETPROP 1
 #define PROP_MSG_GETPROP 2
 #define PROP_MSG_LISTPROP 3
+/* Like GETPROP, but the connection stays open after the reply, so several
+ * requests can be sent on it back to back. Each of them gets exactly one
+ * reply, in order. Android's init doesn't implement it and closes the
+ * connection or answers with an error code, libhybris then falls back to
+ * GETPROP. */
+#define PROP_MSG_GETPROP_PIPELINED 4
 
 #ifdef __cplusplus
 extern "C" {
@@ -47,6 +53,10 @@ extern "C" {
 int property_set(const char *key, const char *value);
 int property_get(const char *key, char *value, const char *default_value);
 int property_list(void (*propfn)(const char *key, const char *value, void *cookie), void *cookie);
+/* Get count properties at once. values[i] has to hold PROP_VALUE_MAX bytes,
+ * default_values may be NULL. Returns 0 on success, -1 on invalid arguments. */
+int property_get_batch(const char * const *keys, char * const *values,
+                       const char * const *default_values, int count);
 
 #ifdef __cplusplus
 }
@@ -91,6 +91,10 @@ protected:
 	virtual int setBuffersDimensions(int width, int height) = 0;
 	virtual int setUsage(uint64_t usage) = 0;
 	virtual int setBufferCount(int cnt) = 0;
+
+	// windows answering more queries point ANativeWindow::query to their own
+	// function, which hands the others on to this one
+	static int _query(const struct ANativeWindow* window, int what, int* value);
 private:
 	static int _setSwapInterval(struct ANativeWindow* window, int interval);
 	static int _dequeueBuffer_DEPRECATED(ANativeWindow* window, ANativeWindowBuffer** buffer);
@@ -98,7 +102,6 @@ private:
 	static const char *_native_query_operation(int what);
 	static int _lockBuffer_DEPRECATED(struct ANativeWindow* window, ANativeWindowBuffer* buffer);
 	static int _queueBuffer_DEPRECATED(struct ANativeWindow* window, ANativeWindowBuffer* buffer);
-	static int _query(const struct ANativeWindow* window, int what, int* value);
 	static int _perform(struct ANativeWindow* window, int operation, ... );
 	static int _cancelBuffer_DEPRECATED(struct ANativeWindow* window, ANativeWindowBuffer* buffer);
 	static int _queueBuffer(struct ANativeWindow *window, ANativeWindowBuffer *buffer, int fenceFd);
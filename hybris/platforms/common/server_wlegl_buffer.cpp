@@ -23,12 +23,237 @@
 #include <android-config.h>
 #include <cstring>
 #include <cassert>
+#include <cstdlib>
+#include <list>
+#include <vector>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <linux/kcmp.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
 
 #include "server_wlegl_buffer.h"
 #include "server_wlegl_private.h"
+#include "logging.h"
 
 #include <hybris/gralloc/gralloc.h>
 
+/*
+ * Clients keep registering the same few swap chain buffers, whenever they
+ * resize or recreate their windows. With HYBRIS_WLEGL_IMPORT_CACHE=<n>, the
+ * last n buffers imported for a client are remembered and a buffer it
+ * registers again is handed the RemoteWindowBuffer, and so the imported
+ * handle, of the first registration instead of being imported anew.
+ *
+ * A buffer is looked up by its ints, its geometry and the inodes of its
+ * fds. Inodes don't tell buffers apart on every kernel (dma-buf and ION
+ * exports before 5.0 share one, so do all ashmem fds), so a hit is only
+ * taken if kcmp() confirms that each fd is the same open file as the one
+ * of the first registration, which the cache keeps a dup of. The cache of
+ * a client goes away with it. The least recently registered buffer is
+ * dropped from the cache once it is full, and released as soon as no
+ * wl_buffer uses it anymore.
+ */
+struct ImportKey {
+	int32_t width;
+	int32_t height;
+	int32_t stride;
+	int32_t format;
+	int64_t usage;
+	/* st_dev and st_ino of each fd */
+	std::vector<uint64_t> files;
+	std::vector<int> ints;
+	uint64_t hash;
+
+	bool operator==(const ImportKey &other) const
+	{
+		return hash == other.hash && width == other.width &&
+			height == other.height && stride == other.stride &&
+			format == other.format && usage == other.usage &&
+			files == other.files && ints == other.ints;
+	}
+};
+
+struct ImportEntry {
+	ImportKey key;
+	/* Dups of the fds of the first registration */
+	std::vector<int> fds;
+	RemoteWindowBuffer *buf;
+};
+
+struct ImportCache {
+	struct wl_listener destroy_listener;
+	/* Most recently registered first */
+	std::list<ImportEntry> entries;
+};
+
+static server_wlegl_import_stats import_stats;
+static pthread_mutex_t import_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static int import_cache_size()
+{
+	static int size = -1;
+
+	if (size == -1) {
+		const char *env = getenv("HYBRIS_WLEGL_IMPORT_CACHE");
+		size = env ? atoi(env) : 0;
+		if (size < 0)
+			size = 0;
+	}
+
+	return size;
+}
+
+static void hash_add(uint64_t *hash, uint64_t value)
+{
+	*hash = (*hash ^ value) * 0x100000001b3ULL;
+}
+
+static bool import_key(ImportKey *key, int32_t width, int32_t height,
+		       int32_t stride, int32_t format, int64_t usage,
+		       buffer_handle_t handle)
+{
+	key->width = width;
+	key->height = height;
+	key->stride = stride;
+	key->format = format;
+	key->usage = usage;
+	key->hash = 0xcbf29ce484222325ULL;
+	hash_add(&key->hash, ((uint64_t) width << 32) | (uint32_t) height);
+	hash_add(&key->hash, ((uint64_t) stride << 32) | (uint32_t) format);
+	hash_add(&key->hash, usage);
+
+	for (int i = 0; i < handle->numFds; i++) {
+		struct stat st;
+
+		if (fstat(handle->data[i], &st) < 0)
+			return false;
+		key->files.push_back(st.st_dev);
+		key->files.push_back(st.st_ino);
+		hash_add(&key->hash, st.st_dev);
+		hash_add(&key->hash, st.st_ino);
+	}
+
+	key->ints.assign(handle->data + handle->numFds,
+			 handle->data + handle->numFds + handle->numInts);
+	for (size_t i = 0; i < key->ints.size(); i++)
+		hash_add(&key->hash, (uint32_t) key->ints[i]);
+
+	return true;
+}
+
+/* Whether the fds of handle are the very files the entry was registered with */
+static bool import_same_files(const ImportEntry &entry, buffer_handle_t handle)
+{
+	pid_t pid = getpid();
+
+	for (int i = 0; i < handle->numFds; i++) {
+		if (syscall(SYS_kcmp, pid, pid, KCMP_FILE, entry.fds[i], handle->data[i]) != 0)
+			return false;
+	}
+
+	return true;
+}
+
+/* Called with import_mutex locked */
+static void import_entry_drop(ImportCache *cache, std::list<ImportEntry>::iterator it)
+{
+	RemoteWindowBuffer *buf = it->buf;
+
+	for (size_t i = 0; i < it->fds.size(); i++)
+		close(it->fds[i]);
+	cache->entries.erase(it);
+	import_stats.entries--;
+	buf->common.decRef(&buf->common);
+}
+
+static void import_cache_client_destroyed(struct wl_listener *listener, void *data)
+{
+	ImportCache *cache = wl_container_of(listener, cache, destroy_listener);
+
+	pthread_mutex_lock(&import_mutex);
+	while (!cache->entries.empty())
+		import_entry_drop(cache, cache->entries.begin());
+	pthread_mutex_unlock(&import_mutex);
+
+	delete cache;
+}
+
+static ImportCache *import_cache_of(wl_client *client)
+{
+	struct wl_listener *listener =
+		wl_client_get_destroy_listener(client, import_cache_client_destroyed);
+	ImportCache *cache;
+
+	if (listener)
+		return wl_container_of(listener, cache, destroy_listener);
+
+	cache = new ImportCache;
+	cache->destroy_listener.notify = import_cache_client_destroyed;
+	wl_client_add_destroy_listener(client, &cache->destroy_listener);
+	return cache;
+}
+
+/* Called with import_mutex locked, returns a new reference to the buffer or NULL */
+static RemoteWindowBuffer *import_cache_get(ImportCache *cache, const ImportKey &key,
+					    buffer_handle_t handle)
+{
+	std::list<ImportEntry>::iterator it;
+
+	for (it = cache->entries.begin(); it != cache->entries.end(); ++it) {
+		if (it->key == key && import_same_files(*it, handle))
+			break;
+	}
+
+	if (it == cache->entries.end()) {
+		import_stats.misses++;
+		HYBRIS_TRACE_COUNTER("server-wlegl", "import_cache_misses", "%lu", import_stats.misses);
+		return NULL;
+	}
+
+	import_stats.hits++;
+	HYBRIS_TRACE_COUNTER("server-wlegl", "import_cache_hits", "%lu", import_stats.hits);
+	cache->entries.splice(cache->entries.begin(), cache->entries, it);
+	it->buf->common.incRef(&it->buf->common);
+	return it->buf;
+}
+
+/* Called with import_mutex locked, the cache takes a reference of its own */
+static void import_cache_add(ImportCache *cache, const ImportKey &key,
+			     buffer_handle_t handle, RemoteWindowBuffer *buf)
+{
+	ImportEntry entry = { key, std::vector<int>(), buf };
+
+	for (int i = 0; i < handle->numFds; i++) {
+		int fd = fcntl(handle->data[i], F_DUPFD_CLOEXEC, 0);
+
+		if (fd < 0) {
+			for (size_t j = 0; j < entry.fds.size(); j++)
+				close(entry.fds[j]);
+			return;
+		}
+		entry.fds.push_back(fd);
+	}
+
+	buf->common.incRef(&buf->common);
+	cache->entries.push_front(entry);
+	import_stats.entries++;
+
+	while ((int) cache->entries.size() > import_cache_size()) {
+		import_entry_drop(cache, --cache->entries.end());
+		import_stats.evictions++;
+	}
+}
+
+void
+server_wlegl_buffer_get_import_stats(server_wlegl_import_stats *stats)
+{
+	pthread_mutex_lock(&import_mutex);
+	*stats = import_stats;
+	pthread_mutex_unlock(&import_mutex);
+}
+
 static void
 destroy(struct wl_client *client, struct wl_resource *resource)
 {
@@ -66,23 +291,43 @@ server_wlegl_buffer_create(wl_client *client,
 			   buffer_handle_t handle,
 			   server_wlegl *wlegl)
 {
-	server_wlegl_buffer *buffer = new server_wlegl_buffer;
+	RemoteWindowBuffer *buf = NULL;
+	ImportCache *cache = NULL;
+	ImportKey key;
 	int ret;
 
+	if (import_cache_size() > 0 &&
+	    import_key(&key, width, height, stride, format, usage, handle)) {
+		pthread_mutex_lock(&import_mutex);
+		cache = import_cache_of(client);
+		buf = import_cache_get(cache, key, handle);
+		pthread_mutex_unlock(&import_mutex);
+	}
+
+	if (!buf) {
+		const native_handle_t* out_handle = NULL;
+		ret = hybris_gralloc_import_buffer(handle, &out_handle);
+		if (ret)
+			return NULL;
+
+		buf = new RemoteWindowBuffer(
+		        width, height, stride, format, usage, out_handle);
+		buf->common.incRef(&buf->common);
+
+		if (cache) {
+			pthread_mutex_lock(&import_mutex);
+			import_cache_add(cache, key, handle, buf);
+			pthread_mutex_unlock(&import_mutex);
+		}
+	}
+
+	server_wlegl_buffer *buffer = new server_wlegl_buffer;
+
 	buffer->wlegl = wlegl;
+	buffer->buf = buf;
 	buffer->resource = wl_resource_create(client, &wl_buffer_interface, 1, id);
 	wl_resource_set_implementation(buffer->resource, &server_wlegl_buffer_impl, buffer, server_wlegl_buffer_dtor);
 
-	const native_handle_t* out_handle = NULL;
-	ret = hybris_gralloc_import_buffer(handle, &out_handle);
-	if (ret) {
-		delete buffer;
-		return NULL;
-	}
-
-	buffer->buf = new RemoteWindowBuffer(
-	        width, height, stride, format, usage, out_handle);
-	buffer->buf->common.incRef(&buffer->buf->common);
 	return buffer;
 }
 
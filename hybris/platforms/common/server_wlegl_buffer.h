@@ -39,6 +39,8 @@ struct server_wlegl_buffer {
 	server_wlegl *wlegl;
 
 	RemoteWindowBuffer *buf;
+	/* Set up once an EGLImage is created for the buffer */
+	struct wl_listener images_listener;
 };
 
 server_wlegl_buffer *
@@ -54,4 +56,16 @@ server_wlegl_buffer_create_server(wl_client *client, int32_t width, int32_t heig
 server_wlegl_buffer *
 server_wlegl_buffer_from(struct wl_resource *);
 
+/* How well buffers registered again are recognized, see HYBRIS_WLEGL_IMPORT_CACHE */
+struct server_wlegl_import_stats {
+	unsigned long hits;
+	unsigned long misses;
+	unsigned long evictions;
+	/* The number of buffers in the caches of all clients */
+	int entries;
+};
+
+void
+server_wlegl_buffer_get_import_stats(server_wlegl_import_stats *stats);
+
 #endif /* SERVER_WLEGL_BUFFER_H */
@@ -0,0 +1,285 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "swapchain.h"
+
+#include <assert.h>
+#include <stddef.h>
+
+SwapChain::SwapChain()
+	: m_frame(0)
+	, m_numKeys(0)
+{
+	clear();
+}
+
+void SwapChain::clear()
+{
+	m_slots.clear();
+	m_keys.assign(16, Key());
+	m_numKeys = 0;
+	for (int i = 0; i < NUM_STATES; i++) {
+		m_lists[i].head = -1;
+		m_lists[i].tail = -1;
+		m_lists[i].count = 0;
+	}
+}
+
+unsigned int SwapChain::keyIndex(const void *key) const
+{
+	uint64_t hash = (uint64_t) (uintptr_t) key * 0x9e3779b97f4a7c15ULL;
+
+	return (unsigned int) (hash >> 32) & (m_keys.size() - 1);
+}
+
+void SwapChain::setKey(const void *key, int slot)
+{
+	unsigned int mask = m_keys.size() - 1;
+	unsigned int i;
+
+	if (2 * (m_numKeys + 1) > m_keys.size()) {
+		std::vector<Key> old(m_keys);
+
+		m_keys.assign(2 * old.size(), Key());
+		m_numKeys = 0;
+		for (i = 0; i < old.size(); i++) {
+			if (old[i].key)
+				setKey(old[i].key, old[i].slot);
+		}
+		mask = m_keys.size() - 1;
+	}
+
+	for (i = keyIndex(key); m_keys[i].key && m_keys[i].key != key; i = (i + 1) & mask)
+		;
+	if (!m_keys[i].key)
+		m_numKeys++;
+	m_keys[i].key = key;
+	m_keys[i].slot = slot;
+}
+
+void SwapChain::removeKey(const void *key)
+{
+	unsigned int mask = m_keys.size() - 1;
+	unsigned int i, j;
+
+	for (i = keyIndex(key); m_keys[i].key != key; i = (i + 1) & mask) {
+		if (!m_keys[i].key)
+			return;
+	}
+
+	/* Move the following keys of the run up, so that no lookup stops early */
+	for (j = (i + 1) & mask; m_keys[j].key; j = (j + 1) & mask) {
+		unsigned int home = keyIndex(m_keys[j].key);
+
+		if (((j - home) & mask) >= ((j - i) & mask)) {
+			m_keys[i] = m_keys[j];
+			i = j;
+		}
+	}
+	m_keys[i].key = NULL;
+	m_numKeys--;
+}
+
+/*
+ * Only the FREE and QUEUED slots are taken in order, the others are just
+ * counted.
+ */
+static inline bool ordered(SwapChain::SlotState state)
+{
+	return state == SwapChain::FREE || state == SwapChain::QUEUED;
+}
+
+/* Appends slot to the list of state */
+void SwapChain::link(int slot, SlotState state)
+{
+	Slot &s = m_slots[slot];
+	List &list = m_lists[state];
+
+	s.state = state;
+	list.count++;
+	if (!ordered(state))
+		return;
+
+	s.prev = list.tail;
+	s.next = -1;
+	if (list.tail >= 0)
+		m_slots[list.tail].next = slot;
+	else
+		list.head = slot;
+	list.tail = slot;
+}
+
+void SwapChain::unlink(int slot)
+{
+	Slot &s = m_slots[slot];
+	List &list = m_lists[s.state];
+
+	list.count--;
+	if (!ordered(s.state))
+		return;
+
+	if (s.prev >= 0)
+		m_slots[s.prev].next = s.next;
+	else
+		list.head = s.next;
+	if (s.next >= 0)
+		m_slots[s.next].prev = s.prev;
+	else
+		list.tail = s.prev;
+}
+
+void SwapChain::move(int slot, SlotState from, SlotState to)
+{
+	assert(slot >= 0 && slot < size());
+	assert(m_slots[slot].state == from);
+	(void) from;
+
+	unlink(slot);
+	link(slot, to);
+}
+
+/* Moves the slot at index from to the unused index to */
+void SwapChain::renumber(int from, int to)
+{
+	Slot &s = m_slots[to];
+
+	s = m_slots[from];
+	if (ordered(s.state)) {
+		if (s.prev >= 0)
+			m_slots[s.prev].next = to;
+		else
+			m_lists[s.state].head = to;
+		if (s.next >= 0)
+			m_slots[s.next].prev = to;
+		else
+			m_lists[s.state].tail = to;
+	}
+
+	setKey(s.buffer, to);
+	if (s.alias)
+		setKey(s.alias, to);
+}
+
+int SwapChain::addSlot(BaseNativeWindowBuffer *buffer)
+{
+	int slot = size();
+	Slot s;
+
+	s.buffer = buffer;
+	s.alias = NULL;
+	s.frame = 0;
+	m_slots.push_back(s);
+	link(slot, FREE);
+	setKey(buffer, slot);
+
+	return slot;
+}
+
+void SwapChain::removeSlot(int slot)
+{
+	int last = size() - 1;
+
+	assert(slot >= 0 && slot <= last);
+
+	unlink(slot);
+	removeKey(m_slots[slot].buffer);
+	if (m_slots[slot].alias)
+		removeKey(m_slots[slot].alias);
+
+	if (slot != last)
+		renumber(last, slot);
+	m_slots.pop_back();
+}
+
+void SwapChain::setBuffer(int slot, BaseNativeWindowBuffer *buffer)
+{
+	Slot &s = m_slots[slot];
+
+	removeKey(s.buffer);
+	if (s.alias)
+		removeKey(s.alias);
+
+	s.buffer = buffer;
+	s.alias = NULL;
+	s.frame = 0;
+	setKey(buffer, slot);
+}
+
+void SwapChain::setAlias(int slot, const void *alias)
+{
+	Slot &s = m_slots[slot];
+
+	if (s.alias)
+		removeKey(s.alias);
+	s.alias = alias;
+	if (alias)
+		setKey(alias, slot);
+}
+
+int SwapChain::slotOf(const void *key) const
+{
+	unsigned int mask = m_keys.size() - 1;
+	unsigned int i;
+
+	for (i = keyIndex(key); m_keys[i].key; i = (i + 1) & mask) {
+		if (m_keys[i].key == key)
+			return m_keys[i].slot;
+	}
+	return -1;
+}
+
+int SwapChain::dequeue()
+{
+	int slot = m_lists[FREE].head;
+
+	if (slot >= 0)
+		move(slot, FREE, DEQUEUED);
+	return slot;
+}
+
+void SwapChain::queue(int slot)
+{
+	move(slot, DEQUEUED, QUEUED);
+	m_slots[slot].frame = ++m_frame;
+}
+
+void SwapChain::cancel(int slot)
+{
+	move(slot, DEQUEUED, FREE);
+}
+
+int SwapChain::acquire()
+{
+	int slot = m_lists[QUEUED].head;
+
+	if (slot >= 0)
+		move(slot, QUEUED, ACQUIRED);
+	return slot;
+}
+
+void SwapChain::release(int slot)
+{
+	move(slot, ACQUIRED, FREE);
+}
+
+int SwapChain::age(int slot) const
+{
+	const Slot &s = m_slots[slot];
+
+	if (s.frame == 0)
+		return 0;
+	return (int) (m_frame + 1 - s.frame);
+}
@@ -0,0 +1,141 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SWAPCHAIN_H
+#define SWAPCHAIN_H
+
+#include <stdint.h>
+
+#include <vector>
+
+class BaseNativeWindowBuffer;
+
+/**
+ * @brief The buffer bookkeeping shared by the native windows.
+ *
+ * Every buffer of a window sits in a slot, which goes through
+ *
+ *   FREE -> DEQUEUED -> QUEUED -> ACQUIRED -> FREE
+ *
+ * as the buffer is rendered to, swapped, handed to the display and given
+ * back. A dequeued buffer can also be cancelled, which makes it FREE again.
+ * The free and the queued slots are kept in the order they entered their
+ * state, so that dequeue() hands out the buffer which has been free for the
+ * longest time and acquire() the oldest queued one, both in constant time. Buffers are
+ * looked up by their address or by one alias, like their wl_buffer, in a
+ * hash table.
+ *
+ * The chain doesn't own the buffers and does no locking of its own, the
+ * window has to serialize all calls.
+ **/
+class SwapChain
+{
+public:
+	enum SlotState {
+		FREE,
+		DEQUEUED,
+		QUEUED,
+		ACQUIRED,
+		NUM_STATES
+	};
+
+	SwapChain();
+
+	/* Adds a FREE slot holding buffer and returns its index */
+	int addSlot(BaseNativeWindowBuffer *buffer);
+	/* Removes a slot, the last slot takes over its index */
+	void removeSlot(int slot);
+	/* Replaces the buffer of a slot, which keeps its state but not its age */
+	void setBuffer(int slot, BaseNativeWindowBuffer *buffer);
+	/* Makes the slot findable through alias as well, NULL removes the alias */
+	void setAlias(int slot, const void *alias);
+	void clear();
+
+	int size() const { return (int) m_slots.size(); }
+	BaseNativeWindowBuffer *buffer(int slot) const { return m_slots[slot].buffer; }
+	SlotState state(int slot) const { return m_slots[slot].state; }
+	int count(SlotState state) const { return m_lists[state].count; }
+	int freeCount() const { return m_lists[FREE].count; }
+	/* The slot the next dequeue() returns, -1 if none is free */
+	int nextFree() const { return m_lists[FREE].head; }
+	/* The slot the next acquire() returns, -1 if nothing is queued */
+	int nextQueued() const { return m_lists[QUEUED].head; }
+	/* The slot of a buffer or alias, -1 if it isn't part of the chain */
+	int slotOf(const void *key) const;
+
+	/* FREE -> DEQUEUED, returns -1 if no slot is free */
+	int dequeue();
+	/* DEQUEUED -> QUEUED, the slot's contents become the newest frame */
+	void queue(int slot);
+	/* DEQUEUED -> FREE */
+	void cancel(int slot);
+	/* Oldest QUEUED -> ACQUIRED, returns -1 if nothing is queued */
+	int acquire();
+	/* ACQUIRED -> FREE */
+	void release(int slot);
+
+	/*
+	 * The number of frames since the contents of the slot were queued,
+	 * as defined by EGL_EXT_buffer_age: 1 for the previous frame and 0
+	 * if the contents are undefined.
+	 */
+	int age(int slot) const;
+	/* The number of frames queued so far */
+	uint64_t frames() const { return m_frame; }
+
+private:
+	struct Slot {
+		BaseNativeWindowBuffer *buffer;
+		const void *alias;
+		SlotState state;
+		int prev;
+		int next;
+		uint64_t frame;
+	};
+
+	struct List {
+		int head;
+		int tail;
+		int count;
+	};
+
+	void link(int slot, SlotState state);
+	void unlink(int slot);
+	void move(int slot, SlotState from, SlotState to);
+	void renumber(int from, int to);
+
+	/*
+	 * The keys are hashed into a small open addressing table, which is
+	 * kept at most half full and needs neither allocations nor divisions
+	 * on lookups, unlike a std::unordered_map.
+	 */
+	struct Key {
+		const void *key;
+		int slot;
+	};
+
+	unsigned int keyIndex(const void *key) const;
+	void setKey(const void *key, int slot);
+	void removeKey(const void *key);
+
+	std::vector<Slot> m_slots;
+	List m_lists[NUM_STATES];
+	uint64_t m_frame;
+	std::vector<Key> m_keys;
+	unsigned int m_numKeys;
+};
+
+#endif
@@ -34,6 +34,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include <errno.h>
+#include <poll.h>
+#include <unistd.h>
 
 #include "logging.h"
 
@@ -44,16 +46,14 @@ extern "C" {
 #endif
 
 static void
-buffer_create_sync_callback(void *data, struct wl_callback *callback, uint32_t serial)
+wl_buffer_release(void *data, struct wl_buffer *buffer)
 {
-   struct wl_callback **created_callback = static_cast<struct wl_callback **>(data);
-
-   *created_callback = NULL;
-   wl_callback_destroy(callback);
+    WaylandNativeWindow *win = static_cast<WaylandNativeWindow *>(data);
+    win->releaseBuffer(buffer);
 }
 
-static const struct wl_callback_listener buffer_create_sync_listener = {
-   buffer_create_sync_callback
+static struct wl_buffer_listener wl_buffer_listener = {
+    wl_buffer_release
 };
 
 void WaylandNativeWindowBuffer::wlbuffer_from_native_handle(struct android_wlegl *android_wlegl,
@@ -85,15 +85,10 @@ void WaylandNativeWindowBuffer::wlbuffer_from_native_handle(struct android_wlegl
 
     android_wlegl_handle_destroy(wlegl_handle);
 
+    // No need to wait for the compositor here: the requests are handled in
+    // order and the fds are duplicated when they are marshalled, so the
+    // buffer can be attached or destroyed right away.
     wl_proxy_wrapper_destroy(android_wlegl_wrapper);
-
-    struct wl_display *display_wrapper = (struct wl_display *) wl_proxy_create_wrapper(display);
-    wl_proxy_set_queue((struct wl_proxy *) display_wrapper, queue);
-
-    creation_callback = wl_display_sync(display_wrapper);
-    wl_callback_add_listener(creation_callback, &buffer_create_sync_listener, &creation_callback);
-
-    wl_proxy_wrapper_destroy(display_wrapper);
 }
 
 void WaylandNativeWindow::resize(unsigned int width, unsigned int height)
@@ -190,7 +185,8 @@ WaylandNativeWindow::WaylandNativeWindow(struct wl_egl_window *window,
     pthread_mutex_init(&mutex, NULL);
     pthread_cond_init(&cond, NULL);
     m_queueReads = 0;
-    m_freeBufs = 0;
+    m_bufferAge = 0;
+    ANativeWindow::query = &_query;
     m_damage_rects = NULL;
     m_damage_n_rects = 0;
     WaylandNativeWindow::setBufferCount(3);
@@ -199,6 +195,7 @@ WaylandNativeWindow::WaylandNativeWindow(struct wl_egl_window *window,
 
 WaylandNativeWindow::~WaylandNativeWindow()
 {
+    stopFenceThread();
     destroyBuffers();
     if (frame_callback)
         wl_callback_destroy(frame_callback);
@@ -240,43 +237,39 @@ int WaylandNativeWindow::setSwapInterval(int interval) {
     return 0;
 }
 
-void WaylandNativeWindow::releaseBuffer(struct wl_buffer *buffer)
+static void free_buffer(WaylandNativeWindowBuffer *wnb)
 {
-    std::list<WaylandNativeWindowBuffer *>::iterator it;
-
-    it = fronted.begin();
-
-    for (; it != fronted.end(); ++it)
-    {
-        if ((*it)->wlbuffer == buffer)
-            break;
-    }
-    assert(it != fronted.end());
-
-
+    if (wnb->wlbuffer)
+        wl_buffer_destroy(wnb->wlbuffer);
+    wnb->wlbuffer = NULL;
+    if (wnb->fence_fd >= 0)
+        close(wnb->fence_fd);
+    wnb->fence_fd = -1;
+    wnb->common.decRef(&wnb->common);
+}
 
-    WaylandNativeWindowBuffer* wnb = *it;
-    fronted.erase(it);
-    HYBRIS_TRACE_COUNTER("wayland-platform", "fronted.size", "%lu", fronted.size());
+void WaylandNativeWindow::releaseBuffer(struct wl_buffer *buffer)
+{
+    int slot = m_chain.slotOf(buffer);
+    assert(slot >= 0 && m_chain.state(slot) == SwapChain::ACQUIRED);
 
-    for (it = m_bufList.begin(); it != m_bufList.end(); ++it)
-    {
-        if ((*it) == wnb)
-            break;
-    }
-    assert(it != m_bufList.end());
+    WaylandNativeWindowBuffer *wnb = static_cast<WaylandNativeWindowBuffer *>(m_chain.buffer(slot));
     HYBRIS_TRACE_BEGIN("wayland-platform", "releaseBuffer", "-%p", wnb);
-    wnb->busy = 0;
 
-    ++m_freeBufs;
-    HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_freeBufs);
-    for (it = m_bufList.begin(); it != m_bufList.end(); ++it)
-    {
-        (*it)->youngest = 0;
+    if (wnb->replacement) {
+        // The window was resized while the buffer was in use
+        WaylandNativeWindowBuffer *replacement = wnb->replacement;
+        wnb->replacement = NULL;
+        m_chain.setBuffer(slot, replacement);
+        m_chain.setAlias(slot, replacement->wlbuffer);
+        free_buffer(wnb);
+        wnb = replacement;
     }
-    wnb->youngest = 1;
 
+    m_chain.release(slot);
 
+    HYBRIS_TRACE_COUNTER("wayland-platform", "fronted.size", "%i", m_chain.count(SwapChain::ACQUIRED));
+    HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_chain.freeCount());
     HYBRIS_TRACE_END("wayland-platform", "releaseBuffer", "-%p", wnb);
 }
 
@@ -288,12 +281,49 @@ int WaylandNativeWindow::lockBuffer(BaseNativeWindowBuffer* buffer){
     return NO_ERROR;
 }
 
-int WaylandNativeWindow::readQueue(bool block)
+// Like wl_display_dispatch_queue(), but also returns 0 without dispatching
+// anything once wakeFd becomes readable.
+static int dispatch_queue_or_wake(struct wl_display *display, struct wl_event_queue *queue,
+                                  int wakeFd)
+{
+    while (wl_display_prepare_read_queue(display, queue) != 0) {
+        int ret = wl_display_dispatch_queue_pending(display, queue);
+        if (ret != 0)
+            return ret;
+    }
+
+    if (wl_display_flush(display) < 0 && errno != EAGAIN) {
+        wl_display_cancel_read(display);
+        return -1;
+    }
+
+    struct pollfd fds[2] = {
+        { wl_display_get_fd(display), POLLIN, 0 },
+        { wakeFd, POLLIN, 0 },
+    };
+    int ret;
+    do {
+        ret = poll(fds, 2, -1);
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret < 0 || fds[0].revents == 0) {
+        wl_display_cancel_read(display);
+        return ret < 0 ? -1 : 0;
+    }
+
+    if (wl_display_read_events(display) < 0)
+        return -1;
+    return wl_display_dispatch_queue_pending(display, queue);
+}
+
+int WaylandNativeWindow::readQueue(bool block, int wakeFd)
 {
     int ret = 0;
 
     if (++m_queueReads == 1) {
-        if (block) {
+        if (block && wakeFd >= 0) {
+            ret = dispatch_queue_or_wake(m_display, wl_queue, wakeFd);
+        } else if (block) {
             ret = wl_display_dispatch_queue(m_display, wl_queue);
         } else {
             ret = wl_display_dispatch_queue_pending(m_display, wl_queue);
@@ -325,29 +355,17 @@ int WaylandNativeWindow::readQueue(bool block)
 }
 
 int WaylandNativeWindow::cancelBuffer(BaseNativeWindowBuffer* buffer, int fenceFd){
-    std::list<WaylandNativeWindowBuffer *>::iterator it;
     WaylandNativeWindowBuffer *wnb = (WaylandNativeWindowBuffer*) buffer;
 
     lock();
     HYBRIS_TRACE_BEGIN("wayland-platform", "cancelBuffer", "-%p", wnb);
 
     /* Check first that it really is our buffer */
-    for (it = m_bufList.begin(); it != m_bufList.end(); ++it)
-    {
-        if ((*it) == wnb)
-            break;
-    }
-    assert(it != m_bufList.end());
-
-    wnb->busy = 0;
-    ++m_freeBufs;
-    HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_freeBufs);
+    int slot = m_chain.slotOf(wnb);
+    assert(slot >= 0);
 
-    for (it = m_bufList.begin(); it != m_bufList.end(); ++it)
-    {
-        (*it)->youngest = 0;
-    }
-    wnb->youngest = 1;
+    m_chain.cancel(slot);
+    HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_chain.freeCount());
 
     if (m_queueReads != 0) {
         // Some thread is waiting on wl_display_dispatch_queue(), possibly waiting for a wl_buffer.release
@@ -408,6 +426,28 @@ unsigned int WaylandNativeWindow::transformHint() const {
     return 0;
 }
 
+int WaylandNativeWindow::bufferAge() const {
+    TRACE("value:%i", m_bufferAge);
+    return m_bufferAge;
+}
+
+/*
+ * NATIVE_WINDOW_BUFFER_AGE comes from the swap chain, the other
+ * queries are answered by BaseNativeWindow
+ */
+int WaylandNativeWindow::_query(const struct ANativeWindow* window, int what, int* value)
+{
+#if ANDROID_VERSION_MAJOR>=8
+    if (what == NATIVE_WINDOW_BUFFER_AGE) {
+        const WaylandNativeWindow* self = static_cast<const WaylandNativeWindow*>(
+                static_cast<const BaseNativeWindow*>(window));
+        *value = self->bufferAge();
+        return NO_ERROR;
+    }
+#endif
+    return BaseNativeWindow::_query(window, what, value);
+}
+
 /*
  * returns the current usage of this window
  */
@@ -435,46 +475,41 @@ void WaylandNativeWindow::destroyBuffer(WaylandNativeWindowBuffer* wnb)
 
     assert(wnb != NULL);
 
-    int ret = 0;
-    while (ret != -1 && wnb->creation_callback)
-        ret = wl_display_dispatch_queue(m_display, wl_queue);
-
-    if (wnb->creation_callback) {
-        wl_callback_destroy(wnb->creation_callback);
-        wnb->creation_callback = NULL;
-    }
+    if (wnb->replacement)
+        free_buffer(wnb->replacement);
+    wnb->replacement = NULL;
 
-    if (wnb->wlbuffer)
-        wl_buffer_destroy(wnb->wlbuffer);
-    wnb->wlbuffer = NULL;
-    wnb->common.decRef(&wnb->common);
-    m_freeBufs--;
+    free_buffer(wnb);
 }
 
 void WaylandNativeWindow::destroyBuffers()
 {
     TRACE("");
 
-    std::list<WaylandNativeWindowBuffer*>::iterator it = m_bufList.begin();
-    for (; it!=m_bufList.end(); ++it)
-    {
-        destroyBuffer(*it);
-    }
-    m_bufList.clear();
-    m_freeBufs = 0;
+    for (int slot = 0; slot < m_chain.size(); slot++)
+        destroyBuffer(static_cast<WaylandNativeWindowBuffer *>(m_chain.buffer(slot)));
+    m_chain.clear();
 }
 
-WaylandNativeWindowBuffer *WaylandNativeWindow::addBuffer() {
+bool WaylandNativeWindow::matchesWindow(WaylandNativeWindowBuffer *wnb) const
+{
+    return wnb->width == m_width && wnb->height == m_height
+        && wnb->format == m_format && wnb->usage == m_usage;
+}
+
+/*
+ * Server side buffers are only usable once the compositor has replied,
+ * call registerBuffers() after creating a batch of them.
+ */
+WaylandNativeWindowBuffer *WaylandNativeWindow::createBuffer()
+{
     WaylandNativeWindowBuffer *wnb;
 
 #ifndef HYBRIS_NO_SERVER_SIDE_BUFFERS
     wnb = new ServerWaylandBuffer(m_width, m_height, m_format, m_usage, m_android_wlegl, wl_queue);
-    wl_display_roundtrip_queue(m_display, wl_queue);
 #else
     wnb = new ClientWaylandBuffer(m_width, m_height, m_format, m_usage);
 #endif
-    m_bufList.push_back(wnb);
-    ++m_freeBufs;
 
     TRACE("wnb:%p width:%i height:%i format:x%x usage:x%x",
          wnb, wnb->width, wnb->height, wnb->format, wnb->usage);
@@ -482,29 +517,131 @@ WaylandNativeWindowBuffer *WaylandNativeWindow::addBuffer() {
     return wnb;
 }
 
+WaylandNativeWindowBuffer *WaylandNativeWindow::addBuffer() {
+    WaylandNativeWindowBuffer *wnb = createBuffer();
+
+    m_chain.addSlot(wnb);
+
+    return wnb;
+}
+
+void WaylandNativeWindow::initBuffer(WaylandNativeWindowBuffer *wnb)
+{
+    wnb->init(m_android_wlegl, m_display, wl_queue);
+    if (!wnb->wlbuffer) {
+        TRACE("%p has no wl_buffer", wnb);
+        return;
+    }
+
+    TRACE("%p add listener with %p inside", wnb, wnb->wlbuffer);
+    wl_buffer_add_listener(wnb->wlbuffer, &wl_buffer_listener, this);
+
+    // Replacements get their alias once they take over the slot
+    int slot = m_chain.slotOf(wnb);
+    if (slot >= 0)
+        m_chain.setAlias(slot, wnb->wlbuffer);
+}
+
+/*
+ * Creates the wl_buffers of all the buffers which don't have one yet, so that
+ * none has to be set up when it is presented. All the server side buffers
+ * requested since the last call are waited for with a single roundtrip.
+ */
+void WaylandNativeWindow::registerBuffers()
+{
+    HYBRIS_TRACE_BEGIN("wayland-platform", "registerBuffers", "");
+
+#ifndef HYBRIS_NO_SERVER_SIDE_BUFFERS
+    for (int slot = 0; slot < m_chain.size(); slot++) {
+        WaylandNativeWindowBuffer *wnb = static_cast<WaylandNativeWindowBuffer *>(m_chain.buffer(slot));
+
+        if (!wnb->wlbuffer || (wnb->replacement && !wnb->replacement->wlbuffer)) {
+            wl_display_roundtrip_queue(m_display, wl_queue);
+            break;
+        }
+    }
+#endif
+
+    for (int slot = 0; slot < m_chain.size(); slot++) {
+        WaylandNativeWindowBuffer *wnb = static_cast<WaylandNativeWindowBuffer *>(m_chain.buffer(slot));
+
+        if (!wnb->wlbuffer)
+            initBuffer(wnb);
+        if (wnb->replacement && !wnb->replacement->wlbuffer)
+            initBuffer(wnb->replacement);
+    }
+
+    HYBRIS_TRACE_END("wayland-platform", "registerBuffers", "");
+}
+
+/*
+ * Re-allocates all the buffers which don't match the window anymore in one go.
+ * Free buffers are replaced right away, the ones which are still in use get a
+ * replacement which takes over when they are released.
+ */
+void WaylandNativeWindow::reallocateBuffers()
+{
+    for (int slot = 0; slot < m_chain.size(); slot++) {
+        WaylandNativeWindowBuffer *wnb = static_cast<WaylandNativeWindowBuffer *>(m_chain.buffer(slot));
+        WaylandNativeWindowBuffer *fresh;
+
+        if (matchesWindow(wnb))
+            continue;
+
+        if (wnb->replacement && !matchesWindow(wnb->replacement)) {
+            free_buffer(wnb->replacement);
+            wnb->replacement = NULL;
+        }
+
+        if (m_chain.state(slot) != SwapChain::FREE) {
+            if (!wnb->replacement)
+                wnb->replacement = createBuffer();
+            continue;
+        }
+
+        TRACE("wnb:%p,win:%p %i,%i %i,%i x%x,x%x x%" PRIx64 ",x%" PRIx64,
+            wnb,m_window,
+            wnb->width,m_width, wnb->height,m_height,
+            wnb->format,m_format, (uint64_t)wnb->usage,m_usage);
+
+        fresh = wnb->replacement ? wnb->replacement : createBuffer();
+        wnb->replacement = NULL;
+        m_chain.setBuffer(slot, fresh);
+        m_chain.setAlias(slot, fresh->wlbuffer);
+        free_buffer(wnb);
+    }
+
+    registerBuffers();
+}
 
 int WaylandNativeWindow::setBufferCount(int cnt) {
     TRACE("cnt:%d", cnt);
 
-    if ((int)m_bufList.size() == cnt)
+    if (m_chain.size() == cnt)
         return NO_ERROR;
 
     lock();
 
-    if ((int)m_bufList.size() > cnt) {
-        /* Decreasing buffer count, remove from beginning */
-        std::list<WaylandNativeWindowBuffer*>::iterator it = m_bufList.begin();
-        for (int i = 0; i <= (int)m_bufList.size() - cnt; i++ )
-        {
-            destroyBuffer(*it);
-            ++it;
-            m_bufList.pop_front();
+    // Buffers waiting for their fence still have to be committed
+    waitForPendingCommits();
+
+    if (m_chain.size() > cnt) {
+        /* Decreasing buffer count, remove the free buffers first */
+        while (m_chain.size() > cnt) {
+            int slot = m_chain.nextFree();
+            if (slot < 0)
+                slot = m_chain.size() - 1;
+
+            WaylandNativeWindowBuffer *wnb = static_cast<WaylandNativeWindowBuffer *>(m_chain.buffer(slot));
+            m_chain.removeSlot(slot);
+            destroyBuffer(wnb);
         }
 
     } else {
         /* Increasing buffer count, start from current size */
-        for (int i = (int)m_bufList.size(); i < cnt; i++)
+        for (int i = m_chain.size(); i < cnt; i++)
             (void)addBuffer();
+        registerBuffers();
 
     }
 
@@ -652,6 +789,10 @@ ServerWaylandBuffer::~ServerWaylandBuffer()
 
 void ServerWaylandBuffer::init(android_wlegl *, wl_display *, wl_event_queue *queue)
 {
+    // The compositor didn't reply (yet)
+    if (!m_buf)
+        return;
+
     wlbuffer = m_buf;
     m_buf = 0;
     wl_proxy_set_queue((struct wl_proxy *) wlbuffer, queue);
@@ -42,10 +42,9 @@ class WaylandNativeWindowBuffer : public BaseNativeWindowBuffer
 public:
     WaylandNativeWindowBuffer()
         : wlbuffer(0)
-        , busy(0)
-        , youngest(0)
         , other(0)
-        , creation_callback(0)
+        , fence_fd(-1)
+        , replacement(0)
     {}
     WaylandNativeWindowBuffer(ANativeWindowBuffer *other)
     {
@@ -56,17 +55,17 @@ public:
         ANativeWindowBuffer::handle = other->handle;
         ANativeWindowBuffer::stride = other->stride;
         this->wlbuffer = NULL;
-        this->creation_callback = NULL;
-        this->busy = 0;
+        this->fence_fd = -1;
+        this->replacement = NULL;
         this->other = other;
-        this->youngest = 0;
     }
 
     struct wl_buffer *wlbuffer;
-    int busy;
-    int youngest;
     ANativeWindowBuffer *other;
-    struct wl_callback *creation_callback;
+    // acquire fence passed to queueBuffer, waited on before the buffer is committed
+    int fence_fd;
+    // buffer matching the resized window, takes over once this one is released
+    WaylandNativeWindowBuffer *replacement;
 
     void wlbuffer_from_native_handle(struct android_wlegl *android_wlegl,
                                      struct wl_display *display,
@@ -97,15 +96,12 @@ protected:
         ANativeWindowBuffer::format = format;
         ANativeWindowBuffer::usage = usage;
         this->wlbuffer = NULL;
-        this->creation_callback = NULL;
-        this->busy = 0;
         this->other = NULL;
         int alloc_ok = hybris_gralloc_allocate(this->width ? this->width : 1,
                 this->height ? this->height : 1,
                 this->format, (uint32_t)this->usage,
                 &this->handle, (uint32_t*)&this->stride);
         assert(alloc_ok == 0);
-        this->youngest = 0;
         this->common.incRef(&this->common);
     }
 
@@ -34,6 +34,8 @@ static int (*bionic_property_set)(const char *key, const char *value) = NULL;
 extern int my_property_list(void (*propfn)(const char *key, const char *value, void *cookie), void *cookie);
 extern int my_property_get(const char *key, char *value, const char *default_value);
 extern int my_property_set(const char *key, const char *value);
+extern int my_property_get_batch(const char * const *keys, char * const *values,
+                                 const char * const *default_values, int count);
 
 static void unload_libcutils(void)
 {
@@ -93,3 +95,26 @@ int property_set(const char *key, const char *value)
     else
         return my_property_set(key, value);
 }
+
+int property_get_batch(const char * const *keys, char * const *values,
+                       const char * const *default_values, int count)
+{
+    int i;
+
+    ensure_bionic_properties_initialized();
+
+    if (own_impl)
+        return my_property_get_batch(keys, values, default_values, count);
+
+    if (count < 0 || (count > 0 && (!keys || !values)))
+        return -1;
+
+    /* bionic has no batched interface, it doesn't need a round trip per key */
+    for (i = 0; i < count; i++) {
+        if (bionic_property_get(keys[i], values[i],
+                                default_values ? default_values[i] : NULL) < 0)
+            return -1;
+    }
+
+    return 0;
+}
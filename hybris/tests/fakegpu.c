@@ -0,0 +1,106 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "fakegpu.h"
+
+#include <pthread.h>
+#include <time.h>
+
+int sw_sync_timeline_create(void);
+int sw_sync_timeline_inc(int fd, unsigned count);
+int sw_sync_fence_create(int fd, const char *name, unsigned value);
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int timeline;
+    double job_ms;
+    unsigned submitted;
+    unsigned done;
+} gpu = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, -1, 0, 0, 0 };
+
+double fakegpu_now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+void fakegpu_sleep_ms(double ms)
+{
+    struct timespec ts;
+
+    if (ms <= 0)
+        return;
+    ts.tv_sec = (time_t) (ms / 1000);
+    ts.tv_nsec = (long) ((ms - ts.tv_sec * 1000) * 1e6);
+    nanosleep(&ts, NULL);
+}
+
+void fakegpu_cpu_work(double ms)
+{
+    double end = fakegpu_now_ms() + ms;
+
+    while (fakegpu_now_ms() < end)
+        ;
+}
+
+static void *gpu_thread(void *arg)
+{
+    pthread_mutex_lock(&gpu.lock);
+    for (;;) {
+        while (gpu.done == gpu.submitted)
+            pthread_cond_wait(&gpu.cond, &gpu.lock);
+        pthread_mutex_unlock(&gpu.lock);
+
+        fakegpu_sleep_ms(gpu.job_ms);
+        sw_sync_timeline_inc(gpu.timeline, 1);
+
+        pthread_mutex_lock(&gpu.lock);
+        gpu.done++;
+    }
+
+    return NULL;
+}
+
+int fakegpu_start(double gpu_ms)
+{
+    pthread_t thread;
+
+    gpu.job_ms = gpu_ms;
+    gpu.timeline = sw_sync_timeline_create();
+    if (gpu.timeline < 0)
+        return -1;
+
+    if (pthread_create(&thread, NULL, gpu_thread, NULL) != 0)
+        return -1;
+    pthread_detach(thread);
+
+    return 0;
+}
+
+int fakegpu_submit(const char *name)
+{
+    unsigned value;
+
+    pthread_mutex_lock(&gpu.lock);
+    value = ++gpu.submitted;
+    pthread_cond_signal(&gpu.cond);
+    pthread_mutex_unlock(&gpu.lock);
+
+    return sw_sync_fence_create(gpu.timeline, name, value);
+}
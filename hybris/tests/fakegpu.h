@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef FAKEGPU_H
+#define FAKEGPU_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * A stand-in GPU for the tests measuring frame times: it runs the submitted
+ * jobs one after another on a thread of its own, each taking the given GPU
+ * time, and signals a fence on a sw_sync timeline for every job it is done
+ * with. Needs /dev/sw_sync.
+ *
+ * Returns 0 or -1 on errors.
+ */
+int fakegpu_start(double gpu_ms);
+
+/* Submits a job, returns the fence which signals once the GPU is done with it */
+int fakegpu_submit(const char *name);
+
+/* CLOCK_MONOTONIC in milliseconds */
+double fakegpu_now_ms(void);
+
+void fakegpu_sleep_ms(double ms);
+
+/* Keeps the calling thread busy for the given CPU time */
+void fakegpu_cpu_work(double ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,371 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "synthlib.h"
+
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <link.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* Both segments start at this alignment, so it works with any page size */
+#define SEGMENT_ALIGN       0x10000
+
+#if defined(__x86_64__)
+#define SYNTH_MACHINE       EM_X86_64
+#define SYNTH_R_RELATIVE    R_X86_64_RELATIVE
+#define SYNTH_R_GLOB_DAT    R_X86_64_GLOB_DAT
+#elif defined(__aarch64__)
+#define SYNTH_MACHINE       EM_AARCH64
+#define SYNTH_R_RELATIVE    R_AARCH64_RELATIVE
+#define SYNTH_R_GLOB_DAT    R_AARCH64_GLOB_DAT
+#elif defined(__i386__)
+#define SYNTH_MACHINE       EM_386
+#define SYNTH_R_RELATIVE    R_386_RELATIVE
+#define SYNTH_R_GLOB_DAT    R_386_GLOB_DAT
+#elif defined(__arm__)
+#define SYNTH_MACHINE       EM_ARM
+#define SYNTH_R_RELATIVE    R_ARM_RELATIVE
+#define SYNTH_R_GLOB_DAT    R_ARM_GLOB_DAT
+#else
+#error "unsupported architecture"
+#endif
+
+#if defined(__LP64__)
+#define SYNTH_CLASS         ELFCLASS64
+#define SYNTH_R_INFO(s, t)  ELF64_R_INFO(s, t)
+#define SYNTH_ST_INFO(b, t) ELF64_ST_INFO(b, t)
+#define SYNTH_DT_REL        DT_RELA
+#define SYNTH_DT_RELSZ      DT_RELASZ
+#define SYNTH_DT_RELENT     DT_RELAENT
+typedef ElfW(Rela) synth_rel_t;
+#else
+#define SYNTH_CLASS         ELFCLASS32
+#define SYNTH_R_INFO(s, t)  ELF32_R_INFO(s, t)
+#define SYNTH_ST_INFO(b, t) ELF32_ST_INFO(b, t)
+#define SYNTH_DT_REL        DT_REL
+#define SYNTH_DT_RELSZ      DT_RELSZ
+#define SYNTH_DT_RELENT     DT_RELENT
+typedef ElfW(Rel) synth_rel_t;
+#endif
+
+#define WORD_BITS           (8 * sizeof(ElfW(Addr)))
+#define GNU_HASH_SHIFT2     26
+#define NUM_DYN             10
+
+enum {
+    SHDR_NULL,
+    SHDR_DYNSYM,
+    SHDR_DYNSTR,
+    SHDR_DYNAMIC,
+    SHDR_DATA,
+    SHDR_SHSTRTAB,
+    SHDR_COUNT
+};
+
+static const char shstrtab[] = "\0.dynsym\0.dynstr\0.dynamic\0.data\0.shstrtab";
+
+static uint32_t gnu_hash(const char *name)
+{
+    uint32_t h = 5381;
+
+    while (*name)
+        h = h * 33 + (unsigned char) *name++;
+
+    return h;
+}
+
+static size_t align_up(size_t value, size_t align)
+{
+    return (value + align - 1) & ~(align - 1);
+}
+
+typedef struct {
+    char name[32];
+    uint32_t hash;
+    ElfW(Addr) value;
+    int import;         /* the index of the import the word points to, or -1 */
+} defined_symbol_t;
+
+static uint32_t compare_bucket_nbuckets;
+
+static int compare_bucket(const void *a, const void *b)
+{
+    const defined_symbol_t *sa = a, *sb = b;
+    uint32_t ba = sa->hash % compare_bucket_nbuckets;
+    uint32_t bb = sb->hash % compare_bucket_nbuckets;
+
+    return ba < bb ? -1 : ba > bb;
+}
+
+int synthlib_write(const char *path, const char *soname, const char *prefix, int num_symbols)
+{
+    return synthlib_write_importer(path, soname, prefix, num_symbols, NULL, 0, NULL, 0);
+}
+
+int synthlib_write_importer(const char *path, const char *soname, const char *prefix,
+                            int num_symbols, const char *const *needed, int num_needed,
+                            const char *const *imports, int num_imports)
+{
+    int num_defined = num_symbols + num_imports;
+    uint32_t nbuckets = num_defined / 4 + 1;
+    uint32_t bloom_size = 1;
+    int nsyms = 1 + num_imports + num_defined;
+    int num_dyn = NUM_DYN + num_needed;
+    defined_symbol_t *defs;
+    ElfW(Ehdr) *ehdr;
+    ElfW(Phdr) *phdr;
+    ElfW(Shdr) *shdr;
+    ElfW(Sym) *syms;
+    ElfW(Dyn) *dyn;
+    ElfW(Addr) *bloom;
+    uint32_t *gnu, *buckets, *chains;
+    synth_rel_t *rels;
+    char *image, *strtab;
+    size_t off_phdr, off_syms, off_str, off_hash, off_rels, off_shstr, off_shdr, end_ro;
+    size_t off_dyn, words_addr, file_size, str_size, str_len;
+    int i, fd;
+
+    while (bloom_size * WORD_BITS < (uint32_t) num_defined * 12)
+        bloom_size <<= 1;
+
+    str_size = 1 + strlen(soname) + 1 + (size_t) num_defined * sizeof(defs->name);
+    for (i = 0; i < num_needed; i++)
+        str_size += strlen(needed[i]) + 1;
+    for (i = 0; i < num_imports; i++)
+        str_size += strlen(imports[i]) + 1;
+
+    off_phdr = sizeof(ElfW(Ehdr));
+    off_syms = align_up(off_phdr + 4 * sizeof(ElfW(Phdr)), 8);
+    off_str = off_syms + nsyms * sizeof(ElfW(Sym));
+    off_hash = align_up(off_str + str_size, 8);
+    off_rels = align_up(off_hash + 16 + bloom_size * sizeof(ElfW(Addr)) +
+                        nbuckets * 4 + num_defined * 4, 8);
+    off_shstr = off_rels + num_defined * sizeof(synth_rel_t);
+    off_shdr = align_up(off_shstr + sizeof(shstrtab), 8);
+    end_ro = off_shdr + SHDR_COUNT * sizeof(ElfW(Shdr));
+    off_dyn = align_up(end_ro, SEGMENT_ALIGN);
+    words_addr = off_dyn + num_dyn * sizeof(ElfW(Dyn));
+    file_size = words_addr + num_defined * sizeof(ElfW(Addr));
+
+    image = calloc(1, file_size);
+    defs = calloc(num_defined, sizeof(*defs));
+    if (!image || !defs)
+        return -1;
+
+    ehdr = (ElfW(Ehdr) *) image;
+    phdr = (ElfW(Phdr) *) (image + off_phdr);
+    syms = (ElfW(Sym) *) (image + off_syms);
+    strtab = image + off_str;
+    gnu = (uint32_t *) (image + off_hash);
+    bloom = (ElfW(Addr) *) (gnu + 4);
+    buckets = (uint32_t *) (bloom + bloom_size);
+    chains = buckets + nbuckets;
+    rels = (synth_rel_t *) (image + off_rels);
+    shdr = (ElfW(Shdr) *) (image + off_shdr);
+    dyn = (ElfW(Dyn) *) (image + off_dyn);
+
+    memcpy(image + off_shstr, shstrtab, sizeof(shstrtab));
+
+    /* GNU hash: symbols sorted by bucket, chains end with bit 0 set */
+    for (i = 0; i < num_defined; i++) {
+        uint32_t h;
+
+        if (i < num_symbols) {
+            snprintf(defs[i].name, sizeof(defs[i].name), "%s_sym%d", prefix, i);
+            defs[i].import = -1;
+        } else {
+            snprintf(defs[i].name, sizeof(defs[i].name), "%s_import%d", prefix, i - num_symbols);
+            defs[i].import = i - num_symbols;
+        }
+        defs[i].value = words_addr + i * sizeof(ElfW(Addr));
+        h = defs[i].hash = gnu_hash(defs[i].name);
+        bloom[(h / WORD_BITS) & (bloom_size - 1)] |=
+            ((ElfW(Addr)) 1 << (h % WORD_BITS)) |
+            ((ElfW(Addr)) 1 << ((h >> GNU_HASH_SHIFT2) % WORD_BITS));
+    }
+    compare_bucket_nbuckets = nbuckets;
+    qsort(defs, num_defined, sizeof(*defs), compare_bucket);
+
+    gnu[0] = nbuckets;
+    gnu[1] = 1 + num_imports;
+    gnu[2] = bloom_size;
+    gnu[3] = GNU_HASH_SHIFT2;
+
+    /* The imports are undefined and come first, they aren't hashed */
+    str_len = 1;
+    for (i = 0; i < num_imports; i++) {
+        ElfW(Sym) *sym = &syms[1 + i];
+
+        strcpy(strtab + str_len, imports[i]);
+        sym->st_name = str_len;
+        str_len += strlen(imports[i]) + 1;
+        sym->st_info = SYNTH_ST_INFO(STB_GLOBAL, STT_OBJECT);
+        sym->st_shndx = SHN_UNDEF;
+    }
+
+    for (i = 0; i < num_defined; i++) {
+        ElfW(Sym) *sym = &syms[1 + num_imports + i];
+        uint32_t bucket = defs[i].hash % nbuckets;
+        int last = i + 1 == num_defined || defs[i + 1].hash % nbuckets != bucket;
+
+        strcpy(strtab + str_len, defs[i].name);
+        sym->st_name = str_len;
+        str_len += strlen(defs[i].name) + 1;
+        sym->st_info = SYNTH_ST_INFO(STB_GLOBAL, STT_OBJECT);
+        sym->st_shndx = SHDR_DATA;
+        sym->st_value = defs[i].value;
+        sym->st_size = sizeof(ElfW(Addr));
+
+        if (buckets[bucket] == 0)
+            buckets[bucket] = 1 + num_imports + i;
+        chains[i] = (defs[i].hash & ~1u) | (last ? 1 : 0);
+
+        rels[i].r_offset = defs[i].value;
+        if (defs[i].import >= 0) {
+            /* Each import is looked up in the libraries loaded with this one */
+            rels[i].r_info = SYNTH_R_INFO(1 + defs[i].import, SYNTH_R_GLOB_DAT);
+            continue;
+        }
+
+        /* Relocations make the loading take a while */
+        rels[i].r_info = SYNTH_R_INFO(0, SYNTH_R_RELATIVE);
+#if defined(__LP64__)
+        rels[i].r_addend = defs[i].value;
+#else
+        /* file offsets and addresses are the same */
+        *(ElfW(Addr) *) (image + defs[i].value) = defs[i].value;
+#endif
+    }
+
+    i = 0;
+    for (; i < num_needed; i++) {
+        dyn[i].d_tag = DT_NEEDED;
+        dyn[i].d_un.d_val = str_len;
+        strcpy(strtab + str_len, needed[i]);
+        str_len += strlen(needed[i]) + 1;
+    }
+    dyn[i].d_tag = DT_SONAME;
+    dyn[i++].d_un.d_val = str_len;
+    strcpy(strtab + str_len, soname);
+    str_len += strlen(soname) + 1;
+    dyn[i].d_tag = DT_GNU_HASH;
+    dyn[i++].d_un.d_ptr = off_hash;
+    dyn[i].d_tag = DT_STRTAB;
+    dyn[i++].d_un.d_ptr = off_str;
+    dyn[i].d_tag = DT_SYMTAB;
+    dyn[i++].d_un.d_ptr = off_syms;
+    dyn[i].d_tag = DT_STRSZ;
+    dyn[i++].d_un.d_val = str_len;
+    dyn[i].d_tag = DT_SYMENT;
+    dyn[i++].d_un.d_val = sizeof(ElfW(Sym));
+    dyn[i].d_tag = SYNTH_DT_REL;
+    dyn[i++].d_un.d_ptr = off_rels;
+    dyn[i].d_tag = SYNTH_DT_RELSZ;
+    dyn[i++].d_un.d_val = num_defined * sizeof(synth_rel_t);
+    dyn[i].d_tag = SYNTH_DT_RELENT;
+    dyn[i++].d_un.d_val = sizeof(synth_rel_t);
+    /* the DT_NULL entry is left zeroed */
+
+    memcpy(ehdr->e_ident, ELFMAG, SELFMAG);
+    ehdr->e_ident[EI_CLASS] = SYNTH_CLASS;
+    ehdr->e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr->e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr->e_type = ET_DYN;
+    ehdr->e_machine = SYNTH_MACHINE;
+    ehdr->e_version = EV_CURRENT;
+    ehdr->e_phoff = off_phdr;
+    ehdr->e_shoff = off_shdr;
+    ehdr->e_ehsize = sizeof(ElfW(Ehdr));
+    ehdr->e_phentsize = sizeof(ElfW(Phdr));
+    ehdr->e_phnum = 4;
+    ehdr->e_shentsize = sizeof(ElfW(Shdr));
+    ehdr->e_shnum = SHDR_COUNT;
+    ehdr->e_shstrndx = SHDR_SHSTRTAB;
+
+    phdr[0].p_type = PT_LOAD;
+    phdr[0].p_flags = PF_R;
+    phdr[0].p_filesz = phdr[0].p_memsz = end_ro;
+    phdr[0].p_align = SEGMENT_ALIGN;
+
+    phdr[1].p_type = PT_LOAD;
+    phdr[1].p_flags = PF_R | PF_W;
+    phdr[1].p_offset = phdr[1].p_vaddr = phdr[1].p_paddr = off_dyn;
+    phdr[1].p_filesz = phdr[1].p_memsz = file_size - off_dyn;
+    phdr[1].p_align = SEGMENT_ALIGN;
+
+    phdr[2].p_type = PT_DYNAMIC;
+    phdr[2].p_flags = PF_R | PF_W;
+    phdr[2].p_offset = phdr[2].p_vaddr = phdr[2].p_paddr = off_dyn;
+    phdr[2].p_filesz = phdr[2].p_memsz = num_dyn * sizeof(ElfW(Dyn));
+    phdr[2].p_align = sizeof(ElfW(Addr));
+
+    phdr[3].p_type = PT_GNU_STACK;
+    phdr[3].p_flags = PF_R | PF_W;
+
+    shdr[SHDR_DYNSYM].sh_name = 1;
+    shdr[SHDR_DYNSYM].sh_type = SHT_DYNSYM;
+    shdr[SHDR_DYNSYM].sh_flags = SHF_ALLOC;
+    shdr[SHDR_DYNSYM].sh_addr = shdr[SHDR_DYNSYM].sh_offset = off_syms;
+    shdr[SHDR_DYNSYM].sh_size = nsyms * sizeof(ElfW(Sym));
+    shdr[SHDR_DYNSYM].sh_link = SHDR_DYNSTR;
+    shdr[SHDR_DYNSYM].sh_info = 1;
+    shdr[SHDR_DYNSYM].sh_entsize = sizeof(ElfW(Sym));
+
+    shdr[SHDR_DYNSTR].sh_name = 9;
+    shdr[SHDR_DYNSTR].sh_type = SHT_STRTAB;
+    shdr[SHDR_DYNSTR].sh_flags = SHF_ALLOC;
+    shdr[SHDR_DYNSTR].sh_addr = shdr[SHDR_DYNSTR].sh_offset = off_str;
+    shdr[SHDR_DYNSTR].sh_size = str_len;
+
+    shdr[SHDR_DYNAMIC].sh_name = 17;
+    shdr[SHDR_DYNAMIC].sh_type = SHT_DYNAMIC;
+    shdr[SHDR_DYNAMIC].sh_flags = SHF_ALLOC | SHF_WRITE;
+    shdr[SHDR_DYNAMIC].sh_addr = shdr[SHDR_DYNAMIC].sh_offset = off_dyn;
+    shdr[SHDR_DYNAMIC].sh_size = phdr[2].p_filesz;
+    shdr[SHDR_DYNAMIC].sh_link = SHDR_DYNSTR;
+    shdr[SHDR_DYNAMIC].sh_entsize = sizeof(ElfW(Dyn));
+
+    shdr[SHDR_DATA].sh_name = 26;
+    shdr[SHDR_DATA].sh_type = SHT_PROGBITS;
+    shdr[SHDR_DATA].sh_flags = SHF_ALLOC | SHF_WRITE;
+    shdr[SHDR_DATA].sh_addr = shdr[SHDR_DATA].sh_offset = words_addr;
+    shdr[SHDR_DATA].sh_size = file_size - words_addr;
+
+    shdr[SHDR_SHSTRTAB].sh_name = 32;
+    shdr[SHDR_SHSTRTAB].sh_type = SHT_STRTAB;
+    shdr[SHDR_SHSTRTAB].sh_offset = off_shstr;
+    shdr[SHDR_SHSTRTAB].sh_size = sizeof(shstrtab);
+
+    fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0 || write(fd, image, file_size) != (ssize_t) file_size) {
+        fprintf(stderr, "failed to write %s: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    close(fd);
+    free(defs);
+    free(image);
+    return 0;
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,44 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef SYNTHLIB_H
+#define SYNTHLIB_H
+
+/*
+ * Writes a shared library for the Android linker to path, so that the
+ * linker tests need no toolchain for the Android side. It contains data
+ * only: num_symbols exported words named <prefix>_sym<n>, which are
+ * relocated to point to themselves, so that every address the linker hands
+ * out for them can be checked.
+ *
+ * Returns 0 or -1 on errors.
+ */
+int synthlib_write(const char *path, const char *soname, const char *prefix, int num_symbols);
+
+/*
+ * Like synthlib_write(), the library also depends on the libraries with the
+ * sonames in needed and imports the symbols in imports: for each of them it
+ * exports a word named <prefix>_import<n>, which the linker relocates to the
+ * address of the imported symbol.
+ */
+int synthlib_write_importer(const char *path, const char *soname, const char *prefix,
+                            int num_symbols, const char *const *needed, int num_needed,
+                            const char *const *imports, int num_imports);
+
+#endif
+
+// vim:ts=4:sw=4:noexpandtab
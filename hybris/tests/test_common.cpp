@@ -128,10 +128,7 @@ void HWComposer2::present(HWComposerNativeWindowBuffer *buffer)
 	// HWC2 present fences signal when the frame n is displayed on screen
 	// and the buffer for the previous frame n-1 is no longer needed.
 	if (lastBuffer) {
-		int fenceFd = getFenceBufferFd(lastBuffer);
-		if (fenceFd != -1)
-			close(fenceFd);
-		setFenceBufferFd(lastBuffer, presentFence);
+		mergeFenceBufferFd(lastBuffer, presentFence);
 		lastBuffer->common.decRef(&lastBuffer->common);
 	} else if (presentFence != -1) {
 		close(presentFence);
@@ -14,23 +14,113 @@
  * limitations under the License.
  *
  */
+
+/*
+ * Loads a library with the Android linker and reports how long it took.
+ *
+ * The first load includes the linker setup. The library is then unloaded
+ * and loaded again for the given number of rounds, which relocates it and
+ * its dependencies each time, resolving every imported symbol against the
+ * hooks first. Pick a library which nothing else keeps loaded, e.g. the
+ * vendor EGL or GLES library, so that every round really relocates it.
+ *
+ * It also reports the private dirty memory of libhybris-common, which holds
+ * the hook tables, as each process in a multi-process setup pays for it.
+ *
+ * Usage: test_dlopen [library] [rounds]
+ */
+
 #include <hybris/common/binding.h>
 #include <dlfcn.h>
 #include <EGL/egl.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <stddef.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_ROUNDS 20
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+    return x < y ? -1 : x > y;
+}
 
+/* Sum of Private_Dirty over the mappings of libhybris-common, in kB */
+static long hybris_common_dirty_kb(void)
+{
+    FILE *smaps = fopen("/proc/self/smaps", "r");
+    char line[512];
+    int in_common = 0;
+    long total = 0, kb;
+
+    if (!smaps)
+        return -1;
+
+    while (fgets(line, sizeof(line), smaps)) {
+        /* Mapping headers start with the address range */
+        if (strchr(line, '-') && strchr(line, '-') < strchr(line, ' '))
+            in_common = strstr(line, "libhybris-common") != NULL;
+        else if (in_common && sscanf(line, "Private_Dirty: %ld kB", &kb) == 1)
+            total += kb;
+    }
+
+    fclose(smaps);
+    return total;
+}
 
 int main(int argc, char **argv) {
 
     int i = 0;
     char *libname = "libc.so";
+    int rounds = DEFAULT_ROUNDS;
+    double *times;
+    double start;
 
     if (argc > 1) {
         libname = argv[1];
     }
+    if (argc > 2) {
+        rounds = atoi(argv[2]);
+    }
 
+    start = now_ms();
     void *handler = android_dlopen(libname, RTLD_LAZY);
     printf("android %s is %p\n", libname,handler);
+    if (!handler)
+        return 1;
+    printf("first load of %s took %.3f ms\n", libname, now_ms() - start);
+
+    times = calloc(rounds > 0 ? rounds : 1, sizeof(double));
+    for (i = 0; i < rounds; i++) {
+        android_dlclose(handler);
+        start = now_ms();
+        handler = android_dlopen(libname, RTLD_LAZY);
+        times[i] = now_ms() - start;
+        if (!handler) {
+            printf("reloading %s failed: %s\n", libname, android_dlerror());
+            return 1;
+        }
+    }
+
+    if (rounds > 0) {
+        qsort(times, rounds, sizeof(double), compare_double);
+        printf("reloading %s %d times: min %.3f ms, median %.3f ms, max %.3f ms\n",
+               libname, rounds, times[0], times[rounds / 2], times[rounds - 1]);
+    }
+
+    printf("libhybris-common private dirty memory: %ld kB\n",
+           hybris_common_dirty_kb());
+
+    free(times);
+    android_dlclose(handler);
     return 0;
 }
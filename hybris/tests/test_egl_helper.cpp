@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Stresses the EGLSurface to native window mapping of libEGL from several
+ * render threads at once. Every thread swaps its own surfaces, which means
+ * one lookup per frame, and every now and then destroys one of them and
+ * creates a new one, while the table grows and shrinks underneath. Each
+ * lookup has to find the window of the surface.
+ *
+ * The time per lookup is compared to a std::map behind a mutex, which is
+ * what a locked version of the old mapping would cost.
+ *
+ * usage: test_egl_helper [threads] [frames per thread]
+ */
+
+#include "helper.h"
+
+#include <map>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MAX_THREADS          16
+#define SURFACES_PER_THREAD  8
+#define RECREATE_INTERVAL    64
+
+static int num_threads = 4;
+static int num_frames = 1000000;
+
+static pthread_barrier_t barrier;
+static volatile int errors = 0;
+
+static std::map<EGLSurface, EGLNativeWindowType> locked_map;
+static pthread_mutex_t locked_map_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* Surfaces are unique per thread and generation, the window is derived */
+static EGLSurface fake_surface(int thread, int generation, int i)
+{
+    return (EGLSurface) (uintptr_t) ((((uintptr_t) generation * MAX_THREADS + thread) * SURFACES_PER_THREAD + i + 1) * 16);
+}
+
+static EGLNativeWindowType window_of(EGLSurface surface)
+{
+    return (EGLNativeWindowType) ((uintptr_t) surface + 8);
+}
+
+static void *swap_thread(void *data)
+{
+    int thread = (int) (intptr_t) data;
+    EGLSurface surfaces[SURFACES_PER_THREAD];
+    int generation = 0, i;
+
+    for (i = 0; i < SURFACES_PER_THREAD; i++) {
+        surfaces[i] = fake_surface(thread, generation, i);
+        egl_helper_push_mapping(surfaces[i], window_of(surfaces[i]));
+    }
+
+    pthread_barrier_wait(&barrier);
+
+    for (i = 0; i < num_frames; i++) {
+        EGLSurface surface = surfaces[i % SURFACES_PER_THREAD];
+
+        if (egl_helper_get_mapping(surface) != window_of(surface)) {
+            printf("thread %d: wrong window for surface %p in frame %d\n", thread, surface, i);
+            __sync_fetch_and_add(&errors, 1);
+        }
+
+        if (i % RECREATE_INTERVAL == RECREATE_INTERVAL - 1) {
+            int n = (i / RECREATE_INTERVAL) % SURFACES_PER_THREAD;
+
+            if (egl_helper_pop_mapping(surfaces[n]) != window_of(surfaces[n]) ||
+                egl_helper_get_mapping(surfaces[n]) != (EGLNativeWindowType) 0) {
+                printf("thread %d: surface %p not destroyed\n", thread, surfaces[n]);
+                __sync_fetch_and_add(&errors, 1);
+            }
+            if (n == 0)
+                generation++;
+            surfaces[n] = fake_surface(thread, generation, n);
+            egl_helper_push_mapping(surfaces[n], window_of(surfaces[n]));
+        }
+    }
+
+    for (i = 0; i < SURFACES_PER_THREAD; i++)
+        egl_helper_pop_mapping(surfaces[i]);
+
+    return NULL;
+}
+
+static void *locked_thread(void *data)
+{
+    int thread = (int) (intptr_t) data;
+    EGLSurface surfaces[SURFACES_PER_THREAD];
+    int i;
+
+    pthread_mutex_lock(&locked_map_mutex);
+    for (i = 0; i < SURFACES_PER_THREAD; i++) {
+        surfaces[i] = fake_surface(thread, 0, i);
+        locked_map[surfaces[i]] = window_of(surfaces[i]);
+    }
+    pthread_mutex_unlock(&locked_map_mutex);
+
+    pthread_barrier_wait(&barrier);
+
+    for (i = 0; i < num_frames; i++) {
+        EGLSurface surface = surfaces[i % SURFACES_PER_THREAD];
+        EGLNativeWindowType window = (EGLNativeWindowType) 0;
+
+        pthread_mutex_lock(&locked_map_mutex);
+        if (locked_map.find(surface) != locked_map.end())
+            window = locked_map[surface];
+        pthread_mutex_unlock(&locked_map_mutex);
+
+        if (window != window_of(surface))
+            __sync_fetch_and_add(&errors, 1);
+    }
+
+    return NULL;
+}
+
+/* Returns the time per lookup in ns */
+static double run(void *(*func)(void *))
+{
+    pthread_t threads[MAX_THREADS];
+    double start;
+    int i;
+
+    pthread_barrier_init(&barrier, NULL, num_threads + 1);
+    for (i = 0; i < num_threads; i++)
+        pthread_create(&threads[i], NULL, func, (void *) (intptr_t) i);
+
+    pthread_barrier_wait(&barrier);
+    start = now_ms();
+    for (i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+    pthread_barrier_destroy(&barrier);
+
+    return (now_ms() - start) * 1e6 / ((double) num_threads * num_frames);
+}
+
+int main(int argc, char **argv)
+{
+    if (argc > 1)
+        num_threads = atoi(argv[1]);
+    if (argc > 2)
+        num_frames = atoi(argv[2]);
+    if (num_threads < 1 || num_threads > MAX_THREADS)
+        num_threads = 4;
+
+    printf("%d threads with %d surfaces each, %d frames per thread\n",
+           num_threads, SURFACES_PER_THREAD, num_frames);
+
+    double registry_ns = run(swap_thread);
+    double locked_ns = run(locked_thread);
+
+    printf("registry:           %6.1f ns per frame\n", registry_ns);
+    printf("std::map and mutex: %6.1f ns per frame\n", locked_ns);
+
+    for (int t = 0; t < num_threads; t++) {
+        if (egl_helper_has_mapping(fake_surface(t, 0, 1))) {
+            printf("surface of thread %d left behind\n", t);
+            errors++;
+        }
+    }
+
+    printf("%s\n", errors ? "FAILED" : "OK");
+
+    return errors ? 1 : 0;
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,291 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Measures how fast libEGL creates and destroys EGLImages, the way a
+ * compositor does for every client buffer in every frame. libEGL is built
+ * into the test, on top of a stub Android EGL which does no work of its
+ * own and a stub window system, so only the cost of the wrapper remains.
+ *
+ * Images are created from several threads at once, first with the one
+ * display the client opened and then with many more displays known to
+ * libEGL, which must not slow down their lookup. Then the same buffers are
+ * passed as wl_buffers with the EGLImage cache on (HYBRIS_EGL_IMAGE_CACHE=1),
+ * which has to create one Android EGLImage per buffer only and destroy them
+ * all once the buffers go away.
+ *
+ * usage: test_egl_images [threads] [images per thread]
+ */
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+extern "C" {
+#include "ws.h"
+#include "helper.h"
+}
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define MAX_THREADS    16
+#define EXTRA_DISPLAYS 1000
+#define NUM_BUFFERS    64
+
+/* The EGLDisplay of the stub Android EGL */
+#define STUB_DISPLAY ((EGLDisplay) 1)
+
+static int num_threads = 4;
+static int num_images = 200000;
+
+static pthread_barrier_t barrier;
+static volatile int errors = 0;
+static volatile long live_images = 0;
+static volatile long created_images = 0;
+static EGLenum image_target = EGL_NATIVE_BUFFER_ANDROID;
+
+static PFNEGLCREATEIMAGEKHRPROC create_image;
+static PFNEGLDESTROYIMAGEKHRPROC destroy_image;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* The stub Android EGL */
+
+static EGLDisplay stub_eglGetDisplay(EGLNativeDisplayType display_id)
+{
+    return STUB_DISPLAY;
+}
+
+static EGLBoolean stub_eglInitialize(EGLDisplay dpy, EGLint *major, EGLint *minor)
+{
+    return EGL_TRUE;
+}
+
+static EGLImageKHR stub_eglCreateImageKHR(EGLDisplay dpy, EGLContext ctx, EGLenum target,
+                                          EGLClientBuffer buffer, const EGLint *attrib_list)
+{
+    if (dpy != STUB_DISPLAY)
+        return EGL_NO_IMAGE_KHR;
+
+    __sync_fetch_and_add(&live_images, 1);
+    __sync_fetch_and_add(&created_images, 1);
+    // Any non-zero handle will do, the wrapper only passes it back
+    return (EGLImageKHR) buffer;
+}
+
+static EGLBoolean stub_eglDestroyImageKHR(EGLDisplay dpy, EGLImageKHR image)
+{
+    if (dpy != STUB_DISPLAY || image == EGL_NO_IMAGE_KHR)
+        return EGL_FALSE;
+
+    __sync_fetch_and_sub(&live_images, 1);
+    return EGL_TRUE;
+}
+
+extern "C" void *android_dlopen(const char *filename, int flag)
+{
+    return (void *) filename;
+}
+
+extern "C" void *android_dlsym(void *handle, const char *symbol)
+{
+    if (strcmp(symbol, "eglGetDisplay") == 0)
+        return (void *) stub_eglGetDisplay;
+    if (strcmp(symbol, "eglInitialize") == 0)
+        return (void *) stub_eglInitialize;
+    if (strcmp(symbol, "eglCreateImageKHR") == 0)
+        return (void *) stub_eglCreateImageKHR;
+    if (strcmp(symbol, "eglDestroyImageKHR") == 0)
+        return (void *) stub_eglDestroyImageKHR;
+    return NULL;
+}
+
+/* The stub window system */
+
+extern "C" {
+
+EGLBoolean ws_init(const char *egl_platform)
+{
+    return EGL_TRUE;
+}
+
+struct _EGLDisplay *ws_GetDisplay(EGLNativeDisplayType display)
+{
+    return (struct _EGLDisplay *) calloc(1, sizeof(struct _EGLDisplay));
+}
+
+void ws_releaseDisplay(struct _EGLDisplay *dpy)
+{
+    free(dpy);
+}
+
+void ws_eglInitialized(struct _EGLDisplay *dpy) { }
+void ws_Terminate(struct _EGLDisplay *dpy) { }
+EGLNativeWindowType ws_CreateWindow(EGLNativeWindowType win, struct _EGLDisplay *display) { return win; }
+void ws_DestroyWindow(EGLNativeWindowType win) { }
+__eglMustCastToProperFunctionPointerType ws_eglGetProcAddress(const char *procname) { return NULL; }
+
+/* Our wl_buffers are the native buffers themselves */
+void ws_passthroughImageKHR(EGLContext *ctx, EGLenum *target, EGLClientBuffer *buffer, const EGLint **attrib_list)
+{
+    if (*target == EGL_WAYLAND_BUFFER_WL) {
+        *target = EGL_NATIVE_BUFFER_ANDROID;
+        *ctx = EGL_NO_CONTEXT;
+        *attrib_list = NULL;
+    }
+}
+
+const char *ws_eglQueryString(EGLDisplay dpy, EGLint name, const char *(*real_eglQueryString)(EGLDisplay dpy, EGLint name)) { return NULL; }
+void ws_prepareSwap(EGLDisplay dpy, EGLNativeWindowType win, EGLint *damage_rects, EGLint damage_n_rects) { }
+void ws_finishSwap(EGLDisplay dpy, EGLNativeWindowType win) { }
+void ws_setSwapInterval(EGLDisplay dpy, EGLNativeWindowType win, EGLint interval) { }
+
+}
+
+static struct _EGLDisplay *create_extra_display(void *data)
+{
+    struct _EGLDisplay *display = ws_GetDisplay(NULL);
+
+    display->dpy = (EGLDisplay) data;
+    return display;
+}
+
+/* A compositor importing the buffers of a few clients, frame after frame */
+static void *image_thread(void *data)
+{
+    EGLDisplay dpy = (EGLDisplay) data;
+    int i;
+
+    pthread_barrier_wait(&barrier);
+
+    for (i = 0; i < num_images; i++) {
+        EGLClientBuffer buffer = (EGLClientBuffer) (uintptr_t) ((i % NUM_BUFFERS + 1) * 64);
+        EGLImageKHR image = create_image(dpy, EGL_NO_CONTEXT, image_target, buffer, NULL);
+
+        if (image == EGL_NO_IMAGE_KHR || destroy_image(dpy, image) != EGL_TRUE)
+            __sync_fetch_and_add(&errors, 1);
+    }
+
+    return NULL;
+}
+
+/* Returns the number of images created and destroyed per second */
+static double run(EGLDisplay dpy)
+{
+    pthread_t threads[MAX_THREADS];
+    double start;
+    int i;
+
+    pthread_barrier_init(&barrier, NULL, num_threads + 1);
+    for (i = 0; i < num_threads; i++)
+        pthread_create(&threads[i], NULL, image_thread, (void *) dpy);
+
+    // The threads may be done before this one runs again
+    start = now_ms();
+    pthread_barrier_wait(&barrier);
+    for (i = 0; i < num_threads; i++)
+        pthread_join(threads[i], NULL);
+    pthread_barrier_destroy(&barrier);
+
+    return (double) num_threads * num_images / ((now_ms() - start) / 1e3);
+}
+
+int main(int argc, char **argv)
+{
+    EGLDisplay dpy;
+    int i;
+
+    if (argc > 1)
+        num_threads = atoi(argv[1]);
+    if (argc > 2)
+        num_images = atoi(argv[2]);
+    if (num_threads < 1 || num_threads > MAX_THREADS)
+        num_threads = 4;
+
+    // Only affects images of wl_buffers
+    setenv("HYBRIS_EGL_IMAGE_CACHE", "1", 1);
+
+    dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (dpy != STUB_DISPLAY || !eglInitialize(dpy, NULL, NULL)) {
+        printf("can't open the display\n");
+        return 1;
+    }
+
+    create_image = (PFNEGLCREATEIMAGEKHRPROC) eglGetProcAddress("eglCreateImageKHR");
+    destroy_image = (PFNEGLDESTROYIMAGEKHRPROC) eglGetProcAddress("eglDestroyImageKHR");
+    if (!create_image || !destroy_image) {
+        printf("no eglCreateImageKHR or eglDestroyImageKHR\n");
+        return 1;
+    }
+
+    printf("%d threads creating and destroying %d images each\n", num_threads, num_images);
+    printf("1 display:     %10.0f images/s\n", run(dpy));
+
+    for (i = 0; i < EXTRA_DISPLAYS; i++) {
+        EGLDisplay extra = (EGLDisplay) (uintptr_t) (0x1000 + i);
+
+        if (!egl_helper_get_or_push_display_mapping(extra, create_extra_display, extra)) {
+            printf("display %d not added\n", i);
+            errors++;
+        }
+    }
+    // Displays beyond the first 100 used to be dropped
+    if (egl_helper_get_display_mapping((EGLDisplay) (uintptr_t) (0x1000 + EXTRA_DISPLAYS - 1)) == NULL) {
+        printf("the last display wasn't found\n");
+        errors++;
+    }
+
+    printf("%d displays:  %10.0f images/s\n", EXTRA_DISPLAYS + 1, run(dpy));
+
+    image_target = EGL_WAYLAND_BUFFER_WL;
+    created_images = 0;
+    printf("cached:        %10.0f images/s\n", run(dpy));
+
+    // Threads may race to create the first image of a buffer
+    if (created_images < NUM_BUFFERS || created_images > NUM_BUFFERS * num_threads) {
+        printf("%ld Android EGLImages created for %d buffers\n", created_images, NUM_BUFFERS);
+        errors++;
+    }
+    if (live_images != NUM_BUFFERS) {
+        printf("%ld Android EGLImages cached for %d buffers\n", live_images, NUM_BUFFERS);
+        errors++;
+    }
+
+    // The wl_buffers are destroyed
+    for (i = 0; i < NUM_BUFFERS; i++)
+        hybris_egl_interface.release_buffer_images((EGLClientBuffer) (uintptr_t) ((i + 1) * 64));
+
+    if (live_images != 0) {
+        printf("%ld images leaked\n", live_images);
+        errors++;
+    }
+
+    printf("%s\n", errors ? "FAILED" : "OK");
+
+    return errors ? 1 : 0;
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,84 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Measures the per call overhead of the libGLESv2 passthrough functions by
+ * comparing calls through libhybris' libGLESv2 with calls to the function
+ * pointer resolved from the Android library directly. Build libhybris with
+ * and without --enable-ifunc-dispatch to compare both dispatch modes.
+ */
+
+#include <GLES2/gl2.h>
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <hybris/common/binding.h>
+
+#define DEFAULT_ITERATIONS 10000000
+
+static double now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+int main(int argc, char **argv)
+{
+    long iterations = DEFAULT_ITERATIONS;
+    GLenum (*android_glGetError)(void) FP_ATTRIB;
+    void *handle;
+    double start, wrapped, direct;
+    long i;
+
+    if (argc > 1)
+        iterations = atol(argv[1]);
+
+    handle = android_dlopen(getenv("LIBGLESV2") ? getenv("LIBGLESV2") : "libGLESv2.so", RTLD_LAZY);
+    if (!handle) {
+        fprintf(stderr, "failed to load Android libGLESv2: %s\n", android_dlerror());
+        return 1;
+    }
+
+    android_glGetError = android_dlsym(handle, "glGetError");
+    if (!android_glGetError) {
+        fprintf(stderr, "glGetError not found in Android libGLESv2\n");
+        return 1;
+    }
+
+    /* resolve the libhybris entry point before measuring */
+    glGetError();
+
+    start = now_ns();
+    for (i = 0; i < iterations; i++)
+        glGetError();
+    wrapped = (now_ns() - start) / iterations;
+
+    start = now_ns();
+    for (i = 0; i < iterations; i++)
+        android_glGetError();
+    direct = (now_ns() - start) / iterations;
+
+    printf("%ld calls of glGetError\n", iterations);
+    printf("  through libhybris: %.2f ns/call\n", wrapped);
+    printf("  direct:            %.2f ns/call\n", direct);
+    printf("  overhead:          %.2f ns/call\n", wrapped - direct);
+
+    return 0;
+}
@@ -0,0 +1,326 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Locks and unlocks buffers through libgralloc with the mapping cache on
+ * (HYBRIS_GRALLOC_MAP_CACHE and HYBRIS_GRALLOC_MAP_CACHE_COHERENT), on top
+ * of a fake gralloc 0 module provided
+ * by the test in place of the Android one. Its buffers are memfds, which
+ * are mapped on lock and unmapped on unlock like many vendor
+ * implementations do.
+ *
+ * A software renderer drawing to its buffers frame after frame has to map
+ * each of them once. Locks with a usage or region the kept mapping doesn't
+ * cover have to go to gralloc, the least recently used buffer has to be
+ * unlocked once the cache is full, and no buffer may still be locked when
+ * it is freed. Without HYBRIS_GRALLOC_MAP_CACHE_COHERENT=1 every lock and
+ * unlock has to go to gralloc.
+ *
+ * usage: test_gralloc_map_cache [frames]
+ */
+
+#include <android-config.h>
+#include <hardware/gralloc.h>
+#include <hybris/gralloc/gralloc.h>
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CACHE_SIZE   4
+#define CHAIN_BUFFERS 3
+#define MAX_BUFFERS  16
+#define WIDTH        64
+#define HEIGHT       64
+#define BUFFER_SIZE  (WIDTH * HEIGHT * 4)
+
+#define USAGE_RARELY (GRALLOC_USAGE_SW_READ_RARELY | GRALLOC_USAGE_SW_WRITE_RARELY)
+#define USAGE_OFTEN  (GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN)
+
+static int errors = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        errors++; \
+    } \
+} while (0)
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* The fake gralloc */
+
+struct mapping {
+    buffer_handle_t handle;
+    void *map;
+};
+
+static struct mapping mappings[MAX_BUFFERS];
+
+static int gralloc_locks = 0;
+static int gralloc_unlocks = 0;
+
+static struct mapping *mapping_of(buffer_handle_t handle)
+{
+    int i;
+
+    for (i = 0; i < MAX_BUFFERS; i++) {
+        if (mappings[i].handle == handle)
+            return &mappings[i];
+    }
+    for (i = 0; i < MAX_BUFFERS; i++) {
+        if (mappings[i].handle == NULL) {
+            mappings[i].handle = handle;
+            return &mappings[i];
+        }
+    }
+
+    return NULL;
+}
+
+static int fake_lock(gralloc_module_t const *module, buffer_handle_t handle,
+                     int usage, int l, int t, int w, int h, void **vaddr)
+{
+    struct mapping *mapping = mapping_of(handle);
+
+    if (!mapping || mapping->map)
+        return -EBUSY;
+
+    mapping->map = mmap(NULL, BUFFER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, handle->data[0], 0);
+    if (mapping->map == MAP_FAILED) {
+        mapping->map = NULL;
+        return -errno;
+    }
+
+    gralloc_locks++;
+    *vaddr = mapping->map;
+    return 0;
+}
+
+static int fake_unlock(gralloc_module_t const *module, buffer_handle_t handle)
+{
+    struct mapping *mapping = mapping_of(handle);
+
+    if (!mapping || !mapping->map)
+        return -EINVAL;
+
+    munmap(mapping->map, BUFFER_SIZE);
+    mapping->map = NULL;
+    gralloc_unlocks++;
+    return 0;
+}
+
+static int fake_alloc(struct alloc_device_t *dev, int w, int h, int format,
+                      int usage, buffer_handle_t *handle, int *stride)
+{
+    native_handle_t *native = native_handle_create(1, 0);
+
+    native->data[0] = memfd_create("test_gralloc_map_cache", 0);
+    if (native->data[0] < 0 || ftruncate(native->data[0], BUFFER_SIZE) < 0) {
+        native_handle_delete(native);
+        return -ENOMEM;
+    }
+
+    *handle = native;
+    *stride = w;
+    return 0;
+}
+
+static int fake_free(struct alloc_device_t *dev, buffer_handle_t handle)
+{
+    struct mapping *mapping = mapping_of(handle);
+
+    if (mapping && mapping->map) {
+        printf("buffer %p freed while locked\n", handle);
+        errors++;
+    }
+    if (mapping)
+        mapping->handle = NULL;
+
+    native_handle_close((native_handle_t *) handle);
+    native_handle_delete((native_handle_t *) handle);
+    return 0;
+}
+
+static int fake_close(struct hw_device_t *device)
+{
+    return 0;
+}
+
+static alloc_device_t fake_alloc_device;
+
+static int fake_open(const struct hw_module_t *module, const char *id,
+                     struct hw_device_t **device)
+{
+    fake_alloc_device.common.tag = HARDWARE_DEVICE_TAG;
+    fake_alloc_device.common.module = (struct hw_module_t *) module;
+    fake_alloc_device.common.close = fake_close;
+    fake_alloc_device.alloc = fake_alloc;
+    fake_alloc_device.free = fake_free;
+
+    *device = &fake_alloc_device.common;
+    return 0;
+}
+
+static struct hw_module_methods_t fake_methods = { fake_open };
+
+static gralloc_module_t fake_module;
+
+int hw_get_module(const char *id, const struct hw_module_t **module)
+{
+    fake_module.common.tag = HARDWARE_MODULE_TAG;
+    fake_module.common.module_api_version = GRALLOC_MODULE_API_VERSION_0_1;
+    fake_module.common.id = GRALLOC_HARDWARE_MODULE_ID;
+    fake_module.common.methods = &fake_methods;
+    fake_module.lock = fake_lock;
+    fake_module.unlock = fake_unlock;
+
+    *module = &fake_module.common;
+    return 0;
+}
+
+/* Keep libgralloc away from the Android mapper and the linker */
+void hybris_ui_initialize()
+{
+}
+
+bool hybris_ui_check_for_symbol(const char *sym)
+{
+    return false;
+}
+
+int android_dlclose(void *handle)
+{
+    return 0;
+}
+
+static int draw(buffer_handle_t handle, int usage, int l, int t, int w, int h, int frame)
+{
+    void *vaddr = NULL;
+
+    if (hybris_gralloc_lock(handle, usage, l, t, w, h, &vaddr) != 0 || !vaddr)
+        return -1;
+    memset(vaddr, frame, BUFFER_SIZE);
+    return hybris_gralloc_unlock(handle);
+}
+
+/* In a child, as the environment is only read once: the cache stays off */
+static int run_not_coherent(void)
+{
+    buffer_handle_t handle;
+    uint32_t stride;
+    int status;
+    pid_t pid;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0) {
+        setenv("HYBRIS_GRALLOC_MAP_CACHE", "4", 1);
+        hybris_gralloc_initialize(0);
+        CHECK(hybris_gralloc_allocate(WIDTH, HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888, USAGE_RARELY, &handle, &stride) == 0);
+        CHECK(draw(handle, USAGE_RARELY, 0, 0, WIDTH, HEIGHT, 0) == 0);
+        CHECK(draw(handle, USAGE_RARELY, 0, 0, WIDTH, HEIGHT, 1) == 0);
+        CHECK(gralloc_locks == 2 && gralloc_unlocks == 2);
+        hybris_gralloc_release(handle, 1);
+        fflush(stdout);
+        _exit(errors);
+    }
+
+    return pid > 0 && waitpid(pid, &status, 0) == pid &&
+        WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+int main(int argc, char **argv)
+{
+    buffer_handle_t chain[CHAIN_BUFFERS], other[CACHE_SIZE];
+    struct hybris_gralloc_map_cache_stats stats;
+    uint32_t stride;
+    int frames = 10000;
+    int i, locks;
+
+    if (argc > 1)
+        frames = atoi(argv[1]);
+    if (frames < CHAIN_BUFFERS)
+        frames = CHAIN_BUFFERS;
+
+    CHECK(run_not_coherent() == 0);
+
+    setenv("HYBRIS_GRALLOC_MAP_CACHE", "4", 1);
+    setenv("HYBRIS_GRALLOC_MAP_CACHE_COHERENT", "1", 1);
+    hybris_gralloc_initialize(0);
+
+    for (i = 0; i < CHAIN_BUFFERS; i++)
+        CHECK(hybris_gralloc_allocate(WIDTH, HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888, USAGE_RARELY, &chain[i], &stride) == 0);
+
+    double start = now_ms();
+    for (i = 0; i < frames; i++)
+        CHECK(draw(chain[i % CHAIN_BUFFERS], USAGE_RARELY, 0, 0, WIDTH, HEIGHT, i) == 0);
+    double elapsed = now_ms() - start;
+
+    hybris_gralloc_get_map_cache_stats(&stats);
+    printf("%d frames: %.2f us per frame, %lu hits, %lu misses, %d gralloc locks\n",
+           frames, elapsed * 1e3 / frames, stats.hits, stats.misses, gralloc_locks);
+    CHECK(gralloc_locks == CHAIN_BUFFERS);
+    CHECK(gralloc_unlocks == 0);
+    CHECK(stats.deferred_unlocks == (unsigned long) frames);
+
+    // A part of the mapped region with less usage is served by the mapping
+    locks = gralloc_locks;
+    CHECK(draw(chain[0], GRALLOC_USAGE_SW_WRITE_RARELY, 8, 8, 16, 16, 0) == 0);
+    CHECK(gralloc_locks == locks);
+
+    // More usage needs a new lock, which is kept in turn
+    CHECK(draw(chain[0], USAGE_RARELY | GRALLOC_USAGE_HW_TEXTURE, 0, 0, WIDTH, HEIGHT, 0) == 0);
+    CHECK(gralloc_locks == locks + 1 && gralloc_unlocks == 1);
+    CHECK(draw(chain[1], USAGE_OFTEN, 0, 0, WIDTH, HEIGHT, 0) == 0);
+    CHECK(gralloc_locks == locks + 2 && gralloc_unlocks == 2);
+    CHECK(draw(chain[1], USAGE_OFTEN, 0, 0, WIDTH, HEIGHT, 0) == 0);
+    CHECK(gralloc_locks == locks + 2 && gralloc_unlocks == 2);
+
+    // The least recently used buffers make room
+    for (i = 0; i < CACHE_SIZE; i++) {
+        CHECK(hybris_gralloc_allocate(WIDTH, HEIGHT, HAL_PIXEL_FORMAT_RGBA_8888, USAGE_RARELY, &other[i], &stride) == 0);
+        CHECK(draw(other[i], USAGE_RARELY, 0, 0, WIDTH, HEIGHT, i) == 0);
+    }
+
+    hybris_gralloc_get_map_cache_stats(&stats);
+    printf("%d more buffers: %lu evictions\n", CACHE_SIZE, stats.evictions);
+    CHECK(stats.evictions == CHAIN_BUFFERS);
+
+    for (i = 0; i < CHAIN_BUFFERS; i++)
+        hybris_gralloc_release(chain[i], 1);
+    for (i = 0; i < CACHE_SIZE; i++)
+        hybris_gralloc_release(other[i], 1);
+    CHECK(gralloc_locks == gralloc_unlocks);
+
+    printf("%s\n", errors ? "FAILED" : "OK");
+
+    return errors ? 1 : 0;
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,237 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Drives a hwcomposer window with a fake present callback standing in for a
+ * display, which blocks until the next vsync and fences the buffers it
+ * scans out on a sw_sync timeline. The GPU is simulated with a second
+ * timeline, like in test_wayland_fences.
+ *
+ * The window is measured presenting in eglSwapBuffers, from its present
+ * thread (HYBRIS_HWC_PRESENT_THREAD=1) and from the present thread in
+ * mailbox mode with swap interval 0, each in a child process of its own.
+ * The callback checks that frames are shown in order, without gaps unless
+ * in mailbox mode, and only once their render fence signalled.
+ *
+ * Needs gralloc and /dev/sw_sync.
+ *
+ * usage: test_hwcomposer_present [cpu ms] [gpu ms] [vsync ms]
+ */
+
+#include <android-config.h>
+#include <system/window.h>
+
+#include "hwcomposer.h"
+#include "fakegpu.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+extern "C" {
+#include <sync/sync.h>
+int sw_sync_timeline_create(void);
+int sw_sync_timeline_inc(int fd, unsigned count);
+int sw_sync_fence_create(int fd, const char *name, unsigned value);
+}
+
+#define NUM_FRAMES    300
+#define WARMUP_FRAMES 30
+#define MAX_BUFFERS   8
+
+static double cpu_ms = 4;
+static double gpu_ms = 4;
+static double vsync_ms = 16.7;
+
+/* The fake display, only touched by the present callback */
+static struct {
+    int timeline;
+    unsigned presents;
+    double next_vsync;
+    int last_frame;
+    int errors;
+} display = { -1, 0, 0, 0, 0 };
+
+/* The frame rendered to each buffer, set by the render thread */
+static struct {
+    pthread_mutex_t lock;
+    ANativeWindowBuffer *buffer[MAX_BUFFERS];
+    int frame[MAX_BUFFERS];
+} frames = { PTHREAD_MUTEX_INITIALIZER, { NULL }, { 0 } };
+
+static bool mailbox_mode = false;
+
+static void set_frame(ANativeWindowBuffer *buffer, int frame)
+{
+    int i;
+
+    pthread_mutex_lock(&frames.lock);
+    for (i = 0; i < MAX_BUFFERS; i++) {
+        if (frames.buffer[i] == buffer || frames.buffer[i] == NULL) {
+            frames.buffer[i] = buffer;
+            frames.frame[i] = frame;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&frames.lock);
+}
+
+static int get_frame(ANativeWindowBuffer *buffer)
+{
+    int i, frame = -1;
+
+    pthread_mutex_lock(&frames.lock);
+    for (i = 0; i < MAX_BUFFERS; i++) {
+        if (frames.buffer[i] == buffer)
+            frame = frames.frame[i];
+    }
+    pthread_mutex_unlock(&frames.lock);
+
+    return frame;
+}
+
+/*
+ * Shows the buffer at the next vsync. Its release fence signals once the
+ * following buffer is on screen.
+ */
+static void present(void *user_data, struct ANativeWindow *window,
+                    struct ANativeWindowBuffer *buffer)
+{
+    int fence = HWCNativeBufferGetFence(buffer);
+    int frame = get_frame(buffer);
+
+    if (fence >= 0) {
+        sync_wait(fence, -1);
+        close(fence);
+    }
+
+    if (frame <= display.last_frame || (!mailbox_mode && frame != display.last_frame + 1)) {
+        printf("frame %d presented after frame %d\n", frame, display.last_frame);
+        display.errors++;
+    }
+    display.last_frame = frame;
+
+    if (display.next_vsync == 0)
+        display.next_vsync = fakegpu_now_ms();
+    fakegpu_sleep_ms(display.next_vsync - fakegpu_now_ms());
+    display.next_vsync += vsync_ms;
+
+    // The previous buffer is off screen now
+    sw_sync_timeline_inc(display.timeline, 1);
+    display.presents++;
+    HWCNativeBufferSetFence(buffer, sw_sync_fence_create(display.timeline,
+                            "test_hwcomposer_present", display.presents + 1));
+}
+
+static int run(const char *name, int interval)
+{
+    ANativeWindow *window;
+    double start = 0, elapsed;
+    unsigned presents_start = 0;
+    int i;
+
+    display.timeline = sw_sync_timeline_create();
+    if (display.timeline < 0 || fakegpu_start(gpu_ms) != 0) {
+        fprintf(stderr, "%s: can't create sw_sync timelines\n", name);
+        return 1;
+    }
+
+    window = HWCNativeWindowCreate(640, 480, HAL_PIXEL_FORMAT_RGBA_8888, present, NULL);
+    if (!window) {
+        fprintf(stderr, "%s: can't create the window\n", name);
+        return 1;
+    }
+    window->setSwapInterval(window, interval);
+
+    for (i = 0; i < WARMUP_FRAMES + NUM_FRAMES; i++) {
+        ANativeWindowBuffer *buffer;
+        int fence;
+
+        if (i == WARMUP_FRAMES) {
+            start = fakegpu_now_ms();
+            presents_start = display.presents;
+        }
+
+        if (window->dequeueBuffer(window, &buffer, &fence) != 0) {
+            fprintf(stderr, "%s: dequeueBuffer failed in frame %d\n", name, i);
+            return 1;
+        }
+        if (fence >= 0) {
+            sync_wait(fence, -1);
+            close(fence);
+        }
+        set_frame(buffer, i + 1);
+
+        fakegpu_cpu_work(cpu_ms);
+        window->queueBuffer(window, buffer, fakegpu_submit("test_hwcomposer_present"));
+    }
+    elapsed = fakegpu_now_ms() - start;
+
+    // Frames still queued when the window goes away are never shown
+    unsigned presents = display.presents - presents_start;
+    HWCNativeWindowDestroy(window);
+
+    printf("%-8s %8.2f ms/frame %6u presented %6d dropped\n", name,
+           elapsed / NUM_FRAMES, presents, NUM_FRAMES - (int) presents);
+
+    return display.errors ? 1 : 0;
+}
+
+/* Runs a mode in a child process, as the window reads the environment once */
+static int run_child(const char *name, const char *present_thread, int interval)
+{
+    pid_t pid = fork();
+    int status;
+
+    if (pid == 0) {
+        setenv("HYBRIS_HWC_PRESENT_THREAD", present_thread, 1);
+        mailbox_mode = interval == 0;
+        exit(run(name, interval));
+    }
+
+    if (pid < 0 || waitpid(pid, &status, 0) != pid)
+        return 1;
+    return WIFEXITED(status) ? WEXITSTATUS(status) : 1;
+}
+
+int main(int argc, char **argv)
+{
+    int errors = 0;
+
+    if (argc > 1)
+        cpu_ms = atof(argv[1]);
+    if (argc > 2)
+        gpu_ms = atof(argv[2]);
+    if (argc > 3)
+        vsync_ms = atof(argv[3]);
+
+    printf("%d frames, %.1f ms cpu, %.1f ms gpu, %.1f ms vsync\n",
+           NUM_FRAMES, cpu_ms, gpu_ms, vsync_ms);
+
+    errors += run_child("sync", "0", 1);
+    errors += run_child("thread", "1", 1);
+    errors += run_child("mailbox", "1", 0);
+
+    printf("%s\n", errors ? "FAILED" : "OK");
+
+    return errors ? 1 : 0;
+}
+
+// vim:ts=4:sw=4:noexpandtab
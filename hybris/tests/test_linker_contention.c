@@ -0,0 +1,300 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Measures how lookups in the Android linker hold up while another thread
+ * keeps loading and unloading a library, like worker threads calling
+ * dlsym() and throwing C++ exceptions (the unwinder walks the libraries with
+ * dl_iterate_phdr() for every frame) while the main thread dlopen()s plugins.
+ * The Q linker runs lookups concurrently, so they must not stall for the
+ * whole of a dlopen().
+ *
+ * The libraries are written by this program (see synthlib.h), so every
+ * looked up address can be checked. The lookups also have to work when a
+ * phdr callback calls back into the linker, which includes dlopen().
+ *
+ * Usage: test_linker_contention [threads] [milliseconds]
+ */
+
+#include <dlfcn.h>
+#include <limits.h>
+#include <link.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <hybris/common/binding.h>
+
+#include "synthlib.h"
+
+#define DEFAULT_THREADS     4
+#define DEFAULT_DURATION    1000
+#define MAX_THREADS         32
+#define NUM_SYMBOLS         20000
+
+/* Not in the public headers, libhybris-common exports it */
+extern int android_dl_iterate_phdr(int (*cb)(void *info, size_t size, void *data), void *data);
+
+static char dir[] = "/tmp/hybris-linker-contention-XXXXXX";
+static char resident_path[PATH_MAX];
+static char cycled_path[PATH_MAX];
+static void *resident;
+
+static int num_threads = DEFAULT_THREADS;
+static int duration = DEFAULT_DURATION;
+
+static volatile int running;
+static volatile int errors = 0;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* What the unwinder does: find the object with a PT_LOAD segment containing pc */
+struct find_pc {
+    ElfW(Addr) pc;
+    const char *name;
+    int objects;
+};
+
+static int find_pc_callback(void *raw_info, size_t size, void *data)
+{
+    struct dl_phdr_info *info = raw_info;
+    struct find_pc *find = data;
+    int i;
+
+    find->objects++;
+    for (i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr) *phdr = &info->dlpi_phdr[i];
+        ElfW(Addr) start = info->dlpi_addr + phdr->p_vaddr;
+
+        if (phdr->p_type == PT_LOAD && find->pc >= start && find->pc < start + phdr->p_memsz) {
+            find->name = info->dlpi_name;
+            return 1;
+        }
+    }
+
+    return 0;
+}
+
+/* Looks up a symbol of the resident library and checks the address everywhere */
+static int lookup(int i, double *max_latency)
+{
+    struct find_pc find = { 0, NULL, 0 };
+    char name[32];
+    ElfW(Addr) *word;
+    Dl_info info;
+    double start = now_ms(), latency;
+
+    snprintf(name, sizeof(name), "resident_sym%d", i);
+    word = android_dlsym(resident, name);
+    if (!word || *word != (ElfW(Addr)) word)
+        return -1;
+
+    if (!android_dladdr(word, &info) || !info.dli_sname || strcmp(info.dli_sname, name) != 0)
+        return -1;
+
+    find.pc = (ElfW(Addr)) word;
+    if (android_dl_iterate_phdr(find_pc_callback, &find) != 1 ||
+        !find.name || !strstr(find.name, "libresident.so"))
+        return -1;
+
+    latency = now_ms() - start;
+    if (latency > *max_latency)
+        *max_latency = latency;
+
+    return 0;
+}
+
+struct lookup_thread {
+    pthread_t thread;
+    long lookups;
+    double max_latency;
+};
+
+static void *lookup_thread(void *data)
+{
+    struct lookup_thread *self = data;
+    int i = 0;
+
+    self->lookups = 0;
+    self->max_latency = 0;
+
+    while (running) {
+        if (lookup(i, &self->max_latency) < 0) {
+            __sync_fetch_and_add(&errors, 1);
+            break;
+        }
+        i = (i + 7919) % NUM_SYMBOLS;
+        self->lookups++;
+    }
+
+    return NULL;
+}
+
+static void *load_thread(void *data)
+{
+    long *loads = data;
+
+    while (running) {
+        void *handle = android_dlopen(cycled_path, RTLD_NOW);
+
+        if (!handle || !android_dlsym(handle, "cycled_sym0")) {
+            printf("failed to load %s: %s\n", cycled_path, android_dlerror());
+            __sync_fetch_and_add(&errors, 1);
+            break;
+        }
+        android_dlclose(handle);
+        (*loads)++;
+    }
+
+    return NULL;
+}
+
+/* Runs the lookup threads for the duration, with or without a thread loading */
+static void run(int loading)
+{
+    struct lookup_thread threads[MAX_THREADS];
+    pthread_t loader;
+    double max_latency = 0;
+    long lookups = 0, loads = 0;
+    int i;
+
+    running = 1;
+    for (i = 0; i < num_threads; i++)
+        pthread_create(&threads[i].thread, NULL, lookup_thread, &threads[i]);
+    if (loading)
+        pthread_create(&loader, NULL, load_thread, &loads);
+
+    usleep(duration * 1000);
+    running = 0;
+
+    for (i = 0; i < num_threads; i++) {
+        pthread_join(threads[i].thread, NULL);
+        lookups += threads[i].lookups;
+        if (threads[i].max_latency > max_latency)
+            max_latency = threads[i].max_latency;
+    }
+    if (loading)
+        pthread_join(loader, NULL);
+
+    printf("%-13s %10.0f lookups/s, longest %.3f ms", loading ? "with dlopen:" : "lookups only:",
+           lookups / (duration / 1e3), max_latency);
+    if (loading)
+        printf(", %.0f loads/s", loads / (duration / 1e3));
+    printf("\n");
+}
+
+/* Calls back into the linker from a phdr callback, like a nested unwind does */
+static int reenter_callback(void *info, size_t size, void *data)
+{
+    int *result = data;
+    void *handle;
+
+    if (!android_dlsym(resident, "resident_sym1"))
+        return 1;
+
+    handle = android_dlopen(cycled_path, RTLD_NOW);
+    if (!handle)
+        return 1;
+    android_dlclose(handle);
+
+    *result = 0;
+    return 1;
+}
+
+static void cleanup(void)
+{
+    unlink(resident_path);
+    unlink(cycled_path);
+    rmdir(dir);
+}
+
+int main(int argc, char **argv)
+{
+    int reentered = -1;
+
+    if (argc > 1)
+        num_threads = atoi(argv[1]);
+    if (argc > 2)
+        duration = atoi(argv[2]);
+
+    if (num_threads < 1 || num_threads > MAX_THREADS || duration < 1) {
+        fprintf(stderr, "usage: %s [threads <= %d] [milliseconds]\n", argv[0], MAX_THREADS);
+        return 1;
+    }
+
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    snprintf(resident_path, sizeof(resident_path), "%s/libresident.so", dir);
+    snprintf(cycled_path, sizeof(cycled_path), "%s/libcycled.so", dir);
+    if (synthlib_write(resident_path, "libresident.so", "resident", NUM_SYMBOLS) < 0 ||
+        synthlib_write(cycled_path, "libcycled.so", "cycled", NUM_SYMBOLS) < 0) {
+        cleanup();
+        return 1;
+    }
+
+    resident = android_dlopen(resident_path, RTLD_NOW);
+    if (!resident) {
+        printf("failed to load %s: %s\n", resident_path, android_dlerror());
+        cleanup();
+        return 1;
+    }
+
+    // Errors are per thread, a failed lookup must report its own
+    if (android_dlsym(resident, "resident_missing") != NULL) {
+        printf("found a symbol which doesn't exist\n");
+        errors++;
+    } else {
+        const char *error = android_dlerror();
+
+        if (!error || !strstr(error, "resident_missing")) {
+            printf("unexpected dlerror: %s\n", error ? error : "(null)");
+            errors++;
+        }
+    }
+
+    android_dl_iterate_phdr(reenter_callback, &reentered);
+    if (reentered != 0) {
+        printf("calling the linker from a phdr callback failed\n");
+        errors++;
+    }
+
+    printf("%d threads looking up, dlopen() of a library with %d relocations\n",
+           num_threads, NUM_SYMBOLS);
+    run(0);
+    run(1);
+
+    android_dlclose(resident);
+    cleanup();
+
+    printf("%s\n", errors ? "FAILED" : "OK");
+
+    return errors ? 1 : 0;
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,195 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Measures how fast the Android linker resolves the imports of a library
+ * which depends on a large group of libraries, with all imports defined in
+ * the last quarter of the group. Every lookup goes through the bloom
+ * filters of most of the group before it finds its symbol, like a vendor
+ * library importing from the libraries at the end of a long DT_NEEDED list.
+ *
+ * The dependencies stay loaded, so every load of the importing library
+ * only relocates it. Every import has to point to its symbol.
+ *
+ * Usage: test_linker_group_lookup [libraries] [loads]
+ */
+
+#include <dlfcn.h>
+#include <limits.h>
+#include <link.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <hybris/common/binding.h>
+
+#include "synthlib.h"
+
+#define DEFAULT_LIBS        100
+#define DEFAULT_LOADS       200
+#define NUM_SYMBOLS         64
+#define NUM_IMPORTS         2000
+
+static char dir[] = "/tmp/hybris-linker-group-lookup-XXXXXX";
+static char user_path[PATH_MAX];
+static int num_libs = DEFAULT_LIBS;
+static int num_loads = DEFAULT_LOADS;
+static void **handles;
+static char **sonames;
+static char **imports;
+static int *import_libs;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void lib_path(char *buf, size_t size, int lib)
+{
+    snprintf(buf, size, "%s/libgroup%03d.so", dir, lib);
+}
+
+/* Returns the number of imports of the loaded library which don't point to their symbol */
+static int check_imports(void *user)
+{
+    char name[32];
+    int i, wrong = 0;
+
+    for (i = 0; i < NUM_IMPORTS; i++) {
+        ElfW(Addr) *word, *symbol;
+
+        snprintf(name, sizeof(name), "user_import%d", i);
+        word = android_dlsym(user, name);
+        symbol = android_dlsym(handles[import_libs[i]], imports[i]);
+        if (!word || !symbol || *word != (ElfW(Addr)) symbol) {
+            printf("%s doesn't point to %s\n", name, imports[i]);
+            wrong++;
+        }
+    }
+
+    return wrong;
+}
+
+static void cleanup(void)
+{
+    char path[PATH_MAX];
+    int i;
+
+    for (i = 0; i < num_libs; i++) {
+        lib_path(path, sizeof(path), i);
+        unlink(path);
+    }
+    unlink(user_path);
+    rmdir(dir);
+}
+
+int main(int argc, char **argv)
+{
+    char path[PATH_MAX], prefix[32];
+    double start, elapsed;
+    int i, errors = 0;
+    int quarter;
+
+    if (argc > 1)
+        num_libs = atoi(argv[1]);
+    if (argc > 2)
+        num_loads = atoi(argv[2]);
+
+    if (num_libs < 4 || num_libs > 1000 || num_loads < 1) {
+        fprintf(stderr, "usage: %s [4 <= libraries <= 1000] [loads]\n", argv[0]);
+        return 1;
+    }
+
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    handles = calloc(num_libs, sizeof(*handles));
+    sonames = calloc(num_libs, sizeof(*sonames));
+    imports = calloc(NUM_IMPORTS, sizeof(*imports));
+    import_libs = calloc(NUM_IMPORTS, sizeof(*import_libs));
+    if (!handles || !sonames || !imports || !import_libs)
+        return 1;
+
+    for (i = 0; i < num_libs; i++) {
+        sonames[i] = malloc(32);
+        snprintf(sonames[i], 32, "libgroup%03d.so", i);
+        snprintf(prefix, sizeof(prefix), "group%03d", i);
+        lib_path(path, sizeof(path), i);
+        if (synthlib_write(path, sonames[i], prefix, NUM_SYMBOLS) < 0) {
+            cleanup();
+            return 1;
+        }
+
+        handles[i] = android_dlopen(path, RTLD_NOW);
+        if (!handles[i]) {
+            printf("failed to load %s: %s\n", path, android_dlerror());
+            cleanup();
+            return 1;
+        }
+    }
+
+    quarter = num_libs / 4;
+    for (i = 0; i < NUM_IMPORTS; i++) {
+        import_libs[i] = num_libs - 1 - i % quarter;
+        imports[i] = malloc(32);
+        snprintf(imports[i], 32, "group%03d_sym%d", import_libs[i], i / quarter % NUM_SYMBOLS);
+    }
+
+    snprintf(user_path, sizeof(user_path), "%s/libgroupuser.so", dir);
+    if (synthlib_write_importer(user_path, "libgroupuser.so", "user", 0,
+                                (const char *const *) sonames, num_libs,
+                                (const char *const *) imports, NUM_IMPORTS) < 0) {
+        cleanup();
+        return 1;
+    }
+
+    start = now_ms();
+    for (i = 0; i < num_loads; i++) {
+        void *user = android_dlopen(user_path, RTLD_NOW);
+
+        if (!user) {
+            printf("failed to load %s: %s\n", user_path, android_dlerror());
+            errors++;
+            break;
+        }
+        if (i == 0 && check_imports(user) != 0)
+            errors++;
+        android_dlclose(user);
+    }
+    elapsed = now_ms() - start;
+
+    printf("%d libraries, %d imports from the last %d: %.3f ms per load, %.0f ns per import\n",
+           num_libs, NUM_IMPORTS, quarter, elapsed / num_loads,
+           elapsed * 1e6 / num_loads / NUM_IMPORTS);
+
+    for (i = 0; i < num_libs; i++)
+        android_dlclose(handles[i]);
+    cleanup();
+
+    printf("%s\n", errors ? "FAILED" : "OK");
+
+    return errors ? 1 : 0;
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Measures how many addresses per second the Android linker maps to their
+ * library with hundreds of libraries loaded, as dladdr() and, on ARM, the
+ * unwinder's dl_unwind_find_exidx() do for every frame of a backtrace.
+ *
+ * The addresses are spread over all libraries first, then come in runs
+ * within the same library like the frames of a backtrace do. Every lookup
+ * has to find the right symbol, none may find a library which was unloaded
+ * and libraries loaded again have to be found at their new addresses.
+ *
+ * Usage: test_linker_lookup [libraries] [lookups]
+ */
+
+#include <dlfcn.h>
+#include <limits.h>
+#include <link.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <hybris/common/binding.h>
+
+#include "synthlib.h"
+
+#define DEFAULT_LIBS        300
+#define DEFAULT_LOOKUPS     1000000
+#define NUM_SYMBOLS         16
+#define RUN_LENGTH          8
+
+#if defined(__arm__)
+/* Not in the public headers, libhybris-common exports it */
+extern void *android_dl_unwind_find_exidx(void *pc, int *pcount);
+#endif
+
+static char dir[] = "/tmp/hybris-linker-lookup-XXXXXX";
+static int num_libs = DEFAULT_LIBS;
+static int num_lookups = DEFAULT_LOOKUPS;
+static void **handles;
+static ElfW(Addr) **words;
+static int errors = 0;
+
+static unsigned rand_state = 1;
+
+static unsigned next_rand(void)
+{
+    rand_state = rand_state * 1103515245 + 12345;
+    return rand_state >> 8;
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void lib_path(char *buf, size_t size, int lib)
+{
+    snprintf(buf, size, "%s/liblookup%03d.so", dir, lib);
+}
+
+static int load_library(int lib)
+{
+    char path[PATH_MAX], name[32];
+    int i;
+
+    lib_path(path, sizeof(path), lib);
+    handles[lib] = android_dlopen(path, RTLD_NOW);
+    if (!handles[lib]) {
+        printf("failed to load %s: %s\n", path, android_dlerror());
+        return -1;
+    }
+
+    for (i = 0; i < NUM_SYMBOLS; i++) {
+        snprintf(name, sizeof(name), "lookup%03d_sym%d", lib, i);
+        words[lib * NUM_SYMBOLS + i] = android_dlsym(handles[lib], name);
+        if (!words[lib * NUM_SYMBOLS + i]) {
+            printf("%s not found\n", name);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/* Returns 0 if dladdr() finds the address of symbol sym of library lib to be that symbol */
+static int check_address(int lib, int sym)
+{
+    ElfW(Addr) *word = words[lib * NUM_SYMBOLS + sym];
+    char name[32];
+    Dl_info info;
+
+    snprintf(name, sizeof(name), "lookup%03d_sym%d", lib, sym);
+    if (!android_dladdr(word, &info) || !info.dli_sname || strcmp(info.dli_sname, name) != 0 ||
+        info.dli_saddr != (void *) word)
+        return -1;
+
+    return 0;
+}
+
+/* Looks up num_lookups addresses in runs of run_length within one library */
+static double run(int run_length)
+{
+    double start = now_ms();
+    int i, lib = 0;
+
+    for (i = 0; i < num_lookups; i++) {
+        if (i % run_length == 0)
+            lib = next_rand() % num_libs;
+        if (check_address(lib, next_rand() % NUM_SYMBOLS) < 0) {
+            errors++;
+            break;
+        }
+    }
+
+    return num_lookups / ((now_ms() - start) / 1e3);
+}
+
+#if defined(__arm__)
+static double run_exidx(void)
+{
+    double start = now_ms();
+    int i, count;
+
+    for (i = 0; i < num_lookups; i++) {
+        int lib = i / RUN_LENGTH % num_libs;
+        android_dl_unwind_find_exidx(words[lib * NUM_SYMBOLS + i % NUM_SYMBOLS], &count);
+    }
+
+    return num_lookups / ((now_ms() - start) / 1e3);
+}
+#endif
+
+static void cleanup(void)
+{
+    char path[PATH_MAX];
+    int i;
+
+    for (i = 0; i < num_libs; i++) {
+        lib_path(path, sizeof(path), i);
+        unlink(path);
+    }
+    rmdir(dir);
+}
+
+int main(int argc, char **argv)
+{
+    ElfW(Addr) *unloaded;
+    char path[PATH_MAX], soname[32], prefix[32];
+    Dl_info info;
+    int i;
+
+    if (argc > 1)
+        num_libs = atoi(argv[1]);
+    if (argc > 2)
+        num_lookups = atoi(argv[2]);
+
+    if (num_libs < 2 || num_libs > 1000 || num_lookups < 1) {
+        fprintf(stderr, "usage: %s [libraries <= 1000] [lookups]\n", argv[0]);
+        return 1;
+    }
+
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    handles = calloc(num_libs, sizeof(*handles));
+    words = calloc(num_libs * NUM_SYMBOLS, sizeof(*words));
+    if (!handles || !words)
+        return 1;
+
+    for (i = 0; i < num_libs; i++) {
+        lib_path(path, sizeof(path), i);
+        snprintf(soname, sizeof(soname), "liblookup%03d.so", i);
+        snprintf(prefix, sizeof(prefix), "lookup%03d", i);
+        if (synthlib_write(path, soname, prefix, NUM_SYMBOLS) < 0 || load_library(i) < 0) {
+            cleanup();
+            return 1;
+        }
+    }
+
+    printf("%d libraries loaded, %d lookups\n", num_libs, num_lookups);
+    printf("dladdr, spread:     %10.0f lookups/s\n", run(1));
+    printf("dladdr, backtraces: %10.0f lookups/s\n", run(RUN_LENGTH));
+#if defined(__arm__)
+    printf("exidx, backtraces:  %10.0f lookups/s\n", run_exidx());
+#endif
+
+    // The library is gone, its addresses must not be found anymore
+    unloaded = words[NUM_SYMBOLS];
+    if (check_address(1, 0) < 0 || android_dlclose(handles[1]) != 0) {
+        printf("unloading failed\n");
+        errors++;
+    } else if (android_dladdr(unloaded, &info)) {
+        printf("unloaded library %s found at %p\n", info.dli_fname, (void *) unloaded);
+        errors++;
+    }
+
+    // And found wherever it is loaded next
+    if (load_library(1) < 0 || check_address(1, 0) < 0 || check_address(0, 0) < 0 ||
+        check_address(num_libs - 1, NUM_SYMBOLS - 1) < 0) {
+        printf("lookups after loading again failed\n");
+        errors++;
+    }
+
+    for (i = 0; i < num_libs; i++)
+        android_dlclose(handles[i]);
+    cleanup();
+
+    printf("%s\n", errors ? "FAILED" : "OK");
+
+    return errors ? 1 : 0;
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,352 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Compares the time android_dlopen() takes to load a synthetic, deep graph
+ * of shared libraries with serial loading and with HYBRIS_LD_PARALLEL,
+ * which is supported by the Q linker.
+ *
+ * The libraries are written with synthlib, so that no toolchain for the
+ * Android side is needed. Besides the words relocated to point to
+ * themselves, every library but the last level exports words relocated
+ * against symbols of its DT_NEEDED libraries. Every load runs in a fresh
+ * process and the result of all relocations is checked afterwards.
+ *
+ * Usage: test_linker_parallel [threads] [depth] [width] [relocations]
+ */
+
+#include <dlfcn.h>
+#include <limits.h>
+#include <link.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <hybris/common/binding.h>
+
+#include "synthlib.h"
+
+#define DEFAULT_THREADS     4
+#define DEFAULT_DEPTH       12
+#define DEFAULT_WIDTH       8
+#define DEFAULT_RELOCATIONS 4000
+#define NUM_DEPS            3
+#define NUM_SYMBOLS         1000
+#define NUM_RUNS            5
+
+static int depth = DEFAULT_DEPTH;
+static int width = DEFAULT_WIDTH;
+static int relocations = DEFAULT_RELOCATIONS;
+static int num_libs;
+static int **deps;
+static int *num_deps;
+static char dir[] = "/tmp/hybris-linker-parallel-XXXXXX";
+
+static unsigned rand_state = 1;
+
+static unsigned next_rand(void)
+{
+    rand_state = rand_state * 1103515245 + 12345;
+    return rand_state >> 8;
+}
+
+static void lib_name(char *buf, size_t size, int lib)
+{
+    snprintf(buf, size, "libsynth%03d.so", lib);
+}
+
+/* Libraries with dependencies import this many symbols of them */
+static int num_imports(int lib)
+{
+    return num_deps[lib] ? relocations : 0;
+}
+
+static void import_name(int lib, int index, char *buf, size_t size)
+{
+    int n = num_deps[lib];
+
+    snprintf(buf, size, "synth%03d_sym%d", deps[lib][index % n],
+             (lib * 7 + index / n) % NUM_SYMBOLS);
+}
+
+static int write_library(int lib)
+{
+    int ndeps = num_deps[lib];
+    int nimports = num_imports(lib);
+    char **needed, **imports;
+    char path[PATH_MAX], soname[32], prefix[32];
+    int i, ret = -1;
+
+    needed = calloc(ndeps, sizeof(char *));
+    imports = calloc(nimports, sizeof(char *));
+    if ((ndeps && !needed) || (nimports && !imports))
+        goto out;
+
+    for (i = 0; i < ndeps; i++) {
+        needed[i] = malloc(32);
+        if (!needed[i])
+            goto out;
+        lib_name(needed[i], 32, deps[lib][i]);
+    }
+    for (i = 0; i < nimports; i++) {
+        imports[i] = malloc(32);
+        if (!imports[i])
+            goto out;
+        import_name(lib, i, imports[i], 32);
+    }
+
+    lib_name(soname, sizeof(soname), lib);
+    snprintf(path, sizeof(path), "%s/%s", dir, soname);
+    snprintf(prefix, sizeof(prefix), "synth%03d", lib);
+    ret = synthlib_write_importer(path, soname, prefix, NUM_SYMBOLS,
+                                  (const char *const *) needed, ndeps,
+                                  (const char *const *) imports, nimports);
+
+out:
+    for (i = 0; needed && i < ndeps; i++)
+        free(needed[i]);
+    for (i = 0; imports && i < nimports; i++)
+        free(imports[i]);
+    free(needed);
+    free(imports);
+    return ret;
+}
+
+/*
+ * Library 0 is the root, it needs all libraries of the first level. Every
+ * library of a level needs NUM_DEPS distinct libraries of the next one, the
+ * last level has no dependencies.
+ */
+static int generate_graph(void)
+{
+    int level, i, j;
+
+    num_libs = 1 + depth * width;
+    deps = calloc(num_libs, sizeof(*deps));
+    num_deps = calloc(num_libs, sizeof(*num_deps));
+    if (!deps || !num_deps)
+        return -1;
+
+    deps[0] = calloc(width, sizeof(int));
+    if (!deps[0])
+        return -1;
+    num_deps[0] = width;
+    for (i = 0; i < width; i++)
+        deps[0][i] = 1 + i;
+
+    for (level = 0; level < depth - 1; level++) {
+        for (i = 0; i < width; i++) {
+            int lib = 1 + level * width + i;
+            int next = 1 + (level + 1) * width;
+            int first = next_rand() % width;
+
+            deps[lib] = calloc(NUM_DEPS, sizeof(int));
+            if (!deps[lib])
+                return -1;
+            num_deps[lib] = NUM_DEPS;
+
+            /* every library of the next level is needed by someone */
+            deps[lib][0] = next + i;
+            for (j = 1; j < NUM_DEPS; j++)
+                deps[lib][j] = next + (i + first % (width - NUM_DEPS + 1) + j) % width;
+        }
+    }
+
+    for (i = 0; i < num_libs; i++) {
+        if (write_library(i) < 0)
+            return -1;
+    }
+
+    return 0;
+}
+
+static int check_library(void *handle, int lib)
+{
+    char name[32];
+    ElfW(Addr) *words;
+    int nimports = num_imports(lib);
+    int i, errors = 0;
+
+    snprintf(name, sizeof(name), "synth%03d_sym0", lib);
+    words = android_dlsym(handle, name);
+    if (!words) {
+        printf("%s: symbol not found\n", name);
+        return 1;
+    }
+
+    for (i = 0; i < NUM_SYMBOLS; i++) {
+        if (words[i] != (ElfW(Addr)) &words[i])
+            errors++;
+    }
+
+    for (i = 0; i < nimports; i += 97) {
+        ElfW(Addr) *import;
+
+        snprintf(name, sizeof(name), "synth%03d_import%d", lib, i);
+        import = android_dlsym(handle, name);
+        import_name(lib, i, name, sizeof(name));
+        if (!import || *import != (ElfW(Addr)) android_dlsym(handle, name))
+            errors++;
+    }
+
+    if (errors)
+        printf("libsynth%03d.so: %d wrong relocations\n", lib, errors);
+
+    return errors;
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* Loads the graph in a child process, returns the time or -1 on errors */
+static double load_graph(int threads)
+{
+    double result = -1;
+    int pipefd[2];
+    pid_t pid;
+
+    if (pipe(pipefd) < 0)
+        return -1;
+
+    pid = fork();
+    if (pid == 0) {
+        char path[PATH_MAX], value[16];
+        double start, elapsed;
+        void *handle;
+        int errors = 0, i;
+
+        close(pipefd[0]);
+        snprintf(value, sizeof(value), "%d", threads);
+        setenv("HYBRIS_LD_PARALLEL", value, 1);
+        setenv("HYBRIS_LD_LIBRARY_PATH", dir, 1);
+
+        /* initialize the linker outside of the measurement */
+        android_dlerror();
+
+        snprintf(path, sizeof(path), "%s/libsynth000.so", dir);
+        start = now_ms();
+        handle = android_dlopen(path, RTLD_NOW);
+        elapsed = now_ms() - start;
+
+        if (!handle) {
+            printf("failed to load %s: %s\n", path, android_dlerror());
+            _exit(1);
+        }
+
+        for (i = 0; i < num_libs; i++)
+            errors += check_library(handle, i);
+
+        if (errors)
+            elapsed = -1;
+        if (write(pipefd[1], &elapsed, sizeof(elapsed)) != sizeof(elapsed))
+            _exit(1);
+        _exit(0);
+    }
+
+    close(pipefd[1]);
+    if (pid < 0 || read(pipefd[0], &result, sizeof(result)) != sizeof(result))
+        result = -1;
+    close(pipefd[0]);
+    if (pid > 0)
+        waitpid(pid, NULL, 0);
+
+    return result;
+}
+
+static void cleanup(void)
+{
+    char path[PATH_MAX];
+    int i;
+
+    for (i = 0; i < num_libs; i++) {
+        snprintf(path, sizeof(path), "%s/libsynth%03d.so", dir, i);
+        unlink(path);
+    }
+    rmdir(dir);
+}
+
+int main(int argc, char **argv)
+{
+    int threads = DEFAULT_THREADS;
+    double serial = 0, parallel = 0;
+    int run, errors = 0;
+
+    if (argc > 1)
+        threads = atoi(argv[1]);
+    if (argc > 2)
+        depth = atoi(argv[2]);
+    if (argc > 3)
+        width = atoi(argv[3]);
+    if (argc > 4)
+        relocations = atoi(argv[4]);
+
+    if (threads < 2 || depth < 1 || width < NUM_DEPS || relocations < 1) {
+        fprintf(stderr, "usage: %s [threads] [depth] [width >= %d] [relocations]\n",
+                argv[0], NUM_DEPS);
+        return 1;
+    }
+
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    if (generate_graph() < 0) {
+        cleanup();
+        return 1;
+    }
+
+    printf("%d libraries, %d levels of %d, %d symbols and %d imports each\n",
+           num_libs, depth, width, NUM_SYMBOLS, relocations);
+
+    /* the runs alternate, so that both see the same page cache state */
+    for (run = 0; run < NUM_RUNS; run++) {
+        double s = load_graph(0);
+        double p = load_graph(threads);
+
+        if (s < 0 || p < 0) {
+            errors++;
+            break;
+        }
+
+        printf("run %d: serial %.2f ms, %d threads %.2f ms\n", run, s, threads, p);
+        if (run == 0 || s < serial)
+            serial = s;
+        if (run == 0 || p < parallel)
+            parallel = p;
+    }
+
+    if (!errors) {
+        printf("best: serial %.2f ms, %d threads %.2f ms, speedup %.2fx\n",
+               serial, threads, parallel, serial / parallel);
+    }
+
+    cleanup();
+
+    printf("%s\n", errors ? "FAILED" : "OK");
+
+    return errors ? 1 : 0;
+}
+
+// vim:ts=4:sw=4:noexpandtab
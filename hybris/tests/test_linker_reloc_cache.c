@@ -0,0 +1,337 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Measures the startup of processes loading a library with a large group of
+ * dependencies with the relocation cache of the Android linker
+ * (HYBRIS_LD_RELOC_CACHE): cold, when the first process writes the cache,
+ * and warm, when the next ones bind the imports from it. Each process is a
+ * child of this one which hasn't touched the linker yet.
+ *
+ * Every process checks that each import points to its symbol, also after
+ * one of the dependencies changed, which has to invalidate the cache. The
+ * records must only be accessible by their owner, and a cache directory
+ * others can write to must not be used.
+ *
+ * Usage: test_linker_reloc_cache [libraries] [processes]
+ */
+
+#include <dirent.h>
+#include <dlfcn.h>
+#include <limits.h>
+#include <link.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <hybris/common/binding.h>
+
+#include "synthlib.h"
+
+#define DEFAULT_LIBS        100
+#define DEFAULT_PROCESSES   5
+#define NUM_SYMBOLS         64
+#define NUM_IMPORTS         2000
+
+static char dir[] = "/tmp/hybris-linker-reloc-cache-XXXXXX";
+static char cache_dir[PATH_MAX];
+static char user_path[PATH_MAX];
+static int num_libs = DEFAULT_LIBS;
+static int num_processes = DEFAULT_PROCESSES;
+static char **imports;
+static int *import_libs;
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void lib_path(char *buf, size_t size, int lib)
+{
+    snprintf(buf, size, "%s/libgroup%03d.so", dir, lib);
+}
+
+static int write_dependency(int lib, int num_symbols)
+{
+    char path[PATH_MAX], soname[32], prefix[32];
+
+    lib_path(path, sizeof(path), lib);
+    snprintf(soname, sizeof(soname), "libgroup%03d.so", lib);
+    snprintf(prefix, sizeof(prefix), "group%03d", lib);
+    return synthlib_write(path, soname, prefix, num_symbols);
+}
+
+/* In the child: loads the library, checks its imports and exits with the number of errors */
+static void load(int use_cache, int fd)
+{
+    char path[PATH_MAX], name[32];
+    double start, elapsed;
+    void *user;
+    int i, errors = 0;
+
+    setenv("HYBRIS_LD_LIBRARY_PATH", dir, 1);
+    if (use_cache)
+        setenv("HYBRIS_LD_RELOC_CACHE", cache_dir, 1);
+    else
+        unsetenv("HYBRIS_LD_RELOC_CACHE");
+
+    start = now_ms();
+    user = android_dlopen(user_path, RTLD_NOW);
+    elapsed = now_ms() - start;
+    if (!user) {
+        printf("failed to load %s: %s\n", user_path, android_dlerror());
+        fflush(stdout);
+        _exit(1);
+    }
+
+    for (i = 0; i < NUM_IMPORTS; i++) {
+        ElfW(Addr) *word, *symbol;
+        void *lib;
+
+        lib_path(path, sizeof(path), import_libs[i]);
+        lib = android_dlopen(path, RTLD_NOW);
+        snprintf(name, sizeof(name), "user_import%d", i);
+        word = android_dlsym(user, name);
+        symbol = lib ? android_dlsym(lib, imports[i]) : NULL;
+        if (!word || !symbol || *word != (ElfW(Addr)) symbol) {
+            printf("%s doesn't point to %s\n", name, imports[i]);
+            errors++;
+            break;
+        }
+        android_dlclose(lib);
+    }
+
+    if (write(fd, &elapsed, sizeof(elapsed)) != sizeof(elapsed))
+        errors++;
+    fflush(stdout);
+    _exit(errors);
+}
+
+/* Returns how long loading took in a new process, or -1 if it failed */
+static double run(int use_cache)
+{
+    double elapsed = -1;
+    int fds[2], status;
+    pid_t pid;
+
+    if (pipe(fds) < 0)
+        return -1;
+
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        load(use_cache, fds[1]);
+    }
+    close(fds[1]);
+
+    if (pid < 0 || read(fds[0], &elapsed, sizeof(elapsed)) != sizeof(elapsed))
+        elapsed = -1;
+    close(fds[0]);
+
+    if (pid > 0 && (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) ||
+                    WEXITSTATUS(status) != 0))
+        elapsed = -1;
+
+    return elapsed;
+}
+
+/*
+ * Reads the single record of the cache into buf, returns its size or -1,
+ * also if others could access it
+ */
+static ssize_t read_record(char *buf, size_t size)
+{
+    char path[PATH_MAX];
+    struct dirent *entry;
+    struct stat st;
+    ssize_t length = -1;
+    int records = 0;
+    DIR *d = opendir(cache_dir);
+    FILE *f;
+
+    if (!d)
+        return -1;
+
+    while ((entry = readdir(d)) != NULL) {
+        if (!strstr(entry->d_name, ".reloc"))
+            continue;
+        records++;
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, entry->d_name);
+        if (stat(path, &st) < 0 || (st.st_mode & 077) != 0) {
+            printf("%s has mode %o\n", path, (unsigned) st.st_mode & 0777);
+            continue;
+        }
+        f = fopen(path, "r");
+        if (f) {
+            length = fread(buf, 1, size, f);
+            fclose(f);
+        }
+    }
+    closedir(d);
+
+    return records == 1 ? length : -1;
+}
+
+static void cleanup_records(void)
+{
+    char path[PATH_MAX];
+    struct dirent *entry;
+    DIR *d = opendir(cache_dir);
+
+    if (!d)
+        return;
+
+    while ((entry = readdir(d)) != NULL) {
+        snprintf(path, sizeof(path), "%s/%s", cache_dir, entry->d_name);
+        unlink(path);
+    }
+    closedir(d);
+}
+
+static void cleanup(void)
+{
+    char path[PATH_MAX];
+    int i;
+
+    for (i = 0; i < num_libs; i++) {
+        lib_path(path, sizeof(path), i);
+        unlink(path);
+    }
+    unlink(user_path);
+
+    cleanup_records();
+    rmdir(cache_dir);
+    rmdir(dir);
+}
+
+int main(int argc, char **argv)
+{
+    static char record[1 << 16], changed_record[1 << 16];
+    double cold, warm = 0, uncached, elapsed;
+    ssize_t record_size, changed_size;
+    char **sonames;
+    int i, quarter, errors = 0;
+
+    if (argc > 1)
+        num_libs = atoi(argv[1]);
+    if (argc > 2)
+        num_processes = atoi(argv[2]);
+
+    if (num_libs < 4 || num_libs > 1000 || num_processes < 1) {
+        fprintf(stderr, "usage: %s [4 <= libraries <= 1000] [processes]\n", argv[0]);
+        return 1;
+    }
+
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    snprintf(cache_dir, sizeof(cache_dir), "%s/cache", dir);
+    snprintf(user_path, sizeof(user_path), "%s/libgroupuser.so", dir);
+    if (mkdir(cache_dir, 0700) < 0) {
+        perror("mkdir");
+        cleanup();
+        return 1;
+    }
+
+    sonames = calloc(num_libs, sizeof(*sonames));
+    imports = calloc(NUM_IMPORTS, sizeof(*imports));
+    import_libs = calloc(NUM_IMPORTS, sizeof(*import_libs));
+    if (!sonames || !imports || !import_libs)
+        return 1;
+
+    for (i = 0; i < num_libs; i++) {
+        sonames[i] = malloc(32);
+        snprintf(sonames[i], 32, "libgroup%03d.so", i);
+        if (write_dependency(i, NUM_SYMBOLS) < 0) {
+            cleanup();
+            return 1;
+        }
+    }
+
+    // Imported from the end of the group, like in test_linker_group_lookup
+    quarter = num_libs / 4;
+    for (i = 0; i < NUM_IMPORTS; i++) {
+        import_libs[i] = num_libs - 1 - i % quarter;
+        imports[i] = malloc(32);
+        snprintf(imports[i], 32, "group%03d_sym%d", import_libs[i], i / quarter % NUM_SYMBOLS);
+    }
+
+    if (synthlib_write_importer(user_path, "libgroupuser.so", "user", 0,
+                                (const char *const *) sonames, num_libs,
+                                (const char *const *) imports, NUM_IMPORTS) < 0) {
+        cleanup();
+        return 1;
+    }
+
+    uncached = run(0);
+    cold = run(1);
+    record_size = read_record(record, sizeof(record));
+    if (uncached < 0 || cold < 0 || record_size <= 0) {
+        printf("loading without the cache or writing it failed\n");
+        errors++;
+    }
+
+    for (i = 0; i < num_processes; i++) {
+        elapsed = run(1);
+        if (elapsed < 0) {
+            printf("loading with the cache failed\n");
+            errors++;
+            break;
+        }
+        warm += elapsed / num_processes;
+    }
+
+    printf("%d libraries, %d imports: %.3f ms without the cache, %.3f ms cold, %.3f ms warm\n",
+           num_libs, NUM_IMPORTS, uncached, cold, warm);
+
+    // More symbols in a dependency move the imported ones, the record must not be used
+    if (write_dependency(import_libs[0], 2 * NUM_SYMBOLS) < 0 || run(1) < 0) {
+        printf("loading after a dependency changed failed\n");
+        errors++;
+    }
+
+    changed_size = read_record(changed_record, sizeof(changed_record));
+    if (changed_size <= 0 ||
+        (changed_size == record_size && memcmp(record, changed_record, record_size) == 0)) {
+        printf("the cache wasn't written again after a dependency changed\n");
+        errors++;
+    }
+
+    // Others could plant records in there
+    cleanup_records();
+    if (chmod(cache_dir, 0770) < 0 || run(1) < 0 || read_record(record, sizeof(record)) != -1) {
+        printf("a group writable cache directory was used\n");
+        errors++;
+    }
+
+    cleanup();
+
+    printf("%s\n", errors ? "FAILED" : "OK");
+
+    return errors ? 1 : 0;
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,301 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Runs a stand-in for the (patched) Android init property service and
+ * measures a storm of property gets against it, one by one and batched.
+ * With --legacy the service behaves like one without support for pipelined
+ * requests, closing the connection after every reply, with --silent it
+ * ignores pipelined requests without closing the connection.
+ */
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#include <hybris/properties/properties.h>
+
+#define NUM_KEYS    2000
+#define NUM_THREADS 4
+
+typedef struct prop_msg_s {
+        unsigned cmd;
+        char name[PROP_NAME_MAX];
+        char value[PROP_VALUE_MAX];
+} prop_msg_t;
+
+extern int my_property_get(const char *key, char *value, const char *default_value);
+extern int my_property_get_batch(const char * const *keys, char * const *values,
+                                 const char * const *default_values, int count);
+
+enum {
+    PIPELINED,
+    LEGACY,
+    SILENT
+};
+
+static int service_mode = PIPELINED;
+static int connections = 0;
+static int requests = 0;
+
+static void *serve_connection(void *arg)
+{
+    int s = (int)(intptr_t) arg;
+    prop_msg_t msg;
+
+    while (recv(s, &msg, sizeof(msg), MSG_WAITALL) == sizeof(msg)) {
+        __sync_fetch_and_add(&requests, 1);
+
+        if (msg.cmd == PROP_MSG_GETPROP_PIPELINED && service_mode == LEGACY)
+            break;
+        if (msg.cmd == PROP_MSG_GETPROP_PIPELINED && service_mode == SILENT) {
+            /* until the client gives up */
+            while (recv(s, &msg, sizeof(msg), 0) > 0)
+                ;
+            break;
+        }
+
+        msg.name[PROP_NAME_MAX - 1] = '\0';
+        /* every property except the unset.* ones has a value */
+        if (strncmp(msg.name, "unset.", 6) != 0)
+            snprintf(msg.value, sizeof(msg.value), "value-of-%s", msg.name);
+        else
+            msg.value[0] = '\0';
+
+        send(s, &msg, sizeof(msg), MSG_NOSIGNAL);
+
+        if (msg.cmd != PROP_MSG_GETPROP_PIPELINED)
+            break;
+    }
+
+    close(s);
+    return NULL;
+}
+
+static void *property_service(void *arg)
+{
+    int server = (int)(intptr_t) arg;
+
+    for (;;) {
+        pthread_t thread;
+        int s = accept(server, NULL, NULL);
+
+        if (s < 0)
+            continue;
+
+        __sync_fetch_and_add(&connections, 1);
+        pthread_create(&thread, NULL, serve_connection, (void *)(intptr_t) s);
+        pthread_detach(thread);
+    }
+
+    return NULL;
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static int check_value(const char *key, const char *value)
+{
+    char expected[PROP_VALUE_MAX];
+
+    snprintf(expected, sizeof(expected), "value-of-%s", key);
+    if (strcmp(value, expected) != 0) {
+        printf("wrong value for %s: '%s'\n", key, value);
+        return 1;
+    }
+
+    return 0;
+}
+
+/* Gets its share of the keys in a batch, returns the number of wrong values */
+static void *batch_thread(void *arg)
+{
+    static char keys[NUM_THREADS][NUM_KEYS / NUM_THREADS][PROP_NAME_MAX];
+    static char values[NUM_THREADS][NUM_KEYS / NUM_THREADS][PROP_VALUE_MAX];
+    const char *key_ptrs[NUM_KEYS / NUM_THREADS];
+    char *value_ptrs[NUM_KEYS / NUM_THREADS];
+    int t = (int)(intptr_t) arg;
+    intptr_t errors = 0;
+    int i;
+
+    for (i = 0; i < NUM_KEYS / NUM_THREADS; i++) {
+        snprintf(keys[t][i], sizeof(keys[t][i]), "test.thread%d.%d", t, i);
+        key_ptrs[i] = keys[t][i];
+        value_ptrs[i] = values[t][i];
+    }
+
+    my_property_get_batch(key_ptrs, value_ptrs, NULL, NUM_KEYS / NUM_THREADS);
+
+    for (i = 0; i < NUM_KEYS / NUM_THREADS; i++)
+        errors += check_value(keys[t][i], values[t][i]);
+
+    return (void *) errors;
+}
+
+static void report(const char *what, double start)
+{
+    double ms = now_ms() - start;
+
+    printf("%-8s %d gets in %.2f ms (%.2f us/get), %d connections, %d requests\n",
+           what, NUM_KEYS, ms, ms * 1000 / NUM_KEYS, connections, requests);
+    connections = 0;
+    requests = 0;
+}
+
+int main(int argc, char **argv)
+{
+    static char keys[NUM_KEYS][PROP_NAME_MAX];
+    static char values[NUM_KEYS][PROP_VALUE_MAX];
+    const char *key_ptrs[NUM_KEYS];
+    char *value_ptrs[NUM_KEYS];
+    struct sockaddr_un addr;
+    char dir[] = "/tmp/hybris-properties-XXXXXX";
+    char value[PROP_VALUE_MAX];
+    pthread_t thread, threads[NUM_THREADS];
+    double start;
+    int server, status, errors = 0, i;
+    pid_t pid;
+
+    if (argc > 1 && !strcmp(argv[1], "--legacy"))
+        service_mode = LEGACY;
+    if (argc > 1 && !strcmp(argv[1], "--silent"))
+        service_mode = SILENT;
+
+    if (!mkdtemp(dir)) {
+        perror("mkdtemp");
+        return 1;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_LOCAL;
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s/%s", dir, PROP_SERVICE_NAME);
+
+    server = socket(AF_LOCAL, SOCK_STREAM, 0);
+    if (server < 0 || bind(server, (struct sockaddr *) &addr, sizeof(addr)) < 0 ||
+        listen(server, 128) < 0) {
+        perror("property service socket");
+        return 1;
+    }
+
+    pthread_create(&thread, NULL, property_service, (void *)(intptr_t) server);
+    setenv("HYBRIS_PROPERTY_SERVICE_SOCKET", addr.sun_path, 1);
+
+    start = now_ms();
+    for (i = 0; i < NUM_KEYS; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "test.single.%d", i);
+        my_property_get(keys[i], value, NULL);
+        errors += check_value(keys[i], value);
+    }
+    report("single", start);
+
+    for (i = 0; i < NUM_KEYS; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "test.batch.%d", i);
+        key_ptrs[i] = keys[i];
+        value_ptrs[i] = values[i];
+    }
+
+    start = now_ms();
+    my_property_get_batch(key_ptrs, value_ptrs, NULL, NUM_KEYS);
+    report("batched", start);
+
+    for (i = 0; i < NUM_KEYS; i++)
+        errors += check_value(keys[i], values[i]);
+
+    /* repeated gets are served by the runtime cache */
+    start = now_ms();
+    for (i = 0; i < NUM_KEYS; i++)
+        my_property_get(keys[i], value, NULL);
+    report("cached", start);
+
+    /* a key asked for twice in a batch is fetched once */
+    for (i = 0; i < NUM_KEYS; i++) {
+        snprintf(keys[i], sizeof(keys[i]), "test.duplicate.%d", i / 2);
+        key_ptrs[i] = keys[i];
+    }
+
+    start = now_ms();
+    my_property_get_batch(key_ptrs, value_ptrs, NULL, NUM_KEYS);
+    if (requests != NUM_KEYS / 2) {
+        printf("%d requests for %d distinct keys\n", requests, NUM_KEYS / 2);
+        errors++;
+    }
+    report("dupes", start);
+
+    /* threads share the connection of the process */
+    start = now_ms();
+    for (i = 0; i < NUM_THREADS; i++)
+        pthread_create(&threads[i], NULL, batch_thread, (void *)(intptr_t) i);
+    for (i = 0; i < NUM_THREADS; i++) {
+        void *thread_errors;
+
+        pthread_join(threads[i], &thread_errors);
+        errors += (int)(intptr_t) thread_errors;
+    }
+    if (service_mode == PIPELINED && connections != 0) {
+        printf("%d more connections for %d threads\n", connections, NUM_THREADS);
+        errors++;
+    }
+    report("threads", start);
+
+    /* a child gets a connection of its own */
+    fflush(stdout);
+    pid = fork();
+    if (pid == 0) {
+        int child_errors;
+
+        my_property_get("test.child", value, NULL);
+        child_errors = check_value("test.child", value);
+        fflush(stdout);
+        _exit(child_errors);
+    }
+    if (pid < 0 || waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+        printf("the child didn't get its property\n");
+        errors++;
+    }
+    my_property_get("test.parent", value, NULL);
+    errors += check_value("test.parent", value);
+
+    for (i = 0; i < NUM_KEYS; i++)
+        errors += check_value(keys[i], values[i]);
+
+    my_property_get("unset.property", value, "default");
+    if (strcmp(value, "default") != 0) {
+        printf("default value not applied: '%s'\n", value);
+        errors++;
+    }
+
+    unlink(addr.sun_path);
+    rmdir(dir);
+
+    printf("%s\n", errors ? "FAILED" : "OK");
+
+    return errors ? 1 : 0;
+}
+
+// vim:ts=4:sw=4:noexpandtab
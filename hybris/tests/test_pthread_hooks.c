@@ -0,0 +1,267 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Stress test for the lazy initialization of statically initialized bionic
+ * mutexes, conditions and rwlocks. A number of threads race to initialize
+ * the same objects and then use them; all of them have to end up with the
+ * same glibc object and no update of the protected counters may get lost.
+ * The mutexes use the normal, recursive and errorcheck bionic initializers
+ * in turn, and the glibc mutex has to behave according to the initializer.
+ *
+ * It also creates and destroys process-shared objects over and over, which
+ * must not make the shared memory region grow.
+ */
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hooks_pthread.h"
+#include "hooks_shm.h"
+
+#define NUM_THREADS 16
+#define NUM_OBJECTS 64
+#define NUM_ROUNDS  200
+#define NUM_LOCKS   100
+#define NUM_SHM     32
+
+/* Static initializer values of bionic mutexes */
+#define BIONIC_MUTEX_INITIALIZER            0
+#define BIONIC_RECURSIVE_MUTEX_INITIALIZER  0x4000
+#define BIONIC_ERRORCHECK_MUTEX_INITIALIZER 0x8000
+
+static const uintptr_t mutex_initializers[] = {
+    BIONIC_MUTEX_INITIALIZER,
+    BIONIC_RECURSIVE_MUTEX_INITIALIZER,
+    BIONIC_ERRORCHECK_MUTEX_INITIALIZER,
+};
+
+#define MUTEX_INITIALIZER(i) \
+    mutex_initializers[(i) % (sizeof(mutex_initializers) / sizeof(mutex_initializers[0]))]
+
+/* Large enough for the bionic objects on all architectures */
+typedef union {
+    uintptr_t value;
+    char storage[40];
+} bionic_object_t;
+
+static bionic_object_t mutexes[NUM_OBJECTS];
+static bionic_object_t conds[NUM_OBJECTS];
+static bionic_object_t rwlocks[NUM_OBJECTS];
+
+static void *seen_mutex[NUM_THREADS][NUM_OBJECTS];
+static void *seen_cond[NUM_THREADS][NUM_OBJECTS];
+static void *seen_rwlock[NUM_THREADS][NUM_OBJECTS];
+
+static long counters[NUM_OBJECTS];
+static int type_errors;
+static pthread_barrier_t barrier;
+
+static void *stress_thread(void *arg)
+{
+    int id = (int)(intptr_t) arg;
+    int i, j;
+
+    pthread_barrier_wait(&barrier);
+
+    for (i = 0; i < NUM_OBJECTS; i++) {
+        uintptr_t init = MUTEX_INITIALIZER(i);
+        uintptr_t value = __atomic_load_n(&mutexes[i].value, __ATOMIC_ACQUIRE);
+        pthread_mutex_t *mutex = (pthread_mutex_t *) value;
+        pthread_cond_t *cond;
+        pthread_rwlock_t *rwlock;
+
+        if (value == init)
+            mutex = hybris_lazy_init_mutex((pthread_mutex_t *) &mutexes[i], value);
+        seen_mutex[id][i] = mutex;
+
+        value = __atomic_load_n(&conds[i].value, __ATOMIC_ACQUIRE);
+        cond = (pthread_cond_t *) value;
+        if (value == 0)
+            cond = hybris_lazy_init_cond((pthread_cond_t *) &conds[i], value);
+        seen_cond[id][i] = cond;
+
+        value = __atomic_load_n(&rwlocks[i].value, __ATOMIC_ACQUIRE);
+        rwlock = (pthread_rwlock_t *) value;
+        if (value == 0)
+            rwlock = hybris_lazy_init_rwlock((pthread_rwlock_t *) &rwlocks[i], value);
+        seen_rwlock[id][i] = rwlock;
+
+        for (j = 0; j < NUM_LOCKS; j++) {
+            pthread_mutex_lock(mutex);
+            counters[i]++;
+            if (init == BIONIC_RECURSIVE_MUTEX_INITIALIZER) {
+                /* The owner may lock it again */
+                if (pthread_mutex_lock(mutex) == 0)
+                    pthread_mutex_unlock(mutex);
+                else
+                    __atomic_add_fetch(&type_errors, 1, __ATOMIC_RELAXED);
+            } else if (init == BIONIC_ERRORCHECK_MUTEX_INITIALIZER) {
+                /* The owner relocking it must fail instead of deadlocking */
+                if (pthread_mutex_lock(mutex) != EDEADLK)
+                    __atomic_add_fetch(&type_errors, 1, __ATOMIC_RELAXED);
+            }
+            pthread_cond_signal(cond);
+            pthread_mutex_unlock(mutex);
+
+            pthread_rwlock_rdlock(rwlock);
+            pthread_rwlock_unlock(rwlock);
+        }
+    }
+
+    return NULL;
+}
+
+static int run_round(int round)
+{
+    pthread_t threads[NUM_THREADS];
+    int errors = 0;
+    int i, t;
+
+    memset(mutexes, 0, sizeof(mutexes));
+    for (i = 0; i < NUM_OBJECTS; i++)
+        mutexes[i].value = MUTEX_INITIALIZER(i);
+    memset(conds, 0, sizeof(conds));
+    memset(rwlocks, 0, sizeof(rwlocks));
+    memset(counters, 0, sizeof(counters));
+    type_errors = 0;
+
+    pthread_barrier_init(&barrier, NULL, NUM_THREADS);
+
+    for (t = 0; t < NUM_THREADS; t++)
+        pthread_create(&threads[t], NULL, stress_thread, (void *)(intptr_t) t);
+    for (t = 0; t < NUM_THREADS; t++)
+        pthread_join(threads[t], NULL);
+
+    pthread_barrier_destroy(&barrier);
+
+    if (type_errors) {
+        printf("round %d: %d relocks did not match the mutex type\n",
+               round, type_errors);
+        errors++;
+    }
+
+    for (i = 0; i < NUM_OBJECTS; i++) {
+        if (counters[i] != NUM_THREADS * NUM_LOCKS) {
+            printf("round %d: counter %d is %ld, expected %d\n",
+                   round, i, counters[i], NUM_THREADS * NUM_LOCKS);
+            errors++;
+        }
+
+        for (t = 0; t < NUM_THREADS; t++) {
+            if (seen_mutex[t][i] != (void *) mutexes[i].value ||
+                seen_cond[t][i] != (void *) conds[i].value ||
+                seen_rwlock[t][i] != (void *) rwlocks[i].value) {
+                printf("round %d: thread %d used a different object %d\n",
+                       round, t, i);
+                errors++;
+            }
+        }
+
+        /* Only the owner of an errorcheck mutex may unlock it */
+        if (MUTEX_INITIALIZER(i) == BIONIC_ERRORCHECK_MUTEX_INITIALIZER &&
+            pthread_mutex_unlock((pthread_mutex_t *) mutexes[i].value) != EPERM) {
+            printf("round %d: errorcheck mutex %d unlocked without owner\n",
+                   round, i);
+            errors++;
+        }
+
+        pthread_mutex_destroy((pthread_mutex_t *) mutexes[i].value);
+        hybris_pthread_mutex_free((pthread_mutex_t *) mutexes[i].value);
+        pthread_cond_destroy((pthread_cond_t *) conds[i].value);
+        hybris_pthread_cond_free((pthread_cond_t *) conds[i].value);
+        pthread_rwlock_destroy((pthread_rwlock_t *) rwlocks[i].value);
+        hybris_pthread_rwlock_free((pthread_rwlock_t *) rwlocks[i].value);
+    }
+
+    return errors;
+}
+
+static void *shm_thread(void *arg)
+{
+    hybris_shm_pointer_t handles[NUM_SHM];
+    int round, i;
+
+    (void) arg;
+
+    for (round = 0; round < NUM_ROUNDS; round++) {
+        for (i = 0; i < NUM_SHM; i++) {
+            handles[i] = hybris_shm_alloc(sizeof(pthread_mutex_t));
+            pthread_mutex_init(hybris_get_shmpointer(handles[i]), NULL);
+        }
+        for (i = 0; i < NUM_SHM; i++) {
+            pthread_mutex_destroy(hybris_get_shmpointer(handles[i]));
+            hybris_shm_free(handles[i], sizeof(pthread_mutex_t));
+        }
+    }
+
+    return NULL;
+}
+
+static int run_shm(void)
+{
+    pthread_t threads[NUM_THREADS];
+    size_t start, live, peak;
+    int t;
+
+    hybris_shm_get_usage(&start, NULL);
+
+    for (t = 0; t < NUM_THREADS; t++)
+        pthread_create(&threads[t], NULL, shm_thread, NULL);
+    for (t = 0; t < NUM_THREADS; t++)
+        pthread_join(threads[t], NULL);
+
+    hybris_shm_get_usage(&live, &peak);
+    printf("shm: %zu bytes in use, peak %zu bytes\n", live, peak);
+
+    if (live != start) {
+        printf("shm: %zu bytes leaked\n", live - start);
+        return 1;
+    }
+    if (peak > start + NUM_THREADS * NUM_SHM * 64) {
+        printf("shm: released objects were not reused\n");
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int rounds = NUM_ROUNDS;
+    int errors = 0;
+    int i;
+
+    if (argc > 1)
+        rounds = atoi(argv[1]);
+
+    for (i = 0; i < rounds; i++)
+        errors += run_round(i);
+
+    errors += run_shm();
+
+    printf("%d rounds with %d threads: %s\n", rounds, NUM_THREADS,
+           errors ? "FAILED" : "OK");
+
+    return errors ? 1 : 0;
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,308 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Checks the swap chain shared by the native windows against a simple model
+ * and measures it driving dequeue/queue at a high rate, next to the list
+ * walks the windows used to pick and release their buffers with.
+ *
+ * A stand-in compositor keeps the last few presented buffers before it
+ * releases them. The chain never looks at its buffers, so they are just
+ * addresses here.
+ *
+ * usage: test_swapchain [frames]
+ */
+
+#include "swapchain.h"
+
+#include <list>
+#include <deque>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define MAX_BUFFERS 64
+
+static char storage[MAX_BUFFERS + 1];
+static char wl_storage[MAX_BUFFERS];
+
+static BaseNativeWindowBuffer *fake_buffer(int i)
+{
+    return (BaseNativeWindowBuffer *) &storage[i];
+}
+
+/* Stands in for the wl_buffer of a buffer */
+static const void *fake_wlbuffer(int i)
+{
+    return &wl_storage[i];
+}
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+        errors++; \
+    } \
+} while (0)
+
+static int errors = 0;
+
+/* Random transitions, checked against the state kept by the test */
+static void check_model(void)
+{
+    SwapChain chain;
+    SwapChain::SlotState model[MAX_BUFFERS];
+    std::deque<int> freed, queued;
+    int buffers = 6, i;
+
+    srand(1);
+
+    for (i = 0; i < buffers; i++) {
+        CHECK(chain.addSlot(fake_buffer(i)) == i);
+        model[i] = SwapChain::FREE;
+        freed.push_back(i);
+    }
+
+    for (i = 0; i < 100000; i++) {
+        int slot = rand() % buffers;
+        int n;
+
+        switch (rand() % 5) {
+        case 0:
+            n = chain.dequeue();
+            if (freed.empty()) {
+                CHECK(n == -1);
+                break;
+            }
+            CHECK(n == freed.front());
+            freed.pop_front();
+            model[n] = SwapChain::DEQUEUED;
+            break;
+        case 1:
+            if (model[slot] != SwapChain::DEQUEUED)
+                break;
+            chain.queue(slot);
+            model[slot] = SwapChain::QUEUED;
+            queued.push_back(slot);
+            CHECK(chain.age(slot) == 1);
+            break;
+        case 2:
+            if (model[slot] != SwapChain::DEQUEUED)
+                break;
+            chain.cancel(slot);
+            model[slot] = SwapChain::FREE;
+            freed.push_back(slot);
+            break;
+        case 3:
+            CHECK(chain.nextQueued() == (queued.empty() ? -1 : queued.front()));
+            n = chain.acquire();
+            if (queued.empty()) {
+                CHECK(n == -1);
+                break;
+            }
+            CHECK(n == queued.front());
+            queued.pop_front();
+            model[n] = SwapChain::ACQUIRED;
+            break;
+        case 4:
+            if (model[slot] != SwapChain::ACQUIRED)
+                break;
+            chain.release(slot);
+            model[slot] = SwapChain::FREE;
+            freed.push_back(slot);
+            break;
+        }
+    }
+
+    int counts[SwapChain::NUM_STATES] = { 0, 0, 0, 0 };
+    for (i = 0; i < buffers; i++) {
+        CHECK(chain.state(i) == model[i]);
+        CHECK(chain.slotOf(fake_buffer(i)) == i);
+        counts[model[i]]++;
+    }
+    for (i = 0; i < SwapChain::NUM_STATES; i++)
+        CHECK(chain.count((SwapChain::SlotState) i) == counts[i]);
+}
+
+/* Aliases, replaced and removed slots */
+static void check_slots(void)
+{
+    SwapChain chain;
+    int slot, i;
+
+    for (i = 0; i < 4; i++)
+        chain.addSlot(fake_buffer(i));
+
+    chain.setAlias(1, fake_buffer(MAX_BUFFERS));
+    CHECK(chain.slotOf(fake_buffer(MAX_BUFFERS)) == 1);
+
+    /* A new buffer in the slot has unknown contents and no alias yet */
+    slot = chain.dequeue();
+    chain.queue(slot);
+    CHECK(chain.age(slot) == 1);
+    chain.setBuffer(slot, fake_buffer(4));
+    CHECK(chain.age(slot) == 0);
+    CHECK(chain.slotOf(fake_buffer(0)) == -1);
+    CHECK(chain.slotOf(fake_buffer(4)) == slot);
+    CHECK(chain.state(slot) == SwapChain::QUEUED);
+
+    /* The last slot takes over the index of the removed one */
+    chain.setAlias(3, fake_buffer(5));
+    chain.removeSlot(1);
+    CHECK(chain.size() == 3);
+    CHECK(chain.slotOf(fake_buffer(1)) == -1);
+    CHECK(chain.slotOf(fake_buffer(MAX_BUFFERS)) == -1);
+    CHECK(chain.slotOf(fake_buffer(3)) == 1);
+    CHECK(chain.slotOf(fake_buffer(5)) == 1);
+    CHECK(chain.buffer(1) == fake_buffer(3));
+    CHECK(chain.freeCount() == 2);
+
+    /* The free slots are still handed out in order */
+    CHECK(chain.dequeue() == 2);
+    CHECK(chain.dequeue() == 1);
+    CHECK(chain.dequeue() == -1);
+    CHECK(chain.acquire() == slot);
+}
+
+/* Presents frames through the chain, returns the time per frame in ns */
+static double run_chain(int buffers, int held, int frames)
+{
+    SwapChain chain;
+    std::deque<const void *> screen;
+    double start;
+    int i;
+
+    for (i = 0; i < buffers; i++)
+        chain.setAlias(chain.addSlot(fake_buffer(i)), fake_wlbuffer(i));
+
+    start = now_ms();
+    for (i = 0; i < frames; i++) {
+        int slot = chain.dequeue();
+
+        if (slot < 0) {
+            printf("%d buffers: nothing free in frame %d\n", buffers, i);
+            errors++;
+            return 0;
+        }
+        // Every buffer is used in turn once all of them were presented
+        if (i >= buffers && chain.age(slot) != buffers) {
+            printf("%d buffers: age %d in frame %d\n", buffers, chain.age(slot), i);
+            errors++;
+            return 0;
+        }
+
+        chain.queue(slot);
+        screen.push_back(fake_wlbuffer(chain.acquire()));
+
+        // The release event only tells which wl_buffer is free again
+        if ((int) screen.size() > held) {
+            chain.release(chain.slotOf(screen.front()));
+            screen.pop_front();
+        }
+    }
+
+    return (now_ms() - start) * 1e6 / frames;
+}
+
+struct ListBuffer {
+    int busy;
+    int youngest;
+};
+
+/* The same with the buffer list walks the windows did before */
+static double run_list(int buffers, int held, int frames)
+{
+    static ListBuffer list_buffers[MAX_BUFFERS];
+    std::list<ListBuffer *> bufList, fronted;
+    std::list<ListBuffer *>::iterator it;
+    double start;
+    int i;
+
+    for (i = 0; i < buffers; i++) {
+        list_buffers[i].busy = 0;
+        list_buffers[i].youngest = 0;
+        bufList.push_back(&list_buffers[i]);
+    }
+
+    start = now_ms();
+    for (i = 0; i < frames; i++) {
+        for (it = bufList.begin(); it != bufList.end(); ++it) {
+            if (!(*it)->busy && !(*it)->youngest)
+                break;
+        }
+        if (it == bufList.end()) {
+            for (it = bufList.begin(); it != bufList.end() && (*it)->busy; ++it)
+                ;
+        }
+
+        ListBuffer *b = *it;
+        b->busy = 1;
+        fronted.push_back(b);
+
+        if ((int) fronted.size() > held) {
+            ListBuffer *released = fronted.front();
+
+            for (it = fronted.begin(); it != fronted.end() && *it != released; ++it)
+                ;
+            fronted.erase(it);
+            for (it = bufList.begin(); it != bufList.end() && *it != released; ++it)
+                ;
+            released->busy = 0;
+            for (it = bufList.begin(); it != bufList.end(); ++it)
+                (*it)->youngest = 0;
+            released->youngest = 1;
+        }
+    }
+
+    return (now_ms() - start) * 1e6 / frames;
+}
+
+int main(int argc, char **argv)
+{
+    static const int counts[] = { 2, 3, 4, 8, 16, 32, MAX_BUFFERS };
+    int frames = 2000000;
+    unsigned i;
+
+    if (argc > 1)
+        frames = atoi(argv[1]);
+
+    check_model();
+    check_slots();
+
+    printf("%d frames, the compositor holds all but one buffer\n", frames);
+    printf("buffers   swap chain   list walk\n");
+    for (i = 0; i < sizeof(counts) / sizeof(counts[0]); i++) {
+        int held = counts[i] - 1;
+        double chain_ns = run_chain(counts[i], held, frames);
+        double list_ns = run_list(counts[i], held, frames);
+
+        printf("%7d   %7.1f ns   %7.1f ns\n", counts[i], chain_ns, list_ns);
+    }
+
+    printf("%s\n", errors ? "FAILED" : "OK");
+
+    return errors ? 1 : 0;
+}
+
+// vim:ts=4:sw=4:noexpandtab
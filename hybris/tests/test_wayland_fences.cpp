@@ -0,0 +1,206 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Measures the frame time of a client which is both CPU and GPU bound on the
+ * wayland EGL platform. The GPU is simulated with a sw_sync timeline: every
+ * frame submits a job to a GPU thread which signals the frame's fence once
+ * it is done, while the render thread spends its CPU time on the next frame.
+ *
+ * Both ways of handling the fence are measured in a child process of their
+ * own, waiting for it in eglSwapBuffers (HYBRIS_WAYLAND_FENCE_THREAD=0) and
+ * handing it over to the fence thread of the window.
+ *
+ * Needs a running compositor advertising android_wlegl and /dev/sw_sync.
+ *
+ * usage: test_wayland_fences [cpu ms] [gpu ms]
+ */
+
+#include <android-config.h>
+#include <system/window.h>
+
+#include "fakegpu.h"
+#include "wsplatform.h"
+
+#include <wayland-client.h>
+#include <wayland-egl.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define NUM_FRAMES    300
+#define WARMUP_FRAMES 30
+
+static double cpu_ms = 8;
+static double gpu_ms = 8;
+
+static struct wl_compositor *compositor = NULL;
+
+static void registry_handle_global(void *data, struct wl_registry *registry,
+                                   uint32_t name, const char *interface, uint32_t version)
+{
+    if (strcmp(interface, "wl_compositor") == 0)
+        compositor = (struct wl_compositor *) wl_registry_bind(registry, name, &wl_compositor_interface, 1);
+}
+
+static void registry_handle_global_remove(void *data, struct wl_registry *registry, uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registry_listener = {
+    registry_handle_global,
+    registry_handle_global_remove
+};
+
+/* Renders the frames and writes the average frame time to fd */
+static int run_frames(int fd)
+{
+    struct ws_module *ws = wsplatform_load("wayland");
+    struct wl_display *display;
+    struct wl_registry *registry;
+    struct wl_surface *surface;
+    struct wl_egl_window *egl_window;
+    struct _EGLDisplay *dpy;
+    EGLNativeWindowType win;
+    ANativeWindow *anw;
+    double start = 0, frame_ms;
+    int i;
+
+    if (!ws)
+        return 1;
+
+    display = wl_display_connect(NULL);
+    if (!display) {
+        printf("failed to connect to the compositor\n");
+        return 1;
+    }
+
+    registry = wl_display_get_registry(display);
+    wl_registry_add_listener(registry, &registry_listener, NULL);
+    wl_display_roundtrip(display);
+    if (!compositor) {
+        printf("the compositor doesn't advertise wl_compositor\n");
+        return 1;
+    }
+
+    if (fakegpu_start(gpu_ms) != 0) {
+        perror("sw_sync_timeline_create");
+        return 1;
+    }
+
+    surface = wl_compositor_create_surface(compositor);
+    egl_window = wl_egl_window_create(surface, 256, 256);
+
+    dpy = ws->GetDisplay((EGLNativeDisplayType) display);
+    ws->eglInitialized(dpy);
+    win = ws->CreateWindow((EGLNativeWindowType) egl_window, dpy);
+    anw = (ANativeWindow *) win;
+
+    // Don't let the compositor's frame callbacks limit the frame rate
+    ws->setSwapInterval(NULL, win, 0);
+
+    for (i = 0; i < WARMUP_FRAMES + NUM_FRAMES; i++) {
+        ANativeWindowBuffer *buffer;
+        int fence;
+
+        if (i == WARMUP_FRAMES)
+            start = fakegpu_now_ms();
+
+        if (anw->dequeueBuffer(anw, &buffer, &fence) != 0 || !buffer) {
+            printf("frame %d: dequeueBuffer failed\n", i);
+            return 1;
+        }
+        if (fence >= 0)
+            close(fence);
+
+        fakegpu_cpu_work(cpu_ms);
+
+        // What eglSwapBuffers does with the rendered buffer
+        ws->prepareSwap(NULL, win, NULL, 0);
+        anw->queueBuffer(anw, buffer, fakegpu_submit("test_wayland_fences"));
+        ws->finishSwap(NULL, win);
+    }
+
+    frame_ms = (fakegpu_now_ms() - start) / NUM_FRAMES;
+    if (write(fd, &frame_ms, sizeof(frame_ms)) != sizeof(frame_ms))
+        return 1;
+
+    ws->DestroyWindow(win);
+    wl_egl_window_destroy(egl_window);
+    wl_surface_destroy(surface);
+    wl_display_disconnect(display);
+
+    return 0;
+}
+
+static int measure(const char *fence_thread, double *frame_ms)
+{
+    int fds[2], status;
+    pid_t pid;
+
+    if (pipe(fds) < 0) {
+        perror("pipe");
+        return 1;
+    }
+
+    pid = fork();
+    if (pid == 0) {
+        close(fds[0]);
+        setenv("HYBRIS_WAYLAND_FENCE_THREAD", fence_thread, 1);
+        _exit(run_frames(fds[1]));
+    }
+
+    close(fds[1]);
+    if (read(fds[0], frame_ms, sizeof(*frame_ms)) != sizeof(*frame_ms))
+        *frame_ms = -1;
+    close(fds[0]);
+
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || *frame_ms < 0)
+        return 1;
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    double blocking_ms, async_ms;
+
+    if (argc > 1)
+        cpu_ms = atof(argv[1]);
+    if (argc > 2)
+        gpu_ms = atof(argv[2]);
+
+    printf("%d frames, %.1f ms CPU and %.1f ms GPU time each\n", NUM_FRAMES, cpu_ms, gpu_ms);
+
+    if (measure("0", &blocking_ms) != 0 || measure("1", &async_ms) != 0) {
+        printf("FAILED\n");
+        return 1;
+    }
+
+    printf("sync_wait in eglSwapBuffers: %.2f ms/frame\n", blocking_ms);
+    printf("fence thread:                %.2f ms/frame\n", async_ms);
+    printf("speedup %.2fx, at best %.2fx\n", blocking_ms / async_ms,
+           (cpu_ms + gpu_ms) / (cpu_ms > gpu_ms ? cpu_ms : gpu_ms));
+
+    return 0;
+}
+
+// vim:ts=4:sw=4:noexpandtab
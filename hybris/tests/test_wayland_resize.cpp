@@ -0,0 +1,415 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Measures how long frames take on the wayland EGL platform while the window
+ * is resized before every one of them, compared to frames at a fixed size.
+ *
+ * The compositor is a minimal headless one running in a child process, with
+ * android_wlegl provided by libhybris-platformcommon. It releases buffers as
+ * soon as they are replaced and never shows anything.
+ *
+ * usage: test_wayland_resize [frames]
+ */
+
+#include <android-config.h>
+#include <system/window.h>
+
+#include <server_wlegl.h>
+#include <hybris/gralloc/gralloc.h>
+
+#include <wayland-client.h>
+#include <wayland-server.h>
+#include <wayland-egl.h>
+
+#include "wsplatform.h"
+
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define SOCKET_NAME "hybris-test-resize"
+
+/* A buffer reference which is dropped when the client destroys the buffer */
+struct buffer_ref {
+    struct wl_resource *buffer;
+    struct wl_listener destroy;
+};
+
+struct surface {
+    struct buffer_ref pending;
+    struct buffer_ref current;
+    bool attached;
+    struct wl_list frame_callbacks;
+};
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static void buffer_destroyed(struct wl_listener *listener, void *data)
+{
+    struct buffer_ref *ref = wl_container_of(listener, ref, destroy);
+
+    wl_list_remove(&ref->destroy.link);
+    ref->buffer = NULL;
+}
+
+static void buffer_ref_set(struct buffer_ref *ref, struct wl_resource *buffer)
+{
+    if (ref->buffer)
+        wl_list_remove(&ref->destroy.link);
+
+    ref->buffer = buffer;
+    if (buffer) {
+        ref->destroy.notify = buffer_destroyed;
+        wl_resource_add_destroy_listener(buffer, &ref->destroy);
+    }
+}
+
+static void resource_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+    wl_resource_destroy(resource);
+}
+
+static void surface_attach(struct wl_client *client, struct wl_resource *resource,
+                           struct wl_resource *buffer, int32_t x, int32_t y)
+{
+    struct surface *surface = (struct surface *) wl_resource_get_user_data(resource);
+
+    buffer_ref_set(&surface->pending, buffer);
+    surface->attached = true;
+}
+
+static void surface_damage(struct wl_client *client, struct wl_resource *resource,
+                           int32_t x, int32_t y, int32_t width, int32_t height)
+{
+}
+
+static void frame_callback_destroyed(struct wl_resource *resource)
+{
+    wl_list_remove(wl_resource_get_link(resource));
+}
+
+static void surface_frame(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct surface *surface = (struct surface *) wl_resource_get_user_data(resource);
+    struct wl_resource *callback = wl_resource_create(client, &wl_callback_interface, 1, id);
+
+    wl_resource_set_implementation(callback, NULL, NULL, frame_callback_destroyed);
+    wl_list_insert(surface->frame_callbacks.prev, wl_resource_get_link(callback));
+}
+
+static void surface_set_region(struct wl_client *client, struct wl_resource *resource,
+                               struct wl_resource *region)
+{
+}
+
+/* Everything is "presented" right away */
+static void surface_commit(struct wl_client *client, struct wl_resource *resource)
+{
+    struct surface *surface = (struct surface *) wl_resource_get_user_data(resource);
+    struct wl_resource *callback, *next;
+
+    if (surface->attached) {
+        if (surface->current.buffer && surface->current.buffer != surface->pending.buffer)
+            wl_buffer_send_release(surface->current.buffer);
+        buffer_ref_set(&surface->current, surface->pending.buffer);
+        buffer_ref_set(&surface->pending, NULL);
+        surface->attached = false;
+    }
+
+    wl_resource_for_each_safe(callback, next, &surface->frame_callbacks) {
+        wl_callback_send_done(callback, (uint32_t) now_ms());
+        wl_resource_destroy(callback);
+    }
+}
+
+static void surface_set_int(struct wl_client *client, struct wl_resource *resource, int32_t value)
+{
+}
+
+static const struct wl_surface_interface surface_impl = {
+    resource_destroy,
+    surface_attach,
+    surface_damage,
+    surface_frame,
+    surface_set_region,
+    surface_set_region,
+    surface_commit,
+    surface_set_int,
+    surface_set_int,
+    surface_damage,
+};
+
+static void surface_resource_destroyed(struct wl_resource *resource)
+{
+    struct surface *surface = (struct surface *) wl_resource_get_user_data(resource);
+    struct wl_resource *callback, *next;
+
+    buffer_ref_set(&surface->pending, NULL);
+    buffer_ref_set(&surface->current, NULL);
+    wl_resource_for_each_safe(callback, next, &surface->frame_callbacks)
+        wl_resource_destroy(callback);
+    delete surface;
+}
+
+static void region_rect(struct wl_client *client, struct wl_resource *resource,
+                        int32_t x, int32_t y, int32_t width, int32_t height)
+{
+}
+
+static const struct wl_region_interface region_impl = {
+    resource_destroy,
+    region_rect,
+    region_rect,
+};
+
+static void compositor_create_surface(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct wl_resource *res = wl_resource_create(client, &wl_surface_interface,
+                                                 wl_resource_get_version(resource), id);
+    struct surface *surface = new struct surface();
+
+    wl_list_init(&surface->frame_callbacks);
+    wl_resource_set_implementation(res, &surface_impl, surface, surface_resource_destroyed);
+}
+
+static void compositor_create_region(struct wl_client *client, struct wl_resource *resource, uint32_t id)
+{
+    struct wl_resource *res = wl_resource_create(client, &wl_region_interface, 1, id);
+
+    wl_resource_set_implementation(res, &region_impl, NULL, NULL);
+}
+
+static const struct wl_compositor_interface compositor_impl = {
+    compositor_create_surface,
+    compositor_create_region,
+};
+
+static void compositor_bind(struct wl_client *client, void *data, uint32_t version, uint32_t id)
+{
+    struct wl_resource *resource = wl_resource_create(client, &wl_compositor_interface, version, id);
+
+    wl_resource_set_implementation(resource, &compositor_impl, NULL, NULL);
+}
+
+static void run_compositor(int ready_fd)
+{
+    struct wl_display *display = wl_display_create();
+
+    if (wl_display_add_socket(display, SOCKET_NAME) < 0) {
+        perror("wl_display_add_socket");
+        _exit(1);
+    }
+
+    wl_global_create(display, &wl_compositor_interface, 4, NULL, compositor_bind);
+    hybris_gralloc_initialize(0);
+    server_wlegl_create(display);
+
+    if (write(ready_fd, "", 1) != 1)
+        _exit(1);
+    close(ready_fd);
+
+    wl_display_run(display);
+    _exit(0);
+}
+
+static struct wl_compositor *compositor = NULL;
+
+static void registry_handle_global(void *data, struct wl_registry *registry,
+                                   uint32_t name, const char *interface, uint32_t version)
+{
+    if (strcmp(interface, "wl_compositor") == 0)
+        compositor = (struct wl_compositor *) wl_registry_bind(registry, name, &wl_compositor_interface, 4);
+}
+
+static void registry_handle_global_remove(void *data, struct wl_registry *registry, uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registry_listener = {
+    registry_handle_global,
+    registry_handle_global_remove
+};
+
+/* One frame the way eglSwapBuffers does it, returns how long it took */
+static double render_frame(struct ws_module *ws, EGLNativeWindowType win)
+{
+    ANativeWindow *anw = (ANativeWindow *) win;
+    ANativeWindowBuffer *buffer;
+    double start = now_ms();
+    int fence;
+
+    if (anw->dequeueBuffer(anw, &buffer, &fence) != 0 || !buffer)
+        return -1;
+    if (fence >= 0)
+        close(fence);
+
+    ws->prepareSwap(NULL, win, NULL, 0);
+    anw->queueBuffer(anw, buffer, -1);
+    ws->finishSwap(NULL, win);
+
+    return now_ms() - start;
+}
+
+static void report(const char *what, double *times, int frames)
+{
+    double total = 0, max = 0;
+    int i;
+
+    for (i = 0; i < frames; i++) {
+        total += times[i];
+        if (times[i] > max)
+            max = times[i];
+    }
+
+    printf("%-8s %d frames: %.3f ms/frame on average, %.3f ms at most\n",
+           what, frames, total / frames, max);
+}
+
+static int run_client(int frames)
+{
+    struct ws_module *ws = wsplatform_load("wayland");
+    struct wl_display *display;
+    struct wl_registry *registry;
+    struct wl_surface *surface;
+    struct wl_egl_window *egl_window;
+    struct _EGLDisplay *dpy;
+    EGLNativeWindowType win;
+    double *steady, *storm;
+    int i;
+
+    if (!ws)
+        return 1;
+
+    display = wl_display_connect(SOCKET_NAME);
+    if (!display) {
+        printf("failed to connect to the compositor\n");
+        return 1;
+    }
+
+    registry = wl_display_get_registry(display);
+    wl_registry_add_listener(registry, &registry_listener, NULL);
+    wl_display_roundtrip(display);
+    if (!compositor) {
+        printf("the compositor doesn't advertise wl_compositor\n");
+        return 1;
+    }
+
+    surface = wl_compositor_create_surface(compositor);
+    egl_window = wl_egl_window_create(surface, 256, 256);
+
+    dpy = ws->GetDisplay((EGLNativeDisplayType) display);
+    ws->eglInitialized(dpy);
+    win = ws->CreateWindow((EGLNativeWindowType) egl_window, dpy);
+    ws->setSwapInterval(NULL, win, 0);
+
+    steady = new double[frames];
+    storm = new double[frames];
+
+    // Let the initial buffers go through the swap chain once
+    for (i = 0; i < 8; i++)
+        render_frame(ws, win);
+
+    for (i = 0; i < frames; i++)
+        steady[i] = render_frame(ws, win);
+
+    for (i = 0; i < frames; i++) {
+        int size = 128 + (i % 16) * 16;
+
+        wl_egl_window_resize(egl_window, size, size, 0, 0);
+        storm[i] = render_frame(ws, win);
+    }
+
+    for (i = 0; i < frames; i++) {
+        if (steady[i] < 0 || storm[i] < 0) {
+            printf("dequeueBuffer failed\n");
+            return 1;
+        }
+    }
+
+    report("steady", steady, frames);
+    report("resizing", storm, frames);
+
+    delete[] steady;
+    delete[] storm;
+
+    ws->DestroyWindow(win);
+    wl_egl_window_destroy(egl_window);
+    wl_surface_destroy(surface);
+    wl_display_disconnect(display);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    char dir[] = "/tmp/hybris-wayland-XXXXXX";
+    char path[PATH_MAX];
+    int frames = 200;
+    int fds[2], status, ret;
+    pid_t server;
+    char ready;
+
+    if (argc > 1)
+        frames = atoi(argv[1]);
+
+    if (!mkdtemp(dir) || pipe(fds) < 0) {
+        perror("test setup");
+        return 1;
+    }
+    setenv("XDG_RUNTIME_DIR", dir, 1);
+
+    server = fork();
+    if (server == 0) {
+        close(fds[0]);
+        run_compositor(fds[1]);
+    }
+
+    close(fds[1]);
+    if (read(fds[0], &ready, 1) != 1) {
+        printf("the compositor failed to start\n");
+        return 1;
+    }
+    close(fds[0]);
+
+    ret = run_client(frames);
+
+    kill(server, SIGTERM);
+    waitpid(server, &status, 0);
+
+    snprintf(path, sizeof(path), "%s/%s", dir, SOCKET_NAME);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/%s.lock", dir, SOCKET_NAME);
+    unlink(path);
+    rmdir(dir);
+
+    printf("%s\n", ret ? "FAILED" : "OK");
+
+    return ret;
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,233 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/*
+ * Registers the buffers of fake clients with the wlegl server the way a
+ * client does which keeps recreating its window, with the buffer import
+ * cache on (HYBRIS_WLEGL_IMPORT_CACHE). The test stands in for gralloc:
+ * buffers are memfds, an import dups the fds of the handle and a release
+ * closes them, so no Android libraries are needed.
+ *
+ * Every registration passes fresh fds, like the wayland connection does.
+ * The buffers of the swap chain have to be imported once only. Neither a
+ * buffer with the same ints on another open file of the same memfd, which
+ * has the same inode, nor the same buffer registered by another client may
+ * be taken for one of them. Buffers beyond the size of the cache have to be
+ * evicted and released once their wl_buffers are gone.
+ *
+ * usage: test_wlegl_import_cache [recreations]
+ */
+
+#include <android-config.h>
+#include <cutils/native_handle.h>
+#include <wayland-server.h>
+
+#include "server_wlegl_buffer.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CACHE_SIZE    8
+#define CHAIN_BUFFERS 3
+
+static int imports = 0;
+static int releases = 0;
+static int errors = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { \
+        printf("%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+        errors++; \
+    } \
+} while (0)
+
+static double now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+/* The fake gralloc */
+
+extern "C" int hybris_gralloc_import_buffer(buffer_handle_t raw_handle, buffer_handle_t *out_handle)
+{
+    native_handle_t *handle = native_handle_create(raw_handle->numFds, raw_handle->numInts);
+    int i;
+
+    for (i = 0; i < raw_handle->numFds; i++)
+        handle->data[i] = dup(raw_handle->data[i]);
+    for (i = raw_handle->numFds; i < raw_handle->numFds + raw_handle->numInts; i++)
+        handle->data[i] = raw_handle->data[i];
+
+    // Real importers map the buffer, which is what the cache saves
+    void *map = mmap(NULL, 4096, PROT_READ, MAP_SHARED, handle->data[0], 0);
+    if (map != MAP_FAILED)
+        munmap(map, 4096);
+
+    imports++;
+    *out_handle = handle;
+    return 0;
+}
+
+extern "C" int hybris_gralloc_release(buffer_handle_t handle, int was_allocated)
+{
+    native_handle_close((native_handle_t *) handle);
+    native_handle_delete((native_handle_t *) handle);
+    releases++;
+    return 0;
+}
+
+struct fake_buffer {
+    int fd;
+    int id;
+};
+
+static void fake_buffer_init(struct fake_buffer *buffer, int id)
+{
+    buffer->fd = memfd_create("test_wlegl_import_cache", 0);
+    if (buffer->fd >= 0 && ftruncate(buffer->fd, 4096) < 0) {
+        close(buffer->fd);
+        buffer->fd = -1;
+    }
+    buffer->id = id;
+}
+
+/* Another open file of the same memfd: same inode, same ints */
+static void fake_buffer_reopen(struct fake_buffer *buffer, const struct fake_buffer *from)
+{
+    char path[64];
+
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", from->fd);
+    buffer->fd = open(path, O_RDWR | O_CLOEXEC);
+    buffer->id = from->id;
+}
+
+/* Registers the buffer like server_wlegl_create_buffer() does and returns its wl_buffer */
+static server_wlegl_buffer *register_buffer(wl_client *client, uint32_t id, struct fake_buffer *buffer)
+{
+    native_handle_t *native = native_handle_create(1, 2);
+    server_wlegl_buffer *wlbuffer;
+
+    native->data[0] = dup(buffer->fd);
+    native->data[1] = 0x5ca1ab1e;
+    native->data[2] = buffer->id;
+
+    wlbuffer = server_wlegl_buffer_create(client, id, 256, 256, 256,
+                                          HAL_PIXEL_FORMAT_RGBA_8888,
+                                          GRALLOC_USAGE_HW_TEXTURE, native, NULL);
+    native_handle_close(native);
+    native_handle_delete(native);
+
+    return wlbuffer;
+}
+
+int main(int argc, char **argv)
+{
+    struct fake_buffer chain[CHAIN_BUFFERS], other[CACHE_SIZE + 1], reopened;
+    server_wlegl_import_stats stats;
+    int recreations = 1000;
+    int fds[2], other_fds[2], i, j;
+    uint32_t id = 1;
+
+    if (argc > 1)
+        recreations = atoi(argv[1]);
+
+    setenv("HYBRIS_WLEGL_IMPORT_CACHE", "8", 1);
+
+    wl_display *display = wl_display_create();
+    if (!display || socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) < 0) {
+        printf("can't set up the display\n");
+        return 1;
+    }
+    wl_client *client = wl_client_create(display, fds[0]);
+
+    for (i = 0; i < CHAIN_BUFFERS; i++) {
+        fake_buffer_init(&chain[i], i);
+        CHECK(chain[i].fd >= 0);
+    }
+
+    double start = now_ms();
+    for (i = 0; i < recreations; i++) {
+        server_wlegl_buffer *buffers[CHAIN_BUFFERS];
+
+        for (j = 0; j < CHAIN_BUFFERS; j++) {
+            buffers[j] = register_buffer(client, id++, &chain[j]);
+            CHECK(buffers[j] != NULL);
+        }
+        // The window is destroyed and recreated
+        for (j = 0; j < CHAIN_BUFFERS; j++)
+            wl_resource_destroy(buffers[j]->resource);
+    }
+    double elapsed = now_ms() - start;
+
+    server_wlegl_buffer_get_import_stats(&stats);
+    printf("%d recreations: %.2f us per buffer, %lu hits, %lu misses, %d imports\n",
+           recreations, elapsed * 1e3 / (recreations * CHAIN_BUFFERS),
+           stats.hits, stats.misses, imports);
+    CHECK(imports == CHAIN_BUFFERS);
+    CHECK(stats.misses == CHAIN_BUFFERS);
+    CHECK(stats.hits == (unsigned long) (recreations - 1) * CHAIN_BUFFERS);
+
+    // Not the same open file, and not the same client
+    fake_buffer_reopen(&reopened, &chain[0]);
+    CHECK(reopened.fd >= 0);
+    server_wlegl_buffer *collision = register_buffer(client, id++, &reopened);
+    CHECK(collision && imports == CHAIN_BUFFERS + 1);
+    wl_resource_destroy(collision->resource);
+
+    CHECK(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, other_fds) == 0);
+    wl_client *other_client = wl_client_create(display, other_fds[0]);
+    collision = register_buffer(other_client, 1, &chain[0]);
+    CHECK(collision && imports == CHAIN_BUFFERS + 2);
+    // Its cache goes away with it
+    wl_client_destroy(other_client);
+    close(other_fds[1]);
+    CHECK(releases == 1);
+
+    // Other buffers with the same ints, enough to overflow the cache
+    for (i = 0; i < CACHE_SIZE + 1; i++) {
+        fake_buffer_init(&other[i], i);
+        server_wlegl_buffer *buffer = register_buffer(client, id++, &other[i]);
+        CHECK(buffer && buffer->buf->handle != NULL);
+        wl_resource_destroy(buffer->resource);
+    }
+
+    server_wlegl_buffer_get_import_stats(&stats);
+    printf("%d more buffers: %lu evictions, %d entries, %d releases\n",
+           CACHE_SIZE + 1, stats.evictions, stats.entries, releases);
+    // The swap chain, the reopened buffer and the first other one are evicted
+    CHECK(imports == CHAIN_BUFFERS + 2 + CACHE_SIZE + 1);
+    CHECK(stats.entries == CACHE_SIZE);
+    CHECK(stats.evictions == CHAIN_BUFFERS + 2);
+    CHECK(releases == 1 + CHAIN_BUFFERS + 2);
+
+    wl_client_destroy(client);
+    close(fds[1]);
+    wl_display_destroy(display);
+
+    printf("%s\n", errors ? "FAILED" : "OK");
+
+    return errors ? 1 : 0;
+}
+
+// vim:ts=4:sw=4:noexpandtab
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#include "wsplatform.h"
+
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static void *no_egl_dlsym(const char *symbol)
+{
+    return NULL;
+}
+
+static int no_mapping(EGLSurface surface)
+{
+    return 0;
+}
+
+static EGLNativeWindowType get_no_mapping(EGLSurface surface)
+{
+    return 0;
+}
+
+static void no_buffer_images(EGLClientBuffer buffer)
+{
+}
+
+static struct ws_egl_interface egl_interface = {
+    no_egl_dlsym,
+    no_mapping,
+    get_no_mapping,
+    no_buffer_images
+};
+
+struct ws_module *wsplatform_load(const char *name)
+{
+    const char *dir = getenv("HYBRIS_EGLPLATFORM_DIR");
+    char path[2048];
+    struct ws_module *ws;
+    void *module;
+
+    snprintf(path, sizeof(path), "%s/eglplatform_%s.so", dir ? dir : PKGLIBDIR, name);
+
+    module = dlopen(path, RTLD_NOW);
+    if (!module) {
+        printf("failed to load %s: %s\n", path, dlerror());
+        return NULL;
+    }
+
+    ws = (struct ws_module *) dlsym(module, "ws_module_info");
+    if (!ws) {
+        printf("%s has no ws_module_info\n", path);
+        return NULL;
+    }
+
+    ws->init_module(&egl_interface);
+    return ws;
+}
@@ -0,0 +1,41 @@
+/*
+ * Copyright (c) 2026 libhybris contributors
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+#ifndef WSPLATFORM_H
+#define WSPLATFORM_H
+
+#include <ws.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Loads eglplatform_<name>.so from HYBRIS_EGLPLATFORM_DIR or the install
+ * directory and initialises it without libEGL, so that the tests can drive
+ * the platform's windows directly. The EGL side of the interface is only
+ * needed for EGLImages and does nothing.
+ *
+ * Returns NULL on errors.
+ */
+struct ws_module *wsplatform_load(const char *name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
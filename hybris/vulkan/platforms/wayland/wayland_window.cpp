@@ -43,17 +43,6 @@ extern "C" {
 }
 #endif
 
-static void
-wl_buffer_release(void *data, struct wl_buffer *buffer)
-{
-    WaylandNativeWindow *win = static_cast<WaylandNativeWindow *>(data);
-    win->releaseBuffer(buffer);
-}
-
-static struct wl_buffer_listener wl_buffer_listener = {
-    wl_buffer_release
-};
-
 static void
 wayland_frame_callback(void *data, struct wl_callback *callback, uint32_t time)
 {
@@ -82,64 +71,29 @@ int WaylandNativeWindow::dequeueBuffer(BaseNativeWindowBuffer **buffer, int *fen
 
     HYBRIS_TRACE_BEGIN("wayland-platform", "dequeueBuffer_wait_for_buffer", "");
 
-    HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_freeBufs);
+    HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_chain.freeCount());
 
-    while (m_freeBufs==0) {
-        HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_freeBufs);
+    while (m_chain.freeCount() == 0) {
+        HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_chain.freeCount());
         readQueue(true);
     }
 
-    std::list<WaylandNativeWindowBuffer *>::iterator it = m_bufList.begin();
-    for (; it != m_bufList.end(); ++it)
-    {
-         if ((*it)->busy)
-             continue;
-         if ((*it)->youngest == 1)
-             continue;
-         break;
-    }
-
-    if (it==m_bufList.end()) {
-        HYBRIS_TRACE_BEGIN("wayland-platform", "dequeueBuffer_worst_case_scenario", "");
-        HYBRIS_TRACE_END("wayland-platform", "dequeueBuffer_worst_case_scenario", "");
-
-        it = m_bufList.begin();
-        for (; it != m_bufList.end() && (*it)->busy; ++it)
-        {}
-
-    }
-    if (it==m_bufList.end()) {
-        *buffer = 0;
-        *fenceFd = -1;
-        unlock();
-        HYBRIS_TRACE_BEGIN("wayland-platform", "dequeueBuffer_no_free_buffers", "");
-        HYBRIS_TRACE_END("wayland-platform", "dequeueBuffer_no_free_buffers", "");
-        TRACE("%p: no free buffers", buffer);
-        return NO_ERROR;
-    }
-
-    wnb = *it;
+    // Take the buffer which has been free for the longest time, which leaves
+    // the compositor as much time as possible to really be done with it.
+    wnb = static_cast<WaylandNativeWindowBuffer *>(m_chain.buffer(m_chain.nextFree()));
     assert(wnb!=NULL);
     HYBRIS_TRACE_END("wayland-platform", "dequeueBuffer_wait_for_buffer", "");
 
-    /* If the buffer doesn't match the window anymore, re-allocate */
-    if (wnb->width != m_width || wnb->height != m_height
-        || wnb->format != m_format || wnb->usage != m_usage)
-    {
-        TRACE("wnb:%p,win:%p %i,%i %i,%i x%x,x%x x%x,x%" PRIx64,
-            wnb,m_window,
-            wnb->width,m_width, wnb->height,m_height,
-            wnb->format,m_format, wnb->usage, m_usage);
-        destroyBuffer(wnb);
-        m_bufList.erase(it);
-        wnb = addBuffer();
-    }
+    /* If the buffer doesn't match the window anymore, re-allocate all of them */
+    if (!matchesWindow(wnb))
+        reallocateBuffers();
 
-    wnb->busy = 1;
+    int slot = m_chain.dequeue();
+    wnb = static_cast<WaylandNativeWindowBuffer *>(m_chain.buffer(slot));
+    m_bufferAge = m_chain.age(slot);
     *buffer = wnb;
-    --m_freeBufs;
 
-    HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_freeBufs);
+    HYBRIS_TRACE_COUNTER("wayland-platform", "m_freeBufs", "%i", m_chain.freeCount());
     HYBRIS_TRACE_BEGIN("wayland-platform", "dequeueBuffer_gotBuffer", "-%p", wnb);
     HYBRIS_TRACE_END("wayland-platform", "dequeueBuffer_gotBuffer", "-%p", wnb);
     HYBRIS_TRACE_END("wayland-platform", "dequeueBuffer_wait_for_buffer", "");
@@ -174,20 +128,16 @@ void WaylandNativeWindow::presentBuffer(WaylandNativeWindowBuffer *wnb)
     }
 
     if (wnb) {
-        assert(wnb->busy == 1);
+        assert(m_chain.state(m_chain.slotOf(wnb)) == SwapChain::ACQUIRED);
 
-        if (!wnb->wlbuffer) {
-            wnb->init(m_android_wlegl, m_display, wl_queue);
-            TRACE("%p add listener with %p inside", wnb, wnb->wlbuffer);
-            wl_buffer_add_listener(wnb->wlbuffer, &wl_buffer_listener, this);
-        }
+        // Buffers are normally registered when they are allocated
+        if (!wnb->wlbuffer)
+            initBuffer(wnb);
 
         wl_surface_attach(wl_surface_wrapper, wnb->wlbuffer, 0, 0);
 
         m_window->attached_width = wnb->width;
         m_window->attached_height = wnb->height;
-
-        fronted.push_back(wnb);
     }
 
     // If the compositor doesn't support damage_buffer, we deliberately
@@ -226,6 +176,16 @@ void WaylandNativeWindow::presentBuffer(WaylandNativeWindowBuffer *wnb)
     m_damage_n_rects = 0;
 }
 
+// Buffers are presented from queueBuffer itself, there never are commits
+// in flight on another thread.
+void WaylandNativeWindow::waitForPendingCommits()
+{
+}
+
+void WaylandNativeWindow::stopFenceThread()
+{
+}
+
 static int debugenvchecked = 0;
 
 int WaylandNativeWindow::queueBuffer(BaseNativeWindowBuffer* buffer, int fenceFd)
@@ -250,6 +210,10 @@ int WaylandNativeWindow::queueBuffer(BaseNativeWindowBuffer* buffer, int fenceFd
 
     }
 
+    int slot = m_chain.slotOf(wnb);
+    assert(slot >= 0);
+    m_chain.queue(slot);
+    m_chain.acquire();
     presentBuffer(wnb);
 
 #if ANDROID_VERSION_MAJOR>=4 && ANDROID_VERSION_MINOR>=2 || ANDROID_VERSION_MAJOR>=5
@@ -262,7 +226,7 @@ int WaylandNativeWindow::queueBuffer(BaseNativeWindowBuffer* buffer, int fenceFd
     HYBRIS_TRACE_END("wayland-platform", "queueBuffer_waiting_for_fence", "-%p", wnb);
 #endif
 
-    HYBRIS_TRACE_COUNTER("wayland-platform", "fronted.size", "%lu", fronted.size());
+    HYBRIS_TRACE_COUNTER("wayland-platform", "fronted.size", "%i", m_chain.count(SwapChain::ACQUIRED));
     HYBRIS_TRACE_END("wayland-platform", "queueBuffer", "-%p", wnb);
     unlock();
 
@@ -26,6 +26,7 @@
 #ifndef WAYLAND_WINDOW_H
 #define WAYLAND_WINDOW_H
 #include "wayland_window_common.h"
+#include "swapchain.h"
 
 #include <hybris/gralloc/gralloc.h>
 
@@ -37,8 +38,6 @@ extern "C" {
 #include <pthread.h>
 }
 
-#include <list>
-
 class WaylandNativeWindow : public BaseNativeWindow {
 public:
     WaylandNativeWindow(struct wl_egl_window *window, struct wl_display *display, android_wlegl *wlegl);
@@ -80,16 +79,28 @@ protected:
     virtual int setBuffersFormat(int format);
     virtual int setBuffersDimensions(int width, int height);
     virtual int setBufferCount(int cnt);
+    // see NATIVE_WINDOW_BUFFER_AGE, answered by _query()
+    int bufferAge() const;
 
 private:
+    static int _query(const struct ANativeWindow* window, int what, int* value);
+    bool matchesWindow(WaylandNativeWindowBuffer *wnb) const;
+    WaylandNativeWindowBuffer *createBuffer();
     WaylandNativeWindowBuffer *addBuffer();
+    void initBuffer(WaylandNativeWindowBuffer *wnb);
+    void registerBuffers();
+    void reallocateBuffers();
     void destroyBuffer(WaylandNativeWindowBuffer *);
     void destroyBuffers();
     void presentBuffer(WaylandNativeWindowBuffer *wnb);
-    int readQueue(bool block);
+    int readQueue(bool block, int wakeFd = -1);
+    void waitForPendingCommits();
+    void stopFenceThread();
 
-    std::list<WaylandNativeWindowBuffer *> m_bufList;
-    std::list<WaylandNativeWindowBuffer *> fronted;
+    // The slots of the buffers attached to the surface are ACQUIRED until
+    // the compositor releases them, wl_buffers are aliases of their slot.
+    SwapChain m_chain;
+    int m_bufferAge;
     struct wl_egl_window *m_window;
     struct wl_display *m_display;
     int m_width;
@@ -102,7 +113,6 @@ private:
     pthread_mutex_t mutex;
     pthread_cond_t cond;
     int m_queueReads;
-    int m_freeBufs;
     // TODO damage rects
     struct android_native_rect_t *m_damage_rects;
     size_t m_damage_n_rects;
@@ -110,6 +110,82 @@ print """
         return android_dlsym(name##_handle, sym) != NULL; \\
     }
 
+/*
+ * With HYBRIS_USE_IFUNC_DISPATCH defined, the HYBRIS_IMPLEMENT_* macros
+ * generate GNU indirect functions next to the wrappers. A constructor of
+ * the library resolves each symbol from the Android library, and the
+ * resolver, run when the dynamic linker binds the symbol, returns that
+ * function so callers jump directly into the Android library, skipping the
+ * checks the wrappers do on every call.
+ *
+ * Resolvers must not load libraries: they may run as IRELATIVE relocations
+ * while the library is still being loaded (BIND_NOW, hidden visibility),
+ * before any constructor. Then, and for symbols the Android library lacks,
+ * they return the wrapper, which resolves the symbol on its first call.
+ *
+ * This is not possible when FP_ATTRIB is needed, as the Android function
+ * would then be called with the wrong floating point ABI.
+ */
+#if defined(HYBRIS_USE_IFUNC_DISPATCH) && !defined(__ARM_PCS_VFP)
+#define HYBRIS_IFUNC_DISPATCH 1
+#endif
+
+#define HYBRIS_IMPLEMENT_IFUNC(name, symbol) \\
+    static void __attribute__((constructor)) symbol##_dispatch_init(void) \\
+    { \\
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \\
+    } \\
+    __asm__ (".type " #symbol ", %gnu_indirect_function"); \\
+    __typeof__(symbol) *symbol##_dispatch(void) __asm__ (#symbol); \\
+    __typeof__(symbol) *symbol##_dispatch(void) \\
+    { \\
+        return symbol##_fptr ? symbol##_fptr : symbol##_wrapper; \\
+    }
+
+#ifdef HYBRIS_IFUNC_DISPATCH
+"""
+
+for count in range(MAX_ARGS):
+    args = ['a%d' % (x+1) for x in range(count)]
+    names = ['n%d' % (x+1) for x in range(count)]
+    wrapper_signature = ', '.join(['name', 'return_type', 'symbol'] + args)
+    signature = ', '.join(args)
+    signature_with_names = ', '.join(' '.join(x) for x in zip(args, names))
+    call_names = ', '.join(names)
+
+    print """
+#define HYBRIS_IMPLEMENT_FUNCTION{count}({wrapper_signature}) \\
+    static return_type (*symbol##_fptr)({signature}) = NULL; \\
+    static return_type symbol##_wrapper({signature_with_names}) \\
+    {BEGIN} \\
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \\
+        return symbol##_fptr({call_names}); \\
+    {END} \\
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+""".format(**locals())
+
+for count in range(MAX_ARGS):
+    args = ['a%d' % (x+1) for x in range(count)]
+    names = ['n%d' % (x+1) for x in range(count)]
+    wrapper_signature = ', '.join(['name', 'symbol'] + args)
+    signature = ', '.join(args)
+    signature_with_names = ', '.join(' '.join(x) for x in zip(args, names))
+    call_names = ', '.join(names)
+
+    print """
+#define HYBRIS_IMPLEMENT_VOID_FUNCTION{count}({wrapper_signature}) \\
+    static void (*symbol##_fptr)({signature}) = NULL; \\
+    static void symbol##_wrapper({signature_with_names}) \\
+    {BEGIN} \\
+        HYBRIS_DLSYSM(name, &symbol##_fptr, #symbol); \\
+        symbol##_fptr({call_names}); \\
+    {END} \\
+    HYBRIS_IMPLEMENT_IFUNC(name, symbol)
+""".format(**locals())
+
+print """
+#else
+
 """
 
 for count in range(MAX_ARGS):
@@ -147,6 +223,9 @@ for count in range(MAX_ARGS):
     {END}
 """.format(**locals())
 
+print """#endif /* HYBRIS_IFUNC_DISPATCH */
+"""
+
 # Print it again, so people wanting to append new macros will see it
 print AUTO_GENERATED_WARNING
 